@@ -392,6 +392,40 @@ vimshell_request_cb(
 	}
     }
 }
+
+/*
+ * VIM-Shell callback, called when a command streaming into a buffer
+ * (":vimshellread") has output available.
+ */
+    static void
+vimshell_stream_cb(
+    CFFileDescriptorRef fdref,
+    CFOptionFlags callBackTypes,
+    void *info)
+{
+    struct vim_shell_stream *st;
+    int source_fd = CFFileDescriptorGetNativeDescriptor(fdref);
+
+    for(st=vim_shell_streams; st!=NULL; st=st->next)
+    {
+	if(st->fd == source_fd)
+	{
+	    /* re-armed in gui_mch_wait_for_chars(), like for the shells */
+	    CFFileDescriptorInvalidate(fdref);
+	    CFRelease(fdref);
+	    st->fdref = NULL;
+	    CFRunLoopSourceInvalidate(st->source);
+	    CFRelease(st->source);
+	    st->source = NULL;
+
+	    vim_shell_stream_read(st);
+	    break;
+	}
+    }
+
+    if(vim_shell_stream_flush()>0 && updating_screen==FALSE)
+	update_screen(VALID);
+}
 #endif
 
 /*
@@ -431,6 +465,19 @@ gui_mch_wait_for_chars(int wtime)
             }
 	}
     }
+    {
+	struct vim_shell_stream *st;
+	for(st=vim_shell_streams; st!=NULL; st=st->next)
+	{
+            if(!st->fdref && vim_shell_stream_wants_read(st))
+            {
+                st->fdref = CFFileDescriptorCreate(NULL, st->fd, false, vimshell_stream_cb, NULL);
+                st->source = CFFileDescriptorCreateRunLoopSource(NULL, st->fdref, 0);
+                CFRunLoopAddSource(CFRunLoopGetCurrent(), st->source, kCFRunLoopDefaultMode);
+                CFFileDescriptorEnableCallBacks(st->fdref, kCFFileDescriptorReadCallBack);
+            }
+	}
+    }
 #endif
 
     return [[MMBackend sharedInstance] waitForInput:wtime];
@@ -596,6 +596,7 @@ buf_freeall(buf, flags)
 	 */
 	vim_shell_delete(buf);
     }
+    vim_shell_stream_stop(buf);
 #endif
 
     ml_close(buf, TRUE);	    /* close and delete the memline/memfile */
@@ -3805,6 +3806,14 @@ build_stl_str_hl(wp, out, outlen, fmt, use_sandbox, fillchar, maxwidth, hltab, t
 		str = tmp;
 	    break;
 
+	case STL_SEARCHCOUNT:
+	    fillable = FALSE;
+#if defined(FEAT_SEARCH_EXTRA) && defined(FEAT_RELTIME)
+	    if (search_count_str(wp, tmp, (int)sizeof(tmp)) == OK)
+		str = tmp;
+#endif
+	    break;
+
 	case STL_KEYMAP:
 	    fillable = FALSE;
 	    if (get_keymap_str(wp, tmp, TMPLEN))
@@ -56,6 +56,13 @@ static int    chartab_initialized = FALSE;
     int
 init_chartab()
 {
+#ifdef FEAT_SEARCH_EXTRA
+    /* 'isident', 'isfname' and 'isprint' change what a pattern matches. */
+    search_hl_cache_clear(NULL);
+#endif
+#if defined(FEAT_SEARCH_EXTRA) && defined(FEAT_RELTIME)
+    search_count_clear(NULL);
+#endif
     return buf_init_chartab(curbuf, TRUE);
 }
 
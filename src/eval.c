@@ -632,6 +632,7 @@ static void f_matchend __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_matchlist __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_matchstr __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_max __ARGS((typval_T *argvars, typval_T *rettv));
+static void f_memfilestat __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_min __ARGS((typval_T *argvars, typval_T *rettv));
 #ifdef vim_mkdir
 static void f_mkdir __ARGS((typval_T *argvars, typval_T *rettv));
@@ -651,6 +652,7 @@ static void f_printf __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_pumvisible __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_range __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_readfile __ARGS((typval_T *argvars, typval_T *rettv));
+static void f_regcachestat __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_reltime __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_reltimestr __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_remote_expr __ARGS((typval_T *argvars, typval_T *rettv));
@@ -667,6 +669,7 @@ static void f_reverse __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_round __ARGS((typval_T *argvars, typval_T *rettv));
 #endif
 static void f_search __ARGS((typval_T *argvars, typval_T *rettv));
+static void f_searchcount __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_searchdecl __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_searchpair __ARGS((typval_T *argvars, typval_T *rettv));
 static void f_searchpairpos __ARGS((typval_T *argvars, typval_T *rettv));
@@ -774,6 +777,7 @@ static void init_tv __ARGS((typval_T *varp));
 static long get_tv_number __ARGS((typval_T *varp));
 static linenr_T get_tv_lnum __ARGS((typval_T *argvars));
 static linenr_T get_tv_lnum_buf __ARGS((typval_T *argvars, buf_T *buf));
+static int append_list_lines __ARGS((linenr_T lnum, listitem_T *li, long *added));
 static char_u *get_tv_string __ARGS((typval_T *varp));
 static char_u *get_tv_string_buf __ARGS((typval_T *varp, char_u *buf));
 static char_u *get_tv_string_buf_chk __ARGS((typval_T *varp, char_u *buf));
@@ -4486,13 +4490,13 @@ eval4(arg, rettv, evaluate)
 			    /* avoid 'l' flag in 'cpoptions' */
 			    save_cpo = p_cpo;
 			    p_cpo = (char_u *)"";
-			    regmatch.regprog = vim_regcomp(s2,
+			    regmatch.regprog = vim_regcomp_cached(s2,
 							RE_MAGIC + RE_STRING);
 			    regmatch.rm_ic = ic;
 			    if (regmatch.regprog != NULL)
 			    {
 				n1 = vim_regexec_nl(&regmatch, s1, (colnr_T)0);
-				vim_free(regmatch.regprog);
+				vim_regfree(regmatch.regprog);
 				if (type == TYPE_NOMATCH)
 				    n1 = !n1;
 			    }
@@ -7809,6 +7813,7 @@ static struct fst
     {"matchlist",	2, 4, f_matchlist},
     {"matchstr",	2, 4, f_matchstr},
     {"max",		1, 1, f_max},
+    {"memfilestat",	0, 0, f_memfilestat},
     {"min",		1, 1, f_min},
 #ifdef vim_mkdir
     {"mkdir",		1, 3, f_mkdir},
@@ -7828,6 +7833,7 @@ static struct fst
     {"pumvisible",	0, 0, f_pumvisible},
     {"range",		1, 3, f_range},
     {"readfile",	1, 3, f_readfile},
+    {"regcachestat",	0, 0, f_regcachestat},
     {"reltime",		0, 2, f_reltime},
     {"reltimestr",	1, 1, f_reltimestr},
     {"remote_expr",	2, 3, f_remote_expr},
@@ -7844,6 +7850,7 @@ static struct fst
     {"round",		1, 1, f_round},
 #endif
     {"search",		1, 4, f_search},
+    {"searchcount",	0, 1, f_searchcount},
     {"searchdecl",	1, 3, f_searchdecl},
     {"searchpair",	3, 7, f_searchpair},
     {"searchpairpos",	3, 7, f_searchpairpos},
@@ -8514,7 +8521,6 @@ f_append(argvars, rettv)
     char_u	*line;
     list_T	*l = NULL;
     listitem_T	*li = NULL;
-    typval_T	*tv;
     long	added = 0;
 
     lnum = get_tv_lnum(argvars);
@@ -8529,25 +8535,22 @@ f_append(argvars, rettv)
 		return;
 	    li = l->lv_first;
 	}
-	for (;;)
+	if (l != NULL)
 	{
-	    if (l == NULL)
-		tv = &argvars[1];	/* append a string */
-	    else if (li == NULL)
-		break;			/* end of list */
-	    else
-		tv = &li->li_tv;	/* append item from list */
-	    line = get_tv_string_chk(tv);
+	    /* append all items of the list at once */
+	    if (append_list_lines(lnum, li, &added) == FAIL)
+		rettv->vval.v_number = 1;	/* Failed */
+	}
+	else
+	{
+	    line = get_tv_string_chk(&argvars[1]);
 	    if (line == NULL)		/* type error */
-	    {
 		rettv->vval.v_number = 1;	/* Failed */
-		break;
+	    else
+	    {
+		ml_append(lnum, line, (colnr_T)0, FALSE);
+		++added;
 	    }
-	    ml_append(lnum + added, line, (colnr_T)0, FALSE);
-	    ++added;
-	    if (l == NULL)
-		break;
-	    li = li->li_next;
 	}
 
 	appended_lines_mark(lnum, added);
@@ -8558,6 +8561,79 @@ f_append(argvars, rettv)
 	rettv->vval.v_number = 1;	/* Failed */
 }
 
+/*
+ * Append the String or Number items of a list, starting at "li", below line
+ * "lnum" in the current buffer.  Uses ml_append_bulk(), so that a long list
+ * does not have to find the data block for every line.
+ * "*added" is set to the number of lines appended.
+ * Returns FAIL when an item has the wrong type or memory runs out, the items
+ * before it are appended anyway.
+ */
+    static int
+append_list_lines(lnum, li, added)
+    linenr_T	lnum;
+    listitem_T	*li;
+    long	*added;
+{
+    garray_T	ga;		/* pointers to the lines */
+    garray_T	ga_num;		/* Numbers converted to a String */
+    char_u	*line;
+    listitem_T	*item;
+    int		count = 0;
+    int		ret = OK;
+
+    /* grow the arrays only once */
+    for (item = li; item != NULL; item = item->li_next)
+	++count;
+    ga_init2(&ga, (int)sizeof(char_u *), count);
+    ga_init2(&ga_num, (int)sizeof(char_u *), count);
+    for ( ; li != NULL; li = li->li_next)
+    {
+	line = get_tv_string_chk(&li->li_tv);
+	if (line == NULL)		/* type error */
+	{
+	    ret = FAIL;
+	    break;
+	}
+	/* A Number is converted in a static buffer, need a copy. */
+	if (li->li_tv.v_type != VAR_STRING)
+	{
+	    if (ga_grow(&ga_num, 1) == FAIL
+				       || (line = vim_strsave(line)) == NULL)
+	    {
+		ret = FAIL;
+		break;
+	    }
+	    ((char_u **)ga_num.ga_data)[ga_num.ga_len++] = line;
+	}
+	if (ga_grow(&ga, 1) == FAIL)
+	{
+	    ret = FAIL;
+	    break;
+	}
+	((char_u **)ga.ga_data)[ga.ga_len++] = line;
+    }
+
+    *added = 0;
+    if (ga.ga_len > 0)
+    {
+	linenr_T    old_count = curbuf->b_ml.ml_line_count;
+
+	if (ml_append_bulk(lnum, (char_u **)ga.ga_data, NULL,
+						 (long)ga.ga_len, FALSE) == OK)
+	    *added = ga.ga_len;
+	else
+	{
+	    /* The lines before the failure were appended. */
+	    *added = curbuf->b_ml.ml_line_count - old_count;
+	    ret = FAIL;
+	}
+    }
+    ga_clear_strings(&ga_num);
+    ga_clear(&ga);
+    return ret;
+}
+
 /*
  * "argc()" function
  */
@@ -11956,6 +12032,9 @@ f_has(argvars, rettv)
 #ifdef FEAT_SESSION
 	"mksession",
 #endif
+#ifdef FEAT_MMAP
+	"mmap",
+#endif
 #ifdef FEAT_MODIFY_FNAME
 	"modify_fname",
 #endif
@@ -13501,7 +13580,7 @@ find_some_match(argvars, rettv, type)
 	    goto theend;
     }
 
-    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING);
+    regmatch.regprog = vim_regcomp_cached(pat, RE_MAGIC + RE_STRING);
     if (regmatch.regprog != NULL)
     {
 	regmatch.rm_ic = p_ic;
@@ -13589,7 +13668,7 @@ find_some_match(argvars, rettv, type)
 		rettv->vval.v_number += (varnumber_T)(str - expr);
 	    }
 	}
-	vim_free(regmatch.regprog);
+	vim_regfree(regmatch.regprog);
     }
 
 theend:
@@ -13805,6 +13884,18 @@ f_max(argvars, rettv)
     max_min(argvars, rettv, TRUE);
 }
 
+/*
+ * "memfilestat()" function
+ */
+    static void
+f_memfilestat(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    if (rettv_dict_alloc(rettv) == OK)
+	mf_stat(rettv->vval.v_dict);
+}
+
 /*
  * "min()" function
  */
@@ -14376,6 +14467,18 @@ list2proftime(arg, tm)
 }
 #endif /* FEAT_RELTIME */
 
+/*
+ * "regcachestat()" function
+ */
+    static void
+f_regcachestat(argvars, rettv)
+    typval_T	*argvars UNUSED;
+    typval_T	*rettv;
+{
+    if (rettv_dict_alloc(rettv) == OK)
+	vim_regcache_stat(rettv->vval.v_dict);
+}
+
 /*
  * "reltime()" function
  */
@@ -15289,6 +15392,53 @@ f_search(argvars, rettv)
     rettv->vval.v_number = search_cmn(argvars, NULL, &flags);
 }
 
+/*
+ * "searchcount()" function
+ */
+    static void
+f_searchcount(argvars, rettv)
+    typval_T	*argvars;
+    typval_T	*rettv;
+{
+#if defined(FEAT_SEARCH_EXTRA) && defined(FEAT_RELTIME)
+    long	timeout = 500L;
+    long	maxcount = 99L;
+    long	current;
+    long	total;
+    int		exact;
+    int		incomplete;
+    dict_T	*d;
+#endif
+
+    if (rettv_dict_alloc(rettv) == FAIL)
+	return;
+#if defined(FEAT_SEARCH_EXTRA) && defined(FEAT_RELTIME)
+    if (argvars[0].v_type != VAR_UNKNOWN)
+    {
+	if (argvars[0].v_type != VAR_DICT)
+	{
+	    EMSG(_(e_dictreq));
+	    return;
+	}
+	d = argvars[0].vval.v_dict;
+	if (d != NULL && dict_find(d, (char_u *)"timeout", -1) != NULL)
+	    timeout = get_dict_number(d, (char_u *)"timeout");
+	if (d != NULL && dict_find(d, (char_u *)"maxcount", -1) != NULL)
+	    maxcount = get_dict_number(d, (char_u *)"maxcount");
+    }
+
+    if (search_count_get(curwin, timeout, maxcount, &current, &total, &exact,
+							   &incomplete) == OK)
+    {
+	d = rettv->vval.v_dict;
+	dict_add_nr_str(d, "current", current, NULL);
+	dict_add_nr_str(d, "total", total, NULL);
+	dict_add_nr_str(d, "exact_match", (long)exact, NULL);
+	dict_add_nr_str(d, "incomplete", (long)incomplete, NULL);
+    }
+#endif
+}
+
 /*
  * "searchdecl()" function
  */
@@ -15774,6 +15924,18 @@ f_setline(argvars, rettv)
 	    /* list argument, get next string */
 	    if (li == NULL)
 		break;
+	    if (lnum == curbuf->b_ml.ml_line_count + 1)
+	    {
+		long	n = 0;
+
+		/* the remaining items are appended at the end in one go */
+		rettv->vval.v_number = 1;	/* FAIL */
+		if ((added > 0 || u_save(lnum - 1, lnum) == OK)
+			&& append_list_lines(lnum - 1, li, &n) == OK)
+		    rettv->vval.v_number = 0;	/* OK */
+		added += n;
+		break;
+	    }
 	    line = get_tv_string_chk(&li->li_tv);
 	    li = li->li_next;
 	}
@@ -23406,7 +23568,7 @@ do_string_sub(str, pat, sub, flags)
     do_all = (flags[0] == 'g');
 
     regmatch.rm_ic = p_ic;
-    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING);
+    regmatch.regprog = vim_regcomp_cached(pat, RE_MAGIC + RE_STRING);
     if (regmatch.regprog != NULL)
     {
 	tail = str;
@@ -23455,7 +23617,7 @@ do_string_sub(str, pat, sub, flags)
 	if (ga.ga_data != NULL)
 	    STRCPY((char *)ga.ga_data + ga.ga_len, tail);
 
-	vim_free(regmatch.regprog);
+	vim_regfree(regmatch.regprog);
     }
 
     ret = vim_strsave(ga.ga_data == NULL ? str : (char_u *)ga.ga_data);
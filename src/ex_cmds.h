@@ -925,6 +925,8 @@ EX(CMD_swapname,	"swapname",	ex_swapname,
 			TRLBAR|CMDWIN),
 EX(CMD_syntax,		"syntax",	ex_syntax,
 			EXTRA|NOTRLCOM|CMDWIN),
+EX(CMD_syntime,		"syntime",	ex_syntime,
+			NEEDARG|WORD1|TRLBAR|CMDWIN),
 EX(CMD_syncbind,	"syncbind",	ex_syncbind,
 			TRLBAR),
 EX(CMD_t,		"t",		ex_copymove,
@@ -1034,6 +1036,10 @@ EX(CMD_view,		"view",		ex_edit,
 #ifdef FEAT_VIMSHELL
 EX(CMD_vimshell,	"vimshell",	ex_vimshell,
 			EXTRA|BANG|TRLBAR|CMDWIN),
+EX(CMD_vimshelllog,	"vimshelllog",	ex_vimshelllog,
+			BANG|FILE1|TRLBAR|CMDWIN),
+EX(CMD_vimshellread,	"vimshellread",	ex_vimshellread,
+			RANGE|ZEROR|EXTRA|NEEDARG|NOTRLCOM|CMDWIN),
 #endif
 EX(CMD_vimgrep,		"vimgrep",	ex_vimgrep,
 			RANGE|NOTADR|BANG|NEEDARG|EXTRA|NOTRLCOM|TRLBAR|XFILE),
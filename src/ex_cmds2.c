@@ -991,6 +991,30 @@ profile_add(tm, tm2)
 # endif
 }
 
+/*
+ * Divide the time "tm" by "count" and store in "tm2".
+ */
+    void
+profile_divide(tm, count, tm2)
+    proftime_T	*tm;
+    long	count;
+    proftime_T	*tm2;
+{
+    if (count <= 0)
+	profile_zero(tm2);
+    else
+    {
+# ifdef WIN3264
+	tm2->QuadPart = tm->QuadPart / count;
+# else
+	double usec = ((double)tm->tv_sec * 1000000.0 + tm->tv_usec) / count;
+
+	tm2->tv_sec = (long)(usec / 1000000.0);
+	tm2->tv_usec = (long)(usec - (double)tm2->tv_sec * 1000000.0);
+# endif
+    }
+}
+
 /*
  * Add the "self" time from the total time and the children's time.
  */
@@ -150,6 +150,8 @@ static void	ex_quit __ARGS((exarg_T *eap));
 static void	ex_cquit __ARGS((exarg_T *eap));
 static void	ex_quit_all __ARGS((exarg_T *eap));
 static void	ex_vimshell __ARGS((exarg_T *eap));
+static void	ex_vimshelllog __ARGS((exarg_T *eap));
+static void	ex_vimshellread __ARGS((exarg_T *eap));
 #ifdef FEAT_WINDOWS
 static void	ex_close __ARGS((exarg_T *eap));
 static void	ex_win_close __ARGS((int forceit, win_T *win, tabpage_T *tp));
@@ -244,6 +246,9 @@ static void	ex_popup __ARGS((exarg_T *eap));
 # define ex_syntax		ex_ni
 # define ex_ownsyntax		ex_ni
 #endif
+#if !defined(FEAT_SYN_HL) || !defined(FEAT_PROFILE)
+# define ex_syntime		ex_ni
+#endif
 #ifndef FEAT_SPELL
 # define ex_spell		ex_ni
 # define ex_mkspell		ex_ni
@@ -3846,6 +3851,13 @@ set_one_cmd_context(xp, buff)
 	    xp->xp_pattern = arg;
 	    break;
 
+#if defined(FEAT_SYN_HL) && defined(FEAT_PROFILE)
+	case CMD_syntime:
+	    xp->xp_context = EXPAND_SYNTIME;
+	    xp->xp_pattern = arg;
+	    break;
+#endif
+
 	case CMD_setfiletype:
 	    xp->xp_context = EXPAND_FILETYPE;
 	    xp->xp_pattern = arg;
@@ -11382,4 +11394,54 @@ ex_vimshell(eap)
      * we're up and running.
      */
 }
+
+/*
+ * ":vimshelllog {file}": append the text the shell in the current buffer
+ * prints to {file}, with escape sequences removed.
+ * ":vimshelllog! {file}": same, but log the raw output of the shell.
+ * ":vimshelllog": stop logging.
+ */
+    static void
+ex_vimshelllog(eap)
+    exarg_T	*eap;
+{
+    if(curbuf->is_shell==0)
+    {
+	EMSG(_("VIMSHELL: current buffer is not a shell"));
+	return;
+    }
+
+    if(*eap->arg==NUL)
+    {
+	vim_shell_log_close(curbuf->shell);
+	return;
+    }
+
+    if(vim_shell_log_open(curbuf->shell, (char *)eap->arg, eap->forceit,
+						    p_vsls * 1024L) < 0)
+	EMSG2(_("VIMSHELL: error opening the log: %s"), vim_shell_strerror());
+}
+
+/*
+ * ":[line]vimshellread {cmd}": run {cmd} in the background and stream its
+ * output into the current buffer below [line].
+ */
+    static void
+ex_vimshellread(eap)
+    exarg_T	*eap;
+{
+    if(curbuf->is_shell!=0)
+    {
+	EMSG(_("VIMSHELL: current buffer is a shell"));
+	return;
+    }
+    if(!curbuf->b_p_ma)
+    {
+	EMSG(_(e_modifiable));
+	return;
+    }
+
+    if(vim_shell_stream_start(curbuf, eap->line2, eap->arg) < 0)
+	EMSG2(_("VIMSHELL: cannot start the command: %s"), vim_shell_strerror());
+}
 #endif
@@ -82,6 +82,9 @@ static int	cmd_fkmap = 0;	/* Farsi mapping during command line */
 #endif
 
 static int	cmdline_charsize __ARGS((int idx));
+#ifdef FEAT_SEARCH_EXTRA
+static int	incsearch_can_resume __ARGS((char_u *prev, char_u *pat, long count));
+#endif
 static void	set_cmdspos __ARGS((void));
 static void	set_cmdspos_cursor __ARGS((void));
 #ifdef FEAT_MBYTE
@@ -121,6 +124,29 @@ static int	ExpandUserList __ARGS((expand_T *xp, int *num_file, char_u ***file));
 static int	ex_window __ARGS((void));
 #endif
 
+#ifdef FEAT_SEARCH_EXTRA
+/*
+ * Return TRUE when an 'incsearch' search for "pat" can continue where the
+ * search for "prev" ended.  That is when it is the same pattern, or both are
+ * literal text and "pat" starts with "prev": a match for "pat" is then also a
+ * match for "prev" and can't be before where "prev" was found, or before
+ * where searching for it stopped.
+ */
+    static int
+incsearch_can_resume(prev, pat, count)
+    char_u	*prev;
+    char_u	*pat;
+    long	count;
+{
+    if (prev == NULL || count != 1)
+	return FALSE;
+    if (STRCMP(prev, pat) == 0)
+	return TRUE;
+    return STRNCMP(prev, pat, STRLEN(prev)) == 0
+		    && vim_strpbrk(pat, (char_u *)"\\^$.*[~") == NULL;
+}
+#endif
+
 /*
  * getcmdline() - accept a command line starting with firstc.
  *
@@ -167,6 +193,9 @@ getcmdline(firstc, count, indent)
     linenr_T	old_botline;
     int		did_incsearch = FALSE;
     int		incsearch_postponed = FALSE;
+    char_u	*is_pat = NULL;		/* pattern of previous 'incsearch' */
+    pos_T	is_pos;			/* where to continue for "is_pat", lnum
+					   is zero when there was no match */
 #endif
     int		did_wild_list = FALSE;	/* did wild_list() recently */
     int		wim_index = 0;		/* index in wim_flags[] */
@@ -1734,8 +1763,22 @@ cmdline_changed:
 	    /* If there is no command line, don't do anything */
 	    if (ccline.cmdlen == 0)
 		i = 0;
+	    else if (incsearch_can_resume(is_pat, ccline.cmdbuff, count)
+							   && is_pos.lnum == 0)
+		/* searching for less didn't find anything */
+		i = 0;
 	    else
 	    {
+		int	options = SEARCH_KEEP + SEARCH_OPT + SEARCH_NOOF
+								 + SEARCH_PEEK;
+
+		/* Continue where the previous search stopped or found a
+		 * match, instead of searching the same lines again. */
+		if (incsearch_can_resume(is_pat, ccline.cmdbuff, count))
+		{
+		    curwin->w_cursor = is_pos;
+		    options += SEARCH_START;
+		}
 		cursor_off();		/* so the user knows we're busy */
 		out_flush();
 		++emsg_off;    /* So it doesn't beep if bad expr */
@@ -1743,8 +1786,8 @@ cmdline_changed:
 		/* Set the time limit to half a second. */
 		profile_setlimit(500L, &tm);
 #endif
-		i = do_search(NULL, firstc, ccline.cmdbuff, count,
-			SEARCH_KEEP + SEARCH_OPT + SEARCH_NOOF + SEARCH_PEEK,
+		search_stop_lnum = 0;
+		i = do_search(NULL, firstc, ccline.cmdbuff, count, options,
 #ifdef FEAT_RELTIME
 			&tm
 #else
@@ -1752,6 +1795,35 @@ cmdline_changed:
 #endif
 			);
 		--emsg_off;
+
+		/* Remember where to continue with this pattern. */
+		vim_free(is_pat);
+		is_pat = NULL;
+		if (!got_int && count == 1 && *skip_regexp(ccline.cmdbuff,
+					     firstc, p_magic, NULL) == NUL
+			/* A search that stopped in the start line can't be
+			 * continued, matches before the cursor don't count
+			 * yet. */
+			&& (i != 0 || search_stop_lnum != old_cursor.lnum))
+		{
+		    if (i != 0)
+			is_pos = curwin->w_cursor;
+		    else
+		    {
+			is_pos.lnum = search_stop_lnum;
+			is_pos.col = firstc == '/' ? 0 : MAXCOL;
+#ifdef FEAT_VIRTUALEDIT
+			is_pos.coladd = 0;
+#endif
+		    }
+		    is_pat = vim_strsave(ccline.cmdbuff);
+		}
+
+		/* Without a match stay at the old position, also when
+		 * continuing the search started somewhere else. */
+		if (i == 0)
+		    curwin->w_cursor = old_cursor;
+
 		/* if interrupted while searching, behave like it failed */
 		if (got_int)
 		{
@@ -1762,6 +1834,9 @@ cmdline_changed:
 		else if (char_avail())
 		    /* cancelled searching because a char was typed */
 		    incsearch_postponed = TRUE;
+		else if (i == 0 && search_stop_lnum != 0)
+		    /* ran out of time, continue with the next key */
+		    incsearch_postponed = TRUE;
 	    }
 	    if (i != 0)
 		highlight_match = TRUE;		/* highlight position */
@@ -1864,6 +1939,7 @@ returncmd:
 	validate_cursor();	/* needed for TAB */
 	redraw_later(SOME_VALID);
     }
+    vim_free(is_pat);
 #endif
 
     if (ccline.cmdbuff != NULL)
@@ -4553,6 +4629,9 @@ ExpandFromContext(xp, pat, num_file, file, options)
 #endif
 #ifdef FEAT_SYN_HL
 	    {EXPAND_SYNTAX, get_syntax_name, TRUE},
+#endif
+#if defined(FEAT_SYN_HL) && defined(FEAT_PROFILE)
+	    {EXPAND_SYNTIME, get_syntime_arg, TRUE},
 #endif
 	    {EXPAND_HIGHLIGHT, get_highlight_name, TRUE},
 #ifdef FEAT_AUTOCMD
@@ -1338,6 +1338,22 @@
 # define FEAT_PERSISTENT_UNDO
 #endif
 
+/*
+ * +mmap		A big file is mapped into memory instead of read, see
+ *			'mmapsize'.
+ */
+#if defined(FEAT_NORMAL) && defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+# define FEAT_MMAP
+#endif
+
+/*
+ * swap file writer	Write swap file blocks and sync the swap file in a
+ *			background thread.
+ */
+#if defined(UNIX) && defined(HAVE_PTHREAD_H) && defined(HAVE_PWRITE)
+# define FEAT_SWAP_WRITER
+#endif
+
 /*
  * +transparency        'transparency' option.
  */
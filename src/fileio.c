@@ -30,6 +30,7 @@
 #endif
 
 #define BUFSIZE		8192	/* size of normal write buffer */
+#define READ_BULK_LINES	1024	/* lines collected for ml_append_bulk() */
 #define SMBUFSIZE	256	/* size of emergency write buffer */
 
 #ifdef FEAT_CRYPT
@@ -249,6 +250,8 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     char_u	*buffer = NULL;		/* read buffer */
     char_u	*new_buffer = NULL;	/* init to shut up gcc */
     char_u	*line_start = NULL;	/* init to shut up gcc */
+    char_u	*buf_end;		/* end of the bytes in the buffer */
+    char_u	*eol;			/* end of the current line */
     int		wasempty;		/* buffer was empty before reading */
     colnr_T	len;
     long	size = 0;
@@ -264,6 +267,9 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     int		read_undo_file = FALSE;
 #endif
     int		split = 0;		/* number of split lines */
+    char_u	*bulk_lines[READ_BULK_LINES];	/* lines not appended yet */
+    colnr_T	bulk_lens[READ_BULK_LINES];
+    int		bulk_count = 0;
 #define UNKNOWN	 0x0fffffff		/* file size is unknown */
     linenr_T	linecnt;
     int		error = FALSE;		/* errors encountered */
@@ -317,6 +323,10 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     char_u	conv_rest[CONV_RESTLEN];
     int		conv_restlen = 0;	/* nr of bytes in conv_rest[] */
 #endif
+#ifdef FEAT_MMAP
+    int		try_mmap;		/* map the file instead of reading */
+    mlmap_T	*mapped = NULL;		/* the mapped file */
+#endif
 
 #ifdef FEAT_AUTOCMD
     /* Remember the initial values of curbuf, curbuf->b_ffname and
@@ -832,6 +842,18 @@ readfile(fname, sfname, from, lines_to_skip, lines_to_read, eap, flags)
     /* Autocommands may add lines to the file, need to check if it is empty */
     wasempty = (curbuf->b_ml.ml_flags & ML_EMPTY);
 
+#ifdef FEAT_MMAP
+    /* A big file may be mapped, see below. */
+    try_mmap = (p_mms > 0 && newfile && wasempty
+	    && !filtering && !read_stdin && !read_buffer
+	    && !(flags & READ_DUMMY) && !recoverymode
+	    && from == 0 && lines_to_skip == 0 && lines_to_read == MAXLNUM
+# ifdef FEAT_PERSISTENT_UNDO
+	    && !curbuf->b_p_udf
+# endif
+	    );
+#endif
+
     if (!recoverymode && !filtering && !(flags & READ_DUMMY))
     {
 	/*
@@ -1186,6 +1208,98 @@ retry:
     can_retry = (*fenc != NUL && !read_stdin && !keep_dest_enc);
 #endif
 
+#ifdef FEAT_MMAP
+    /*
+     * A big file is mapped into memory instead of being read, the memline
+     * gets the lines from there until the buffer is changed or it has been
+     * loaded in the background.  Only when the text can be used as it is: no
+     * conversion, no BOM, not encrypted and all lines ending in NL or all in
+     * CR-NL.
+     */
+    if (try_mmap && !skip_read)
+    {
+	if (mapped == NULL)
+	    mapped = ml_map_open(fd, (off_t)p_mms * 1024);
+	if (mapped == NULL || got_int
+		/* no line break: the format can't be detected */
+		|| (mapped->mm_lines == 1 && mapped->mm_noeol))
+	    try_mmap = FALSE;
+	else
+	{
+# ifdef FEAT_MBYTE
+	    int	    blen;
+	    int	    bom = (mapped->mm_size >= 2
+			    && check_for_bom(mapped->mm_addr,
+				   mapped->mm_size > 4 ? 4L : (long)mapped->mm_size,
+						      &blen, FIO_ALL) != NULL);
+
+	    if (converted && fio_flags == FIO_UCSBOM && !bom)
+	    {
+		/* No BOM, try the next entry in 'fileencodings'. */
+		advance_fenc = TRUE;
+		goto retry;
+	    }
+	    if (converted || bom || (enc_utf8 && !curbuf->b_p_bin
+					   && ml_map_utf8(mapped) == FAIL))
+		try_mmap = FALSE;
+# endif
+# ifdef FEAT_CRYPT
+	    if (mapped->mm_size >= STRLEN(crypt_magic_head)
+		    && memcmp(mapped->mm_addr, crypt_magic_head,
+					       STRLEN(crypt_magic_head)) == 0)
+		try_mmap = FALSE;
+# endif
+
+	    /* Detect the format like below: Dos when the first NL has a CR
+	     * before it, but Unix when a CR is missing somewhere. */
+	    if (try_mmap && fileformat == EOL_UNKNOWN)
+	    {
+		if (try_mac)
+		    try_mmap = FALSE;
+		else if (try_dos && (mapped->mm_firstcr || !try_unix))
+		    fileformat = EOL_DOS;
+		else
+		    fileformat = EOL_UNIX;
+	    }
+	    if (try_mmap && fileformat == EOL_DOS && mapped->mm_nocr)
+	    {
+		if (try_unix)
+		    fileformat = EOL_UNIX;
+		else
+		    try_mmap = FALSE;
+	    }
+	    if (try_mmap && fileformat == EOL_MAC)
+		try_mmap = FALSE;
+	}
+
+	if (try_mmap)
+	{
+	    if (set_options)
+		set_fileformat(fileformat, OPT_LOCAL);
+	    /* When the file may be changed it is loaded in the background. */
+	    ml_map_attach(curbuf, mapped, fileformat == EOL_DOS,
+							   !curbuf->b_p_ro);
+	    lnum = curbuf->b_ml.ml_line_count;
+	    filesize = (off_t)mapped->mm_size;
+	    if (mapped->mm_noeol)
+	    {
+		/* remember for when writing */
+		if (set_options)
+		    curbuf->b_p_eol = FALSE;
+		read_no_eol_lnum = lnum;
+	    }
+	    goto failed;
+	}
+	if (mapped != NULL)
+	{
+	    ml_map_free(mapped);
+	    mapped = NULL;
+	}
+	if (got_int)
+	    goto failed;
+    }
+#endif
+
     if (!skip_read)
     {
 	linerest = 0;
@@ -1773,6 +1887,7 @@ retry:
 		int	u8c;
 		char_u	*dest;
 		char_u	*tail = NULL;
+		long	ascii_len = 0;
 
 		/*
 		 * "enc_utf8" set: Convert Unicode or Latin1 to UTF-8.
@@ -1839,9 +1954,16 @@ retry:
 		    mch_memmove(conv_rest, (char_u *)tail, conv_restlen);
 		    size -= conv_restlen;
 		}
+		/* utf_head_off() may look at the byte after the text */
+		if (fio_flags == FIO_UTF8)
+		    ptr[size] = NUL;
 
+		/* ASCII is the same in Latin1 and UTF-8, the ASCII bytes at the
+		 * start only need to be moved. */
+		if (fio_flags == FIO_LATIN1 || fio_flags == FIO_UTF8)
+		    ascii_len = utf_ascii_len(ptr, (long)(p - ptr));
 
-		while (p > ptr)
+		while (p > ptr + ascii_len)
 		{
 		    if (fio_flags & FIO_LATIN1)
 			u8c = *--p;
@@ -1951,8 +2073,13 @@ retry:
 		    }
 		    if (enc_utf8)	/* produce UTF-8 */
 		    {
-			dest -= utf_char2len(u8c);
-			(void)utf_char2bytes(u8c, dest);
+			if (u8c < 0x80)
+			    *--dest = u8c;
+			else
+			{
+			    dest -= utf_char2len(u8c);
+			    (void)utf_char2bytes(u8c, dest);
+			}
 		    }
 		    else		/* produce Latin1 */
 		    {
@@ -1980,6 +2107,12 @@ retry:
 		    }
 		}
 
+		if (ascii_len > 0)
+		{
+		    dest -= ascii_len;
+		    mch_memmove(dest, ptr, (size_t)ascii_len);
+		}
+
 		/* move the linerest to before the converted characters */
 		line_start = dest - linerest;
 		mch_memmove(line_start, buffer, (size_t)linerest);
@@ -2053,6 +2186,9 @@ retry:
 			else
 			    p += l - 1;
 		    }
+		    else
+			/* skip over ASCII quickly */
+			p += utf_ascii_len(p, (long)todo) - 1;
 		}
 		if (p < ptr + size && !incomplete_tail)
 		{
@@ -2084,17 +2220,13 @@ rewind_retry:
 		/* First try finding a NL, for Dos and Unix */
 		if (try_dos || try_unix)
 		{
-		    for (p = ptr; p < ptr + size; ++p)
+		    p = (char_u *)memchr(ptr, NL, (size_t)size);
+		    if (p != NULL)
 		    {
-			if (*p == NL)
-			{
-			    if (!try_unix
-				    || (try_dos && p > ptr && p[-1] == CAR))
-				fileformat = EOL_DOS;
-			    else
-				fileformat = EOL_UNIX;
-			    break;
-			}
+			if (!try_unix || (try_dos && p > ptr && p[-1] == CAR))
+			    fileformat = EOL_DOS;
+			else
+			    fileformat = EOL_UNIX;
 		    }
 
 		    /* Don't give in to EOL_UNIX if EOL_MAC is more likely */
@@ -2107,13 +2239,12 @@ rewind_retry:
 			    ;
 			if (p >= ptr)
 			{
-			    for (p = ptr; p < ptr + size; ++p)
-			    {
-				if (*p == NL)
-				    try_unix++;
-				else if (*p == CAR)
-				    try_mac++;
-			    }
+			    for (p = ptr; (p = (char_u *)memchr(p, NL,
+				     (size_t)(ptr + size - p))) != NULL; ++p)
+				try_unix++;
+			    for (p = ptr; (p = (char_u *)memchr(p, CAR,
+				     (size_t)(ptr + size - p))) != NULL; ++p)
+				try_mac++;
 			    if (try_mac > try_unix)
 				fileformat = EOL_MAC;
 			}
@@ -2135,118 +2266,157 @@ rewind_retry:
 	}
 
 	/*
-	 * This loop is executed once for every character read.
-	 * Keep it fast!
+	 * This loop is executed once for every line read.  memchr() is used to
+	 * find the end of the line and the NULs in it, that is much faster
+	 * than looking at every character.
 	 */
+	buf_end = ptr + size;
 	if (fileformat == EOL_MAC)
 	{
-	    --ptr;
-	    while (++ptr, --size >= 0)
+	    for (;;)
 	    {
-		/* catch most common case first */
-		if ((c = *ptr) != NUL && c != CAR && c != NL)
-		    continue;
-		if (c == NUL)
-		    *ptr = NL;	/* NULs are replaced by newlines! */
-		else if (c == NL)
-		    *ptr = CAR;	/* NLs are replaced by CRs! */
-		else
+		eol = (char_u *)memchr(ptr, CAR, (size_t)(buf_end - ptr));
+		if (eol == NULL)
+		    eol = buf_end;
+		/* NLs are replaced by CRs, NULs by newlines! */
+		for (p = ptr; (p = (char_u *)memchr(p, NL,
+					     (size_t)(eol - p))) != NULL; ++p)
+		    *p = CAR;
+		for (p = ptr; (p = (char_u *)memchr(p, NUL,
+					     (size_t)(eol - p))) != NULL; ++p)
+		    *p = NL;
+		ptr = eol;
+		if (ptr == buf_end)
+		    break;
+
+		if (skip_count == 0)
 		{
-		    if (skip_count == 0)
+		    *ptr = NUL;	    /* end of line */
+		    len = (colnr_T) (ptr - line_start + 1);
+		    bulk_lines[bulk_count] = line_start;
+		    bulk_lens[bulk_count] = len;
+		    if (++bulk_count == READ_BULK_LINES)
 		    {
-			*ptr = NUL;	    /* end of line */
-			len = (colnr_T) (ptr - line_start + 1);
-			if (ml_append(lnum, line_start, len, newfile) == FAIL)
+			bulk_count = 0;
+			if (ml_append_bulk(lnum + 1 - READ_BULK_LINES,
+				    bulk_lines, bulk_lens,
+				    (long)READ_BULK_LINES, newfile) == FAIL)
 			{
 			    error = TRUE;
 			    break;
 			}
+		    }
 #ifdef FEAT_PERSISTENT_UNDO
-			if (read_undo_file)
-			    sha256_update(&sha_ctx, line_start, len);
+		    if (read_undo_file)
+			sha256_update(&sha_ctx, line_start, len);
 #endif
-			++lnum;
-			if (--read_count == 0)
-			{
-			    error = TRUE;	/* break loop */
-			    line_start = ptr;	/* nothing left to write */
-			    break;
-			}
+		    ++lnum;
+		    if (--read_count == 0)
+		    {
+			error = TRUE;	/* break loop */
+			line_start = ptr;	/* nothing left to write */
+			break;
 		    }
-		    else
-			--skip_count;
-		    line_start = ptr + 1;
 		}
+		else
+		    --skip_count;
+		line_start = ptr + 1;
+		++ptr;
 	    }
 	}
 	else
 	{
-	    --ptr;
-	    while (++ptr, --size >= 0)
+	    for (;;)
 	    {
-		if ((c = *ptr) != NUL && c != NL)  /* catch most common case */
-		    continue;
-		if (c == NUL)
-		    *ptr = NL;	/* NULs are replaced by newlines! */
-		else
+		eol = (char_u *)memchr(ptr, NL, (size_t)(buf_end - ptr));
+		if (eol == NULL)
+		    eol = buf_end;
+		/* NULs are replaced by newlines! */
+		for (p = ptr; (p = (char_u *)memchr(p, NUL,
+					     (size_t)(eol - p))) != NULL; ++p)
+		    *p = NL;
+		ptr = eol;
+		if (ptr == buf_end)
+		    break;
+
+		if (skip_count == 0)
 		{
-		    if (skip_count == 0)
+		    *ptr = NUL;		/* end of line */
+		    len = (colnr_T)(ptr - line_start + 1);
+		    if (fileformat == EOL_DOS)
 		    {
-			*ptr = NUL;		/* end of line */
-			len = (colnr_T)(ptr - line_start + 1);
-			if (fileformat == EOL_DOS)
+			/* remove CR */
+			if (ptr > line_start && ptr[-1] == CAR)
 			{
-			    if (ptr[-1] == CAR)	/* remove CR */
-			    {
-				ptr[-1] = NUL;
-				--len;
-			    }
-			    /*
-			     * Reading in Dos format, but no CR-LF found!
-			     * When 'fileformats' includes "unix", delete all
-			     * the lines read so far and start all over again.
-			     * Otherwise give an error message later.
-			     */
-			    else if (ff_error != EOL_DOS)
+			    ptr[-1] = NUL;
+			    --len;
+			}
+			/*
+			 * Reading in Dos format, but no CR-LF found!
+			 * When 'fileformats' includes "unix", delete all
+			 * the lines read so far and start all over again.
+			 * Otherwise give an error message later.
+			 */
+			else if (ff_error != EOL_DOS)
+			{
+			    if (   try_unix
+				&& !read_stdin
+				&& (read_buffer
+				    || lseek(fd, (off_t)0L, SEEK_SET) == 0))
 			    {
-				if (   try_unix
-				    && !read_stdin
-				    && (read_buffer
-					|| lseek(fd, (off_t)0L, SEEK_SET) == 0))
-				{
-				    fileformat = EOL_UNIX;
-				    if (set_options)
-					set_fileformat(EOL_UNIX, OPT_LOCAL);
-				    file_rewind = TRUE;
-				    keep_fileformat = TRUE;
-				    goto retry;
-				}
-				ff_error = EOL_DOS;
+				fileformat = EOL_UNIX;
+				if (set_options)
+				    set_fileformat(EOL_UNIX, OPT_LOCAL);
+				file_rewind = TRUE;
+				keep_fileformat = TRUE;
+				/* drop the lines not appended yet */
+				lnum -= bulk_count;
+				bulk_count = 0;
+				goto retry;
 			    }
+			    ff_error = EOL_DOS;
 			}
-			if (ml_append(lnum, line_start, len, newfile) == FAIL)
+		    }
+		    bulk_lines[bulk_count] = line_start;
+		    bulk_lens[bulk_count] = len;
+		    if (++bulk_count == READ_BULK_LINES)
+		    {
+			bulk_count = 0;
+			if (ml_append_bulk(lnum + 1 - READ_BULK_LINES,
+				    bulk_lines, bulk_lens,
+				    (long)READ_BULK_LINES, newfile) == FAIL)
 			{
 			    error = TRUE;
 			    break;
 			}
+		    }
 #ifdef FEAT_PERSISTENT_UNDO
-			if (read_undo_file)
-			    sha256_update(&sha_ctx, line_start, len);
+		    if (read_undo_file)
+			sha256_update(&sha_ctx, line_start, len);
 #endif
-			++lnum;
-			if (--read_count == 0)
-			{
-			    error = TRUE;	    /* break loop */
-			    line_start = ptr;	/* nothing left to write */
-			    break;
-			}
+		    ++lnum;
+		    if (--read_count == 0)
+		    {
+			error = TRUE;	    /* break loop */
+			line_start = ptr;	/* nothing left to write */
+			break;
 		    }
-		    else
-			--skip_count;
-		    line_start = ptr + 1;
 		}
+		else
+		    --skip_count;
+		line_start = ptr + 1;
+		++ptr;
 	    }
 	}
+
+	/* Append the collected lines before "buffer" is used again. */
+	if (bulk_count > 0)
+	{
+	    if (ml_append_bulk(lnum - bulk_count, bulk_lines, bulk_lens,
+					      (long)bulk_count, newfile) == FAIL)
+		error = TRUE;
+	    bulk_count = 0;
+	}
 	linerest = (long)(ptr - line_start);
 	ui_breakcheck();
     }
@@ -2355,13 +2525,19 @@ failed:
 	/* need to delete the last line, which comes from the empty buffer */
 	if (newfile && wasempty && !(curbuf->b_ml.ml_flags & ML_EMPTY))
 	{
+#ifdef FEAT_MMAP
+	    /* a mapped file replaced the empty line */
+	    if (curbuf->b_ml.ml_map == NULL)
+#endif
+	    {
 #ifdef FEAT_NETBEANS_INTG
-	    netbeansFireChanges = 0;
+		netbeansFireChanges = 0;
 #endif
-	    ml_delete(curbuf->b_ml.ml_line_count, FALSE);
+		ml_delete(curbuf->b_ml.ml_line_count, FALSE);
 #ifdef FEAT_NETBEANS_INTG
-	    netbeansFireChanges = 1;
+		netbeansFireChanges = 1;
 #endif
+	    }
 	    --linecnt;
 	}
 	linecnt = curbuf->b_ml.ml_line_count - linecnt;
@@ -2469,6 +2645,16 @@ failed:
 		STRCAT(IObuff, _("[long lines split]"));
 		c = TRUE;
 	    }
+#ifdef FEAT_MMAP
+	    if (curbuf->b_ml.ml_map != NULL)
+	    {
+		if (curbuf->b_ml.ml_map->mm_load)
+		    STRCAT(IObuff, _("[loading]"));
+		else
+		    STRCAT(IObuff, _("[mapped]"));
+		c = TRUE;
+	    }
+#endif
 #ifdef FEAT_MBYTE
 	    if (notconverted)
 	    {
@@ -3220,6 +3406,13 @@ buf_write(buf, fname, sfname, start, end, eap, append, forceit,
 	return FAIL;
     }
 
+#ifdef FEAT_MMAP
+    /* Overwriting the file would change the text of the buffer while it's
+     * being written.  Copy the text into the memline first. */
+    if (ml_map_samefile(buf, fname) && ml_unmap(buf) == FAIL)
+	return FAIL;
+#endif
+
 #ifdef FEAT_MBYTE
     /* must init bw_conv_buf and bw_iconv_fd before jumping to "fail" */
     write_info.bw_conv_buf = NULL;
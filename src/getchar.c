@@ -2997,6 +2997,12 @@ inchar(buf, maxlen, wait_time, tb_change_cnt)
 	 */
 	out_flush();
 
+#if defined(FEAT_SEARCH_EXTRA) && defined(FEAT_RELTIME)
+	/* Use the time waiting for the user to count search matches. */
+	if (wait_time == -1L)
+	    search_count_background();
+#endif
+
 	/*
 	 * Fill up to a third of the buffer, because each character may be
 	 * tripled below.
@@ -344,6 +344,14 @@ EXTERN int	highlight_match INIT(= FALSE);	/* show search match pos */
 EXTERN linenr_T	search_match_lines;		/* lines of of matched string */
 EXTERN colnr_T	search_match_endcol;		/* col nr of match end */
 
+/*
+ * When searchit() stopped early, because of the time limit or because a
+ * character was typed, search_stop_lnum is the line where the search can be
+ * resumed; there is no match between the start position and that line.
+ * Zero when the search wasn't stopped.
+ */
+EXTERN linenr_T	search_stop_lnum INIT(= 0);
+
 EXTERN int	no_smartcase INIT(= FALSE);	/* don't use 'smartcase' once */
 
 EXTERN int	need_check_timestamps INIT(= FALSE); /* need to check file
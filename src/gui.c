@@ -131,6 +131,13 @@ gui_start()
 	 * knows when the child has done the setsid() call and is allowed to
 	 * exit. */
 	pipe_error = (pipe(pipefd) < 0);
+
+	/* Threads don't continue in the child and the parent exits, let the
+	 * writers finish their work first. */
+	mf_fork_prepare();
+# ifdef FEAT_VIMSHELL
+	vim_shell_fork_prepare();
+# endif
 	pid = fork();
 	if (pid > 0)	    /* Parent */
 	{
@@ -160,6 +167,13 @@ gui_start()
 	    _exit(0);
 	}
 
+	if (pid == 0)
+	    mf_fork_child();
+# ifdef FEAT_VIMSHELL
+	/* In the child, or when fork() failed: start the log writers again. */
+	vim_shell_fork_done();
+# endif
+
 # if defined(HAVE_SETSID) || defined(HAVE_SETPGID)
 	/*
 	 * Change our process group.  On some systems/shells a CTRL-C in the
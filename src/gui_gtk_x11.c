@@ -5415,6 +5415,45 @@ vimshell_request_cb(
     if (gtk_main_level() > 0)
 	gtk_main_quit();
 }
+
+/*
+ * VIM-Shell callback, called when a command streaming into a buffer
+ * (":vimshellread") has output available.
+ */
+    static void
+vimshell_stream_cb(
+    gpointer	data,
+    gint	source_fd,
+    GdkInputCondition condition)
+{
+    struct vim_shell_stream *st;
+
+    for(st=vim_shell_streams;st!=NULL;st=st->next)
+    {
+	if(st->fd==source_fd)
+	{
+	    vim_shell_stream_read(st);
+	    break;
+	}
+    }
+
+    if(vim_shell_stream_flush()>0 && updating_screen==FALSE)
+	update_screen(VALID);
+
+    /* Stop watching while the queue is full, added again in
+     * gui_mch_wait_for_chars(). */
+    for(st=vim_shell_streams;st!=NULL;st=st->next)
+    {
+	if(st->gtk_input_id!=0 && !vim_shell_stream_wants_read(st))
+	{
+	    gdk_input_remove(st->gtk_input_id);
+	    st->gtk_input_id=0;
+	}
+    }
+
+    if (gtk_main_level() > 0)
+	gtk_main_quit();
+}
 #endif
 
 /*
@@ -5468,6 +5507,15 @@ gui_mch_wait_for_chars(long wtime)
 	    }
 	}
     }
+    {
+	struct vim_shell_stream *st;
+	for(st=vim_shell_streams;st!=NULL;st=st->next)
+	{
+	    if(st->gtk_input_id==0 && vim_shell_stream_wants_read(st))
+		st->gtk_input_id=gdk_input_add(st->fd,
+			GDK_INPUT_READ, vimshell_stream_cb, NULL);
+	}
+    }
 #endif
 
     timed_out = FALSE;
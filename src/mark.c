@@ -1084,6 +1084,11 @@ mark_adjust(line1, line2, amount, amount_after)
     if (saved_cursor.lnum != 0)
 	one_adjust_nodel(&(saved_cursor.lnum));
 
+#ifdef FEAT_VIMSHELL
+    /* where ":vimshellread" appends its output */
+    vim_shell_stream_mark_adjust(line1, line2, amount, amount_after);
+#endif
+
     /*
      * Adjust items in all windows related to the current buffer.
      */
@@ -1957,6 +1957,32 @@ utf_ptr2len_len(p, size)
     return len;
 }
 
+/*
+ * Return the number of ASCII bytes at the start of "p[len]".
+ * Looks at a word at a time, used for checking and converting big buffers.
+ */
+    long
+utf_ascii_len(p, len)
+    char_u	*p;
+    long	len;
+{
+    char_u	*s = p;
+    char_u	*end = p + len;
+    long_u	highbits = ((long_u)-1 / 0xff) * 0x80;
+
+    while (s < end && ((long_u)s & (sizeof(long_u) - 1)) != 0)
+    {
+	if (*s >= 0x80)
+	    return (long)(s - p);
+	++s;
+    }
+    while (s + sizeof(long_u) <= end && (*(long_u *)s & highbits) == 0)
+	s += sizeof(long_u);
+    while (s < end && *s < 0x80)
+	++s;
+    return (long)(s - p);
+}
+
 /*
  * Return the number of bytes the UTF-8 encoding of the character at "p" takes.
  * This includes following composing characters.
@@ -73,7 +73,74 @@ extern int dos2;			/* this is in os_amiga.c */
 
 static long_u	total_mem_used = 0;	/* total memory used for memfiles */
 
-static void mf_ins_hash __ARGS((memfile_T *, bhdr_T *));
+/* Where mf_get() found blocks, for memfilestat(). */
+static long_u	mf_stat_memory = 0;	/* in the used list */
+static long_u	mf_stat_zip = 0;	/* compressed */
+static long_u	mf_stat_file = 0;	/* read from the swap file */
+
+#ifdef FEAT_SWAP_WRITER
+# include <pthread.h>
+
+/*
+ * Blocks are not written to the swap file by mf_write_block() itself but by
+ * a writer thread.  mf_write_block() puts a copy of the block in a queue,
+ * thus editing can go on while the write is done and the block can be
+ * changed or freed.  mf_sync() queues a sync request; one that is still
+ * waiting is moved to the end of the queue instead of adding another one.
+ *
+ * Before the swap file is read or closed the queued writes for it must be
+ * done, see mf_wait().  A failing write is remembered in the memfile and
+ * reported by the next mf_write_block() or mf_sync() call.
+ *
+ * Writes are done with pwrite(), so that they don't disturb the file
+ * position used by mf_read() and the synchronous writes.
+ */
+typedef struct mf_wr_S mf_wr_T;
+
+struct mf_wr_S
+{
+    mf_wr_T	*wr_next;	/* next in the queue or the done list */
+    memfile_T	*wr_mfp;	/* memfile this is for */
+    int		wr_fd;		/* its file descriptor */
+    char_u	*wr_data;	/* block to write, NULL for a sync request */
+    off_t	wr_offset;	/* where to write it */
+    unsigned	wr_size;	/* number of bytes to write */
+    int		wr_fsync;	/* sync request: use fsync() and not sync() */
+};
+
+/*
+ * When this many bytes are queued the main thread waits for the writer.
+ */
+#define MF_WR_MAX_BYTES (1024L * 1024L)
+
+#define MF_WR_NONE	0	/* writer not started yet */
+#define MF_WR_RUNNING	1	/* writer thread running */
+#define MF_WR_STOPPED	2	/* no writer: could not start it or exiting */
+
+static int		mf_wr_state = MF_WR_NONE;
+static pthread_t	mf_wr_thread;
+static pthread_mutex_t	mf_wr_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	mf_wr_cond = PTHREAD_COND_INITIALIZER;	/* queued */
+static pthread_cond_t	mf_wr_done = PTHREAD_COND_INITIALIZER;	/* done */
+
+/* The following are protected by mf_wr_mutex. */
+static mf_wr_T	*mf_wr_first = NULL;	/* queue of writes and syncs */
+static mf_wr_T	*mf_wr_last = NULL;
+static mf_wr_T	*mf_wr_done_list = NULL; /* done, to be freed by main thread */
+static long_u	mf_wr_bytes = 0;	/* bytes in the queue */
+static int	mf_wr_busy = FALSE;	/* writer is working on an item */
+
+static int mf_wr_do __ARGS((mf_wr_T *wr));
+static void *mf_wr_main __ARGS((void *arg));
+static int mf_wr_start __ARGS((void));
+static int mf_wr_queue __ARGS((memfile_T *mfp, char_u *data, off_t offset, unsigned size));
+static void mf_wr_free __ARGS((mf_wr_T *list));
+static void mf_wr_wait __ARGS((memfile_T *mfp));
+static void mf_wr_drain __ARGS((void));
+static int mf_wr_error __ARGS((memfile_T *mfp));
+#endif
+
+static int mf_ins_hash __ARGS((memfile_T *, bhdr_T *));
 static void mf_rem_hash __ARGS((memfile_T *, bhdr_T *));
 static bhdr_T *mf_find_hash __ARGS((memfile_T *, blocknr_T));
 static void mf_ins_used __ARGS((memfile_T *, bhdr_T *));
@@ -87,7 +154,23 @@ static int  mf_read __ARGS((memfile_T *, bhdr_T *));
 static int  mf_write __ARGS((memfile_T *, bhdr_T *));
 static int  mf_write_block __ARGS((memfile_T *mfp, bhdr_T *hp, off_t offset, unsigned size));
 static int  mf_trans_add __ARGS((memfile_T *, bhdr_T *));
+static void mf_set_used_count_max __ARGS((memfile_T *mfp));
 static void mf_do_open __ARGS((memfile_T *, char_u *, int));
+static void mf_zip_put __ARGS((memfile_T *mfp, bhdr_T *hp));
+static int mf_zip_get __ARGS((memfile_T *mfp, bhdr_T *hp));
+static void mf_zip_unlink __ARGS((memfile_T *mfp, mf_zblock_T *zp));
+static void mf_zip_rem __ARGS((memfile_T *mfp, mf_zblock_T *zp));
+static void mf_zip_forget __ARGS((bhdr_T *hp));
+static int mf_zip_free_all __ARGS((memfile_T *mfp));
+static char_u *mf_lz_putlen __ARGS((unsigned n, char_u *p, char_u *end));
+static unsigned mf_lz_compress __ARGS((char_u *src, unsigned len, char_u *dst, unsigned dstlen));
+static int mf_lz_decompress __ARGS((char_u *src, unsigned len, char_u *dst, unsigned dstlen));
+static void mf_hash_init __ARGS((mf_hashtab_T *));
+static void mf_hash_free __ARGS((mf_hashtab_T *));
+static void *mf_hash_find __ARGS((mf_hashtab_T *, blocknr_T));
+static int mf_hash_add_item __ARGS((mf_hashtab_T *, blocknr_T, void *));
+static void mf_hash_rem_item __ARGS((mf_hashtab_T *, blocknr_T));
+static int mf_hash_grow __ARGS((mf_hashtab_T *));
 
 /*
  * The functions for using a memfile:
@@ -100,6 +183,7 @@ static void mf_do_open __ARGS((memfile_T *, char_u *, int));
  * mf_put()	    unlock a block, may be marked for writing
  * mf_free()	    remove a block
  * mf_sync()	    sync changed parts of memfile to disk
+ * mf_wait()	    wait for the swap file writer to finish
  * mf_release_all() release as much memory as possible
  * mf_trans_del()   may translate negative to positive block number
  * mf_fullname()    make file name full path (use before first :cd)
@@ -123,7 +207,6 @@ mf_open(fname, flags)
     int		flags;
 {
     memfile_T		*mfp;
-    int			i;
     off_t		size;
 #if defined(STATFS) && defined(UNIX) && !defined(__QNX__)
 # define USE_FSTATFS
@@ -156,11 +239,17 @@ mf_open(fname, flags)
     mfp->mf_used_last = NULL;
     mfp->mf_dirty = FALSE;
     mfp->mf_used_count = 0;
-    for (i = 0; i < MEMHASHSIZE; ++i)
-    {
-	mfp->mf_hash[i] = NULL;		/* hash lists are empty */
-	mfp->mf_trans[i] = NULL;	/* trans lists are empty */
-    }
+#ifdef FEAT_SWAP_WRITER
+    mfp->mf_wr_pending = 0;
+    mfp->mf_wr_error = FALSE;
+    mfp->mf_wr_sync = NULL;
+#endif
+    mf_hash_init(&mfp->mf_hash);	/* hash tables are empty */
+    mf_hash_init(&mfp->mf_trans);
+    mf_hash_init(&mfp->mf_zhash);
+    mfp->mf_zfirst = NULL;		/* no compressed blocks */
+    mfp->mf_zlast = NULL;
+    mfp->mf_zbytes = 0;
     mfp->mf_page_size = MEMFILE_PAGE_SIZE;
 #ifdef FEAT_CRYPT
     mfp->mf_old_key = NULL;
@@ -190,27 +279,31 @@ mf_open(fname, flags)
     mfp->mf_blocknr_min = -1;
     mfp->mf_neg_count = 0;
     mfp->mf_infile_count = mfp->mf_blocknr_max;
+    mf_set_used_count_max(mfp);
 
-    /*
-     * Compute maximum number of pages ('maxmem' is in Kbyte):
-     *	'mammem' * 1Kbyte / page-size-in-bytes.
-     * Avoid overflow by first reducing page size as much as possible.
-     */
-    {
-	int	    shift = 10;
-	unsigned    page_size = mfp->mf_page_size;
+    return mfp;
+}
 
-	while (shift > 0 && (page_size & 1) == 0)
-	{
-	    page_size = page_size >> 1;
-	    --shift;
-	}
-	mfp->mf_used_count_max = (p_mm << shift) / page_size;
-	if (mfp->mf_used_count_max < 10)
-	    mfp->mf_used_count_max = 10;
-    }
+/*
+ * Compute maximum number of pages ('maxmem' is in Kbyte):
+ *	'mammem' * 1Kbyte / page-size-in-bytes.
+ * Avoid overflow by first reducing page size as much as possible.
+ */
+    static void
+mf_set_used_count_max(mfp)
+    memfile_T	*mfp;
+{
+    int		shift = 10;
+    unsigned	page_size = mfp->mf_page_size;
 
-    return mfp;
+    while (shift > 0 && (page_size & 1) == 0)
+    {
+	page_size = page_size >> 1;
+	--shift;
+    }
+    mfp->mf_used_count_max = (p_mm << shift) / page_size;
+    if (mfp->mf_used_count_max < 10)
+	mfp->mf_used_count_max = 10;
 }
 
 /*
@@ -246,13 +339,13 @@ mf_close(mfp, del_file)
     int		del_file;
 {
     bhdr_T	*hp, *nextp;
-    NR_TRANS	*tp, *tpnext;
-    int		i;
+    long_u	i;
 
     if (mfp == NULL)		    /* safety check */
 	return;
     if (mfp->mf_fd >= 0)
     {
+	(void)mf_wait(mfp);
 	if (close(mfp->mf_fd) < 0)
 	    EMSG(_(e_swapclose));
     }
@@ -267,12 +360,13 @@ mf_close(mfp, del_file)
     }
     while (mfp->mf_free_first != NULL)	    /* free entries in free list */
 	vim_free(mf_rem_free(mfp));
-    for (i = 0; i < MEMHASHSIZE; ++i)	    /* free entries in trans lists */
-	for (tp = mfp->mf_trans[i]; tp != NULL; tp = tpnext)
-	{
-	    tpnext = tp->nt_next;
-	    vim_free(tp);
-	}
+    (void)mf_zip_free_all(mfp);		    /* free compressed blocks */
+    mf_hash_free(&mfp->mf_zhash);
+					    /* free entries in trans table */
+    for (i = 0; i <= mfp->mf_trans.mht_mask; ++i)
+	vim_free(mfp->mf_trans.mht_buckets[i].mhi_item);
+    mf_hash_free(&mfp->mf_trans);
+    mf_hash_free(&mfp->mf_hash);
     vim_free(mfp->mf_fname);
     vim_free(mfp->mf_ffname);
     vim_free(mfp);
@@ -302,7 +396,10 @@ mf_close_file(buf, getlines)
 	mf_dont_release = FALSE;
 	/* TODO: should check if all blocks are really in core */
     }
+    /* Compressed blocks can't be read back from the file. */
+    (void)mf_zip_free_all(mfp);
 
+    (void)mf_wait(mfp);
     if (close(mfp->mf_fd) < 0)			/* close the file */
 	EMSG(_(e_swapclose));
     mfp->mf_fd = -1;
@@ -330,6 +427,20 @@ mf_new_page_size(mfp, new_size)
      * freed with that size later on. */
     total_mem_used += new_size - mfp->mf_page_size;
     mfp->mf_page_size = new_size;
+    mf_set_used_count_max(mfp);
+}
+
+/*
+ * Set the page size of memfile "mfp", which must not have any blocks yet.
+ * Used for a bigger page size when a big file is going to be edited.
+ */
+    void
+mf_set_page_size(mfp, new_size)
+    memfile_T	*mfp;
+    unsigned	new_size;
+{
+    mfp->mf_page_size = new_size;
+    mf_set_used_count_max(mfp);
 }
 
 /*
@@ -409,11 +520,17 @@ mf_new(mfp, negative, page_count)
 	    mfp->mf_blocknr_max += page_count;
 	}
     }
+    if (mf_ins_hash(mfp, hp) == FAIL)
+    {
+	if (hp->bh_bnum < 0)
+	    mfp->mf_neg_count--;
+	mf_free_bhdr(hp);
+	return NULL;
+    }
     hp->bh_flags = BH_LOCKED | BH_DIRTY;	/* new block is always dirty */
     mfp->mf_dirty = TRUE;
     hp->bh_page_count = page_count;
     mf_ins_used(mfp, hp);
-    mf_ins_hash(mfp, hp);
 
     /*
      * Init the data to all zero, to avoid reading uninitialized data.
@@ -464,7 +581,16 @@ mf_get(mfp, nr, page_count)
 	hp->bh_bnum = nr;
 	hp->bh_flags = 0;
 	hp->bh_page_count = page_count;
-	if (mf_read(mfp, hp) == FAIL)	    /* cannot read the block! */
+	if (mf_zip_get(mfp, hp) == OK)
+	    ++mf_stat_zip;
+	else if (mf_read(mfp, hp) == FAIL)  /* cannot read the block! */
+	{
+	    mf_free_bhdr(hp);
+	    return NULL;
+	}
+	else
+	    ++mf_stat_file;
+	if (mf_ins_hash(mfp, hp) == FAIL)
 	{
 	    mf_free_bhdr(hp);
 	    return NULL;
@@ -473,12 +599,11 @@ mf_get(mfp, nr, page_count)
     else
     {
 	mf_rem_used(mfp, hp);	/* remove from list, insert in front below */
-	mf_rem_hash(mfp, hp);
+	++mf_stat_memory;
     }
 
     hp->bh_flags |= BH_LOCKED;
     mf_ins_used(mfp, hp);	/* put in front of used list */
-    mf_ins_hash(mfp, hp);	/* put in front of hash list */
 
     return hp;
 }
@@ -509,6 +634,7 @@ mf_put(mfp, hp, dirty, infile)
     {
 	flags |= BH_DIRTY;
 	mfp->mf_dirty = TRUE;
+	mf_zip_forget(hp);	    /* compressed copy is outdated */
     }
     hp->bh_flags = flags;
     if (infile)
@@ -524,6 +650,7 @@ mf_free(mfp, hp)
     bhdr_T	*hp;
 {
     vim_free(hp->bh_data);	/* free the memory */
+    mf_zip_forget(hp);
     mf_rem_hash(mfp, hp);	/* get *hp out of the hash list */
     mf_rem_used(mfp, hp);	/* get *hp out of the used list */
     if (hp->bh_bnum < 0)
@@ -556,6 +683,9 @@ fdtofh(int filedescriptor)
  *  MFS_FLUSH	Make sure buffers are flushed to disk, so they will survive a
  *		system crash.
  *  MFS_ZERO	Only write block 0.
+ *  MFS_WAIT	Wait until the blocks have been written (and flushed to disk,
+ *		when MFS_FLUSH is also given).  Without it they may still be
+ *		queued for the swap file writer.
  *
  * Return FAIL for failure, OK otherwise
  */
@@ -623,6 +753,15 @@ mf_sync(mfp, flags)
 
     if ((flags & MFS_FLUSH) && *p_sws != NUL)
     {
+#ifdef FEAT_SWAP_WRITER
+	/* The writer syncs after writing what was queued before. */
+	if (mf_wr_start() == OK)
+	{
+	    if (mf_wr_queue(mfp, NULL, (off_t)0, 0) == FAIL)
+		status = FAIL;
+	}
+	else
+#endif
 #if defined(UNIX)
 # ifdef HAVE_FSYNC
 	/*
@@ -717,6 +856,15 @@ mf_sync(mfp, flags)
 #endif /* AMIGA */
     }
 
+#ifdef FEAT_SWAP_WRITER
+    if (flags & MFS_WAIT)
+    {
+	mf_wr_wait(mfp);
+	if (mf_wr_error(mfp) == FAIL)
+	    status = FAIL;
+    }
+#endif
+
     got_int |= got_int_save;
 
     return status;
@@ -740,56 +888,38 @@ mf_set_dirty(mfp)
 }
 
 /*
- * insert block *hp in front of hashlist of memfile *mfp
+ * insert block *hp in the hash table of memfile *mfp
+ *
+ * Return FAIL for failure, OK otherwise
  */
-    static void
+    static int
 mf_ins_hash(mfp, hp)
     memfile_T	*mfp;
     bhdr_T	*hp;
 {
-    bhdr_T	*hhp;
-    int		hash;
-
-    hash = MEMHASH(hp->bh_bnum);
-    hhp = mfp->mf_hash[hash];
-    hp->bh_hash_next = hhp;
-    hp->bh_hash_prev = NULL;
-    if (hhp != NULL)
-	hhp->bh_hash_prev = hp;
-    mfp->mf_hash[hash] = hp;
+    return mf_hash_add_item(&mfp->mf_hash, hp->bh_bnum, hp);
 }
 
 /*
- * remove block *hp from hashlist of memfile list *mfp
+ * remove block *hp from the hash table of memfile *mfp
  */
     static void
 mf_rem_hash(mfp, hp)
     memfile_T	*mfp;
     bhdr_T	*hp;
 {
-    if (hp->bh_hash_prev == NULL)
-	mfp->mf_hash[MEMHASH(hp->bh_bnum)] = hp->bh_hash_next;
-    else
-	hp->bh_hash_prev->bh_hash_next = hp->bh_hash_next;
-
-    if (hp->bh_hash_next)
-	hp->bh_hash_next->bh_hash_prev = hp->bh_hash_prev;
+    mf_hash_rem_item(&mfp->mf_hash, hp->bh_bnum);
 }
 
 /*
- * look in hash lists of memfile *mfp for block header with number 'nr'
+ * look in the hash table of memfile *mfp for block header with number 'nr'
  */
     static bhdr_T *
 mf_find_hash(mfp, nr)
     memfile_T	*mfp;
     blocknr_T	nr;
 {
-    bhdr_T	*hp;
-
-    for (hp = mfp->mf_hash[MEMHASH(nr)]; hp != NULL; hp = hp->bh_hash_next)
-	if (hp->bh_bnum == nr)
-	    break;
-    return hp;
+    return (bhdr_T *)mf_hash_find(&mfp->mf_hash, nr);
 }
 
 /*
@@ -898,6 +1028,7 @@ mf_release(mfp, page_count)
 
     mf_rem_used(mfp, hp);
     mf_rem_hash(mfp, hp);
+    mf_zip_put(mfp, hp);
 
     /*
      * If a bhdr_T is returned, make sure that the page_count of bh_data is
@@ -942,6 +1073,8 @@ mf_release_all()
 	    /* only if there is a swapfile */
 	    if (mfp->mf_fd >= 0)
 	    {
+		if (mf_zip_free_all(mfp))
+		    retval = TRUE;
 		for (hp = mfp->mf_used_last; hp != NULL; )
 		{
 		    if (!(hp->bh_flags & BH_LOCKED)
@@ -963,6 +1096,218 @@ mf_release_all()
     return retval;
 }
 
+/*
+ * Compressed blocks.
+ *
+ * A block released by mf_release() is not just dropped, it is kept
+ * compressed in memory when that makes it at least a quarter smaller.  Text
+ * usually compresses much better.  When mf_get() needs the block again it is
+ * uncompressed instead of read from the swap file.  The compressed blocks of
+ * a memfile use up to the same amount of memory as 'maxmem' allows for the
+ * blocks in the used list, they are counted for 'maxmemtot'.  When there is
+ * no room the oldest compressed blocks are dropped, they are in the swap
+ * file.
+ */
+
+/*
+ * Keep block "hp", which is in the swap file and about to be released,
+ * compressed.  When it wasn't changed since it was uncompressed its old
+ * compressed copy is used, that saves compressing it again.
+ */
+    static void
+mf_zip_put(mfp, hp)
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+{
+    static char_u   *buf = NULL;	/* compression buffer */
+    static unsigned buflen = 0;
+    unsigned	    size = mfp->mf_page_size * hp->bh_page_count;
+    unsigned	    len;
+    unsigned	    extra = 0;		/* memory that will be used extra */
+    long_u	    maxbytes;
+    mf_zblock_T	    *zp;
+
+    if (hp->bh_bnum < 0)
+	return;
+    if (hp->bh_zblock != NULL)
+	len = hp->bh_zblock->zb_size;	/* already counted in total_mem_used */
+    else
+    {
+	if (buflen < size)
+	{
+	    vim_free(buf);
+	    buf = alloc(size);
+	    buflen = buf == NULL ? 0 : size;
+	    if (buf == NULL)
+		return;
+	}
+	len = mf_lz_compress(hp->bh_data, size, buf, size - size / 4);
+	if (len == 0)
+	    return;
+	extra = len;
+    }
+
+    /* Make room by dropping the oldest compressed blocks. */
+    maxbytes = (long_u)mfp->mf_used_count_max * mfp->mf_page_size;
+    while (mfp->mf_zlast != NULL && (mfp->mf_zbytes + len > maxbytes
+		       || ((total_mem_used + extra) >> 10) >= (long_u)p_mmt))
+	mf_zip_rem(mfp, mfp->mf_zlast);
+    if (mfp->mf_zbytes + len > maxbytes
+		       || ((total_mem_used + extra) >> 10) >= (long_u)p_mmt)
+    {
+	mf_zip_forget(hp);
+	return;
+    }
+
+    zp = hp->bh_zblock;
+    hp->bh_zblock = NULL;
+    if (zp == NULL)
+    {
+	zp = (mf_zblock_T *)alloc((unsigned)(sizeof(mf_zblock_T) + len));
+	if (zp == NULL)
+	    return;
+	zp->zb_bnum = hp->bh_bnum;
+	zp->zb_page_count = hp->bh_page_count;
+	zp->zb_size = len;
+	mch_memmove(zp->zb_data, buf, (size_t)len);
+	total_mem_used += len;
+    }
+    if (mf_hash_add_item(&mfp->mf_zhash, zp->zb_bnum, zp) == FAIL)
+    {
+	total_mem_used -= len;
+	vim_free(zp);
+	return;
+    }
+    zp->zb_prev = NULL;
+    zp->zb_next = mfp->mf_zfirst;
+    if (mfp->mf_zfirst == NULL)
+	mfp->mf_zlast = zp;
+    else
+	mfp->mf_zfirst->zb_prev = zp;
+    mfp->mf_zfirst = zp;
+    mfp->mf_zbytes += len;
+}
+
+/*
+ * Uncompress block "hp" if it was kept compressed.  The compressed copy is
+ * then kept with the block, until the block is changed or released.
+ * Return FAIL when the block must be read from the file.
+ */
+    static int
+mf_zip_get(mfp, hp)
+    memfile_T	*mfp;
+    bhdr_T	*hp;
+{
+    mf_zblock_T	*zp;
+
+    zp = (mf_zblock_T *)mf_hash_find(&mfp->mf_zhash, hp->bh_bnum);
+    if (zp == NULL)
+	return FAIL;
+    mf_zip_unlink(mfp, zp);
+    hp->bh_zblock = zp;
+    if (zp->zb_page_count == hp->bh_page_count
+	    && mf_lz_decompress(zp->zb_data, zp->zb_size, hp->bh_data,
+				mfp->mf_page_size * hp->bh_page_count) == OK)
+	return OK;
+    mf_zip_forget(hp);
+    return FAIL;
+}
+
+/*
+ * Take compressed block "zp" out of the list and the hash table.  Its memory
+ * remains counted in total_mem_used.
+ */
+    static void
+mf_zip_unlink(mfp, zp)
+    memfile_T	*mfp;
+    mf_zblock_T	*zp;
+{
+    mf_hash_rem_item(&mfp->mf_zhash, zp->zb_bnum);
+    if (zp->zb_prev == NULL)
+	mfp->mf_zfirst = zp->zb_next;
+    else
+	zp->zb_prev->zb_next = zp->zb_next;
+    if (zp->zb_next == NULL)
+	mfp->mf_zlast = zp->zb_prev;
+    else
+	zp->zb_next->zb_prev = zp->zb_prev;
+    mfp->mf_zbytes -= zp->zb_size;
+}
+
+/*
+ * Drop compressed block "zp".
+ */
+    static void
+mf_zip_rem(mfp, zp)
+    memfile_T	*mfp;
+    mf_zblock_T	*zp;
+{
+    mf_zip_unlink(mfp, zp);
+    total_mem_used -= zp->zb_size;
+    vim_free(zp);
+}
+
+/*
+ * Drop the compressed copy kept with block "hp", if there is one.
+ */
+    static void
+mf_zip_forget(hp)
+    bhdr_T	*hp;
+{
+    if (hp->bh_zblock != NULL)
+    {
+	total_mem_used -= hp->bh_zblock->zb_size;
+	vim_free(hp->bh_zblock);
+	hp->bh_zblock = NULL;
+    }
+}
+
+/*
+ * Drop all compressed blocks of memfile "mfp".
+ * Return TRUE if there were any.
+ */
+    static int
+mf_zip_free_all(mfp)
+    memfile_T	*mfp;
+{
+    int		retval = mfp->mf_zfirst != NULL;
+
+    while (mfp->mf_zfirst != NULL)
+	mf_zip_rem(mfp, mfp->mf_zfirst);
+    return retval;
+}
+
+#if defined(FEAT_EVAL) || defined(PROTO)
+/*
+ * Add the counters for where blocks were found and the memory used for
+ * compressed blocks to dictionary "d", for memfilestat().
+ */
+    void
+mf_stat(d)
+    dict_T	*d;
+{
+    buf_T	*buf;
+    long	blocks = 0;
+    long	bytes = 0;
+    mf_zblock_T	*zp;
+
+    for (buf = firstbuf; buf != NULL; buf = buf->b_next)
+	if (buf->b_ml.ml_mfp != NULL)
+	{
+	    for (zp = buf->b_ml.ml_mfp->mf_zfirst; zp != NULL;
+							    zp = zp->zb_next)
+		++blocks;
+	    bytes += (long)buf->b_ml.ml_mfp->mf_zbytes;
+	}
+
+    dict_add_nr_str(d, "memory", (long)mf_stat_memory, NULL);
+    dict_add_nr_str(d, "compressed", (long)mf_stat_zip, NULL);
+    dict_add_nr_str(d, "file", (long)mf_stat_file, NULL);
+    dict_add_nr_str(d, "compressed_blocks", blocks, NULL);
+    dict_add_nr_str(d, "compressed_bytes", bytes, NULL);
+}
+#endif
+
 /*
  * Allocate a block header and a block of memory for it
  */
@@ -982,6 +1327,7 @@ mf_alloc_bhdr(mfp, page_count)
 	    return NULL;
 	}
 	hp->bh_page_count = page_count;
+	hp->bh_zblock = NULL;
     }
     return hp;
 }
@@ -993,6 +1339,7 @@ mf_alloc_bhdr(mfp, page_count)
 mf_free_bhdr(hp)
     bhdr_T	*hp;
 {
+    mf_zip_forget(hp);
     vim_free(hp->bh_data);
     vim_free(hp);
 }
@@ -1041,6 +1388,11 @@ mf_read(mfp, hp)
     if (mfp->mf_fd < 0)	    /* there is no file, can't read */
 	return FAIL;
 
+#ifdef FEAT_SWAP_WRITER
+    /* The block may still be waiting to be written. */
+    mf_wr_wait(mfp);
+#endif
+
     page_size = mfp->mf_page_size;
     offset = (off_t)page_size * hp->bh_bnum;
     size = page_size * hp->bh_page_count;
@@ -1158,6 +1510,12 @@ mf_write_block(mfp, hp, offset, size)
     char_u	*data = hp->bh_data;
     int		result = OK;
 
+#ifdef FEAT_SWAP_WRITER
+    /* Report a failed background write here, like a failing write. */
+    if (mf_wr_error(mfp) == FAIL)
+	return FAIL;
+#endif
+
 #ifdef FEAT_CRYPT
     /* Encrypt if 'key' is set and this is a data block. */
     if (*mfp->mf_buffer->b_p_key != NUL)
@@ -1168,6 +1526,26 @@ mf_write_block(mfp, hp, offset, size)
     }
 #endif
 
+#ifdef FEAT_SWAP_WRITER
+    if (mf_wr_start() == OK)
+    {
+	/* The writer gets a copy, the block may change before it is written.
+	 * An encrypted block already is a copy. */
+	if (data == hp->bh_data)
+	{
+	    data = alloc(size);
+	    if (data != NULL)
+		mch_memmove(data, hp->bh_data, (size_t)size);
+	}
+	if (data != NULL)
+	    return mf_wr_queue(mfp, data, offset, size);
+
+	/* Out of memory: write it here, after the queued writes. */
+	data = hp->bh_data;
+	mf_wr_wait(mfp);
+    }
+#endif
+
     if ((unsigned)vim_write(mfp->mf_fd, data, size) != size)
 	result = FAIL;
 
@@ -1179,6 +1557,382 @@ mf_write_block(mfp, hp, offset, size)
     return result;
 }
 
+#ifdef FEAT_SWAP_WRITER
+/*
+ * Write or sync for queue item "wr".  Used by the writer thread, and by the
+ * main thread when there is no writer.
+ * Return FAIL or OK.
+ */
+    static int
+mf_wr_do(wr)
+    mf_wr_T	*wr;
+{
+    char_u	*p = wr->wr_data;
+    unsigned	todo = wr->wr_size;
+    off_t	offset = wr->wr_offset;
+    ssize_t	n;
+
+    if (p == NULL)
+    {
+# ifdef HAVE_FSYNC
+	if (wr->wr_fsync)
+	    return fsync(wr->wr_fd) == 0 ? OK : FAIL;
+# endif
+	sync();
+	return OK;
+    }
+
+    while (todo > 0)
+    {
+	n = pwrite(wr->wr_fd, p, (size_t)todo, offset);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return FAIL;
+	p += n;
+	offset += n;
+	todo -= (unsigned)n;
+    }
+    return OK;
+}
+
+/*
+ * The swap file writer thread: does the queued writes and syncs in order.
+ * Finished items go to the done list, only the main thread allocates and
+ * frees memory.
+ */
+    static void *
+mf_wr_main(arg)
+    void	*arg UNUSED;
+{
+    mf_wr_T	*wr;
+    int		ok;
+
+    pthread_mutex_lock(&mf_wr_mutex);
+    for (;;)
+    {
+	while (mf_wr_first == NULL)
+	    pthread_cond_wait(&mf_wr_cond, &mf_wr_mutex);
+	wr = mf_wr_first;
+	mf_wr_first = wr->wr_next;
+	if (mf_wr_first == NULL)
+	    mf_wr_last = NULL;
+	if (wr->wr_mfp->mf_wr_sync == (void *)wr)
+	    wr->wr_mfp->mf_wr_sync = NULL;
+	mf_wr_busy = TRUE;
+	pthread_mutex_unlock(&mf_wr_mutex);
+
+	ok = mf_wr_do(wr);
+
+	pthread_mutex_lock(&mf_wr_mutex);
+	mf_wr_busy = FALSE;
+	if (ok == FAIL)
+	    wr->wr_mfp->mf_wr_error = TRUE;
+	--wr->wr_mfp->mf_wr_pending;
+	mf_wr_bytes -= wr->wr_size;
+	wr->wr_next = mf_wr_done_list;
+	mf_wr_done_list = wr;
+	pthread_cond_broadcast(&mf_wr_done);
+    }
+    /*NOTREACHED*/
+    return NULL;
+}
+
+/*
+ * Start the writer thread if that wasn't done yet.
+ * Return OK when writes are to be queued for it.
+ */
+    static int
+mf_wr_start()
+{
+    sigset_t	all, old;
+
+    if (mf_wr_state == MF_WR_NONE)
+    {
+	/* Signals must be handled by the main thread. */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	if (pthread_create(&mf_wr_thread, NULL, mf_wr_main, NULL) == 0)
+	{
+	    pthread_detach(mf_wr_thread);
+	    mf_wr_state = MF_WR_RUNNING;
+	}
+	else
+	    mf_wr_state = MF_WR_STOPPED;
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+    }
+
+    /* When exiting after a deadly signal, do everything here. */
+    if (really_exiting && mf_wr_state == MF_WR_RUNNING)
+	mf_wr_drain();
+
+    return mf_wr_state == MF_WR_RUNNING ? OK : FAIL;
+}
+
+/*
+ * Queue writing "size" bytes of "data" at "offset" in the swap file of "mfp".
+ * "data" must be allocated, it is freed after writing.  When "data" is NULL
+ * queue a sync for 'swapsync', replacing one that is still waiting.
+ * Return FAIL when the item can't be allocated and doing the work directly
+ * fails.
+ */
+    static int
+mf_wr_queue(mfp, data, offset, size)
+    memfile_T	*mfp;
+    char_u	*data;
+    off_t	offset;
+    unsigned	size;
+{
+    mf_wr_T	*wr;
+    mf_wr_T	*done = NULL;
+    mf_wr_T	*prev;
+    mf_wr_T	item;
+    int		status;
+
+    wr = (mf_wr_T *)alloc((unsigned)sizeof(mf_wr_T));
+    if (wr == NULL)
+	wr = &item;
+    wr->wr_next = NULL;
+    wr->wr_mfp = mfp;
+    wr->wr_fd = mfp->mf_fd;
+    wr->wr_data = data;
+    wr->wr_offset = offset;
+    wr->wr_size = size;
+    wr->wr_fsync = (STRCMP(p_sws, "fsync") == 0);
+
+    if (wr == &item)
+    {
+	/* Out of memory: do it here, after the queued work. */
+	mf_wr_wait(mfp);
+	status = mf_wr_do(wr);
+	vim_free(data);
+	return status;
+    }
+
+    pthread_mutex_lock(&mf_wr_mutex);
+
+    /* Don't let the queue grow without limit when the disk is slow. */
+    while (mf_wr_bytes >= MF_WR_MAX_BYTES)
+	pthread_cond_wait(&mf_wr_done, &mf_wr_mutex);
+
+    if (data == NULL && mfp->mf_wr_sync != NULL)
+    {
+	/* A sync is still waiting: drop it, the new one at the end of the
+	 * queue also covers the writes before it. */
+	prev = NULL;
+	for (done = mf_wr_first; done != mfp->mf_wr_sync;
+						       done = done->wr_next)
+	    prev = done;
+	if (prev == NULL)
+	    mf_wr_first = done->wr_next;
+	else
+	    prev->wr_next = done->wr_next;
+	if (mf_wr_last == done)
+	    mf_wr_last = prev;
+	--mfp->mf_wr_pending;
+    }
+
+    if (mf_wr_last == NULL)
+	mf_wr_first = wr;
+    else
+	mf_wr_last->wr_next = wr;
+    mf_wr_last = wr;
+    ++mfp->mf_wr_pending;
+    mf_wr_bytes += size;
+    if (data == NULL)
+	mfp->mf_wr_sync = (void *)wr;
+
+    /* Take over what the writer has finished, to free it below. */
+    if (done != NULL)
+	done->wr_next = mf_wr_done_list;
+    else
+	done = mf_wr_done_list;
+    mf_wr_done_list = NULL;
+
+    pthread_cond_signal(&mf_wr_cond);
+    pthread_mutex_unlock(&mf_wr_mutex);
+
+    mf_wr_free(done);
+    return OK;
+}
+
+/*
+ * Free a list of queue items.
+ */
+    static void
+mf_wr_free(list)
+    mf_wr_T	*list;
+{
+    mf_wr_T	*wr;
+
+    while (list != NULL)
+    {
+	wr = list;
+	list = list->wr_next;
+	vim_free(wr->wr_data);
+	vim_free(wr);
+    }
+}
+
+/*
+ * Wait for the writer to do all queued work for "mfp".
+ */
+    static void
+mf_wr_wait(mfp)
+    memfile_T	*mfp;
+{
+    mf_wr_T	*done;
+
+    if (mf_wr_state != MF_WR_RUNNING)
+	return;
+    if (really_exiting)
+    {
+	mf_wr_drain();
+	return;
+    }
+
+    pthread_mutex_lock(&mf_wr_mutex);
+    while (mfp->mf_wr_pending > 0)
+	pthread_cond_wait(&mf_wr_done, &mf_wr_mutex);
+    done = mf_wr_done_list;
+    mf_wr_done_list = NULL;
+    pthread_mutex_unlock(&mf_wr_mutex);
+
+    mf_wr_free(done);
+}
+
+/*
+ * Stop using the writer, after a deadly signal: take over the queue and do
+ * the work in the main thread.  The main thread may have been interrupted
+ * while holding the mutex, thus only try locking it for a while.
+ */
+    static void
+mf_wr_drain()
+{
+    mf_wr_T	*list;
+    int		locked = FALSE;
+    int		i;
+
+    mf_wr_state = MF_WR_STOPPED;
+    for (i = 0; i < 100; ++i)
+    {
+	if (pthread_mutex_trylock(&mf_wr_mutex) == 0)
+	{
+	    locked = TRUE;
+	    break;
+	}
+	mch_delay(10L, TRUE);
+    }
+
+    list = mf_wr_first;
+    mf_wr_first = NULL;
+    mf_wr_last = NULL;
+    if (locked)
+    {
+	/* Let the writer finish the block it is writing, it must not
+	 * overwrite a newer version written below. */
+	for (i = 0; mf_wr_busy && i < 100; ++i)
+	{
+	    pthread_mutex_unlock(&mf_wr_mutex);
+	    mch_delay(10L, TRUE);
+	    pthread_mutex_lock(&mf_wr_mutex);
+	}
+	pthread_mutex_unlock(&mf_wr_mutex);
+    }
+
+    /* Nothing is freed while exiting, no need to update the counts. */
+    for ( ; list != NULL; list = list->wr_next)
+	(void)mf_wr_do(list);
+}
+
+/*
+ * Return FAIL if a queued write or sync for "mfp" failed since the last call.
+ */
+    static int
+mf_wr_error(mfp)
+    memfile_T	*mfp;
+{
+    int		error;
+
+    if (mf_wr_state == MF_WR_NONE)
+	return OK;
+    if (really_exiting)
+	return mfp->mf_wr_error ? FAIL : OK;
+    pthread_mutex_lock(&mf_wr_mutex);
+    error = mfp->mf_wr_error;
+    mfp->mf_wr_error = FALSE;
+    pthread_mutex_unlock(&mf_wr_mutex);
+    return error ? FAIL : OK;
+}
+#endif
+
+/*
+ * Wait until the swap file writer has done the queued writes and syncs for
+ * "mfp".  Must be called before its file descriptor is closed.
+ * Return FAIL if one of them failed (it is reported later).
+ */
+    int
+mf_wait(mfp)
+    memfile_T	*mfp UNUSED;
+{
+#ifdef FEAT_SWAP_WRITER
+    int		error;
+
+    mf_wr_wait(mfp);
+    if (mf_wr_state == MF_WR_NONE || really_exiting)
+	return OK;
+    pthread_mutex_lock(&mf_wr_mutex);
+    error = mfp->mf_wr_error;
+    pthread_mutex_unlock(&mf_wr_mutex);
+    if (error)
+	return FAIL;
+#endif
+    return OK;
+}
+
+/*
+ * Called before fork() when the child continues as Vim (":gui").  The swap
+ * file writer thread doesn't continue in the child and the parent exits:
+ * wait for the writer to do all queued work.
+ */
+    void
+mf_fork_prepare()
+{
+#ifdef FEAT_SWAP_WRITER
+    mf_wr_T	*done;
+
+    if (mf_wr_state != MF_WR_RUNNING || really_exiting)
+	return;
+    pthread_mutex_lock(&mf_wr_mutex);
+    while (mf_wr_first != NULL || mf_wr_busy)
+	pthread_cond_wait(&mf_wr_done, &mf_wr_mutex);
+    done = mf_wr_done_list;
+    mf_wr_done_list = NULL;
+    pthread_mutex_unlock(&mf_wr_mutex);
+
+    mf_wr_free(done);
+#endif
+}
+
+/*
+ * Called in the child after fork() when it continues as Vim.  It has no
+ * writer thread, a new one is started when needed.  The writer may have held
+ * the mutex at the moment of the fork(), thus initialize it again.
+ */
+    void
+mf_fork_child()
+{
+#ifdef FEAT_SWAP_WRITER
+    if (mf_wr_state == MF_WR_RUNNING)
+    {
+	pthread_mutex_init(&mf_wr_mutex, NULL);
+	pthread_cond_init(&mf_wr_cond, NULL);
+	pthread_cond_init(&mf_wr_done, NULL);
+	mf_wr_state = MF_WR_NONE;
+    }
+#endif
+}
+
 /*
  * Make block number for *hp positive and add it to the translation list
  *
@@ -1191,7 +1945,6 @@ mf_trans_add(mfp, hp)
 {
     bhdr_T	*freep;
     blocknr_T	new_bnum;
-    int		hash;
     NR_TRANS	*np;
     int		page_count;
 
@@ -1200,6 +1953,12 @@ mf_trans_add(mfp, hp)
 
     if ((np = (NR_TRANS *)alloc((unsigned)sizeof(NR_TRANS))) == NULL)
 	return FAIL;
+    np->nt_old_bnum = hp->bh_bnum;
+    if (mf_hash_add_item(&mfp->mf_trans, np->nt_old_bnum, np) == FAIL)
+    {
+	vim_free(np);
+	return FAIL;
+    }
 
 /*
  * Get a new number for the block.
@@ -1232,19 +1991,12 @@ mf_trans_add(mfp, hp)
 	mfp->mf_blocknr_max += page_count;
     }
 
-    np->nt_old_bnum = hp->bh_bnum;	    /* adjust number */
-    np->nt_new_bnum = new_bnum;
+    np->nt_new_bnum = new_bnum;		    /* adjust number */
 
-    mf_rem_hash(mfp, hp);		    /* remove from old hash list */
+    /* Removing first makes room, adding the block again can't fail. */
+    mf_rem_hash(mfp, hp);
     hp->bh_bnum = new_bnum;
-    mf_ins_hash(mfp, hp);		    /* insert in new hash list */
-
-    hash = MEMHASH(np->nt_old_bnum);	    /* insert in trans list */
-    np->nt_next = mfp->mf_trans[hash];
-    mfp->mf_trans[hash] = np;
-    if (np->nt_next != NULL)
-	np->nt_next->nt_prev = np;
-    np->nt_prev = NULL;
+    mf_ins_hash(mfp, hp);
 
     return OK;
 }
@@ -1259,25 +2011,16 @@ mf_trans_del(mfp, old_nr)
     memfile_T	*mfp;
     blocknr_T	old_nr;
 {
-    int		hash;
     NR_TRANS	*np;
     blocknr_T	new_bnum;
 
-    hash = MEMHASH(old_nr);
-    for (np = mfp->mf_trans[hash]; np != NULL; np = np->nt_next)
-	if (np->nt_old_bnum == old_nr)
-	    break;
+    np = (NR_TRANS *)mf_hash_find(&mfp->mf_trans, old_nr);
     if (np == NULL)		/* not found */
 	return old_nr;
 
     mfp->mf_neg_count--;
     new_bnum = np->nt_new_bnum;
-    if (np->nt_prev != NULL)		/* remove entry from the trans list */
-	np->nt_prev->nt_next = np->nt_next;
-    else
-	mfp->mf_trans[hash] = np->nt_next;
-    if (np->nt_next != NULL)
-	np->nt_next->nt_prev = np->nt_prev;
+    mf_hash_rem_item(&mfp->mf_trans, old_nr);  /* remove from trans table */
     vim_free(np);
 
     return new_bnum;
@@ -1401,3 +2144,376 @@ mf_do_open(mfp, fname, flags)
 	mch_hide(mfp->mf_fname);    /* try setting the 'hidden' flag */
     }
 }
+
+/*
+ * A simple and fast LZ77 compressor for mf_zip_put(), in the style of LZ4.
+ * The compressed data is a sequence of:
+ *	token		literal length in the high four bits, match length
+ *			minus MF_LZ_MINMATCH in the low four bits
+ *	[length]	when the literal length is 15 or more: bytes that are
+ *			added, until one is not 255
+ *	literals
+ *	offset		two bytes, least significant first; the match starts
+ *			this many bytes back in the output
+ *	[length]	when the match length field is 15: more length bytes
+ * The last sequence has literals only and ends after them.
+ */
+#define MF_LZ_MINMATCH	4
+#define MF_LZ_HASHBITS	12
+#define MF_LZ_MAXOFF	0xffff
+#define MF_LZ_HASH(v) \
+	((UINT32_T)((v) * 2654435761UL) >> (32 - MF_LZ_HASHBITS))
+
+/*
+ * Get four bytes at "p" as one number, for hashing and comparing.
+ */
+    static UINT32_T
+mf_lz_get4(p)
+    char_u	*p;
+{
+    UINT32_T	v;
+
+    mch_memmove(&v, p, 4);
+    return v;
+}
+
+/*
+ * Put the length bytes for "n" at "p", not beyond "end".
+ * Return a pointer after them, NULL when there is no room.
+ */
+    static char_u *
+mf_lz_putlen(n, p, end)
+    unsigned	n;
+    char_u	*p;
+    char_u	*end;
+{
+    for (;;)
+    {
+	if (p >= end)
+	    return NULL;
+	if (n < 255)
+	    break;
+	*p++ = 255;
+	n -= 255;
+    }
+    *p++ = (char_u)n;
+    return p;
+}
+
+/*
+ * Compress "len" bytes at "src" into "dst", which has room for "dstlen"
+ * bytes.
+ * Return the compressed size, zero when it doesn't fit.
+ */
+    static unsigned
+mf_lz_compress(src, len, dst, dstlen)
+    char_u	*src;
+    unsigned	len;
+    char_u	*dst;
+    unsigned	dstlen;
+{
+    unsigned	table[1 << MF_LZ_HASHBITS];
+    char_u	*ip = src;
+    char_u	*anchor = src;
+    char_u	*end = src + len;
+    char_u	*op = dst;
+    char_u	*oend = dst + dstlen;
+    char_u	*ref;
+    char_u	*token;
+    unsigned	h;
+    unsigned	n;
+    unsigned	mlen;
+    UINT32_T	v;
+
+    vim_memset(table, 0, sizeof(table));
+    for (;;)
+    {
+	/* Find a match of at least MF_LZ_MINMATCH bytes.  Skip faster when
+	 * there hasn't been a match for a while. */
+	ref = NULL;
+	while (ip + MF_LZ_MINMATCH <= end)
+	{
+	    v = mf_lz_get4(ip);
+	    h = (unsigned)MF_LZ_HASH(v);
+	    ref = src + table[h];
+	    table[h] = (unsigned)(ip - src);
+	    if (ref < ip && ip - ref <= MF_LZ_MAXOFF && mf_lz_get4(ref) == v)
+		break;
+	    ref = NULL;
+	    ip += 1 + ((ip - anchor) >> 6);
+	}
+	if (ref == NULL)
+	    ip = end;
+
+	/* The token and the literals before the match. */
+	if (op >= oend)
+	    return 0;
+	token = op++;
+	n = (unsigned)(ip - anchor);
+	if (n >= 15)
+	{
+	    *token = 15 << 4;
+	    if ((op = mf_lz_putlen(n - 15, op, oend)) == NULL)
+		return 0;
+	}
+	else
+	    *token = n << 4;
+	if (n > (unsigned)(oend - op))
+	    return 0;
+	mch_memmove(op, anchor, (size_t)n);
+	op += n;
+	if (ref == NULL)
+	    break;
+
+	/* The match. */
+	mlen = MF_LZ_MINMATCH;
+	while (ip + mlen + 4 <= end
+			    && mf_lz_get4(ref + mlen) == mf_lz_get4(ip + mlen))
+	    mlen += 4;
+	while (ip + mlen < end && ref[mlen] == ip[mlen])
+	    ++mlen;
+	if (op + 2 > oend)
+	    return 0;
+	*op++ = (char_u)(ip - ref);
+	*op++ = (char_u)((ip - ref) >> 8);
+	n = mlen - MF_LZ_MINMATCH;
+	if (n >= 15)
+	{
+	    *token |= 15;
+	    if ((op = mf_lz_putlen(n - 15, op, oend)) == NULL)
+		return 0;
+	}
+	else
+	    *token |= n;
+	ip += mlen;
+	anchor = ip;
+    }
+    return (unsigned)(op - dst);
+}
+
+/*
+ * Uncompress "len" bytes at "src" into "dst", which must become exactly
+ * "dstlen" bytes.
+ * Return FAIL when the data is invalid.
+ */
+    static int
+mf_lz_decompress(src, len, dst, dstlen)
+    char_u	*src;
+    unsigned	len;
+    char_u	*dst;
+    unsigned	dstlen;
+{
+    char_u	*ip = src;
+    char_u	*end = src + len;
+    char_u	*op = dst;
+    char_u	*oend = dst + dstlen;
+    char_u	*ref;
+    unsigned	token;
+    unsigned	n;
+    unsigned	off;
+
+    while (ip < end)
+    {
+	token = *ip++;
+
+	n = token >> 4;
+	if (n == 15)
+	    do
+	    {
+		if (ip >= end)
+		    return FAIL;
+		n += *ip;
+	    } while (*ip++ == 255);
+	if (n > (unsigned)(end - ip) || n > (unsigned)(oend - op))
+	    return FAIL;
+	mch_memmove(op, ip, (size_t)n);
+	ip += n;
+	op += n;
+	if (ip == end)
+	    break;
+
+	if (ip + 2 > end)
+	    return FAIL;
+	off = ip[0] | (ip[1] << 8);
+	ip += 2;
+	n = token & 15;
+	if (n == 15)
+	    do
+	    {
+		if (ip >= end)
+		    return FAIL;
+		n += *ip;
+	    } while (*ip++ == 255);
+	n += MF_LZ_MINMATCH;
+	if (off == 0 || off > (unsigned)(op - dst)
+					       || n > (unsigned)(oend - op))
+	    return FAIL;
+	ref = op - off;
+	if (off >= n)
+	{
+	    mch_memmove(op, ref, (size_t)n);
+	    op += n;
+	}
+	else
+	    /* Overlaps, copy byte by byte. */
+	    for ( ; n > 0; --n)
+		*op++ = *ref++;
+    }
+    return op == oend ? OK : FAIL;
+}
+
+/*
+ * Functions for the hash tables of a memfile, see mf_hashtab_T.
+ */
+
+/*
+ * Block numbers are mostly consecutive, both positive and negative.
+ * Multiplying with an odd number scatters them over the table, while a run of
+ * consecutive numbers still doesn't collide with itself.
+ */
+#define MHT_HASH(nr) ((long_u)(nr) * (long_u)2654435761UL)
+
+/*
+ * Initialize an empty hash table.
+ */
+    static void
+mf_hash_init(mht)
+    mf_hashtab_T *mht;
+{
+    vim_memset(mht, 0, sizeof(mf_hashtab_T));
+    mht->mht_buckets = mht->mht_small_array;
+    mht->mht_mask = MHT_INIT_SIZE - 1;
+}
+
+/*
+ * Free the array of a hash table.  Does not free the items it contains!
+ * The hash table must not be used again without another mf_hash_init() call.
+ */
+    static void
+mf_hash_free(mht)
+    mf_hashtab_T *mht;
+{
+    if (mht->mht_buckets != mht->mht_small_array)
+	vim_free(mht->mht_buckets);
+}
+
+/*
+ * Find the item with key "key" in hash table "mht".
+ * Returns NULL when not found.
+ */
+    static void *
+mf_hash_find(mht, key)
+    mf_hashtab_T *mht;
+    blocknr_T	key;
+{
+    mf_hashitem_T   *mhi;
+    long_u	    idx = MHT_HASH(key) & mht->mht_mask;
+
+    for (;;)
+    {
+	mhi = &mht->mht_buckets[idx];
+	if (mhi->mhi_item == NULL || mhi->mhi_key == key)
+	    return mhi->mhi_item;
+	idx = (idx + 1) & mht->mht_mask;
+    }
+}
+
+/*
+ * Add item "item" with key "key" to hash table "mht".  The key must not be
+ * in the table yet.  Grows the table when it gets half full.
+ * Returns FAIL when the table is full and can't be grown.
+ */
+    static int
+mf_hash_add_item(mht, key, item)
+    mf_hashtab_T *mht;
+    blocknr_T	key;
+    void	*item;
+{
+    long_u	idx;
+
+    /* When growing fails keep going with a fuller table, but always keep an
+     * empty slot, it ends the search in mf_hash_find(). */
+    if ((mht->mht_count + 1) * 2 > mht->mht_mask + 1
+	    && mf_hash_grow(mht) == FAIL
+	    && mht->mht_count + 1 >= mht->mht_mask)
+	return FAIL;
+
+    idx = MHT_HASH(key) & mht->mht_mask;
+    while (mht->mht_buckets[idx].mhi_item != NULL)
+	idx = (idx + 1) & mht->mht_mask;
+    mht->mht_buckets[idx].mhi_key = key;
+    mht->mht_buckets[idx].mhi_item = item;
+    ++mht->mht_count;
+    return OK;
+}
+
+/*
+ * Remove the item with key "key" from hash table "mht", if it is there.
+ * The items after it in the same cluster are moved back, so that no
+ * "deleted" markers are needed.
+ */
+    static void
+mf_hash_rem_item(mht, key)
+    mf_hashtab_T *mht;
+    blocknr_T	key;
+{
+    mf_hashitem_T   *buckets = mht->mht_buckets;
+    long_u	    mask = mht->mht_mask;
+    long_u	    idx = MHT_HASH(key) & mask;
+    long_u	    next;
+    long_u	    home;
+
+    while (buckets[idx].mhi_item != NULL && buckets[idx].mhi_key != key)
+	idx = (idx + 1) & mask;
+    if (buckets[idx].mhi_item == NULL)
+	return;			/* not found */
+    --mht->mht_count;
+
+    for (next = (idx + 1) & mask; buckets[next].mhi_item != NULL;
+						     next = (next + 1) & mask)
+    {
+	/* An item can move to the hole at "idx" when its home slot is not in
+	 * the (cyclic) range idx + 1 to next. */
+	home = MHT_HASH(buckets[next].mhi_key) & mask;
+	if (((next - home) & mask) >= ((next - idx) & mask))
+	{
+	    buckets[idx] = buckets[next];
+	    idx = next;
+	}
+    }
+    buckets[idx].mhi_item = NULL;
+}
+
+/*
+ * Double the size of hash table "mht".
+ * Returns FAIL for failure (out of memory), the table is unchanged then.
+ */
+    static int
+mf_hash_grow(mht)
+    mf_hashtab_T *mht;
+{
+    mf_hashitem_T   *buckets;
+    long_u	    size = (mht->mht_mask + 1) * 2;
+    long_u	    mask = size - 1;
+    long_u	    i, idx;
+
+    buckets = (mf_hashitem_T *)lalloc_clear(
+				    (long_u)(size * sizeof(mf_hashitem_T)), FALSE);
+    if (buckets == NULL)
+	return FAIL;
+
+    for (i = 0; i <= mht->mht_mask; ++i)
+	if (mht->mht_buckets[i].mhi_item != NULL)
+	{
+	    idx = MHT_HASH(mht->mht_buckets[i].mhi_key) & mask;
+	    while (buckets[idx].mhi_item != NULL)
+		idx = (idx + 1) & mask;
+	    buckets[idx] = mht->mht_buckets[i];
+	}
+
+    if (mht->mht_buckets != mht->mht_small_array)
+	vim_free(mht->mht_buckets);
+    mht->mht_buckets = buckets;
+    mht->mht_mask = mask;
+    return OK;
+}
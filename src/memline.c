@@ -60,6 +60,10 @@
 # include <errno.h>
 #endif
 
+#ifdef FEAT_MMAP
+# include <sys/mman.h>
+#endif
+
 typedef struct block0		ZERO_BL;    /* contents of the first block */
 typedef struct pointer_block	PTR_BL;	    /* contents of a pointer block */
 typedef struct data_block	DATA_BL;    /* contents of a data block */
@@ -209,6 +213,20 @@ struct block0
 
 #define STACK_INCR	5	/* nr of entries added to ml_stack at a time */
 
+/*
+ * A big file gets a bigger page size, so that its lines are in fewer data
+ * blocks and the tree of pointer blocks is less deep.  The page size is
+ * doubled until the file fits in ML_BIG_PAGES pages, up to ML_MAX_PAGE_SIZE.
+ * Changing a line moves the text after it in its block, thus bigger blocks
+ * make changes slower.
+ * Only done when the file fits in 'maxmem', otherwise every block that is
+ * read back from the swap file costs more.
+ * A swap file with a bigger page size can still be recovered, the page size
+ * is stored in block 0.
+ */
+#define ML_BIG_PAGES	    2048
+#define ML_MAX_PAGE_SIZE    16384
+
 /*
  * The line number where the first mark may be is remembered.
  * If it is 0 there are no marks at all.
@@ -237,6 +255,7 @@ typedef enum {
 static void ml_set_b0_crypt __ARGS((buf_T *buf, ZERO_BL *b0p));
 #endif
 static int ml_check_b0_id __ARGS((ZERO_BL *b0p));
+static unsigned ml_page_size __ARGS((buf_T *buf, unsigned page_size));
 static void ml_upd_block0 __ARGS((buf_T *buf, upd_block0_T what));
 static void set_b0_fname __ARGS((ZERO_BL *, buf_T *buf));
 static void set_b0_dir_flag __ARGS((ZERO_BL *b0p, buf_T *buf));
@@ -246,6 +265,8 @@ static void add_b0_fenc __ARGS((ZERO_BL *b0p, buf_T *buf));
 static time_t swapfile_info __ARGS((char_u *));
 static int recov_file_names __ARGS((char_u **, char_u *, int prepend_dot));
 static int ml_append_int __ARGS((buf_T *, linenr_T, char_u *, colnr_T, int, int));
+static int ml_append_bulk_int __ARGS((buf_T *, linenr_T, char_u **, colnr_T *, long, int));
+static long ml_fill_block __ARGS((buf_T *, linenr_T, char_u **, colnr_T *, long, int));
 static int ml_delete_int __ARGS((buf_T *, linenr_T, int));
 static char_u *findswapname __ARGS((buf_T *, char_u **, char_u *));
 static void ml_flush_line __ARGS((buf_T *));
@@ -268,6 +289,25 @@ static void ml_crypt_prepare __ARGS((memfile_T *mfp, off_t offset, int reading))
 #endif
 #ifdef FEAT_BYTEOFF
 static void ml_updatechunk __ARGS((buf_T *buf, long line, long len, int updtype));
+static void ml_updatechunk_lines __ARGS((buf_T *buf, linenr_T line, long count, long len));
+static int ml_splitchunk __ARGS((buf_T *buf, int curix, linenr_T curline));
+static void ml_chunk_add __ARGS((buf_T *buf, int ix, int lines, long size));
+static int ml_chunktree_build __ARGS((buf_T *buf));
+static int ml_findchunk __ARGS((buf_T *, linenr_T, long, int, linenr_T *, long *));
+#endif
+#ifdef FEAT_MMAP
+static void ml_map_drop __ARGS((mlmap_T *mm, long_u *donep, long_u upto));
+static int ml_map_check __ARGS((mlmap_T *mm));
+static void ml_map_changed __ARGS((mlmap_T *mm));
+static long_u ml_map_nextline __ARGS((mlmap_T *mm, long_u off));
+static int ml_map_fill __ARGS((mlmap_T *mm, mm_group_T *mg, long nr));
+static int ml_map_load __ARGS((buf_T *buf, linenr_T count));
+static void ml_map_detach __ARGS((buf_T *buf, mlmap_T *mm));
+static char_u *ml_map_get __ARGS((buf_T *buf, linenr_T lnum));
+static long_u ml_map_linestart __ARGS((mlmap_T *mm, linenr_T lnum));
+# ifdef FEAT_BYTEOFF
+static long ml_map_offset __ARGS((buf_T *buf, linenr_T lnum, long *offp));
+# endif
 #endif
 
 /*
@@ -295,6 +335,12 @@ ml_open(buf)
     buf->b_ml.ml_line_lnum = 0;	/* no cached line */
 #ifdef FEAT_BYTEOFF
     buf->b_ml.ml_chunksize = NULL;
+    buf->b_ml.ml_chunktree = NULL;
+    buf->b_ml.ml_chunktree_size = 0;
+    buf->b_ml.ml_chunktree_len = 0;
+#endif
+#ifdef FEAT_MMAP
+    buf->b_ml.ml_map = NULL;
 #endif
 
     /*
@@ -316,6 +362,7 @@ ml_open(buf)
 #ifdef FEAT_CRYPT
     mfp->mf_buffer = buf;
 #endif
+    mf_set_page_size(mfp, ml_page_size(buf, mfp->mf_page_size));
     buf->b_ml.ml_flags = ML_EMPTY;
     buf->b_ml.ml_line_count = 1;
 #ifdef FEAT_LINEBREAK
@@ -588,6 +635,25 @@ ml_set_crypt_key(buf, old_key, old_cm)
 }
 #endif
 
+/*
+ * Return the page size to use for the memfile of "buf", which is
+ * "page_size" unless the file for "buf" is big.
+ */
+    static unsigned
+ml_page_size(buf, page_size)
+    buf_T	*buf;
+    unsigned	page_size;
+{
+    struct stat	st;
+
+    if (buf->b_ffname != NULL && mch_stat((char *)buf->b_ffname, &st) == 0
+				  && (off_t)(st.st_size >> 10) < (off_t)p_mm)
+	while (page_size < ML_MAX_PAGE_SIZE
+			&& (off_t)st.st_size / page_size > (off_t)ML_BIG_PAGES)
+	    page_size *= 2;
+    return page_size;
+}
+
 /*
  * ml_setname() is called when the file name of "buf" has been changed.
  * It may rename the swap file.
@@ -650,6 +716,7 @@ ml_setname(buf)
 	/* need to close the swap file before renaming */
 	if (mfp->mf_fd >= 0)
 	{
+	    (void)mf_wait(mfp);
 	    close(mfp->mf_fd);
 	    mfp->mf_fd = -1;
 	}
@@ -763,7 +830,7 @@ ml_open_file(buf)
 	    ml_upd_block0(buf, UB_SAME_DIR);
 
 	    /* Flush block zero, so others can read it */
-	    if (mf_sync(mfp, MFS_ZERO) == OK)
+	    if (mf_sync(mfp, MFS_ZERO | MFS_WAIT) == OK)
 	    {
 		/* Mark all blocks that should be in the swapfile as dirty.
 		 * Needed for when the 'swapfile' option was reset, so that
@@ -814,6 +881,12 @@ ml_close(buf, del_file)
 {
     if (buf->b_ml.ml_mfp == NULL)		/* not open */
 	return;
+#ifdef FEAT_SEARCH_EXTRA
+    search_hl_cache_clear(buf);
+#endif
+#if defined(FEAT_SEARCH_EXTRA) && defined(FEAT_RELTIME)
+    search_count_clear(buf);
+#endif
     mf_close(buf->b_ml.ml_mfp, del_file);	/* close the .swp file */
     if (buf->b_ml.ml_line_lnum != 0 && (buf->b_ml.ml_flags & ML_LINE_DIRTY))
 	vim_free(buf->b_ml.ml_line_ptr);
@@ -821,6 +894,17 @@ ml_close(buf, del_file)
 #ifdef FEAT_BYTEOFF
     vim_free(buf->b_ml.ml_chunksize);
     buf->b_ml.ml_chunksize = NULL;
+    vim_free(buf->b_ml.ml_chunktree);
+    buf->b_ml.ml_chunktree = NULL;
+    buf->b_ml.ml_chunktree_size = 0;
+    buf->b_ml.ml_chunktree_len = 0;
+#endif
+#ifdef FEAT_MMAP
+    if (buf->b_ml.ml_map != NULL)
+    {
+	ml_map_free(buf->b_ml.ml_map);
+	buf->b_ml.ml_map = NULL;
+    }
 #endif
     buf->b_ml.ml_mfp = NULL;
 
@@ -1512,6 +1596,7 @@ ml_recover()
 		    bnum = pp->pb_pointer[idx].pe_bnum;
 		    line_count = pp->pb_pointer[idx].pe_line_count;
 		    page_count = pp->pb_pointer[idx].pe_page_count;
+		    idx = 0;
 		    continue;
 		}
 	    }
@@ -2327,7 +2412,7 @@ ml_preserve(buf, message)
 
     ml_flush_line(buf);				    /* flush buffered line */
     (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH); /* flush locked block */
-    status = mf_sync(mfp, MFS_ALL | MFS_FLUSH);
+    status = mf_sync(mfp, MFS_ALL | MFS_FLUSH | MFS_WAIT);
 
     /* stack is invalid after mf_sync(.., MFS_ALL) */
     buf->b_ml.ml_stack_top = 0;
@@ -2347,7 +2432,14 @@ ml_preserve(buf, message)
     if (mf_need_trans(mfp) && !got_int)
     {
 	lnum = 1;
-	while (mf_need_trans(mfp) && lnum <= buf->b_ml.ml_line_count)
+	while (mf_need_trans(mfp) && lnum <= buf->b_ml.ml_line_count
+#ifdef FEAT_MMAP
+		/* the memline of a mapped file only has the lines loaded so
+		 * far and an empty line */
+		&& (buf->b_ml.ml_map == NULL
+				   || lnum <= buf->b_ml.ml_map->mm_loaded + 1)
+#endif
+		)
 	{
 	    hp = ml_find_line(buf, lnum, ML_FIND);
 	    if (hp == NULL)
@@ -2360,7 +2452,7 @@ ml_preserve(buf, message)
 	}
 	(void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);	/* flush locked block */
 	/* sync the updated pointer blocks */
-	if (mf_sync(mfp, MFS_ALL | MFS_FLUSH) == FAIL)
+	if (mf_sync(mfp, MFS_ALL | MFS_FLUSH | MFS_WAIT) == FAIL)
 	    status = FAIL;
 	buf->b_ml.ml_stack_top = 0;	    /* stack is invalid now */
     }
@@ -2462,6 +2554,18 @@ errorret:
     if (buf->b_ml.ml_mfp == NULL)	/* there are no lines */
 	return (char_u *)"";
 
+#ifdef FEAT_MMAP
+    if (buf->b_ml.ml_map != NULL)
+    {
+	/* When loading has finished the memline is used from now on. */
+	if (!will_change
+		&& buf->b_ml.ml_map->mm_loaded < buf->b_ml.ml_map->mm_lines)
+	    return ml_map_get(buf, lnum);
+	if (ml_unmap(buf) == FAIL)
+	    goto errorret;
+    }
+#endif
+
     /*
      * See if it is the same line as requested last time.
      * Otherwise may need to flush last used line.
@@ -2541,6 +2645,167 @@ ml_append(lnum, line, len, newfile)
     return ml_append_int(curbuf, lnum, line, len, newfile, FALSE);
 }
 
+/*
+ * Append "count" lines after lnum in the current buffer.  Does the same as
+ * calling ml_append() for every line, but faster: only the first line for
+ * each data block goes through ml_append_int(), which finds the block and
+ * splits it when needed.  The lines that still fit in that block are copied
+ * into it in one go by ml_fill_block().
+ * "lens" can be NULL, otherwise lens[i] is the length of lines[i], including
+ * NUL, or 0.
+ * Check: The caller of this function should probably also call
+ * appended_lines().
+ *
+ * return FAIL for failure, OK otherwise
+ */
+    int
+ml_append_bulk(lnum, lines, lens, count, newfile)
+    linenr_T	lnum;		/* append after this line (can be 0) */
+    char_u	**lines;	/* text of the new lines */
+    colnr_T	*lens;		/* lengths of the new lines, or NULL */
+    long	count;		/* number of lines */
+    int		newfile;	/* flag, see ml_append() */
+{
+    /* When starting up, we might still need to create the memfile */
+    if (curbuf->b_ml.ml_mfp == NULL && open_buffer(FALSE, NULL, 0) == FAIL)
+	return FAIL;
+
+    if (curbuf->b_ml.ml_line_lnum != 0)
+	ml_flush_line(curbuf);
+    return ml_append_bulk_int(curbuf, lnum, lines, lens, count, newfile);
+}
+
+    static int
+ml_append_bulk_int(buf, lnum, lines, lens, count, newfile)
+    buf_T	*buf;
+    linenr_T	lnum;
+    char_u	**lines;
+    colnr_T	*lens;
+    long	count;
+    int		newfile;
+{
+    long	done;
+
+    for (done = 0; done < count; )
+    {
+	if (ml_append_int(buf, lnum + done, lines[done],
+			lens == NULL ? (colnr_T)0 : lens[done], newfile, FALSE)
+								      == FAIL)
+	    return FAIL;
+	++done;
+	done += ml_fill_block(buf, lnum + done, lines + done,
+			      lens == NULL ? NULL : lens + done, count - done,
+								     newfile);
+    }
+    return OK;
+}
+
+/*
+ * Append as many of the "count" lines as fit in the locked data block after
+ * line "lnum", which must be in that block.  The lines following "lnum" in
+ * the block are moved only once.
+ * Returns the number of lines appended.
+ */
+    static long
+ml_fill_block(buf, lnum, lines, lens, count, newfile)
+    buf_T	*buf;
+    linenr_T	lnum;
+    char_u	**lines;
+    colnr_T	*lens;
+    long	count;
+    int		newfile;
+{
+    DATA_BL	*dp;
+    int		db_idx;
+    int		line_count;
+    int		offset;
+    int		len;
+    long	total = 0;	/* text bytes of the appended lines */
+    long	n;
+    long	i;
+
+    if (buf->b_ml.ml_locked == NULL
+	    || lnum < buf->b_ml.ml_locked_low
+	    || lnum > buf->b_ml.ml_locked_high)
+	return 0;
+
+    dp = (DATA_BL *)(buf->b_ml.ml_locked->bh_data);
+    db_idx = lnum - buf->b_ml.ml_locked_low;
+    line_count = dp->db_line_count;
+
+    for (n = 0; n < count; ++n)
+    {
+	len = (lens == NULL || lens[n] == 0) ? (int)STRLEN(lines[n]) + 1
+								   : lens[n];
+	if (total + len + (n + 1) * INDEX_SIZE > (long)dp->db_free)
+	    break;
+	total += len;
+    }
+    if (n == 0)
+	return 0;
+
+    /*
+     * Offset is the start of line "lnum", the new lines go in front of it.
+     * Move the text of the lines that follow to the front and adjust their
+     * indexes.
+     */
+    offset = ((dp->db_index[db_idx]) & DB_INDEX_MASK);
+    if (line_count > db_idx + 1)
+    {
+	mch_memmove((char *)dp + dp->db_txt_start - total,
+					       (char *)dp + dp->db_txt_start,
+				       (size_t)(offset - dp->db_txt_start));
+	for (i = line_count - 1; i > db_idx; --i)
+	    dp->db_index[i + n] = dp->db_index[i] - total;
+    }
+    dp->db_txt_start -= total;
+    dp->db_free -= total + n * INDEX_SIZE;
+    dp->db_line_count += n;
+
+    for (i = 0; i < n; ++i)
+    {
+	len = (lens == NULL || lens[i] == 0) ? (int)STRLEN(lines[i]) + 1
+								   : lens[i];
+	offset -= len;
+	dp->db_index[db_idx + 1 + i] = offset;
+	mch_memmove((char *)dp + offset, lines[i], (size_t)len);
+    }
+
+    /* the pointer blocks are updated when the block is released */
+    buf->b_ml.ml_line_count += n;
+    buf->b_ml.ml_locked_high += n;
+    buf->b_ml.ml_locked_lineadd += n;
+    buf->b_ml.ml_flags |= ML_LOCKED_DIRTY;
+    if (!newfile)
+	buf->b_ml.ml_flags |= ML_LOCKED_POS;
+    if (lowest_marked && lowest_marked > lnum)
+	lowest_marked = lnum + 1;
+
+#ifdef FEAT_BYTEOFF
+    /* This may lock another block, "dp" is invalid now. */
+    ml_updatechunk_lines(buf, lnum + 1, n, total);
+#endif
+#ifdef FEAT_NETBEANS_INTG
+    if (netbeans_active())
+	for (i = 0; i < n; ++i)
+	{
+	    if (STRLEN(lines[i]) > 0)
+		netbeans_inserted(buf, lnum + 1 + i, (colnr_T)0, lines[i],
+						       (int)STRLEN(lines[i]));
+	    netbeans_inserted(buf, lnum + 1 + i, (colnr_T)STRLEN(lines[i]),
+							   (char_u *)"\n", 1);
+	}
+#endif
+#ifdef FEAT_SEARCH_EXTRA
+    search_hl_cache_changed(buf, lnum + 1, lnum + 1, n);
+#endif
+#if defined(FEAT_SEARCH_EXTRA) && defined(FEAT_RELTIME)
+    search_count_changed(buf, lnum + 1, lnum + 1, n);
+#endif
+
+    return n;
+}
+
 #if defined(FEAT_SPELL) || defined(PROTO)
 /*
  * Like ml_append() but for an arbitrary buffer.  The buffer must already have
@@ -2590,6 +2855,11 @@ ml_append_int(buf, lnum, line, len, newfile, mark)
     if (lnum > buf->b_ml.ml_line_count || buf->b_ml.ml_mfp == NULL)
 	return FAIL;
 
+#ifdef FEAT_MMAP
+    if (buf->b_ml.ml_map != NULL && ml_unmap(buf) == FAIL)
+	return FAIL;
+#endif
+
     if (lowest_marked && lowest_marked > lnum)
 	lowest_marked = lnum + 1;
 
@@ -3057,6 +3327,12 @@ ml_append_int(buf, lnum, line, len, newfile, mark)
 	netbeans_inserted(buf, lnum+1, (colnr_T)STRLEN(line),
 							   (char_u *)"\n", 1);
     }
+#endif
+#ifdef FEAT_SEARCH_EXTRA
+    search_hl_cache_changed(buf, lnum + 1, lnum + 1, 1L);
+#endif
+#if defined(FEAT_SEARCH_EXTRA) && defined(FEAT_RELTIME)
+    search_count_changed(buf, lnum + 1, lnum + 1, 1L);
 #endif
     return OK;
 }
@@ -3087,6 +3363,15 @@ ml_replace(lnum, line, copy)
 
     if (copy && (line = vim_strsave(line)) == NULL) /* allocate memory */
 	return FAIL;
+#ifdef FEAT_MMAP
+    /* After making the copy, "line" may be in the mapped file. */
+    if (curbuf->b_ml.ml_map != NULL && ml_unmap(curbuf) == FAIL)
+    {
+	if (copy)
+	    vim_free(line);
+	return FAIL;
+    }
+#endif
 #ifdef FEAT_NETBEANS_INTG
     if (netbeans_active())
     {
@@ -3101,6 +3386,12 @@ ml_replace(lnum, line, copy)
     curbuf->b_ml.ml_line_ptr = line;
     curbuf->b_ml.ml_line_lnum = lnum;
     curbuf->b_ml.ml_flags = (curbuf->b_ml.ml_flags | ML_LINE_DIRTY) & ~ML_EMPTY;
+#ifdef FEAT_SEARCH_EXTRA
+    search_hl_cache_changed(curbuf, lnum, lnum + 1, 0L);
+#endif
+#if defined(FEAT_SEARCH_EXTRA) && defined(FEAT_RELTIME)
+    search_count_changed(curbuf, lnum, lnum + 1, 0L);
+#endif
 
     return OK;
 }
@@ -3144,6 +3435,11 @@ ml_delete_int(buf, lnum, message)
     if (lnum < 1 || lnum > buf->b_ml.ml_line_count)
 	return FAIL;
 
+#ifdef FEAT_MMAP
+    if (buf->b_ml.ml_map != NULL && ml_unmap(buf) == FAIL)
+	return FAIL;
+#endif
+
     if (lowest_marked && lowest_marked > lnum)
 	lowest_marked--;
 
@@ -3277,6 +3573,12 @@ ml_delete_int(buf, lnum, message)
 
 #ifdef FEAT_BYTEOFF
     ml_updatechunk(buf, lnum, line_size, ML_CHNK_DELLINE);
+#endif
+#ifdef FEAT_SEARCH_EXTRA
+    search_hl_cache_changed(buf, lnum, lnum + 1, -1L);
+#endif
+#if defined(FEAT_SEARCH_EXTRA) && defined(FEAT_RELTIME)
+    search_count_changed(buf, lnum, lnum + 1, -1L);
 #endif
     return OK;
 }
@@ -3298,6 +3600,20 @@ ml_setmarked(lnum)
     if (lowest_marked == 0 || lowest_marked > lnum)
 	lowest_marked = lnum;
 
+#ifdef FEAT_MMAP
+    if (curbuf->b_ml.ml_map != NULL)
+    {
+	mlmap_T	*mm = curbuf->b_ml.ml_map;
+
+	/* The lines of a mapped file have their marks in a bitmap. */
+	if (mm->mm_marks == NULL)
+	    mm->mm_marks = lalloc_clear((long_u)(mm->mm_lines >> 3) + 1, TRUE);
+	if (mm->mm_marks != NULL)
+	    mm->mm_marks[(lnum - 1) >> 3] |= 1 << ((lnum - 1) & 7);
+	return;
+    }
+#endif
+
     /*
      * find the data block containing the line
      * This also fills the stack with the blocks from the root to the data block
@@ -3325,6 +3641,30 @@ ml_firstmarked()
     if (curbuf->b_ml.ml_mfp == NULL)
 	return (linenr_T) 0;
 
+#ifdef FEAT_MMAP
+    if (curbuf->b_ml.ml_map != NULL)
+    {
+	char_u	*marks = curbuf->b_ml.ml_map->mm_marks;
+
+	if (marks == NULL)
+	    return (linenr_T)0;
+	for (lnum = lowest_marked > 0 ? lowest_marked : 1;
+			       lnum <= curbuf->b_ml.ml_line_count; ++lnum)
+	{
+	    i = (lnum - 1) & 7;
+	    if (i == 0 && marks[(lnum - 1) >> 3] == 0)
+		lnum += 7;	/* skip eight lines at once */
+	    else if (marks[(lnum - 1) >> 3] & (1 << i))
+	    {
+		marks[(lnum - 1) >> 3] &= ~(1 << i);
+		lowest_marked = lnum + 1;
+		return lnum;
+	    }
+	}
+	return (linenr_T)0;
+    }
+#endif
+
     /*
      * The search starts with lowest_marked line. This is the last line where
      * a mark was found, adjusted by inserting/deleting lines.
@@ -3369,6 +3709,16 @@ ml_clearmarked()
     if (curbuf->b_ml.ml_mfp == NULL)	    /* nothing to do */
 	return;
 
+#ifdef FEAT_MMAP
+    if (curbuf->b_ml.ml_map != NULL)
+    {
+	vim_free(curbuf->b_ml.ml_map->mm_marks);
+	curbuf->b_ml.ml_map->mm_marks = NULL;
+	lowest_marked = 0;
+	return;
+    }
+#endif
+
     /*
      * The search starts with line lowest_marked.
      */
@@ -4922,6 +5272,13 @@ ml_crypt_prepare(mfp, offset, reading)
 #define MLCS_MAXL 800	/* max no of lines in chunk */
 #define MLCS_MINL 400   /* should be half of MLCS_MAXL */
 
+/* Where ml_updatechunk() found the previous line, used when lines are added
+ * one after another. */
+static buf_T	*ml_upd_lastbuf = NULL;
+static linenr_T	ml_upd_lastline;
+static linenr_T	ml_upd_lastcurline;
+static int	ml_upd_lastcurix;
+
 /*
  * Keep information for finding byte offset of a line, updtype may be one of:
  * ML_CHNK_ADDLINE: Add len to parent chunk, possibly splitting it
@@ -4936,14 +5293,8 @@ ml_updatechunk(buf, line, len, updtype)
     long	len;
     int		updtype;
 {
-    static buf_T	*ml_upd_lastbuf = NULL;
-    static linenr_T	ml_upd_lastline;
-    static linenr_T	ml_upd_lastcurline;
-    static int		ml_upd_lastcurix;
-
     linenr_T		curline = ml_upd_lastcurline;
     int			curix = ml_upd_lastcurix;
-    long		size;
     chunksize_T		*curchnk;
     int			rest;
     bhdr_T		*hp;
@@ -4964,6 +5315,7 @@ ml_updatechunk(buf, line, len, updtype)
 	buf->b_ml.ml_usedchunks = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_totalsize = 1;
+	buf->b_ml.ml_chunktree_len = 0;
     }
 
     if (updtype == ML_CHNK_UPDLINE && buf->b_ml.ml_line_count == 1)
@@ -4975,6 +5327,7 @@ ml_updatechunk(buf, line, len, updtype)
 	buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_totalsize =
 				  (long)STRLEN(buf->b_ml.ml_line_ptr) + 1;
+	buf->b_ml.ml_chunktree_len = 0;
 	return;
     }
 
@@ -4985,13 +5338,9 @@ ml_updatechunk(buf, line, len, updtype)
     if (buf != ml_upd_lastbuf || line != ml_upd_lastline + 1
 	    || updtype != ML_CHNK_ADDLINE)
     {
-	for (curline = 1, curix = 0;
-	     curix < buf->b_ml.ml_usedchunks - 1
-	     && line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	     curix++)
-	{
-	    curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	}
+	curix = ml_findchunk(buf, line, 0L, FALSE, &curline, NULL);
+	if (curix < 0)
+	    return;
     }
     else if (line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines
 		 && curix < buf->b_ml.ml_usedchunks - 1)
@@ -5000,15 +5349,13 @@ ml_updatechunk(buf, line, len, updtype)
 	curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
 	curix++;
     }
-    curchnk = buf->b_ml.ml_chunksize + curix;
-
     if (updtype == ML_CHNK_DELLINE)
 	len = -len;
-    curchnk->mlcs_totalsize += len;
+    ml_chunk_add(buf, curix, updtype == ML_CHNK_ADDLINE ? 1
+			   : updtype == ML_CHNK_DELLINE ? -1 : 0, len);
+    curchnk = buf->b_ml.ml_chunksize + curix;
     if (updtype == ML_CHNK_ADDLINE)
     {
-	curchnk->mlcs_numlines++;
-
 	/* May resize here so we don't have to do it in both cases below */
 	if (buf->b_ml.ml_usedchunks + 1 >= buf->b_ml.ml_numchunks)
 	{
@@ -5026,54 +5373,7 @@ ml_updatechunk(buf, line, len, updtype)
 
 	if (buf->b_ml.ml_chunksize[curix].mlcs_numlines >= MLCS_MAXL)
 	{
-	    int	    count;	    /* number of entries in block */
-	    int	    idx;
-	    int	    text_end;
-	    int	    linecnt;
-
-	    mch_memmove(buf->b_ml.ml_chunksize + curix + 1,
-			buf->b_ml.ml_chunksize + curix,
-			(buf->b_ml.ml_usedchunks - curix) *
-			sizeof(chunksize_T));
-	    /* Compute length of first half of lines in the split chunk */
-	    size = 0;
-	    linecnt = 0;
-	    while (curline < buf->b_ml.ml_line_count
-			&& linecnt < MLCS_MINL)
-	    {
-		if ((hp = ml_find_line(buf, curline, ML_FIND)) == NULL)
-		{
-		    buf->b_ml.ml_usedchunks = -1;
-		    return;
-		}
-		dp = (DATA_BL *)(hp->bh_data);
-		count = (long)(buf->b_ml.ml_locked_high) -
-			(long)(buf->b_ml.ml_locked_low) + 1;
-		idx = curline - buf->b_ml.ml_locked_low;
-		curline = buf->b_ml.ml_locked_high + 1;
-		if (idx == 0)/* first line in block, text at the end */
-		    text_end = dp->db_txt_end;
-		else
-		    text_end = ((dp->db_index[idx - 1]) & DB_INDEX_MASK);
-		/* Compute index of last line to use in this MEMLINE */
-		rest = count - idx;
-		if (linecnt + rest > MLCS_MINL)
-		{
-		    idx += MLCS_MINL - linecnt - 1;
-		    linecnt = MLCS_MINL;
-		}
-		else
-		{
-		    idx = count - 1;
-		    linecnt += rest;
-		}
-		size += text_end - ((dp->db_index[idx]) & DB_INDEX_MASK);
-	    }
-	    buf->b_ml.ml_chunksize[curix].mlcs_numlines = linecnt;
-	    buf->b_ml.ml_chunksize[curix + 1].mlcs_numlines -= linecnt;
-	    buf->b_ml.ml_chunksize[curix].mlcs_totalsize = size;
-	    buf->b_ml.ml_chunksize[curix + 1].mlcs_totalsize -= size;
-	    buf->b_ml.ml_usedchunks++;
+	    ml_splitchunk(buf, curix, curline);
 	    ml_upd_lastbuf = NULL;   /* Force recalc of curix & curline */
 	    return;
 	}
@@ -5087,6 +5387,7 @@ ml_updatechunk(buf, line, len, updtype)
 	     */
 	    curchnk = buf->b_ml.ml_chunksize + curix + 1;
 	    buf->b_ml.ml_usedchunks++;
+	    buf->b_ml.ml_chunktree_len = 0;
 	    if (line == buf->b_ml.ml_line_count)
 	    {
 		curchnk->mlcs_numlines = 0;
@@ -5120,7 +5421,6 @@ ml_updatechunk(buf, line, len, updtype)
     }
     else if (updtype == ML_CHNK_DELLINE)
     {
-	curchnk->mlcs_numlines--;
 	ml_upd_lastbuf = NULL;   /* Force recalc of curix & curline */
 	if (curix < (buf->b_ml.ml_usedchunks - 1)
 		&& (curchnk->mlcs_numlines + curchnk[1].mlcs_numlines)
@@ -5132,6 +5432,7 @@ ml_updatechunk(buf, line, len, updtype)
 	else if (curix == 0 && curchnk->mlcs_numlines <= 0)
 	{
 	    buf->b_ml.ml_usedchunks--;
+	    buf->b_ml.ml_chunktree_len = 0;
 	    mch_memmove(buf->b_ml.ml_chunksize, buf->b_ml.ml_chunksize + 1,
 			buf->b_ml.ml_usedchunks * sizeof(chunksize_T));
 	    return;
@@ -5147,6 +5448,7 @@ ml_updatechunk(buf, line, len, updtype)
 	curchnk[-1].mlcs_numlines += curchnk->mlcs_numlines;
 	curchnk[-1].mlcs_totalsize += curchnk->mlcs_totalsize;
 	buf->b_ml.ml_usedchunks--;
+	buf->b_ml.ml_chunktree_len = 0;
 	if (curix < buf->b_ml.ml_usedchunks)
 	{
 	    mch_memmove(buf->b_ml.ml_chunksize + curix,
@@ -5163,120 +5465,393 @@ ml_updatechunk(buf, line, len, updtype)
 }
 
 /*
- * Find offset for line or line with offset.
- * Find line with offset if "lnum" is 0; return remaining offset in offp
- * Find offset of line if "lnum" > 0
- * return -1 if information is not available
+ * Split chunk "curix", which starts at line "curline", in two: the first one
+ * gets MLCS_MINL lines.  There must be room for one more chunk.
+ * Careful: calls ml_find_line().
+ * Returns FAIL when the chunks have been given up for this buffer.
  */
-    long
-ml_find_line_or_offset(buf, lnum, offp)
+    static int
+ml_splitchunk(buf, curix, curline)
     buf_T	*buf;
-    linenr_T	lnum;
-    long	*offp;
-{
-    linenr_T	curline;
     int		curix;
+    linenr_T	curline;
+{
+    int		count;	    /* number of entries in block */
+    int		idx;
+    int		text_end;
+    int		linecnt;
+    int		rest;
     long	size;
     bhdr_T	*hp;
     DATA_BL	*dp;
-    int		count;		/* number of entries in block */
-    int		idx;
-    int		start_idx;
-    int		text_end;
-    long	offset;
-    int		len;
-    int		ffdos = (get_fileformat(buf) == EOL_DOS);
-    int		extra = 0;
-
-    /* take care of cached line first */
-    ml_flush_line(curbuf);
-
-    if (buf->b_ml.ml_usedchunks == -1
-	    || buf->b_ml.ml_chunksize == NULL
-	    || lnum < 0)
-	return -1;
 
-    if (offp == NULL)
-	offset = 0;
-    else
-	offset = *offp;
-    if (lnum == 0 && offset <= 0)
-	return 1;   /* Not a "find offset" and offset 0 _must_ be in line 1 */
-    /*
-     * Find the last chunk before the one containing our line. Last chunk is
-     * special because it will never qualify
-     */
-    curline = 1;
-    curix = size = 0;
-    while (curix < buf->b_ml.ml_usedchunks - 1
-	    && ((lnum != 0
-	     && lnum >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines)
-		|| (offset != 0
-	       && offset > size + buf->b_ml.ml_chunksize[curix].mlcs_totalsize
-		      + ffdos * buf->b_ml.ml_chunksize[curix].mlcs_numlines)))
-    {
-	curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	size += buf->b_ml.ml_chunksize[curix].mlcs_totalsize;
-	if (offset && ffdos)
-	    size += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	curix++;
-    }
-
-    while ((lnum != 0 && curline < lnum) || (offset != 0 && size < offset))
+    mch_memmove(buf->b_ml.ml_chunksize + curix + 1,
+		buf->b_ml.ml_chunksize + curix,
+		(buf->b_ml.ml_usedchunks - curix) *
+		sizeof(chunksize_T));
+    buf->b_ml.ml_chunktree_len = 0;
+    /* Compute length of first half of lines in the split chunk */
+    size = 0;
+    linecnt = 0;
+    while (curline < buf->b_ml.ml_line_count
+		&& linecnt < MLCS_MINL)
     {
-	if (curline > buf->b_ml.ml_line_count
-		|| (hp = ml_find_line(buf, curline, ML_FIND)) == NULL)
-	    return -1;
+	if ((hp = ml_find_line(buf, curline, ML_FIND)) == NULL)
+	{
+	    buf->b_ml.ml_usedchunks = -1;
+	    return FAIL;
+	}
 	dp = (DATA_BL *)(hp->bh_data);
 	count = (long)(buf->b_ml.ml_locked_high) -
 		(long)(buf->b_ml.ml_locked_low) + 1;
-	start_idx = idx = curline - buf->b_ml.ml_locked_low;
+	idx = curline - buf->b_ml.ml_locked_low;
+	curline = buf->b_ml.ml_locked_high + 1;
 	if (idx == 0)/* first line in block, text at the end */
 	    text_end = dp->db_txt_end;
 	else
 	    text_end = ((dp->db_index[idx - 1]) & DB_INDEX_MASK);
 	/* Compute index of last line to use in this MEMLINE */
-	if (lnum != 0)
+	rest = count - idx;
+	if (linecnt + rest > MLCS_MINL)
 	{
-	    if (curline + (count - idx) >= lnum)
-		idx += lnum - curline - 1;
-	    else
-		idx = count - 1;
+	    idx += MLCS_MINL - linecnt - 1;
+	    linecnt = MLCS_MINL;
 	}
 	else
 	{
-	    extra = 0;
-	    while (offset >= size
-		       + text_end - (int)((dp->db_index[idx]) & DB_INDEX_MASK)
-								      + ffdos)
-	    {
-		if (ffdos)
-		    size++;
-		if (idx == count - 1)
-		{
-		    extra = 1;
-		    break;
-		}
-		idx++;
-	    }
-	}
-	len = text_end - ((dp->db_index[idx]) & DB_INDEX_MASK);
-	size += len;
-	if (offset != 0 && size >= offset)
-	{
-	    if (size + ffdos == offset)
-		*offp = 0;
-	    else if (idx == start_idx)
-		*offp = offset - size + len;
-	    else
-		*offp = offset - size + len
-		     - (text_end - ((dp->db_index[idx - 1]) & DB_INDEX_MASK));
-	    curline += idx - start_idx + extra;
-	    if (curline > buf->b_ml.ml_line_count)
-		return -1;	/* exactly one byte beyond the end */
-	    return curline;
+	    idx = count - 1;
+	    linecnt += rest;
 	}
-	curline = buf->b_ml.ml_locked_high + 1;
+	size += text_end - ((dp->db_index[idx]) & DB_INDEX_MASK);
+    }
+    buf->b_ml.ml_chunksize[curix].mlcs_numlines = linecnt;
+    buf->b_ml.ml_chunksize[curix + 1].mlcs_numlines -= linecnt;
+    buf->b_ml.ml_chunksize[curix].mlcs_totalsize = size;
+    buf->b_ml.ml_chunksize[curix + 1].mlcs_totalsize -= size;
+    buf->b_ml.ml_usedchunks++;
+    return OK;
+}
+
+/*
+ * Like ml_updatechunk() with ML_CHNK_ADDLINE for "count" lines together,
+ * starting at "line", with "len" bytes in total.  All lines must be in the
+ * memline already.  Used by ml_append_bulk().
+ * Careful: may cause ml_find_line() to be called.
+ */
+    static void
+ml_updatechunk_lines(buf, line, count, len)
+    buf_T	*buf;
+    linenr_T	line;
+    long	count;
+    long	len;
+{
+    linenr_T	curline;
+    int		curix;
+
+    /* ml_append_int() has been called for the line above, thus the chunks
+     * exist unless they were given up. */
+    if (buf->b_ml.ml_usedchunks == -1 || buf->b_ml.ml_chunksize == NULL
+								|| count == 0)
+	return;
+
+    /*
+     * Find the chunk that the line belongs to.  When continuing after the
+     * previous line start where that one was found, otherwise loading a big
+     * file would search all chunks for every data block.
+     */
+    if (buf == ml_upd_lastbuf && line == ml_upd_lastline + 1)
+    {
+	curline = ml_upd_lastcurline;
+	curix = ml_upd_lastcurix;
+	while (curix < buf->b_ml.ml_usedchunks - 1
+		&& line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines)
+	{
+	    curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
+	    curix++;
+	}
+    }
+    else
+    {
+	curix = ml_findchunk(buf, line, 0L, FALSE, &curline, NULL);
+	if (curix < 0)
+	    return;
+    }
+    ml_chunk_add(buf, curix, (int)count, len);
+
+    /* Split off MLCS_MINL lines until the chunk is small enough. */
+    ml_upd_lastbuf = NULL;
+    while (buf->b_ml.ml_chunksize[curix].mlcs_numlines >= MLCS_MAXL)
+    {
+	if (buf->b_ml.ml_usedchunks + 1 >= buf->b_ml.ml_numchunks)
+	{
+	    buf->b_ml.ml_numchunks = buf->b_ml.ml_numchunks * 3 / 2;
+	    buf->b_ml.ml_chunksize = (chunksize_T *)
+		vim_realloc(buf->b_ml.ml_chunksize,
+			    sizeof(chunksize_T) * buf->b_ml.ml_numchunks);
+	    if (buf->b_ml.ml_chunksize == NULL)
+	    {
+		/* Hmmmm, Give up on offset for this buffer */
+		buf->b_ml.ml_usedchunks = -1;
+		return;
+	    }
+	}
+	if (ml_splitchunk(buf, curix, curline) == FAIL)
+	    return;
+	curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
+	++curix;
+    }
+
+    /* Remember where the last added line is for the next call. */
+    line += count - 1;
+    while (curix > 0 && line < curline)
+    {
+	--curix;
+	curline -= buf->b_ml.ml_chunksize[curix].mlcs_numlines;
+    }
+    while (curix < buf->b_ml.ml_usedchunks - 1
+	    && line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines)
+    {
+	curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
+	curix++;
+    }
+    ml_upd_lastbuf = buf;
+    ml_upd_lastline = line;
+    ml_upd_lastcurline = curline;
+    ml_upd_lastcurix = curix;
+}
+
+/*
+ * Add "lines" and "size" to chunk "ix", also in the tree when it is valid.
+ */
+    static void
+ml_chunk_add(buf, ix, lines, size)
+    buf_T	*buf;
+    int		ix;
+    int		lines;
+    long	size;
+{
+    chunksize_T	*tree = buf->b_ml.ml_chunktree;
+    int		i;
+
+    buf->b_ml.ml_chunksize[ix].mlcs_numlines += lines;
+    buf->b_ml.ml_chunksize[ix].mlcs_totalsize += size;
+    for (i = ix + 1; i <= buf->b_ml.ml_chunktree_len; i += i & -i)
+    {
+	tree[i].mlcs_numlines += lines;
+	tree[i].mlcs_totalsize += size;
+    }
+}
+
+/*
+ * Build the Fenwick tree over the chunks.  Entry "i" (one based) holds the
+ * sum of the chunks from "i - (i & -i)" up to "i - 1", thus a prefix sum and
+ * the update for one chunk take O(log n) steps.
+ * Splitting and joining chunks shift the array, then ml_chunktree_len is
+ * reset and the tree is built again when it's needed.
+ * Returns FAIL when out of memory, the chunks have been given up then.
+ */
+    static int
+ml_chunktree_build(buf)
+    buf_T	*buf;
+{
+    int		n = buf->b_ml.ml_usedchunks;
+    chunksize_T	*tree;
+    int		i, j;
+
+    if (buf->b_ml.ml_chunktree_size < n + 1)
+    {
+	vim_free(buf->b_ml.ml_chunktree);
+	buf->b_ml.ml_chunktree = (chunksize_T *)alloc((unsigned)
+			    sizeof(chunksize_T) * (buf->b_ml.ml_numchunks + 1));
+	if (buf->b_ml.ml_chunktree == NULL)
+	{
+	    buf->b_ml.ml_chunktree_size = 0;
+	    buf->b_ml.ml_usedchunks = -1;
+	    return FAIL;
+	}
+	buf->b_ml.ml_chunktree_size = buf->b_ml.ml_numchunks + 1;
+    }
+    tree = buf->b_ml.ml_chunktree;
+    mch_memmove(tree + 1, buf->b_ml.ml_chunksize, n * sizeof(chunksize_T));
+    for (i = 1; i <= n; ++i)
+    {
+	j = i + (i & -i);
+	if (j <= n)
+	{
+	    tree[j].mlcs_numlines += tree[i].mlcs_numlines;
+	    tree[j].mlcs_totalsize += tree[i].mlcs_totalsize;
+	}
+    }
+    buf->b_ml.ml_chunktree_len = n;
+    return OK;
+}
+
+/*
+ * Find the chunk that line "lnum" is in, or when "offset" is not zero the
+ * chunk that byte "offset" is in, counting a CR for each line when "ffdos" is
+ * TRUE.  The last chunk is used when the line or offset is beyond it.
+ * Sets "*curlinep" to the first line of the chunk and "*sizep" (when not
+ * NULL) to the number of bytes before it, without CRs.
+ * Returns the index of the chunk, -1 when the chunks have been given up.
+ */
+    static int
+ml_findchunk(buf, lnum, offset, ffdos, curlinep, sizep)
+    buf_T	*buf;
+    linenr_T	lnum;
+    long	offset;
+    int		ffdos;
+    linenr_T	*curlinep;
+    long	*sizep;
+{
+    chunksize_T	*tree;
+    int		n = buf->b_ml.ml_usedchunks;
+    int		pos = 0;
+    int		step;
+    int		i;
+    linenr_T	lines = 0;
+    long	size = 0;
+
+    if (buf->b_ml.ml_chunktree_len != n && ml_chunktree_build(buf) == FAIL)
+	return -1;
+    tree = buf->b_ml.ml_chunktree;
+
+    /* Descend the tree to the last chunk that ends before the line or
+     * offset. */
+    for (step = 1; step * 2 <= n; step *= 2)
+	;
+    for ( ; step > 0; step /= 2)
+    {
+	i = pos + step;
+	if (i <= n
+		&& ((lnum != 0 && lnum > lines + tree[i].mlcs_numlines)
+		    || (offset != 0 && offset > size + tree[i].mlcs_totalsize
+			   + ffdos * (lines + tree[i].mlcs_numlines))))
+	{
+	    pos = i;
+	    lines += tree[i].mlcs_numlines;
+	    size += tree[i].mlcs_totalsize;
+	}
+    }
+    if (pos == n)
+    {
+	--pos;
+	lines -= buf->b_ml.ml_chunksize[pos].mlcs_numlines;
+	size -= buf->b_ml.ml_chunksize[pos].mlcs_totalsize;
+    }
+    *curlinep = lines + 1;
+    if (sizep != NULL)
+	*sizep = size;
+    return pos;
+}
+
+/*
+ * Find offset for line or line with offset.
+ * Find line with offset if "lnum" is 0; return remaining offset in offp
+ * Find offset of line if "lnum" > 0
+ * return -1 if information is not available
+ */
+    long
+ml_find_line_or_offset(buf, lnum, offp)
+    buf_T	*buf;
+    linenr_T	lnum;
+    long	*offp;
+{
+    linenr_T	curline;
+    long	size;
+    bhdr_T	*hp;
+    DATA_BL	*dp;
+    int		count;		/* number of entries in block */
+    int		idx;
+    int		start_idx;
+    int		text_end;
+    long	offset;
+    int		len;
+    int		ffdos = (get_fileformat(buf) == EOL_DOS);
+    int		extra = 0;
+
+    /* take care of cached line first */
+    ml_flush_line(curbuf);
+
+#ifdef FEAT_MMAP
+    if (buf->b_ml.ml_map != NULL)
+	return ml_map_offset(buf, lnum, offp);
+#endif
+
+    if (buf->b_ml.ml_usedchunks == -1
+	    || buf->b_ml.ml_chunksize == NULL
+	    || lnum < 0)
+	return -1;
+
+    if (offp == NULL)
+	offset = 0;
+    else
+	offset = *offp;
+    if (lnum == 0 && offset <= 0)
+	return 1;   /* Not a "find offset" and offset 0 _must_ be in line 1 */
+    /*
+     * Find the last chunk before the one containing our line. Last chunk is
+     * special because it will never qualify
+     */
+    if (ml_findchunk(buf, lnum, offset, ffdos, &curline, &size) < 0)
+	return -1;
+    if (offset && ffdos)
+	size += curline - 1;
+
+    while ((lnum != 0 && curline < lnum) || (offset != 0 && size < offset))
+    {
+	if (curline > buf->b_ml.ml_line_count
+		|| (hp = ml_find_line(buf, curline, ML_FIND)) == NULL)
+	    return -1;
+	dp = (DATA_BL *)(hp->bh_data);
+	count = (long)(buf->b_ml.ml_locked_high) -
+		(long)(buf->b_ml.ml_locked_low) + 1;
+	start_idx = idx = curline - buf->b_ml.ml_locked_low;
+	if (idx == 0)/* first line in block, text at the end */
+	    text_end = dp->db_txt_end;
+	else
+	    text_end = ((dp->db_index[idx - 1]) & DB_INDEX_MASK);
+	/* Compute index of last line to use in this MEMLINE */
+	if (lnum != 0)
+	{
+	    if (curline + (count - idx) >= lnum)
+		idx += lnum - curline - 1;
+	    else
+		idx = count - 1;
+	}
+	else
+	{
+	    extra = 0;
+	    while (offset >= size
+		       + text_end - (int)((dp->db_index[idx]) & DB_INDEX_MASK)
+								      + ffdos)
+	    {
+		if (ffdos)
+		    size++;
+		if (idx == count - 1)
+		{
+		    extra = 1;
+		    break;
+		}
+		idx++;
+	    }
+	}
+	len = text_end - ((dp->db_index[idx]) & DB_INDEX_MASK);
+	size += len;
+	if (offset != 0 && size >= offset)
+	{
+	    if (size + ffdos == offset)
+		*offp = 0;
+	    else if (idx == start_idx)
+		*offp = offset - size + len;
+	    else
+		*offp = offset - size + len
+		     - (text_end - ((dp->db_index[idx - 1]) & DB_INDEX_MASK));
+	    curline += idx - start_idx + extra;
+	    if (curline > buf->b_ml.ml_line_count)
+		return -1;	/* exactly one byte beyond the end */
+	    return curline;
+	}
+	curline = buf->b_ml.ml_locked_high + 1;
     }
 
     if (lnum != 0)
@@ -5332,3 +5907,681 @@ goto_byte(cnt)
 # endif
 }
 #endif
+
+#if defined(FEAT_MMAP) || defined(PROTO)
+/*
+ * A big file is not read into the memline but mapped into memory, see
+ * readfile().  Opening it only needs to find the start of every MM_GROUP-th
+ * line.  ml_get() copies the lines of a group when they are needed.  When the
+ * buffer is about to change ml_unmap() copies all lines into the memline and
+ * the buffer is like any other from then on.
+ * When the file is not only viewed it is loaded into the memline in the
+ * background, ml_map_load_step() copies a piece each time Vim waits for a
+ * typed character.  Until the last piece is in the mapping is still used.
+ */
+
+# define MM_DROP_SIZE	(16 * 1024 * 1024L)
+# define MM_LOAD_STEP	(16 * MM_GROUP)	/* lines loaded in the background
+					   at a time */
+
+/*
+ * Map file "fd" into memory and find where its lines start.
+ * Only done for a regular file of at least "minsize" bytes.
+ * Returns NULL when the file can't be mapped or when interrupted.
+ */
+    mlmap_T *
+ml_map_open(fd, minsize)
+    int		fd;
+    off_t	minsize;
+{
+    struct stat	st;
+    mlmap_T	*mm;
+    char_u	*p;
+    char_u	*nl;
+    char_u	*end;
+    long_u	*new_index;
+    long	index_size = 0;
+    linenr_T	lnum = 0;
+    long_u	dropped = 0;
+
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)
+	    || st.st_size <= 0 || st.st_size < minsize
+	    || (off_t)(size_t)st.st_size != st.st_size)
+	return NULL;
+
+    mm = (mlmap_T *)alloc_clear((unsigned)sizeof(mlmap_T));
+    if (mm == NULL)
+	return NULL;
+    mm->mm_size = (long_u)st.st_size;
+    mm->mm_dev = st.st_dev;
+    mm->mm_ino = st.st_ino;
+    mm->mm_group[0].mg_nr = -1;
+    mm->mm_group[1].mg_nr = -1;
+    mm->mm_fd = dup(fd);
+    p = (char_u *)mmap(NULL, (size_t)mm->mm_size, PROT_READ, MAP_SHARED,
+								fd, (off_t)0);
+    if (mm->mm_fd < 0 || p == (char_u *)MAP_FAILED)
+    {
+	if (p != (char_u *)MAP_FAILED)
+	    munmap((void *)p, (size_t)mm->mm_size);
+	ml_map_free(mm);
+	return NULL;
+    }
+    mm->mm_addr = p;
+# ifdef MADV_SEQUENTIAL
+    (void)madvise((void *)mm->mm_addr, (size_t)mm->mm_size, MADV_SEQUENTIAL);
+# endif
+
+    end = p + mm->mm_size;
+    while (p < end)
+    {
+	if ((lnum & (MM_GROUP - 1)) == 0)
+	{
+	    if ((lnum >> MM_GROUP_SHIFT) >= index_size)
+	    {
+		index_size = index_size == 0 ? 1024 : index_size * 2;
+		new_index = (long_u *)vim_realloc(mm->mm_index,
+					     index_size * sizeof(long_u));
+		if (new_index == NULL)
+		{
+		    do_outofmem_msg((long_u)(index_size * sizeof(long_u)));
+		    ml_map_free(mm);
+		    return NULL;
+		}
+		mm->mm_index = new_index;
+	    }
+	    mm->mm_index[lnum >> MM_GROUP_SHIFT] = (long_u)(p - mm->mm_addr);
+
+	    /* Don't keep the pages that were looked at, the file may be
+	     * much bigger than the memory. */
+	    if ((long_u)(p - mm->mm_addr) >= dropped + MM_DROP_SIZE)
+	    {
+		ml_map_drop(mm, &dropped, (long_u)(p - mm->mm_addr));
+		ui_breakcheck();
+		if (got_int)
+		{
+		    ml_map_free(mm);
+		    return NULL;
+		}
+	    }
+	}
+	++lnum;
+
+	nl = (char_u *)memchr(p, NL, (size_t)(end - p));
+	if (nl == NULL)
+	{
+	    mm->mm_noeol = TRUE;
+	    break;
+	}
+	if (nl > p && nl[-1] == CAR)
+	{
+	    if (lnum == 1)
+		mm->mm_firstcr = TRUE;
+	}
+	else
+	    mm->mm_nocr = TRUE;
+	p = nl + 1;
+    }
+    mm->mm_lines = lnum;
+    mm->mm_textsize = mm->mm_size;
+    ml_map_drop(mm, &dropped, mm->mm_size);
+# ifdef MADV_NORMAL
+    (void)madvise((void *)mm->mm_addr, (size_t)mm->mm_size, MADV_NORMAL);
+# endif
+    return mm;
+}
+
+/*
+ * Tell the system the mapped pages from "*donep" to "upto" are not needed
+ * now.
+ */
+    static void
+ml_map_drop(mm, donep, upto)
+    mlmap_T	*mm;
+    long_u	*donep;
+    long_u	upto;
+{
+# ifdef MADV_DONTNEED
+    /* Only whole pages, the mapping starts at a page boundary. */
+    upto -= upto % (long_u)sysconf(_SC_PAGESIZE);
+    if (upto > *donep)
+	(void)madvise((void *)(mm->mm_addr + *donep), (size_t)(upto - *donep),
+							       MADV_DONTNEED);
+# endif
+    *donep = upto;
+}
+
+# if defined(FEAT_MBYTE) || defined(PROTO)
+/*
+ * Check that the mapped file is valid UTF-8, like readfile() does when
+ * reading it.  ASCII is skipped a word at a time.
+ * Returns FAIL for an illegal or incomplete byte sequence.
+ */
+    int
+ml_map_utf8(mm)
+    mlmap_T	*mm;
+{
+    char_u	*p = mm->mm_addr;
+    char_u	*end = p + mm->mm_size;
+    char_u	*next_drop = p + MM_DROP_SIZE;
+    long_u	dropped = 0;
+    int		l;
+
+    while (p < end)
+    {
+	if (p >= next_drop)
+	{
+	    ml_map_drop(mm, &dropped, (long_u)(p - mm->mm_addr));
+	    ui_breakcheck();
+	    if (got_int)
+		return FAIL;
+	    next_drop = p + MM_DROP_SIZE;
+	}
+	if (*p < 0x80)
+	    /* Skip ASCII, up to where pages are dropped. */
+	    p += utf_ascii_len(p,
+			     (long)((next_drop < end ? next_drop : end) - p));
+	else
+	{
+	    l = utf_ptr2len_len(p, end - p > 8 ? 8 : (int)(end - p));
+	    if (l == 1 || l > end - p)
+		return FAIL;
+	    p += l;
+	}
+    }
+    ml_map_drop(mm, &dropped, mm->mm_size);
+    return OK;
+}
+# endif
+
+/*
+ * Let the lines of "buf" come from the mapped file "mm", which has lines
+ * ending in CR-NL when "dos" is TRUE.  The memline must be empty.
+ */
+    void
+ml_map_attach(buf, mm, dos, load)
+    buf_T	*buf;
+    mlmap_T	*mm;
+    int		dos;
+    int		load;
+{
+    mm->mm_dos = dos;
+    mm->mm_load = load;
+    mm->mm_loaded = 0;
+    mm->mm_dropped = 0;
+
+    /* In Dos format a trailing CTRL-Z is ignored, unless 'binary' set. */
+    if (dos && mm->mm_noeol && !buf->b_p_bin
+	    && mm->mm_addr[mm->mm_size - 1] == Ctrl_Z
+	    && ml_map_linestart(mm, mm->mm_lines) == mm->mm_size - 1)
+    {
+	--mm->mm_lines;
+	--mm->mm_textsize;
+	mm->mm_noeol = FALSE;
+    }
+
+    buf->b_ml.ml_map = mm;
+    buf->b_ml.ml_line_count = mm->mm_lines;
+    buf->b_ml.ml_flags &= ~ML_EMPTY;
+}
+
+/*
+ * Unmap and free "mm".
+ */
+    void
+ml_map_free(mm)
+    mlmap_T	*mm;
+{
+    if (mm->mm_addr != NULL)
+	munmap((void *)mm->mm_addr, (size_t)mm->mm_size);
+    if (mm->mm_fd >= 0)
+	close(mm->mm_fd);
+    vim_free(mm->mm_index);
+    vim_free(mm->mm_group[0].mg_text);
+    vim_free(mm->mm_group[1].mg_text);
+    vim_free(mm->mm_marks);
+    vim_free(mm);
+}
+
+/*
+ * Copy up to "count" lines of the mapped file of "buf" into the memline, after
+ * the lines that were loaded already.  The mapping is still used for all
+ * lines, until the last line was copied, then it is freed.
+ */
+    static int
+ml_map_load(buf, count)
+    buf_T	*buf;
+    linenr_T	count;
+{
+    mlmap_T	*mm = buf->b_ml.ml_map;
+    mm_group_T	mg;
+    char_u	*lines[MM_GROUP];
+    linenr_T	last;
+    linenr_T	save_lowest = lowest_marked;
+    int		n;
+    int		i;
+    int		retval = OK;
+# ifdef FEAT_NETBEANS_INTG
+    int		oldFire = netbeansFireChanges;
+# endif
+
+    if (mm->mm_loaded >= mm->mm_lines)
+    {
+	ml_map_detach(buf, mm);
+	return OK;
+    }
+    if (ml_map_check(mm) == FAIL)
+	return FAIL;
+    last = mm->mm_lines - mm->mm_loaded > count ? mm->mm_loaded + count
+							     : mm->mm_lines;
+
+    /* Use a group of our own, lines that ml_get() returned stay valid. */
+    mg.mg_nr = -1;
+    mg.mg_text = NULL;
+    mg.mg_size = 0;
+
+    /* The memline has the lines loaded so far and the empty line it started
+     * with.  Without the mapping the lines can be appended in the usual way,
+     * line numbers and marks of the buffer don't change. */
+    buf->b_ml.ml_map = NULL;
+    buf->b_ml.ml_line_count = mm->mm_loaded + 1;
+# ifdef FEAT_NETBEANS_INTG
+    netbeansFireChanges = 0;
+# endif
+    while (mm->mm_loaded < last)
+    {
+	if (ml_map_fill(mm, &mg, (long)(mm->mm_loaded >> MM_GROUP_SHIFT))
+								      == FAIL)
+	{
+	    retval = FAIL;
+	    break;
+	}
+	n = mm->mm_lines - mm->mm_loaded < MM_GROUP
+			       ? (int)(mm->mm_lines - mm->mm_loaded) : MM_GROUP;
+	for (i = 0; i < n; ++i)
+	    lines[i] = mg.mg_text + mg.mg_start[i];
+	if (ml_append_bulk_int(buf, mm->mm_loaded, lines, NULL, (long)n, TRUE)
+								      == FAIL)
+	{
+	    retval = FAIL;
+	    break;
+	}
+	mm->mm_loaded += n;
+
+	/* Pages of lines that were loaded are not needed for a while. */
+	if (mm->mm_loaded < mm->mm_lines
+		&& mm->mm_index[mm->mm_loaded >> MM_GROUP_SHIFT]
+					  >= mm->mm_dropped + MM_DROP_SIZE)
+	    ml_map_drop(mm, &mm->mm_dropped,
+			       mm->mm_index[mm->mm_loaded >> MM_GROUP_SHIFT]);
+    }
+# ifdef FEAT_NETBEANS_INTG
+    netbeansFireChanges = oldFire;
+# endif
+    lowest_marked = save_lowest;
+    vim_free(mg.mg_text);
+    if (retval == OK && mm->mm_loaded >= mm->mm_lines)
+	/* Keeping the mapping would use the memory twice, and a change of
+	 * the file would show up in the buffer. */
+	ml_map_detach(buf, mm);
+    else
+    {
+	buf->b_ml.ml_map = mm;
+	buf->b_ml.ml_line_count = mm->mm_lines;
+    }
+    return retval;
+}
+
+/*
+ * Stop using mapping "mm" of "buf" after all lines were copied into the
+ * memline.
+ */
+    static void
+ml_map_detach(buf, mm)
+    buf_T	*buf;
+    mlmap_T	*mm;
+{
+    linenr_T	lnum;
+# ifdef FEAT_NETBEANS_INTG
+    int		oldFire = netbeansFireChanges;
+# endif
+
+    /* Only the empty line the memline started with is to be deleted. */
+    buf->b_ml.ml_map = NULL;
+    buf->b_ml.ml_line_count = mm->mm_lines + 1;
+# ifdef FEAT_NETBEANS_INTG
+    netbeansFireChanges = 0;
+# endif
+    ml_delete_int(buf, buf->b_ml.ml_line_count, FALSE);
+# ifdef FEAT_NETBEANS_INTG
+    netbeansFireChanges = oldFire;
+# endif
+
+    /* Marks set by ":global" that were not handled yet. */
+    if (mm->mm_marks != NULL && buf == curbuf)
+	for (lnum = 1; lnum <= mm->mm_lines; ++lnum)
+	    if (mm->mm_marks[(lnum - 1) >> 3] & (1 << ((lnum - 1) & 7)))
+		ml_setmarked(lnum);
+
+    ml_map_free(mm);
+}
+
+/*
+ * Load the next piece of a file that is loaded in the background.  Called
+ * while waiting for a character to be typed.
+ * Returns FALSE when there is nothing to load.
+ */
+    int
+ml_map_load_step()
+{
+    buf_T	*buf;
+    mlmap_T	*mm;
+
+    for (buf = firstbuf; buf != NULL; buf = buf->b_next)
+    {
+	mm = buf->b_ml.ml_map;
+	if (mm != NULL && mm->mm_load && mm->mm_loaded < mm->mm_lines)
+	{
+	    /* Give up after an error, the rest is loaded when the buffer
+	     * changes. */
+	    if (ml_map_load(buf, (linenr_T)MM_LOAD_STEP) == FAIL)
+		mm->mm_load = FALSE;
+	    return TRUE;
+	}
+    }
+    return FALSE;
+}
+
+/*
+ * Copy the lines of the mapped file of "buf" that were not loaded yet into
+ * the memline and stop using the mapping.  Must be done before changing the
+ * buffer.
+ * Returns FAIL when the file was truncated or memory ran out, the mapping is
+ * still used then.
+ */
+    int
+ml_unmap(buf)
+    buf_T	*buf;
+{
+    /* ml_map_load() stops using the mapping when all lines were copied. */
+    return ml_map_load(buf, buf->b_ml.ml_map->mm_lines);
+}
+
+/*
+ * Return TRUE if the mapped file of "buf" is file "fname".
+ */
+    int
+ml_map_samefile(buf, fname)
+    buf_T	*buf;
+    char_u	*fname;
+{
+    struct stat	st;
+
+    return (buf->b_ml.ml_map != NULL
+	    && mch_stat((char *)fname, &st) >= 0
+	    && st.st_dev == buf->b_ml.ml_map->mm_dev
+	    && st.st_ino == buf->b_ml.ml_map->mm_ino);
+}
+
+/*
+ * Check that the mapped file was not truncated, accessing the missing part
+ * would crash Vim.  Gives an error message the first time.
+ * Returns FAIL when truncated or found to be changed before.
+ */
+    static int
+ml_map_check(mm)
+    mlmap_T	*mm;
+{
+    struct stat	st;
+
+    if (mm->mm_changed)
+	return FAIL;
+    if (fstat(mm->mm_fd, &st) >= 0 && (long_u)st.st_size >= mm->mm_size)
+	return OK;
+    ml_map_changed(mm);
+    return FAIL;
+}
+
+/*
+ * The lines of the mapped file are not where they were when it was opened,
+ * it was changed by another program.  Stop using the text, it can't be
+ * trusted.  Gives an error message the first time.
+ */
+    static void
+ml_map_changed(mm)
+    mlmap_T	*mm;
+{
+    if (mm->mm_changed)
+	return;
+    mm->mm_changed = TRUE;
+    EMSG(_("E836: File was changed while it was mapped, use :e! to reload it"));
+}
+
+/*
+ * Return the offset of the line after the one at offset "off" in the mapped
+ * file.  When there is no line break the file was changed, then the end of
+ * the text is returned.
+ */
+    static long_u
+ml_map_nextline(mm, off)
+    mlmap_T	*mm;
+    long_u	off;
+{
+    char_u	*nl;
+
+    nl = (char_u *)memchr(mm->mm_addr + off, NL,
+					     (size_t)(mm->mm_textsize - off));
+    if (nl == NULL)
+    {
+	ml_map_changed(mm);
+	return mm->mm_textsize;
+    }
+    return (long_u)(nl - mm->mm_addr) + 1;
+}
+
+/*
+ * Copy the lines of group "nr" of "mm" to "mg" and store them the way the
+ * memline does: NUL terminated and with NL for a NUL.
+ */
+    static int
+ml_map_fill(mm, mg, nr)
+    mlmap_T	*mm;
+    mm_group_T	*mg;
+    long	nr;
+{
+    long_u	start = mm->mm_index[nr];
+    long_u	len;
+    char_u	*text;
+    char_u	*p;
+    char_u	*nl;
+    char_u	*eol;
+    char_u	*next;
+    char_u	*end;
+    int		count;
+    int		i;
+
+    mg->mg_nr = -1;
+    if (ml_map_check(mm) == FAIL)
+	return FAIL;
+
+    if (((nr + 1) << MM_GROUP_SHIFT) < mm->mm_lines)
+    {
+	count = MM_GROUP;
+	len = mm->mm_index[nr + 1] - start;
+    }
+    else
+    {
+	count = (int)(mm->mm_lines - (nr << MM_GROUP_SHIFT));
+	len = mm->mm_textsize - start;
+    }
+    if (mg->mg_size < len + 1)
+    {
+	vim_free(mg->mg_text);
+	mg->mg_size = 0;
+	mg->mg_text = lalloc(len + 1, TRUE);
+	if (mg->mg_text == NULL)
+	    return FAIL;
+	mg->mg_size = len + 1;
+    }
+    text = mg->mg_text;
+    mch_memmove(text, mm->mm_addr + start, (size_t)len);
+    text[len] = NUL;
+
+    /* The lines must still end where they did when the file was opened,
+     * otherwise it was changed and "eol" could be anywhere. */
+    end = text + len;
+    for (i = 0, p = text; i < count; ++i, p = next)
+    {
+	mg->mg_start[i] = (long_u)(p - text);
+	nl = (char_u *)memchr(p, NL, (size_t)(end - p));
+	if (nl == NULL)
+	{
+	    /* last line without a line break */
+	    if (i < count - 1 || !mm->mm_noeol
+			     || ((nr + 1) << MM_GROUP_SHIFT) < mm->mm_lines)
+		break;
+	    eol = end;
+	    next = end;
+	}
+	else
+	{
+	    /* In Dos format the CR is not part of the line. */
+	    if (mm->mm_dos && (nl == p || nl[-1] != CAR))
+		break;
+	    eol = mm->mm_dos ? nl - 1 : nl;
+	    next = nl + 1;
+	}
+	while ((p = (char_u *)memchr(p, NUL, (size_t)(eol - p))) != NULL)
+	    *p++ = NL;
+	*eol = NUL;
+    }
+    if (i < count || next != end)
+    {
+	ml_map_changed(mm);
+	return FAIL;
+    }
+    mg->mg_nr = nr;
+    return OK;
+}
+
+/*
+ * ml_get_buf() for a buffer with a mapped file.  The last two groups of lines
+ * that were used are kept, thus it's OK to use the text of two lines.
+ */
+    static char_u *
+ml_map_get(buf, lnum)
+    buf_T	*buf;
+    linenr_T	lnum;
+{
+    mlmap_T	*mm = buf->b_ml.ml_map;
+    long	nr = (long)((lnum - 1) >> MM_GROUP_SHIFT);
+    mm_group_T	*mg = &mm->mm_group[mm->mm_mru];
+
+    if (mg->mg_nr != nr)
+    {
+	mm->mm_mru = !mm->mm_mru;
+	mg = &mm->mm_group[mm->mm_mru];
+	if (mg->mg_nr != nr && ml_map_fill(mm, mg, nr) == FAIL)
+	    return (char_u *)"";
+    }
+    return mg->mg_text + mg->mg_start[(lnum - 1) & (MM_GROUP - 1)];
+}
+
+/*
+ * Return the offset of line "lnum" in the mapped file.  For the line after
+ * the last one it's the end of the text plus a line break when the last line
+ * doesn't have one.
+ */
+    static long_u
+ml_map_linestart(mm, lnum)
+    mlmap_T	*mm;
+    linenr_T	lnum;
+{
+    linenr_T	l;
+    long_u	off;
+
+    if (lnum > mm->mm_lines)
+	return mm->mm_textsize + (mm->mm_noeol ? 1 + mm->mm_dos : 0);
+    l = ((lnum - 1) & ~(linenr_T)(MM_GROUP - 1)) + 1;
+    off = mm->mm_index[(lnum - 1) >> MM_GROUP_SHIFT];
+    for ( ; l < lnum; ++l)
+	off = ml_map_nextline(mm, off);
+    return off;
+}
+
+# ifdef FEAT_BYTEOFF
+/*
+ * ml_find_line_or_offset() for a buffer with a mapped file.  The offset of a
+ * line in the buffer is its offset in the file, corrected for the line breaks
+ * being one byte longer or shorter when 'fileformat' differs.
+ */
+    static long
+ml_map_offset(buf, lnum, offp)
+    buf_T	*buf;
+    linenr_T	lnum;
+    long	*offp;
+{
+    mlmap_T	*mm = buf->b_ml.ml_map;
+    int		ffdos = (get_fileformat(buf) == EOL_DOS);
+    long	extra = ffdos - mm->mm_dos;	/* per line break */
+    long	offset;
+    long	size;
+    long	lo, hi, mid;
+    long_u	start, next;
+
+    if (lnum < 0 || ml_map_check(mm) == FAIL)
+	return -1;
+
+    if (lnum != 0)
+    {
+	if (lnum > mm->mm_lines + 1)
+	    return -1;
+	size = (long)ml_map_linestart(mm, lnum) + (lnum - 1) * extra;
+	if (mm->mm_changed)
+	    return -1;
+
+	/* Don't count the last line break if 'bin' and 'noeol'. */
+	if (buf->b_p_bin && !buf->b_p_eol)
+	    size -= ffdos + 1;
+	return size;
+    }
+
+    offset = offp == NULL ? 0 : *offp;
+    if (offset <= 0)
+	return 1;   /* offset 0 _must_ be in line 1 */
+
+    /* Find the last group that starts at or before "offset". */
+    lo = 0;
+    hi = (long)((mm->mm_lines - 1) >> MM_GROUP_SHIFT);
+    while (lo < hi)
+    {
+	mid = (lo + hi + 1) / 2;
+	if ((long)mm->mm_index[mid] + (mid << MM_GROUP_SHIFT) * extra <= offset)
+	    lo = mid;
+	else
+	    hi = mid - 1;
+    }
+
+    /* Find the line in that group. */
+    lnum = (lo << MM_GROUP_SHIFT) + 1;
+    start = mm->mm_index[lo];
+    while (lnum <= mm->mm_lines)
+    {
+	if (lnum == mm->mm_lines)
+	    next = ml_map_linestart(mm, lnum + 1);
+	else
+	    next = ml_map_nextline(mm, start);
+	if (mm->mm_changed)
+	    return -1;
+	if ((long)next + lnum * extra > offset)
+	    break;
+	++lnum;
+	start = next;
+    }
+    if (lnum > mm->mm_lines)
+	return -1;	/* beyond the end */
+    *offp = offset - ((long)start + (lnum - 1) * extra);
+    return lnum;
+}
+# endif
+#endif
@@ -2734,6 +2734,14 @@ changed_common(lnum, col, lnume, xtra)
     int		add;
 #endif
 
+#ifdef FEAT_SEARCH_EXTRA
+    /* Text may have been changed without ml_replace(), e.g. by del_bytes(). */
+    search_hl_cache_changed(curbuf, lnum, lnume + xtra, 0L);
+#endif
+#if defined(FEAT_SEARCH_EXTRA) && defined(FEAT_RELTIME)
+    search_count_changed(curbuf, lnum, lnume + xtra, 0L);
+#endif
+
     /* mark the buffer as modified */
     changed();
 
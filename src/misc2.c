@@ -1892,15 +1892,11 @@ vim_strbyte(string, c)
     char_u	*string;
     int		c;
 {
-    char_u	*p = string;
-
-    while (*p != NUL)
-    {
-	if (*p == c)
-	    return p;
-	++p;
-    }
-    return NULL;
+    /* The C library's strchr() is a lot faster than a loop.  It compares
+     * "c" converted to a char with the string, that works for bytes. */
+    if (c == NUL || c > 255)
+	return NULL;
+    return (char_u *)strchr((char *)string, c);
 }
 
 /*
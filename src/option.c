@@ -1825,6 +1825,13 @@ static struct vimoption
 			    {(char_u *)0L, (char_u *)0L}
 #endif
 			    SCRIPTID_INIT},
+    {"mmapsize",    "mms",  P_NUM|P_VI_DEF,
+#ifdef FEAT_MMAP
+			    (char_u *)&p_mms, PV_NONE,
+#else
+			    (char_u *)NULL, PV_NONE,
+#endif
+			    {(char_u *)102400L, (char_u *)0L} SCRIPTID_INIT},
     {"modeline",    "ml",   P_BOOL|P_VIM,
 			    (char_u *)&p_ml, PV_ML,
 			    {(char_u *)FALSE, (char_u *)TRUE} SCRIPTID_INIT},
@@ -2109,6 +2116,9 @@ static struct vimoption
 			    (char_u *)NULL, PV_NONE,
 #endif
 			    {(char_u *)2000L, (char_u *)0L} SCRIPTID_INIT},
+    {"regexpengine", "re",  P_NUM|P_VI_DEF,
+			    (char_u *)&p_re, PV_NONE,
+			    {(char_u *)0L, (char_u *)0L} SCRIPTID_INIT},
     {"relativenumber", "rnu", P_BOOL|P_VI_DEF|P_RWIN,
 			    (char_u *)VAR_WIN, PV_RNU,
 			    {(char_u *)FALSE, (char_u *)0L} SCRIPTID_INIT},
@@ -2751,6 +2761,13 @@ static struct vimoption
 			    {(char_u *)0L, (char_u *)0L}
 #endif
 			    SCRIPTID_INIT},
+    {"vimshelllogsize","vsls", P_NUM|P_VI_DEF,
+#ifdef FEAT_VIMSHELL
+			    (char_u *)&p_vsls, PV_NONE,
+#else
+			    (char_u *)NULL, PV_NONE,
+#endif
+			    {(char_u *)10240L, (char_u *)0L} SCRIPTID_INIT},
     {"virtualedit", "ve",   P_STRING|P_COMMA|P_NODUP|P_VI_DEF|P_VIM,
 #ifdef FEAT_VIRTUALEDIT
 			    (char_u *)&p_ve, PV_NONE,
@@ -5934,6 +5951,8 @@ did_set_string_option(opt_idx, varp, new_value_alloced, oldval, errbuf,
 	    if (varp == &p_enc)
 	    {
 		errmsg = mb_init();
+		/* Compiled patterns depend on the encoding. */
+		vim_regcache_clear();
 # ifdef FEAT_TITLE
 		redraw_titles();
 # endif
@@ -8400,6 +8419,17 @@ set_num_option(opt_idx, varp, value, errbuf, errbuflen, opt_flags)
 	    command_height();
     }
 
+#ifdef FEAT_MMAP
+    else if (pp == &p_mms)
+    {
+	if (p_mms < 0)
+	{
+	    errmsg = e_positive;
+	    p_mms = 0;
+	}
+    }
+#endif
+
     /* when 'updatecount' changes from zero to non-zero, open swap files */
     else if (pp == &p_uc)
     {
@@ -8599,6 +8629,11 @@ set_num_option(opt_idx, varp, value, errbuf, errbuflen, opt_flags)
 	errmsg = e_positive;
 	p_report = 1;
     }
+    if (p_re < AUTOMATIC_ENGINE || p_re > NFA_ENGINE)
+    {
+	errmsg = e_invarg;
+	p_re = AUTOMATIC_ENGINE;
+    }
     if ((p_sj < -100 || p_sj >= Rows) && full_screen)
     {
 	if (Rows != old_Rows)	/* Rows changed, just adjust p_sj */
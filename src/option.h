@@ -278,6 +278,7 @@
 #define STL_ALTPERCENT	'P'		/* percentage as TOP BOT ALL or NN% */
 #define STL_ARGLISTSTAT	'a'		/* argument list status as (x of y) */
 #define STL_PAGENUM	'N'		/* page number (when printing)*/
+#define STL_SEARCHCOUNT	'S'		/* last search pattern match count */
 #define STL_VIM_EXPR	'{'		/* start of expression to substitute */
 #define STL_MIDDLEMARK	'='		/* separation between left and right */
 #define STL_TRUNCMARK	'<'		/* truncation mark if line is too long*/
@@ -285,7 +286,7 @@
 #define STL_HIGHLIGHT	'#'		/* highlight name */
 #define STL_TABPAGENR	'T'		/* tab page label nr */
 #define STL_TABCLOSENR	'X'		/* tab page close nr */
-#define STL_ALL		((char_u *) "fFtcvVlLknoObBrRhHmYyWwMqpPaN{#")
+#define STL_ALL		((char_u *) "fFtcvVlLknoObBrRhHmYyWwMqpPaNS{#")
 
 /* flags used for parsed 'wildmode' */
 #define WIM_FULL	1
@@ -622,6 +623,9 @@ EXTERN long	p_mmd;		/* 'maxmapdepth' */
 EXTERN long	p_mm;		/* 'maxmem' */
 EXTERN long	p_mmp;		/* 'maxmempattern' */
 EXTERN long	p_mmt;		/* 'maxmemtot' */
+#ifdef FEAT_MMAP
+EXTERN long	p_mms;		/* 'mmapsize' */
+#endif
 #ifdef FEAT_MENU
 EXTERN long	p_mis;		/* 'menuitems' */
 #endif
@@ -658,6 +662,7 @@ EXTERN char_u	*p_cdpath;	/* 'cdpath' */
 #ifdef FEAT_RELTIME
 EXTERN long	p_rdt;		/* 'redrawtime' */
 #endif
+EXTERN long	p_re;		/* 'regexpengine' */
 EXTERN int	p_remap;	/* 'remap' */
 EXTERN long	p_report;	/* 'report' */
 #if defined(FEAT_WINDOWS) && defined(FEAT_QUICKFIX)
@@ -856,6 +861,9 @@ EXTERN char_u	*p_vdir;	/* 'viewdir' */
 EXTERN char_u	*p_vop;		/* 'viewoptions' */
 EXTERN unsigned	vop_flags;	/* uses SSOP_ flags */
 #endif
+#ifdef FEAT_VIMSHELL
+EXTERN long	p_vsls;		/* 'vimshelllogsize' */
+#endif
 EXTERN int	p_vb;		/* 'visualbell' */
 #ifdef FEAT_VIRTUALEDIT
 EXTERN char_u	*p_ve;		/* 'virtualedit' */
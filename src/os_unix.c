@@ -5168,6 +5168,21 @@ RealWaitForChar(fd, msec, check_for_gpm)
 		}
 	    }
 	}
+	{
+	    /*
+	     * Commands streaming into buffers (":vimshellread"), these are
+	     * read whether the buffer is visible or not.
+	     */
+	    struct vim_shell_stream *st;
+	    for(st=vim_shell_streams; st!=NULL; st=st->next)
+	    {
+		if(!vim_shell_stream_wants_read(st))
+		    continue;
+		FD_SET(st->fd, &rfds);
+		if (maxfd < st->fd)
+		    maxfd = st->fd;
+	    }
+	}
 # endif
 
 # ifdef OLD_VMS
@@ -31,6 +31,7 @@ int utfc_char2bytes __ARGS((int off, char_u *buf));
 int utf_ptr2len __ARGS((char_u *p));
 int utf_byte2len __ARGS((int b));
 int utf_ptr2len_len __ARGS((char_u *p, int size));
+long utf_ascii_len __ARGS((char_u *p, long len));
 int utfc_ptr2len __ARGS((char_u *p));
 int utfc_ptr2len_len __ARGS((char_u *p, int size));
 int utf_char2len __ARGS((int c));
@@ -20,6 +20,7 @@ char_u *ml_get_cursor __ARGS((void));
 char_u *ml_get_buf __ARGS((buf_T *buf, linenr_T lnum, int will_change));
 int ml_line_alloced __ARGS((void));
 int ml_append __ARGS((linenr_T lnum, char_u *line, colnr_T len, int newfile));
+int ml_append_bulk __ARGS((linenr_T lnum, char_u **lines, colnr_T *lens, long count, int newfile));
 int ml_append_buf __ARGS((buf_T *buf, linenr_T lnum, char_u *line, colnr_T len, int newfile));
 int ml_replace __ARGS((linenr_T lnum, char_u *line, int copy));
 int ml_delete __ARGS((linenr_T lnum, int message));
@@ -34,4 +35,11 @@ char_u *ml_encrypt_data __ARGS((memfile_T *mfp, char_u *data, off_t offset, unsi
 void ml_decrypt_data __ARGS((memfile_T *mfp, char_u *data, off_t offset, unsigned size));
 long ml_find_line_or_offset __ARGS((buf_T *buf, linenr_T lnum, long *offp));
 void goto_byte __ARGS((long cnt));
+mlmap_T *ml_map_open __ARGS((int fd, off_t minsize));
+int ml_map_utf8 __ARGS((mlmap_T *mm));
+void ml_map_attach __ARGS((buf_T *buf, mlmap_T *mm, int dos, int load));
+void ml_map_free __ARGS((mlmap_T *mm));
+int ml_map_load_step __ARGS((void));
+int ml_unmap __ARGS((buf_T *buf));
+int ml_map_samefile __ARGS((buf_T *buf, char_u *fname));
 /* vim: set ft=c : */
@@ -1,9 +1,16 @@
 /* regexp.c */
 int re_multiline __ARGS((regprog_T *prog));
 int re_lookbehind __ARGS((regprog_T *prog));
+int re_bufpos __ARGS((regprog_T *prog));
 char_u *skip_regexp __ARGS((char_u *startp, int dirc, int magic, char_u **newp));
 regprog_T *vim_regcomp __ARGS((char_u *expr, int re_flags));
 int vim_regcomp_had_eol __ARGS((void));
+char_u *vim_regmust __ARGS((regprog_T *prog, int ic, int *icp));
+regprog_T *vim_regcomp_cached __ARGS((char_u *expr, int re_flags));
+void vim_regref __ARGS((regprog_T *prog));
+void vim_regfree __ARGS((regprog_T *prog));
+void vim_regcache_clear __ARGS((void));
+void vim_regcache_stat __ARGS((dict_T *d));
 void free_regexp_stuff __ARGS((void));
 int vim_regexec __ARGS((regmatch_T *rmp, char_u *line, colnr_T col));
 int vim_regexec_nl __ARGS((regmatch_T *rmp, char_u *line, colnr_T col));
@@ -11,6 +11,11 @@ char_u *last_search_pat __ARGS((void));
 void reset_search_dir __ARGS((void));
 void set_last_search_pat __ARGS((char_u *s, int idx, int magic, int setlast));
 void last_pat_prog __ARGS((regmmatch_T *regmatch));
+void search_count_clear __ARGS((buf_T *buf));
+void search_count_changed __ARGS((buf_T *buf, linenr_T lnum, linenr_T lnume, long xtra));
+void search_count_background __ARGS((void));
+int search_count_get __ARGS((win_T *wp, long msec, long maxcount, long *current, long *total, int *exact, int *incomplete));
+int search_count_str __ARGS((win_T *wp, char_u *buf, int len));
 int searchit __ARGS((win_T *win, buf_T *buf, pos_T *pos, int dir, char_u *pat, long count, int options, int pat_use, linenr_T stop_lnum, proftime_T *tm));
 void set_search_direction __ARGS((int cdir));
 int do_search __ARGS((oparg_T *oap, int dirc, char_u *pat, long count, int options, proftime_T *tm));
@@ -16,6 +16,8 @@ void out_str_nf __ARGS((char_u *s));
 void out_str __ARGS((char_u *s));
 void term_windgoto __ARGS((int row, int col));
 void term_cursor_right __ARGS((int i));
+int term_windgoto_cost __ARGS((int row, int col));
+int term_cursor_right_cost __ARGS((int i));
 void term_append_lines __ARGS((int line_count));
 void term_delete_lines __ARGS((int line_count));
 void term_set_winpos __ARGS((int x, int y));
@@ -129,6 +129,9 @@ static void	qf_update_buffer __ARGS((qf_info_T *qi));
 static void	qf_fill_buffer __ARGS((qf_info_T *qi));
 #endif
 static char_u	*get_mef_name __ARGS((void));
+static int	vgr_can_read_plain __ARGS((regprog_T *prog));
+static char_u	*vgr_read_plain __ARGS((char_u *fname, long *lenp));
+static int	vgr_match_plain __ARGS((qf_info_T *qi, qfline_T **prevp, char_u *fname, char_u *text, long len, regprog_T *prog, int flags, long *tomatch));
 static buf_T	*load_dummy_buffer __ARGS((char_u *fname));
 static void	wipe_dummy_buffer __ARGS((buf_T *buf));
 static void	unload_dummy_buffer __ARGS((buf_T *buf));
@@ -3054,6 +3057,9 @@ ex_vimgrep(eap)
     char_u	dirname_start[MAXPATHL];
     char_u	dirname_now[MAXPATHL];
     char_u	*target_dir = NULL;
+    int		can_read_plain;
+    char_u	*text;
+    long	textlen;
 #ifdef FEAT_AUTOCMD
     char_u	*au_name =  NULL;
 
@@ -3134,6 +3140,10 @@ ex_vimgrep(eap)
      * ":lcd %:p:h" changes the meaning of short path names. */
     mch_dirname(dirname_start, MAXPATHL);
 
+    /* Most files can be searched without the overhead of loading them into
+     * a buffer. */
+    can_read_plain = vgr_can_read_plain(regmatch.regprog);
+
     seconds = (time_t)0;
     for (fi = 0; fi < fcount && !got_int && tomatch > 0; ++fi)
     {
@@ -3160,6 +3170,15 @@ ex_vimgrep(eap)
 	}
 
 	buf = buflist_findname_exp(fnames[fi]);
+	if ((buf == NULL || buf->b_ml.ml_mfp == NULL) && can_read_plain
+		&& (text = vgr_read_plain(fname, &textlen)) != NULL)
+	{
+	    /* Search the text of the file directly, no buffer needed. */
+	    (void)vgr_match_plain(qi, &prevp, fname, text, textlen,
+					    regmatch.regprog, flags, &tomatch);
+	    vim_free(text);
+	    continue;
+	}
 	if (buf == NULL || buf->b_ml.ml_mfp == NULL)
 	{
 	    /* Remember that a buffer with this name already exists. */
@@ -3425,6 +3444,193 @@ skip_vimgrep_pat(p, s, flags)
     return p;
 }
 
+/*
+ * Return TRUE when ":vimgrep" may search files without loading them into a
+ * buffer: pattern "prog" only looks at one line at a time and the options
+ * used for reading a file can't turn plain ASCII text into something else.
+ */
+    static int
+vgr_can_read_plain(prog)
+    regprog_T	*prog;
+{
+    char_u	*p;
+    char_u	buf[50];
+    int		found_nl = FALSE;
+#ifdef FEAT_MBYTE
+    char_u	*enc;
+    int		ok;
+#endif
+
+    if (re_multiline(prog) || re_bufpos(prog))
+	return FALSE;
+
+    /* A file without a CR is split at NL only when "unix" or "dos" is in
+     * 'fileformats', with only "mac" it is one line. */
+    for (p = p_ffs; *p != NUL; )
+    {
+	copy_option_part(&p, buf, sizeof(buf), ",");
+	if (STRCMP(buf, FF_UNIX) == 0 || STRCMP(buf, FF_DOS) == 0)
+	    found_nl = TRUE;
+    }
+    if (!found_nl)
+	return FALSE;
+
+#ifdef FEAT_MBYTE
+    /* Only when every encoding in 'fileencodings' reads an ASCII file as it
+     * is: an 8-bit encoding or UTF-8.  "ucs-bom" is OK, an ASCII file has no
+     * BOM.  With "ucs-2", a double-byte or an unknown encoding the file may
+     * be converted. */
+    for (p = p_fencs; *p != NUL; )
+    {
+	copy_option_part(&p, buf, sizeof(buf), ",");
+	enc = enc_canonize(buf);
+	if (enc == NULL)
+	    return FALSE;
+	ok = STRCMP(enc, ENC_UCSBOM) == 0 || STRCMP(enc, "utf-8") == 0
+					    || (enc_canon_props(enc) & ENC_8BIT);
+	vim_free(enc);
+	if (!ok)
+	    return FALSE;
+    }
+#endif
+    return TRUE;
+}
+
+/*
+ * Read file "fname" for ":vimgrep" without loading it into a buffer.
+ * Only done when readfile() would give the same lines: a normal file that
+ * only contains ASCII characters without CR and NUL, and no autocommands are
+ * used for reading it.
+ * Returns the text in allocated memory and its length in "*lenp".  Returns
+ * NULL when the file must be loaded into a buffer.
+ */
+    static char_u *
+vgr_read_plain(fname, lenp)
+    char_u	*fname;
+    long	*lenp;
+{
+    int		fd;
+    struct stat	st;
+    char_u	*text = NULL;
+    long	len = 0;
+    long	i;
+
+#ifdef FEAT_AUTOCMD
+    if (has_autocmd(EVENT_BUFREADCMD, fname, NULL)
+	    || has_autocmd(EVENT_BUFREADPRE, fname, NULL)
+	    || has_autocmd(EVENT_BUFREADPOST, fname, NULL))
+	return NULL;
+#endif
+    if (mch_nodetype(fname) != NODE_NORMAL || mch_isdir(fname))
+	return NULL;
+
+    fd = mch_open((char *)fname, O_RDONLY | O_EXTRA, 0);
+    if (fd < 0)
+	return NULL;
+    if (mch_fstat(fd, &st) >= 0 && (off_t)(len = (long)st.st_size)
+								 == st.st_size)
+    {
+	text = lalloc(len + 1, FALSE);
+	if (text != NULL && vim_read(fd, text, len) != len)
+	{
+	    vim_free(text);
+	    text = NULL;
+	}
+    }
+    close(fd);
+    if (text == NULL)
+	return NULL;
+
+    for (i = 0; i < len; ++i)
+	if (text[i] == NUL || text[i] == CAR || text[i] >= 0x80)
+	    break;
+#ifdef FEAT_CRYPT
+    /* An encrypted file starts with "VimCrypt~". */
+    if (len >= 9 && STRNCMP(text, "VimCrypt~", 9) == 0)
+	i = 0;
+#endif
+    if (i < len)
+    {
+	vim_free(text);
+	return NULL;
+    }
+    text[len] = NUL;
+    *lenp = len;
+    return text;
+}
+
+/*
+ * Search "text", the contents of file "fname" with length "len", for the
+ * ":vimgrep" pattern "prog" and add the matches to quickfix list "qi".
+ * Lines are split at NL like readfile() does.
+ * Returns TRUE when a match was found.
+ */
+    static int
+vgr_match_plain(qi, prevp, fname, text, len, prog, flags, tomatch)
+    qf_info_T	*qi;
+    qfline_T	**prevp;
+    char_u	*fname;
+    char_u	*text;
+    long	len;
+    regprog_T	*prog;
+    int		flags;
+    long	*tomatch;
+{
+    regmatch_T	regmatch;
+    char_u	*line = text;
+    char_u	*nl;
+    long	lnum;
+    colnr_T	col;
+    int		found_match = FALSE;
+
+    regmatch.regprog = prog;
+    regmatch.rm_ic = p_ic;
+
+    /* An empty file has one empty line, a NL at the end of the last line
+     * doesn't start another one. */
+    for (lnum = 1; *tomatch > 0; ++lnum)
+    {
+	nl = vim_strchr(line, NL);
+	if (nl != NULL)
+	    *nl = NUL;
+	col = 0;
+	while (vim_regexec(&regmatch, line, col))
+	{
+	    if (qf_add_entry(qi, prevp,
+			NULL,       /* dir */
+			fname,
+			0,
+			line,
+			lnum,
+			(int)(regmatch.startp[0] - line) + 1,
+			FALSE,      /* vis_col */
+			NULL,	    /* search pattern */
+			0,	    /* nr */
+			0,	    /* type */
+			TRUE	    /* valid */
+			) == FAIL)
+	    {
+		got_int = TRUE;
+		break;
+	    }
+	    found_match = TRUE;
+	    if (--*tomatch == 0)
+		break;
+	    if ((flags & VGR_GLOBAL) == 0)
+		break;
+	    col = (colnr_T)(regmatch.endp[0] - line)
+			     + (col == (colnr_T)(regmatch.endp[0] - line));
+	    if (col > (colnr_T)STRLEN(line))
+		break;
+	}
+	line_breakcheck();
+	if (got_int || nl == NULL || nl + 1 == text + len)
+	    break;
+	line = nl + 1;
+    }
+    return found_match;
+}
+
 /*
  * Load file "fname" into a dummy buffer and return the buffer pointer.
  * Returns NULL if it fails.
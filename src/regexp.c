@@ -52,16 +52,17 @@
  * reganch	is the match anchored (at beginning-of-line only)?
  * regmust	string (pointer into program) that match must include, or NULL
  * regmlen	length of regmust string
+ * regmskip	how far to move on when looking for regmust ignoring case
+ * regmlast	bytes that can match the last byte of regmust ignoring case
  * regflags	RF_ values or'ed together
  *
  * Regstart and reganch permit very fast decisions on suitable starting points
  * for a match, cutting down the work a lot.  Regmust permits fast rejection
- * of lines that cannot possibly match.  The regmust tests are costly enough
- * that vim_regcomp() supplies a regmust only if the r.e. contains something
- * potentially expensive (at present, the only such thing detected is * or +
- * at the start of the r.e., which can involve a lot of backup).  Regmlen is
- * supplied because the test in vim_regexec() needs it and vim_regcomp() is
- * computing it anyway.
+ * of lines that cannot possibly match.  It is searched for with strstr(), or
+ * with regmskip when ignoring case, see regmust_find().  When the r.e. starts
+ * with regmust (RF_MSTART) the match is only tried from where it was found.
+ * Regmlen is supplied because the test in vim_regexec() needs it and
+ * vim_regcomp() is computing it anyway.
  */
 
 /*
@@ -332,9 +333,14 @@ toggle_Magic(x)
 
 #define MAX_LIMIT	(32767L << 16L)
 
+/* State of executing a regexp, see below. */
+typedef struct regexec_S regexec_T;
+
 static int re_multi_type __ARGS((int));
-static int cstrncmp __ARGS((char_u *s1, char_u *s2, int *n));
-static char_u *cstrchr __ARGS((char_u *, int));
+static int cstrncmp __ARGS((regexec_T *rex, char_u *s1, char_u *s2, int *n));
+static char_u *cstrchr __ARGS((regexec_T *rex, char_u *, int));
+static regprog_T *nfa_regcomp __ARGS((regprog_T *prog, long progsize, int force));
+static long nfa_regexec __ARGS((regexec_T *rex, regprog_T *prog, colnr_T col, proftime_T *tm));
 
 #ifdef DEBUG
 static void	regdump __ARGS((char_u *, regprog_T *));
@@ -568,6 +574,17 @@ init_class_tab()
 #define RF_HASNL    4	/* can match a NL */
 #define RF_ICOMBINE 8	/* ignore combining characters */
 #define RF_LOOKBH   16	/* uses "\@<=" or "\@<!" */
+#define RF_LOOP	    32	/* repeats a group, uses BACK */
+#define RF_MSTART   64	/* a match starts with "regmust" */
+#define RF_MFOLD    128	/* "regmskip" can be used to find "regmust" */
+#define RF_MFOLDSET 256	/* regmust_fold() was called */
+#define RF_BUFPOS   512	/* uses the cursor, a mark, the Visual area, a line
+			   number, a screen column or the start/end of the
+			   file */
+
+/* bit sets of bytes, used for "regmlast" */
+#define BYTESET_ADD(set, b)	((set)[(b) >> 3] |= 1 << ((b) & 7))
+#define BYTESET_HAS(set, b)	((set)[(b) >> 3] & (1 << ((b) & 7)))
 
 /*
  * Global work variables for vim_regcomp().
@@ -586,9 +603,6 @@ static long	regsize;	/* Code size. */
 static int	reg_toolong;	/* TRUE when offset out of range */
 static char_u	had_endbrace[NSUBEXP];	/* flags, TRUE if end of () found */
 static unsigned	regflags;	/* RF_ flags for prog */
-static long	brace_min[10];	/* Minimums for complex brace repeats */
-static long	brace_max[10];	/* Maximums for complex brace repeats */
-static int	brace_count[10]; /* Current counts for complex brace repeats */
 #if defined(FEAT_SYN_HL) || defined(PROTO)
 static int	had_eol;	/* TRUE when EOL found by vim_regcomp() */
 #endif
@@ -661,7 +675,7 @@ static char_u	*regnode __ARGS((int));
 #ifdef FEAT_MBYTE
 static int	use_multibytecode __ARGS((int c));
 #endif
-static int	prog_magic_wrong __ARGS((void));
+static int	prog_magic_wrong __ARGS((regexec_T *rex));
 static char_u	*regnext __ARGS((char_u *));
 static void	regc __ARGS((int b));
 #ifdef FEAT_MBYTE
@@ -697,6 +711,19 @@ re_lookbehind(prog)
     return (prog->regflags & RF_LOOKBH);
 }
 
+/*
+ * Return TRUE if compiled regular expression "prog" needs to know where in
+ * the buffer the text is (pattern contains "\%#", "\%V", "\%'m", "\%23l",
+ * "\%^" or "\%$") or how it is displayed ("\%23v").  Such a pattern can't be
+ * matched against a single line with vim_regexec().
+ */
+    int
+re_bufpos(prog)
+    regprog_T *prog;
+{
+    return (prog->regflags & RF_BUFPOS);
+}
+
 /*
  * Check for an equivalence class name "[=a=]".  "pp" points to the '['.
  * Returns a character representing the class. Zero means that no item was
@@ -1027,6 +1054,10 @@ skip_regexp(startp, dirc, magic, newp)
  * Beware that the optimization-preparation code in here knows about some
  * of the structure of the compiled regexp.
  * "re_flags": RE_MAGIC and/or RE_STRING.
+ *
+ * Unless 'regexpengine' or a "\%#=" prefix says otherwise, the program is
+ * also translated for the NFA engine in regexp_nfa.c when the pattern
+ * repeats a group, which can make backtracking take exponential time.
  */
     regprog_T *
 vim_regcomp(expr, re_flags)
@@ -1035,13 +1066,25 @@ vim_regcomp(expr, re_flags)
 {
     regprog_T	*r;
     char_u	*scan;
+    char_u	*first;
     char_u	*longest;
     int		len;
     int		flags;
+    int		engine = (int)p_re;
 
     if (expr == NULL)
 	EMSG_RET_NULL(_(e_null));
 
+    /* "\%#=N" at the start selects the engine for this pattern. */
+    if (STRNCMP(expr, "\\%#=", 4) == 0)
+    {
+	engine = expr[4] - '0';
+	if (engine != AUTOMATIC_ENGINE && engine != BACKTRACKING_ENGINE
+						       && engine != NFA_ENGINE)
+	    EMSG_RET_NULL(_("E837: \\%#= can only be followed by 0, 1, or 2"));
+	expr += 5;
+    }
+
     init_class_tab();
 
     /*
@@ -1083,7 +1126,11 @@ vim_regcomp(expr, re_flags)
     r->reganch = 0;
     r->regmust = NULL;
     r->regmlen = 0;
+    r->regnfa = NULL;
+    r->regnfa_len = 0;
+    r->regnfa_nsub = 0;
     r->regflags = regflags;
+    r->regrefcount = 0;
     if (flags & HASNL)
 	r->regflags |= RF_HASNL;
     if (flags & HASLOOKBH)
@@ -1104,44 +1151,36 @@ vim_regcomp(expr, re_flags)
 	    scan = regnext(scan);
 	}
 
+	first = NULL;
 	if (OP(scan) == EXACTLY)
-	{
-#ifdef FEAT_MBYTE
-	    if (has_mbyte)
-		r->regstart = (*mb_ptr2char)(OPERAND(scan));
-	    else
-#endif
-		r->regstart = *OPERAND(scan);
-	}
+	    first = OPERAND(scan);
 	else if ((OP(scan) == BOW
 		    || OP(scan) == EOW
 		    || OP(scan) == NOTHING
 		    || OP(scan) == MOPEN + 0 || OP(scan) == NOPEN
 		    || OP(scan) == MCLOSE + 0 || OP(scan) == NCLOSE)
 		 && OP(regnext(scan)) == EXACTLY)
+	    first = OPERAND(regnext(scan));
+	if (first != NULL)
 	{
 #ifdef FEAT_MBYTE
 	    if (has_mbyte)
-		r->regstart = (*mb_ptr2char)(OPERAND(regnext(scan)));
+		r->regstart = (*mb_ptr2char)(first);
 	    else
 #endif
-		r->regstart = *OPERAND(regnext(scan));
+		r->regstart = *first;
 	}
 
 	/*
-	 * If there's something expensive in the r.e., find the longest
-	 * literal string that must appear and make it the regmust.  Resolve
-	 * ties in favor of later strings, since the regstart check works
-	 * with the beginning of the r.e. and avoiding duplication
+	 * Find the longest literal string that must appear and make it the
+	 * regmust.  Resolve ties in favor of later strings, since the regstart
+	 * check works with the beginning of the r.e. and avoiding duplication
 	 * strengthens checking.  Not a strong reason, but sufficient in the
 	 * absence of others.
+	 * Finding the regmust is cheap, lines that don't have it are rejected
+	 * quickly.  Used a lot for ":global", ":vimgrep" and 'hlsearch'.
 	 */
-	/*
-	 * When the r.e. starts with BOW, it is faster to look for a regmust
-	 * first. Used a lot for "#" and "*" commands. (Added by mool).
-	 */
-	if ((flags & SPSTART || OP(scan) == BOW || OP(scan) == EOW)
-							  && !(flags & HASNL))
+	if (!(flags & HASNL))
 	{
 	    longest = NULL;
 	    len = 0;
@@ -1151,13 +1190,22 @@ vim_regcomp(expr, re_flags)
 		    longest = OPERAND(scan);
 		    len = (int)STRLEN(OPERAND(scan));
 		}
-	    r->regmust = longest;
-	    r->regmlen = len;
+	    if (longest != NULL)
+	    {
+		r->regmust = longest;
+		r->regmlen = len;
+		/* A match can't start before the literal it starts with. */
+		if (longest == first && !r->reganch)
+		    r->regflags |= RF_MSTART;
+	    }
 	}
     }
 #ifdef DEBUG
     regdump(expr, r);
 #endif
+    if (engine != BACKTRACKING_ENGINE)
+	r = nfa_regcomp(r, (long)(regcode - r->program),
+						       engine == NFA_ENGINE);
     return r;
 }
 
@@ -1202,6 +1250,168 @@ vim_regcomp_had_eol()
 {
     return had_eol;
 }
+
+/*
+ * Return the literal text that every match of "prog" must contain, or NULL
+ * when there is no such text.  "ic" is the value that will be used for
+ * matching, "*icp" is set to whether the text may match with different case.
+ * A line that doesn't contain the text can't match, also when the text is
+ * not found by vim_regexec_multi() quickly, e.g. for the NFA engine.
+ */
+    char_u *
+vim_regmust(prog, ic, icp)
+    regprog_T	*prog;
+    int		ic;
+    int		*icp;
+{
+    if (prog == NULL || prog->regmust == NULL
+#ifdef FEAT_MBYTE
+	    /* composing characters may be between the bytes of the text */
+	    || (prog->regflags & RF_ICOMBINE)
+#endif
+	    )
+	return NULL;
+    if (prog->regflags & RF_ICASE)
+	ic = TRUE;
+    else if (prog->regflags & RF_NOICASE)
+	ic = FALSE;
+    *icp = ic;
+    return prog->regmust;
+}
+#endif
+
+/*
+ * Cache of compiled patterns, most recently used first.  For commands and
+ * functions that compile the same pattern over and over, e.g. substitute()
+ * in a loop.  A cached program has a reference count: one for the cache and
+ * one for every user.  Free it with vim_regfree().
+ */
+#define REGCACHE_SIZE	32
+
+typedef struct
+{
+    char_u	*rc_pat;	/* pattern text */
+    int		rc_flags;	/* "re_flags" it was compiled with */
+    int		rc_cpo;		/* CPO_LITERAL and CPO_BACKSL in 'cpo' */
+    int		rc_engine;	/* 'regexpengine' */
+    regprog_T	*rc_prog;
+} regcache_T;
+
+static regcache_T regcache[REGCACHE_SIZE];
+static int	regcache_len = 0;	/* nr of used entries in regcache[] */
+static long	regcache_hits = 0;
+static long	regcache_misses = 0;
+
+/*
+ * Like vim_regcomp(), but use the cache of compiled patterns.  The result
+ * must be freed with vim_regfree().
+ */
+    regprog_T *
+vim_regcomp_cached(expr, re_flags)
+    char_u	*expr;
+    int		re_flags;
+{
+    regprog_T	*prog;
+    regcache_T	rc;
+    int		cpo;
+    int		i;
+
+    cpo = (vim_strchr(p_cpo, CPO_LITERAL) != NULL)
+				    + (vim_strchr(p_cpo, CPO_BACKSL) != NULL) * 2;
+    for (i = 0; i < regcache_len; ++i)
+	if (regcache[i].rc_flags == re_flags
+		&& regcache[i].rc_cpo == cpo
+		&& regcache[i].rc_engine == (int)p_re
+		&& STRCMP(regcache[i].rc_pat, expr) == 0)
+	{
+	    /* Move it to the front. */
+	    rc = regcache[i];
+	    mch_memmove(regcache + 1, regcache, i * sizeof(regcache_T));
+	    regcache[0] = rc;
+	    ++regcache_hits;
+	    ++rc.rc_prog->regrefcount;
+	    return rc.rc_prog;
+	}
+
+    ++regcache_misses;
+    prog = vim_regcomp(expr, re_flags);
+    if (prog == NULL)
+	return NULL;
+    rc.rc_pat = vim_strsave(expr);
+    if (rc.rc_pat == NULL)
+	return prog;		/* not cached, vim_regfree() frees it */
+    rc.rc_flags = re_flags;
+    rc.rc_cpo = cpo;
+    rc.rc_engine = (int)p_re;
+    rc.rc_prog = prog;
+    prog->regrefcount = 2;
+
+    /* Drop the least recently used one when the cache is full. */
+    if (regcache_len == REGCACHE_SIZE)
+    {
+	--regcache_len;
+	vim_free(regcache[regcache_len].rc_pat);
+	vim_regfree(regcache[regcache_len].rc_prog);
+    }
+    mch_memmove(regcache + 1, regcache, regcache_len * sizeof(regcache_T));
+    regcache[0] = rc;
+    ++regcache_len;
+    return prog;
+}
+
+/*
+ * Add a reference to "prog", it is then only freed when vim_regfree() was
+ * called once more.
+ */
+    void
+vim_regref(prog)
+    regprog_T	*prog;
+{
+    /* A count of zero is the same as one: only the owner. */
+    prog->regrefcount = (prog->regrefcount == 0 ? 2 : prog->regrefcount + 1);
+}
+
+/*
+ * Free a program returned by vim_regcomp() or vim_regcomp_cached().  A cached
+ * program is only freed when it's no longer used and not in the cache.
+ */
+    void
+vim_regfree(prog)
+    regprog_T	*prog;
+{
+    if (prog != NULL && (prog->regrefcount == 0 || --prog->regrefcount == 0))
+	vim_free(prog);
+}
+
+/*
+ * Empty the cache of compiled patterns.  Must be done when something changes
+ * that vim_regcomp() depends on and that isn't in the key: 'encoding' and
+ * the previous substitute string used for "~".
+ */
+    void
+vim_regcache_clear()
+{
+    while (regcache_len > 0)
+    {
+	--regcache_len;
+	vim_free(regcache[regcache_len].rc_pat);
+	vim_regfree(regcache[regcache_len].rc_prog);
+    }
+}
+
+#if defined(FEAT_EVAL) || defined(PROTO)
+/*
+ * Add the counters of the cache of compiled patterns to dictionary "d", for
+ * regcachestat().
+ */
+    void
+vim_regcache_stat(d)
+    dict_T	*d;
+{
+    dict_add_nr_str(d, "hits", regcache_hits, NULL);
+    dict_add_nr_str(d, "misses", regcache_misses, NULL);
+    dict_add_nr_str(d, "entries", (long)regcache_len, NULL);
+}
 #endif
 
 /*
@@ -1494,6 +1704,7 @@ regpiece(flagp)
 		regoptail(ret, ret);	/* back */
 		regtail(ret, regnode(BRANCH));	/* or */
 		regtail(ret, regnode(NOTHING)); /* null. */
+		regflags |= RF_LOOP;
 	    }
 	    break;
 
@@ -1508,6 +1719,7 @@ regpiece(flagp)
 		regtail(regnode(BACK), ret);	/* loop back */
 		regtail(next, regnode(BRANCH)); /* or */
 		regtail(ret, regnode(NOTHING)); /* null. */
+		regflags |= RF_LOOP;
 	    }
 	    *flagp = (WORST | HASWIDTH | (flags & (HASNL | HASLOOKBH)));
 	    break;
@@ -1569,6 +1781,7 @@ regpiece(flagp)
 		regoptail(ret, ret);
 		reginsert_limits(BRACE_LIMITS, minval, maxval, ret);
 		++num_complex_braces;
+		regflags |= RF_LOOP;
 	    }
 	    if (minval > 0 && maxval > 0)
 		*flagp = (HASWIDTH | (flags & (HASNL | HASLOOKBH)));
@@ -1881,18 +2094,22 @@ regatom(flagp)
 		 * pattern -- regardless of whether or not it makes sense. */
 		case '^':
 		    ret = regnode(RE_BOF);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case '$':
 		    ret = regnode(RE_EOF);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case '#':
 		    ret = regnode(CURSOR);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		case 'V':
 		    ret = regnode(RE_VISUAL);
+		    regflags |= RF_BUFPOS;
 		    break;
 
 		/* \%[abc]: Emit as a list of branches, all ending at the last
@@ -2011,6 +2228,7 @@ regatom(flagp)
 				  /* "\%'m", "\%<'m" and "\%>'m": Mark */
 				  c = getchr();
 				  ret = regnode(RE_MARK);
+				  regflags |= RF_BUFPOS;
 				  if (ret == JUST_CALC_SIZE)
 				      regsize += 2;
 				  else
@@ -2023,11 +2241,17 @@ regatom(flagp)
 			      else if (c == 'l' || c == 'c' || c == 'v')
 			      {
 				  if (c == 'l')
+				  {
 				      ret = regnode(RE_LNUM);
+				      regflags |= RF_BUFPOS;
+				  }
 				  else if (c == 'c')
 				      ret = regnode(RE_COL);
 				  else
+				  {
 				      ret = regnode(RE_VCOL);
+				      regflags |= RF_BUFPOS;
+				  }
 				  if (ret == JUST_CALC_SIZE)
 				      regsize += 5;
 				  else
@@ -3053,22 +3277,6 @@ read_limits(minval, maxval)
  * vim_regexec and friends
  */
 
-/*
- * Global work variables for vim_regexec().
- */
-
-/* The current match-position is remembered with these variables: */
-static linenr_T	reglnum;	/* line number, relative to first line */
-static char_u	*regline;	/* start of current line */
-static char_u	*reginput;	/* current input, points into "regline" */
-
-static int	need_clear_subexpr;	/* subexpressions still need to be
-					 * cleared */
-#ifdef FEAT_SYN_HL
-static int	need_clear_zsubexpr = FALSE;	/* extmatch subexpressions
-						 * still need to be cleared */
-#endif
-
 /*
  * Structure used to save the current input state, when it needs to be
  * restored after trying a match.  Used by reg_save() and reg_restore().
@@ -3104,25 +3312,28 @@ typedef struct regbehind_S
     save_se_T   save_end[NSUBEXP];
 } regbehind_T;
 
-static char_u	*reg_getline __ARGS((linenr_T lnum));
-static long	vim_regexec_both __ARGS((char_u *line, colnr_T col, proftime_T *tm));
-static long	regtry __ARGS((regprog_T *prog, colnr_T col));
-static void	cleanup_subexpr __ARGS((void));
+static char_u	*reg_getline __ARGS((regexec_T *rex, linenr_T lnum));
+static long	vim_regexec_both __ARGS((regexec_T *rex, char_u *line, colnr_T col, proftime_T *tm));
+static void	regmust_fold __ARGS((regprog_T *r));
+static char_u	*regmust_find __ARGS((regexec_T *rex, regprog_T *prog, char_u *s));
+static long	regtry __ARGS((regexec_T *rex, regprog_T *prog, colnr_T col));
+static void	cleanup_subexpr __ARGS((regexec_T *rex));
 #ifdef FEAT_SYN_HL
-static void	cleanup_zsubexpr __ARGS((void));
+static void	cleanup_zsubexpr __ARGS((regexec_T *rex));
 #endif
-static void	save_subexpr __ARGS((regbehind_T *bp));
-static void	restore_subexpr __ARGS((regbehind_T *bp));
-static void	reg_nextline __ARGS((void));
-static void	reg_save __ARGS((regsave_T *save, garray_T *gap));
-static void	reg_restore __ARGS((regsave_T *save, garray_T *gap));
-static int	reg_save_equal __ARGS((regsave_T *save));
-static void	save_se_multi __ARGS((save_se_T *savep, lpos_T *posp));
-static void	save_se_one __ARGS((save_se_T *savep, char_u **pp));
+static void	save_subexpr __ARGS((regexec_T *rex, regbehind_T *bp));
+static void	restore_subexpr __ARGS((regexec_T *rex, regbehind_T *bp));
+static void	reg_nextline __ARGS((regexec_T *rex));
+static void	reg_save __ARGS((regexec_T *rex, regsave_T *save, garray_T *gap));
+static void	reg_restore __ARGS((regexec_T *rex, regsave_T *save, garray_T *gap));
+static int	reg_save_equal __ARGS((regexec_T *rex, regsave_T *save));
+static void	save_se_multi __ARGS((regexec_T *rex, save_se_T *savep, lpos_T *posp));
+static void	save_se_one __ARGS((regexec_T *rex, save_se_T *savep, char_u **pp));
 
 /* Save the sub-expressions before attempting a match. */
 #define save_se(savep, posp, pp) \
-    REG_MULTI ? save_se_multi((savep), (posp)) : save_se_one((savep), (pp))
+    REG_MULTI ? save_se_multi(rex, (savep), (posp)) \
+	      : save_se_one(rex, (savep), (pp))
 
 /* After a failed match restore the sub-expressions. */
 #define restore_se(savep, posp, pp) { \
@@ -3132,71 +3343,13 @@ static void	save_se_one __ARGS((save_se_T *savep, char_u **pp));
 	*(pp) = (savep)->se_u.ptr; }
 
 static int	re_num_cmp __ARGS((long_u val, char_u *scan));
-static int	regmatch __ARGS((char_u *prog));
-static int	regrepeat __ARGS((char_u *p, long maxcount));
+static int	regmatch __ARGS((regexec_T *rex, char_u *prog));
+static int	regrepeat __ARGS((regexec_T *rex, char_u *p, long maxcount));
 
 #ifdef DEBUG
 int		regnarrate = 0;
 #endif
 
-/*
- * Internal copy of 'ignorecase'.  It is set at each call to vim_regexec().
- * Normally it gets the value of "rm_ic" or "rmm_ic", but when the pattern
- * contains '\c' or '\C' the value is overruled.
- */
-static int	ireg_ic;
-
-#ifdef FEAT_MBYTE
-/*
- * Similar to ireg_ic, but only for 'combining' characters.  Set with \Z flag
- * in the regexp.  Defaults to false, always.
- */
-static int	ireg_icombine;
-#endif
-
-/*
- * Copy of "rmm_maxcol": maximum column to search for a match.  Zero when
- * there is no maximum.
- */
-static colnr_T	ireg_maxcol;
-
-/*
- * Sometimes need to save a copy of a line.  Since alloc()/free() is very
- * slow, we keep one allocated piece of memory and only re-allocate it when
- * it's too small.  It's freed in vim_regexec_both() when finished.
- */
-static char_u	*reg_tofree = NULL;
-static unsigned	reg_tofreelen;
-
-/*
- * These variables are set when executing a regexp to speed up the execution.
- * Which ones are set depends on whether a single-line or multi-line match is
- * done:
- *			single-line		multi-line
- * reg_match		&regmatch_T		NULL
- * reg_mmatch		NULL			&regmmatch_T
- * reg_startp		reg_match->startp	<invalid>
- * reg_endp		reg_match->endp		<invalid>
- * reg_startpos		<invalid>		reg_mmatch->startpos
- * reg_endpos		<invalid>		reg_mmatch->endpos
- * reg_win		NULL			window in which to search
- * reg_buf		<invalid>		buffer in which to search
- * reg_firstlnum	<invalid>		first line in which to search
- * reg_maxline		0			last line nr
- * reg_line_lbr		FALSE or TRUE		FALSE
- */
-static regmatch_T	*reg_match;
-static regmmatch_T	*reg_mmatch;
-static char_u		**reg_startp = NULL;
-static char_u		**reg_endp = NULL;
-static lpos_T		*reg_startpos = NULL;
-static lpos_T		*reg_endpos = NULL;
-static win_T		*reg_win;
-static buf_T		*reg_buf;
-static linenr_T		reg_firstlnum;
-static linenr_T		reg_maxline;
-static int		reg_line_lbr;	    /* "\n" in string is line break */
-
 /* Values for rs_state in regitem_T. */
 typedef enum regstate_E
 {
@@ -3236,8 +3389,8 @@ typedef struct regitem_S
     short	rs_no;		/* submatch nr or BEHIND/NOBEHIND */
 } regitem_T;
 
-static regitem_T *regstack_push __ARGS((regstate_T state, char_u *scan));
-static void regstack_pop __ARGS((char_u **scan));
+static regitem_T *regstack_push __ARGS((regexec_T *rex, regstate_T state, char_u *scan));
+static void regstack_pop __ARGS((regexec_T *rex, char_u **scan));
 
 /* used for STAR, PLUS and BRACE_SIMPLE matching */
 typedef struct regstar_S
@@ -3258,14 +3411,157 @@ typedef struct backpos_S
 } backpos_T;
 
 /*
- * "regstack" and "backpos" are used by regmatch().  They are kept over calls
- * to avoid invoking malloc() and free() often.
- * "regstack" is a stack with regitem_T items, sometimes preceded by regstar_T
- * or regbehind_T.
- * "backpos_T" is a table with backpos_T for BACK
+ * Everything vim_regexec() and friends use while matching is kept in a
+ * regexec_T.  Each of them has its own on the stack and passes a pointer to
+ * it, named "rex", to the functions that do the work.  Thus a match that is
+ * done while another one is in progress, e.g. from an autocommand or a redraw
+ * while checking for CTRL-C, or for the expression in "\=" of a substitute,
+ * does not disturb the outer one.
+ */
+struct regexec_S
+{
+    /* The current match-position is remembered with these variables: */
+    linenr_T	reglnum;	/* line number, relative to first line */
+    char_u	*regline;	/* start of current line */
+    char_u	*reginput;	/* current input, points into "regline" */
+
+    int		need_clear_subexpr;	/* subexpressions still need to be
+					 * cleared */
+#ifdef FEAT_SYN_HL
+    int		need_clear_zsubexpr;	/* extmatch subexpressions still need
+					 * to be cleared */
+#endif
+
+    /*
+     * Internal copy of 'ignorecase'.  It is set at each call to
+     * vim_regexec().  Normally it gets the value of "rm_ic" or "rmm_ic", but
+     * when the pattern contains '\c' or '\C' the value is overruled.
+     */
+    int		ireg_ic;
+
+#ifdef FEAT_MBYTE
+    /*
+     * Similar to ireg_ic, but only for 'combining' characters.  Set with \Z
+     * flag in the regexp.  Defaults to false, always.
+     */
+    int		ireg_icombine;
+#endif
+
+    /*
+     * Copy of "rmm_maxcol": maximum column to search for a match.  Zero when
+     * there is no maximum.
+     */
+    colnr_T	ireg_maxcol;
+
+#ifdef FEAT_RELTIME
+    /*
+     * Time limit for vim_regexec_multi(), also checked while backtracking in
+     * one position, so that a pattern that takes very long in a single line
+     * doesn't hang a search that has a time limit.  "reg_timed_out" is set
+     * when it passed.
+     */
+    proftime_T	*reg_tm;
+    int		reg_tm_count;
+    int		reg_timed_out;
+#endif
+
+    /*
+     * Sometimes need to save a copy of a line.  Since alloc()/free() is very
+     * slow, we keep one allocated piece of memory and only re-allocate it
+     * when it's too small.  It's freed in vim_regexec_both() when finished.
+     */
+    char_u	*reg_tofree;
+    unsigned	reg_tofreelen;
+
+    /*
+     * These are set when executing a regexp to speed up the execution.
+     * Which ones are set depends on whether a single-line or multi-line match
+     * is done:
+     *			single-line		multi-line
+     * reg_match	&regmatch_T		NULL
+     * reg_mmatch	NULL			&regmmatch_T
+     * reg_startp	reg_match->startp	<invalid>
+     * reg_endp		reg_match->endp		<invalid>
+     * reg_startpos	<invalid>		reg_mmatch->startpos
+     * reg_endpos	<invalid>		reg_mmatch->endpos
+     * reg_win		NULL			window in which to search
+     * reg_buf		<invalid>		buffer in which to search
+     * reg_firstlnum	<invalid>		first line in which to search
+     * reg_maxline	0			last line nr
+     * reg_line_lbr	FALSE or TRUE		FALSE
+     */
+    regmatch_T	*reg_match;
+    regmmatch_T	*reg_mmatch;
+    char_u	**reg_startp;
+    char_u	**reg_endp;
+    lpos_T	*reg_startpos;
+    lpos_T	*reg_endpos;
+    win_T	*reg_win;
+    buf_T	*reg_buf;
+    linenr_T	reg_firstlnum;
+    linenr_T	reg_maxline;
+    int		reg_line_lbr;	    /* "\n" in string is line break */
+
+    /*
+     * "regstack" and "backpos" are used by regmatch().  They are kept over
+     * calls to avoid invoking malloc() and free() often.
+     * "regstack" is a stack with regitem_T items, sometimes preceded by
+     * regstar_T or regbehind_T.
+     * "backpos_T" is a table with backpos_T for BACK
+     */
+    garray_T	regstack;
+    garray_T	backpos;
+
+    regsave_T	behind_pos;
+
+#ifdef FEAT_SYN_HL
+    char_u	*reg_startzp[NSUBEXP];	/* Workspace to mark beginning */
+    char_u	*reg_endzp[NSUBEXP];	/*   and end of \z(...\) matches */
+    lpos_T	reg_startzpos[NSUBEXP];	/* idem, beginning pos */
+    lpos_T	reg_endzpos[NSUBEXP];	/* idem, end pos */
+#endif
+
+    /* Used by the NFA engine, see regexp_nfa.c.  The lists and the stack are
+     * kept over calls like "regstack". */
+    garray_T	nfa_list[2];
+    garray_T	nfa_stack;
+    int		*nfa_visited;	/* per state: "nfa_listid" while following
+				   it, + 1 when done */
+    int		*nfa_vmask;	/* per state: mask of passed BACK nodes when
+				   it was followed */
+    int		nfa_visited_len;
+    int		nfa_listid;	/* changes by 2 for every text position */
+    int		nfa_sub[2 * NSUBEXP];	/* submatches of the current thread */
+    int		nfa_best[2 * NSUBEXP];	/* submatches of the match */
+    int		nfa_nomem;	/* ran out of memory */
+
+    /* The arguments and counts of BRACE_COMPLEX, used by regmatch(). */
+    long	brace_min[10];	/* Minimums for complex brace repeats */
+    long	brace_max[10];	/* Maximums for complex brace repeats */
+    int		brace_count[10]; /* Current counts for complex brace repeats */
+
+    /*
+     * The arguments from BRACE_LIMITS are stored here.  They are actually
+     * local to regmatch(), but they are here to reduce the amount of stack
+     * space used (it can be called recursively many times).
+     */
+    long	bl_minval;
+    long	bl_maxval;
+
+    int		rex_pooled;	/* the stacks are from "rex_pool" */
+};
+
+/*
+ * The stacks and "reg_tofree" are kept in "rex_pool" between matches, a match
+ * that is done while another one is in progress gets new ones.
  */
-static garray_T	regstack = {0, 0, 0, 0, NULL};
-static garray_T	backpos = {0, 0, 0, 0, NULL};
+static regexec_T	rex_pool;
+static int		rex_pool_in_use = FALSE;
+
+static void	rex_enter __ARGS((regexec_T *rex));
+static void	rex_leave __ARGS((regexec_T *rex));
+static void	rex_move_pools __ARGS((regexec_T *from, regexec_T *to));
+static void	rex_free_pools __ARGS((regexec_T *rex));
 
 /*
  * Both for regstack and backpos tables we use the following strategy of
@@ -3285,41 +3581,108 @@ static garray_T	backpos = {0, 0, 0, 0, NULL};
     void
 free_regexp_stuff()
 {
-    ga_clear(&regstack);
-    ga_clear(&backpos);
-    vim_free(reg_tofree);
+    rex_free_pools(&rex_pool);
+    vim_regcache_clear();
     vim_free(reg_prev_sub);
 }
 #endif
 
+/*
+ * Start using "rex" for a match: clear it and take the stacks from
+ * "rex_pool" when they are not in use.
+ */
+    static void
+rex_enter(rex)
+    regexec_T	*rex;
+{
+    vim_memset(rex, 0, sizeof(regexec_T));
+    if (!rex_pool_in_use)
+    {
+	rex_pool_in_use = TRUE;
+	rex->rex_pooled = TRUE;
+	rex_move_pools(&rex_pool, rex);
+    }
+}
+
+/*
+ * Done using "rex": put the stacks back in "rex_pool" or free them.
+ */
+    static void
+rex_leave(rex)
+    regexec_T	*rex;
+{
+    if (rex->rex_pooled)
+    {
+	rex_move_pools(rex, &rex_pool);
+	rex_pool_in_use = FALSE;
+    }
+    else
+	rex_free_pools(rex);
+}
+
+/*
+ * Move the stacks and "reg_tofree" from "from" to "to".
+ */
+    static void
+rex_move_pools(from, to)
+    regexec_T	*from;
+    regexec_T	*to;
+{
+    to->regstack = from->regstack;
+    to->backpos = from->backpos;
+    to->nfa_list[0] = from->nfa_list[0];
+    to->nfa_list[1] = from->nfa_list[1];
+    to->nfa_stack = from->nfa_stack;
+    to->nfa_visited = from->nfa_visited;
+    to->nfa_vmask = from->nfa_vmask;
+    to->nfa_visited_len = from->nfa_visited_len;
+    to->nfa_listid = from->nfa_listid;	/* goes with "nfa_visited" */
+    to->reg_tofree = from->reg_tofree;
+    to->reg_tofreelen = from->reg_tofreelen;
+}
+
+/*
+ * Free the memory kept in "rex" for the next match.
+ */
+    static void
+rex_free_pools(rex)
+    regexec_T	*rex;
+{
+    ga_clear(&rex->regstack);
+    ga_clear(&rex->backpos);
+    ga_clear(&rex->nfa_list[0]);
+    ga_clear(&rex->nfa_list[1]);
+    ga_clear(&rex->nfa_stack);
+    vim_free(rex->nfa_visited);
+    rex->nfa_visited = NULL;
+    vim_free(rex->nfa_vmask);
+    rex->nfa_vmask = NULL;
+    rex->nfa_visited_len = 0;
+    vim_free(rex->reg_tofree);
+    rex->reg_tofree = NULL;
+    rex->reg_tofreelen = 0;
+}
+
 /*
  * Get pointer to the line "lnum", which is relative to "reg_firstlnum".
  */
     static char_u *
-reg_getline(lnum)
+reg_getline(rex, lnum)
+    regexec_T	*rex;
     linenr_T	lnum;
 {
     /* when looking behind for a match/no-match lnum is negative.  But we
      * can't go before line 1 */
-    if (reg_firstlnum + lnum < 1)
+    if (rex->reg_firstlnum + lnum < 1)
 	return NULL;
-    if (lnum > reg_maxline)
+    if (lnum > rex->reg_maxline)
 	/* Must have matched the "\n" in the last line. */
 	return (char_u *)"";
-    return ml_get_buf(reg_buf, reg_firstlnum + lnum, FALSE);
+    return ml_get_buf(rex->reg_buf, rex->reg_firstlnum + lnum, FALSE);
 }
 
-static regsave_T behind_pos;
-
-#ifdef FEAT_SYN_HL
-static char_u	*reg_startzp[NSUBEXP];	/* Workspace to mark beginning */
-static char_u	*reg_endzp[NSUBEXP];	/*   and end of \z(...\) matches */
-static lpos_T	reg_startzpos[NSUBEXP];	/* idem, beginning pos */
-static lpos_T	reg_endzpos[NSUBEXP];	/* idem, end pos */
-#endif
-
 /* TRUE if using multi-line regexp. */
-#define REG_MULTI	(reg_match == NULL)
+#define REG_MULTI	(rex->reg_match == NULL)
 
 /*
  * Match a regexp against a string.
@@ -3334,17 +3697,23 @@ vim_regexec(rmp, line, col)
     char_u	*line;	/* string to match against */
     colnr_T	col;	/* column to start looking for match */
 {
-    reg_match = rmp;
-    reg_mmatch = NULL;
-    reg_maxline = 0;
-    reg_line_lbr = FALSE;
-    reg_win = NULL;
-    ireg_ic = rmp->rm_ic;
+    regexec_T	rex;
+    int		r;
+
+    rex_enter(&rex);
+    rex.reg_match = rmp;
+    rex.reg_mmatch = NULL;
+    rex.reg_maxline = 0;
+    rex.reg_line_lbr = FALSE;
+    rex.reg_win = NULL;
+    rex.ireg_ic = rmp->rm_ic;
 #ifdef FEAT_MBYTE
-    ireg_icombine = FALSE;
+    rex.ireg_icombine = FALSE;
 #endif
-    ireg_maxcol = 0;
-    return (vim_regexec_both(line, col, NULL) != 0);
+    rex.ireg_maxcol = 0;
+    r = (vim_regexec_both(&rex, line, col, NULL) != 0);
+    rex_leave(&rex);
+    return r;
 }
 
 #if defined(FEAT_MODIFY_FNAME) || defined(FEAT_EVAL) \
@@ -3358,17 +3727,23 @@ vim_regexec_nl(rmp, line, col)
     char_u	*line;	/* string to match against */
     colnr_T	col;	/* column to start looking for match */
 {
-    reg_match = rmp;
-    reg_mmatch = NULL;
-    reg_maxline = 0;
-    reg_line_lbr = TRUE;
-    reg_win = NULL;
-    ireg_ic = rmp->rm_ic;
+    regexec_T	rex;
+    int		r;
+
+    rex_enter(&rex);
+    rex.reg_match = rmp;
+    rex.reg_mmatch = NULL;
+    rex.reg_maxline = 0;
+    rex.reg_line_lbr = TRUE;
+    rex.reg_win = NULL;
+    rex.ireg_ic = rmp->rm_ic;
 #ifdef FEAT_MBYTE
-    ireg_icombine = FALSE;
+    rex.ireg_icombine = FALSE;
 #endif
-    ireg_maxcol = 0;
-    return (vim_regexec_both(line, col, NULL) != 0);
+    rex.ireg_maxcol = 0;
+    r = (vim_regexec_both(&rex, line, col, NULL) != 0);
+    rex_leave(&rex);
+    return r;
 }
 #endif
 
@@ -3389,27 +3764,30 @@ vim_regexec_multi(rmp, win, buf, lnum, col, tm)
     colnr_T	col;		/* column to start looking for match */
     proftime_T	*tm;		/* timeout limit or NULL */
 {
+    regexec_T	rex;
     long	r;
     buf_T	*save_curbuf = curbuf;
 
-    reg_match = NULL;
-    reg_mmatch = rmp;
-    reg_buf = buf;
-    reg_win = win;
-    reg_firstlnum = lnum;
-    reg_maxline = reg_buf->b_ml.ml_line_count - lnum;
-    reg_line_lbr = FALSE;
-    ireg_ic = rmp->rmm_ic;
+    rex_enter(&rex);
+    rex.reg_match = NULL;
+    rex.reg_mmatch = rmp;
+    rex.reg_buf = buf;
+    rex.reg_win = win;
+    rex.reg_firstlnum = lnum;
+    rex.reg_maxline = rex.reg_buf->b_ml.ml_line_count - lnum;
+    rex.reg_line_lbr = FALSE;
+    rex.ireg_ic = rmp->rmm_ic;
 #ifdef FEAT_MBYTE
-    ireg_icombine = FALSE;
+    rex.ireg_icombine = FALSE;
 #endif
-    ireg_maxcol = rmp->rmm_maxcol;
+    rex.ireg_maxcol = rmp->rmm_maxcol;
 
     /* Need to switch to buffer "buf" to make vim_iswordc() work. */
     curbuf = buf;
-    r = vim_regexec_both(NULL, col, tm);
+    r = vim_regexec_both(&rex, NULL, col, tm);
     curbuf = save_curbuf;
 
+    rex_leave(&rex);
     return r;
 }
 
@@ -3418,7 +3796,8 @@ vim_regexec_multi(rmp, win, buf, lnum, col, tm)
  * lines ("line" is NULL, use reg_getline()).
  */
     static long
-vim_regexec_both(line, col, tm)
+vim_regexec_both(rex, line, col, tm)
+    regexec_T	*rex;
     char_u	*line;
     colnr_T	col;		/* column to start looking for match */
     proftime_T	*tm UNUSED;	/* timeout limit or NULL */
@@ -3431,34 +3810,34 @@ vim_regexec_both(line, col, tm)
      * We allocate *_INITIAL amount of bytes first and then set the grow size
      * to much bigger value to avoid many malloc calls in case of deep regular
      * expressions.  */
-    if (regstack.ga_data == NULL)
+    if (rex->regstack.ga_data == NULL)
     {
 	/* Use an item size of 1 byte, since we push different things
 	 * onto the regstack. */
-	ga_init2(&regstack, 1, REGSTACK_INITIAL);
-	ga_grow(&regstack, REGSTACK_INITIAL);
-	regstack.ga_growsize = REGSTACK_INITIAL * 8;
+	ga_init2(&rex->regstack, 1, REGSTACK_INITIAL);
+	ga_grow(&rex->regstack, REGSTACK_INITIAL);
+	rex->regstack.ga_growsize = REGSTACK_INITIAL * 8;
     }
 
-    if (backpos.ga_data == NULL)
+    if (rex->backpos.ga_data == NULL)
     {
-	ga_init2(&backpos, sizeof(backpos_T), BACKPOS_INITIAL);
-	ga_grow(&backpos, BACKPOS_INITIAL);
-	backpos.ga_growsize = BACKPOS_INITIAL * 8;
+	ga_init2(&rex->backpos, sizeof(backpos_T), BACKPOS_INITIAL);
+	ga_grow(&rex->backpos, BACKPOS_INITIAL);
+	rex->backpos.ga_growsize = BACKPOS_INITIAL * 8;
     }
 
     if (REG_MULTI)
     {
-	prog = reg_mmatch->regprog;
-	line = reg_getline((linenr_T)0);
-	reg_startpos = reg_mmatch->startpos;
-	reg_endpos = reg_mmatch->endpos;
+	prog = rex->reg_mmatch->regprog;
+	line = reg_getline(rex, (linenr_T)0);
+	rex->reg_startpos = rex->reg_mmatch->startpos;
+	rex->reg_endpos = rex->reg_mmatch->endpos;
     }
     else
     {
-	prog = reg_match->regprog;
-	reg_startp = reg_match->startp;
-	reg_endp = reg_match->endp;
+	prog = rex->reg_match->regprog;
+	rex->reg_startp = rex->reg_match->startp;
+	rex->reg_endp = rex->reg_match->endp;
     }
 
     /* Be paranoid... */
@@ -3469,75 +3848,43 @@ vim_regexec_both(line, col, tm)
     }
 
     /* Check validity of program. */
-    if (prog_magic_wrong())
+    if (prog_magic_wrong(rex))
 	goto theend;
 
     /* If the start column is past the maximum column: no need to try. */
-    if (ireg_maxcol > 0 && col >= ireg_maxcol)
+    if (rex->ireg_maxcol > 0 && col >= rex->ireg_maxcol)
 	goto theend;
 
+#ifdef FEAT_RELTIME
+    rex->reg_tm = tm;
+    rex->reg_tm_count = 0;
+    rex->reg_timed_out = FALSE;
+#endif
+
     /* If pattern contains "\c" or "\C": overrule value of ireg_ic */
     if (prog->regflags & RF_ICASE)
-	ireg_ic = TRUE;
+	rex->ireg_ic = TRUE;
     else if (prog->regflags & RF_NOICASE)
-	ireg_ic = FALSE;
+	rex->ireg_ic = FALSE;
 
 #ifdef FEAT_MBYTE
     /* If pattern contains "\Z" overrule value of ireg_icombine */
     if (prog->regflags & RF_ICOMBINE)
-	ireg_icombine = TRUE;
+	rex->ireg_icombine = TRUE;
 #endif
 
     /* If there is a "must appear" string, look for it. */
     if (prog->regmust != NULL)
     {
-	int c;
-
-#ifdef FEAT_MBYTE
-	if (has_mbyte)
-	    c = (*mb_ptr2char)(prog->regmust);
-	else
-#endif
-	    c = *prog->regmust;
-	s = line + col;
-
-	/*
-	 * This is used very often, esp. for ":global".  Use three versions of
-	 * the loop to avoid overhead of conditions.
-	 */
-	if (!ireg_ic
-#ifdef FEAT_MBYTE
-		&& !has_mbyte
-#endif
-		)
-	    while ((s = vim_strbyte(s, c)) != NULL)
-	    {
-		if (cstrncmp(s, prog->regmust, &prog->regmlen) == 0)
-		    break;		/* Found it. */
-		++s;
-	    }
-#ifdef FEAT_MBYTE
-	else if (!ireg_ic || (!enc_utf8 && mb_char2len(c) > 1))
-	    while ((s = vim_strchr(s, c)) != NULL)
-	    {
-		if (cstrncmp(s, prog->regmust, &prog->regmlen) == 0)
-		    break;		/* Found it. */
-		mb_ptr_adv(s);
-	    }
-#endif
-	else
-	    while ((s = cstrchr(s, c)) != NULL)
-	    {
-		if (cstrncmp(s, prog->regmust, &prog->regmlen) == 0)
-		    break;		/* Found it. */
-		mb_ptr_adv(s);
-	    }
+	s = regmust_find(rex, prog, line + col);
 	if (s == NULL)		/* Not present. */
 	    goto theend;
+	if (prog->regflags & RF_MSTART)
+	    col = (colnr_T)(s - line);
     }
 
-    regline = line;
-    reglnum = 0;
+    rex->regline = line;
+    rex->reglnum = 0;
 
     /* Simplest case: Anchored match need be tried only once. */
     if (prog->reganch)
@@ -3546,22 +3893,26 @@ vim_regexec_both(line, col, tm)
 
 #ifdef FEAT_MBYTE
 	if (has_mbyte)
-	    c = (*mb_ptr2char)(regline + col);
+	    c = (*mb_ptr2char)(rex->regline + col);
 	else
 #endif
-	    c = regline[col];
+	    c = rex->regline[col];
 	if (prog->regstart == NUL
 		|| prog->regstart == c
-		|| (ireg_ic && ((
+		|| (rex->ireg_ic && ((
 #ifdef FEAT_MBYTE
 			(enc_utf8 && utf_fold(prog->regstart) == utf_fold(c)))
 			|| (c < 255 && prog->regstart < 255 &&
 #endif
 			    MB_TOLOWER(prog->regstart) == MB_TOLOWER(c)))))
-	    retval = regtry(prog, col);
+	    retval = prog->regnfa != NULL ? nfa_regexec(rex, prog, col, tm)
+						      : regtry(rex, prog, col);
 	else
 	    retval = 0;
     }
+    else if (prog->regnfa != NULL)
+	/* Tries all start columns in one go. */
+	retval = nfa_regexec(rex, prog, col, tm);
     else
     {
 #ifdef FEAT_RELTIME
@@ -3574,44 +3925,48 @@ vim_regexec_both(line, col, tm)
 	    {
 		/* Skip until the char we know it must start with.
 		 * Used often, do some work to avoid call overhead. */
-		if (!ireg_ic
+		if (!rex->ireg_ic
 #ifdef FEAT_MBYTE
 			    && !has_mbyte
 #endif
 			    )
-		    s = vim_strbyte(regline + col, prog->regstart);
+		    s = vim_strbyte(rex->regline + col, prog->regstart);
 		else
-		    s = cstrchr(regline + col, prog->regstart);
+		    s = cstrchr(rex, rex->regline + col, prog->regstart);
 		if (s == NULL)
 		{
 		    retval = 0;
 		    break;
 		}
-		col = (int)(s - regline);
+		col = (int)(s - rex->regline);
 	    }
 
 	    /* Check for maximum column to try. */
-	    if (ireg_maxcol > 0 && col >= ireg_maxcol)
+	    if (rex->ireg_maxcol > 0 && col >= rex->ireg_maxcol)
 	    {
 		retval = 0;
 		break;
 	    }
 
-	    retval = regtry(prog, col);
+	    retval = regtry(rex, prog, col);
 	    if (retval > 0)
 		break;
+#ifdef FEAT_RELTIME
+	    if (rex->reg_timed_out)
+		break;
+#endif
 
 	    /* if not currently on the first line, get it again */
-	    if (reglnum != 0)
+	    if (rex->reglnum != 0)
 	    {
-		reglnum = 0;
-		regline = reg_getline((linenr_T)0);
+		rex->reglnum = 0;
+		rex->regline = reg_getline(rex, (linenr_T)0);
 	    }
-	    if (regline[col] == NUL)
+	    if (rex->regline[col] == NUL)
 		break;
 #ifdef FEAT_MBYTE
 	    if (has_mbyte)
-		col += (*mb_ptr2len)(regline + col);
+		col += (*mb_ptr2len)(rex->regline + col);
 	    else
 #endif
 		++col;
@@ -3630,15 +3985,15 @@ vim_regexec_both(line, col, tm)
 theend:
     /* Free "reg_tofree" when it's a bit big.
      * Free regstack and backpos if they are bigger than their initial size. */
-    if (reg_tofreelen > 400)
+    if (rex->reg_tofreelen > 400)
     {
-	vim_free(reg_tofree);
-	reg_tofree = NULL;
+	vim_free(rex->reg_tofree);
+	rex->reg_tofree = NULL;
     }
-    if (regstack.ga_maxlen > REGSTACK_INITIAL)
-	ga_clear(&regstack);
-    if (backpos.ga_maxlen > BACKPOS_INITIAL)
-	ga_clear(&backpos);
+    if (rex->regstack.ga_maxlen > REGSTACK_INITIAL)
+	ga_clear(&rex->regstack);
+    if (rex->backpos.ga_maxlen > BACKPOS_INITIAL)
+	ga_clear(&rex->backpos);
 
     return retval;
 }
@@ -3691,49 +4046,194 @@ unref_extmatch(em)
 }
 #endif
 
+/*
+ * Fill "r->regmskip" and "r->regmlast" for finding "r->regmust" when ignoring
+ * case and set RF_MFOLD.  Only done when "regmust" is ASCII or the encoding
+ * is single-byte.  Done when first needed, most patterns never need it.
+ */
+    static void
+regmust_fold(r)
+    regprog_T	*r;
+{
+    int		last[256];	/* last index of a folded byte in "regmust" */
+    int		c, fc;
+    int		i;
+    int		maxc = 256;
+    int		m = r->regmlen;
+
+    r->regflags |= RF_MFOLDSET;
+#ifdef FEAT_MBYTE
+    if (has_mbyte && !enc_utf8)
+	return;
+    /* In UTF-8 ASCII in the pattern only matches ASCII, see mb_strnicmp(). */
+    if (enc_utf8)
+	maxc = 0x80;
+# define REG_FOLD(c) (enc_utf8 ? TOLOWER_ASC(c) : MB_TOLOWER(c))
+#else
+# define REG_FOLD(c) MB_TOLOWER(c)
+#endif
+
+    for (c = 0; c < 256; ++c)
+	last[c] = -1;
+    for (i = 0; i < m; ++i)
+    {
+	c = r->regmust[i];
+	if (c >= maxc || (fc = REG_FOLD(c)) >= 256)
+	    return;
+	if (i < m - 1)
+	    last[fc] = i;
+    }
+
+    /* Shift for the byte where the end of "regmust" would be: to where that
+     * byte is in "regmust", or past it when it's not there. */
+    vim_memset(r->regmlast, 0, sizeof(r->regmlast));
+    for (c = 0; c < 256; ++c)
+    {
+	fc = c == NUL || c >= maxc ? 256 : REG_FOLD(c);
+	if (fc < 256 && last[fc] >= 0)
+	    i = m - 1 - last[fc];
+	else
+	    i = m;
+	r->regmskip[c] = i > 255 ? 255 : i;
+	if (fc < 256 && fc == REG_FOLD(r->regmust[m - 1]))
+	    BYTESET_ADD(r->regmlast, c);
+    }
+#undef REG_FOLD
+    r->regflags |= RF_MFOLD;
+}
+
+/*
+ * Find "prog->regmust" in "s".  Returns a pointer to where it starts, or NULL
+ * when it's not there.
+ * This is used very often, esp. for ":global".  The C library's strstr() is
+ * fast, when ignoring case "regmskip" is used to skip over text that can't be
+ * part of a match.  Otherwise look for the first character and compare.
+ */
+    static char_u *
+regmust_find(rex, prog, s)
+    regexec_T	*rex;
+    regprog_T	*prog;
+    char_u	*s;
+{
+    char_u	*end;
+    int		c;
+    int		len;
+
+#ifdef FEAT_MBYTE
+    /* In UTF-8 a byte match is always at a character boundary. */
+    if (!rex->ireg_icombine && (!has_mbyte || enc_utf8))
+#endif
+    {
+	if (!rex->ireg_ic)
+	    return (char_u *)strstr((char *)s, (char *)prog->regmust);
+
+	if (prog->regmlen > 1 && !(prog->regflags & RF_MFOLDSET))
+	    regmust_fold(prog);
+	if (prog->regflags & RF_MFOLD)
+	{
+	    /* Boyer-Moore-Horspool: check the byte where the end of "regmust"
+	     * would be, when it doesn't match move on to where it may match. */
+	    end = s + STRLEN(s);
+	    while (end - s >= prog->regmlen)
+	    {
+		c = s[prog->regmlen - 1];
+		if (BYTESET_HAS(prog->regmlast, c))
+		{
+		    len = prog->regmlen;
+		    if (cstrncmp(rex, prog->regmust, s, &len) == 0)
+			return s;
+		}
+		s += prog->regmskip[c];
+	    }
+	    return NULL;
+	}
+    }
+
+#ifdef FEAT_MBYTE
+    if (has_mbyte)
+	c = (*mb_ptr2char)(prog->regmust);
+    else
+#endif
+	c = *prog->regmust;
+
+    /* Use three versions of the loop to avoid overhead of conditions. */
+    if (!rex->ireg_ic
+#ifdef FEAT_MBYTE
+	    && !has_mbyte
+#endif
+	    )
+	while ((s = vim_strbyte(s, c)) != NULL)
+	{
+	    len = prog->regmlen;
+	    if (cstrncmp(rex, prog->regmust, s, &len) == 0)
+		break;		/* Found it. */
+	    ++s;
+	}
+#ifdef FEAT_MBYTE
+    else if (!rex->ireg_ic || (!enc_utf8 && mb_char2len(c) > 1))
+	while ((s = vim_strchr(s, c)) != NULL)
+	{
+	    len = prog->regmlen;
+	    if (cstrncmp(rex, prog->regmust, s, &len) == 0)
+		break;		/* Found it. */
+	    mb_ptr_adv(s);
+	}
+#endif
+    else
+	while ((s = cstrchr(rex, s, c)) != NULL)
+	{
+	    len = prog->regmlen;
+	    if (cstrncmp(rex, prog->regmust, s, &len) == 0)
+		break;		/* Found it. */
+	    mb_ptr_adv(s);
+	}
+    return s;
+}
+
 /*
  * regtry - try match of "prog" with at regline["col"].
  * Returns 0 for failure, number of lines contained in the match otherwise.
  */
     static long
-regtry(prog, col)
+regtry(rex, prog, col)
+    regexec_T	*rex;
     regprog_T	*prog;
     colnr_T	col;
 {
-    reginput = regline + col;
-    need_clear_subexpr = TRUE;
+    rex->reginput = rex->regline + col;
+    rex->need_clear_subexpr = TRUE;
 #ifdef FEAT_SYN_HL
     /* Clear the external match subpointers if necessary. */
     if (prog->reghasz == REX_SET)
-	need_clear_zsubexpr = TRUE;
+	rex->need_clear_zsubexpr = TRUE;
 #endif
 
-    if (regmatch(prog->program + 1) == 0)
+    if (regmatch(rex, prog->program + 1) == 0)
 	return 0;
 
-    cleanup_subexpr();
+    cleanup_subexpr(rex);
     if (REG_MULTI)
     {
-	if (reg_startpos[0].lnum < 0)
+	if (rex->reg_startpos[0].lnum < 0)
 	{
-	    reg_startpos[0].lnum = 0;
-	    reg_startpos[0].col = col;
+	    rex->reg_startpos[0].lnum = 0;
+	    rex->reg_startpos[0].col = col;
 	}
-	if (reg_endpos[0].lnum < 0)
+	if (rex->reg_endpos[0].lnum < 0)
 	{
-	    reg_endpos[0].lnum = reglnum;
-	    reg_endpos[0].col = (int)(reginput - regline);
+	    rex->reg_endpos[0].lnum = rex->reglnum;
+	    rex->reg_endpos[0].col = (int)(rex->reginput - rex->regline);
 	}
 	else
 	    /* Use line number of "\ze". */
-	    reglnum = reg_endpos[0].lnum;
+	    rex->reglnum = rex->reg_endpos[0].lnum;
     }
     else
     {
-	if (reg_startp[0] == NULL)
-	    reg_startp[0] = regline + col;
-	if (reg_endp[0] == NULL)
-	    reg_endp[0] = reginput;
+	if (rex->reg_startp[0] == NULL)
+	    rex->reg_startp[0] = rex->regline + col;
+	if (rex->reg_endp[0] == NULL)
+	    rex->reg_endp[0] = rex->reginput;
     }
 #ifdef FEAT_SYN_HL
     /* Package any found \z(...\) matches for export. Default is none. */
@@ -3744,58 +4244,52 @@ regtry(prog, col)
     {
 	int		i;
 
-	cleanup_zsubexpr();
+	cleanup_zsubexpr(rex);
 	re_extmatch_out = make_extmatch();
 	for (i = 0; i < NSUBEXP; i++)
 	{
 	    if (REG_MULTI)
 	    {
 		/* Only accept single line matches. */
-		if (reg_startzpos[i].lnum >= 0
-			&& reg_endzpos[i].lnum == reg_startzpos[i].lnum)
-		    re_extmatch_out->matches[i] =
-			vim_strnsave(reg_getline(reg_startzpos[i].lnum)
-						       + reg_startzpos[i].col,
-				   reg_endzpos[i].col - reg_startzpos[i].col);
+		if (rex->reg_startzpos[i].lnum >= 0
+		     && rex->reg_endzpos[i].lnum == rex->reg_startzpos[i].lnum)
+		    re_extmatch_out->matches[i] = vim_strnsave(
+			    reg_getline(rex, rex->reg_startzpos[i].lnum)
+						   + rex->reg_startzpos[i].col,
+			    rex->reg_endzpos[i].col
+						  - rex->reg_startzpos[i].col);
 	    }
 	    else
 	    {
-		if (reg_startzp[i] != NULL && reg_endzp[i] != NULL)
+		if (rex->reg_startzp[i] != NULL && rex->reg_endzp[i] != NULL)
 		    re_extmatch_out->matches[i] =
-			    vim_strnsave(reg_startzp[i],
-					(int)(reg_endzp[i] - reg_startzp[i]));
+			    vim_strnsave(rex->reg_startzp[i],
+			       (int)(rex->reg_endzp[i] - rex->reg_startzp[i]));
 	    }
 	}
     }
 #endif
-    return 1 + reglnum;
+    return 1 + rex->reglnum;
 }
 
 #ifdef FEAT_MBYTE
-static int reg_prev_class __ARGS((void));
+static int reg_prev_class __ARGS((regexec_T *rex));
 
 /*
  * Get class of previous character.
  */
     static int
-reg_prev_class()
+reg_prev_class(rex)
+    regexec_T	*rex;
 {
-    if (reginput > regline)
-	return mb_get_class(reginput - 1
-				     - (*mb_head_off)(regline, reginput - 1));
+    if (rex->reginput > rex->regline)
+	return mb_get_class(rex->reginput - 1
+			    - (*mb_head_off)(rex->regline, rex->reginput - 1));
     return -1;
 }
 
 #endif
-#define ADVANCE_REGINPUT() mb_ptr_adv(reginput)
-
-/*
- * The arguments from BRACE_LIMITS are stored here.  They are actually local
- * to regmatch(), but they are here to reduce the amount of stack space used
- * (it can be called recursively many times).
- */
-static long	bl_minval;
-static long	bl_maxval;
+#define ADVANCE_REGINPUT() mb_ptr_adv(rex->reginput)
 
 /*
  * regmatch - main matching routine
@@ -3813,7 +4307,8 @@ static long	bl_maxval;
  * undefined state!
  */
     static int
-regmatch(scan)
+regmatch(rex, scan)
+    regexec_T	*rex;
     char_u	*scan;		/* Current node. */
 {
   char_u	*next;		/* Next node. */
@@ -3830,8 +4325,8 @@ regmatch(scan)
 
   /* Make "regstack" and "backpos" empty.  They are allocated and freed in
    * vim_regexec_both() to reduce malloc()/free() calls. */
-  regstack.ga_len = 0;
-  backpos.ga_len = 0;
+  rex->regstack.ga_len = 0;
+  rex->backpos.ga_len = 0;
 
   /*
    * Repeat until "regstack" is empty.
@@ -3841,6 +4336,16 @@ regmatch(scan)
     /* Some patterns my cause a long time to match, even though they are not
      * illegal.  E.g., "\([a-z]\+\)\+Q".  Allow breaking them with CTRL-C. */
     fast_breakcheck();
+#ifdef FEAT_RELTIME
+    /* And stop them when the time limit passed, check once in a hundred
+     * times to avoid overhead. */
+    if (rex->reg_tm != NULL && ++rex->reg_tm_count == 100)
+    {
+	rex->reg_tm_count = 0;
+	if (profile_passed_limit(rex->reg_tm))
+	    rex->reg_timed_out = TRUE;
+    }
+#endif
 
 #ifdef DEBUG
     if (scan != NULL && regnarrate)
@@ -3856,7 +4361,11 @@ regmatch(scan)
      */
     for (;;)
     {
-	if (got_int || scan == NULL)
+	if (got_int || scan == NULL
+#ifdef FEAT_RELTIME
+		|| rex->reg_timed_out
+#endif
+		)
 	{
 	    status = RA_FAIL;
 	    break;
@@ -3889,12 +4398,12 @@ regmatch(scan)
 
 	op = OP(scan);
 	/* Check for character class with NL added. */
-	if (!reg_line_lbr && WITH_NL(op) && REG_MULTI
-				&& *reginput == NUL && reglnum <= reg_maxline)
+	if (!rex->reg_line_lbr && WITH_NL(op) && REG_MULTI
+		  && *rex->reginput == NUL && rex->reglnum <= rex->reg_maxline)
 	{
-	    reg_nextline();
+	    reg_nextline(rex);
 	}
-	else if (reg_line_lbr && WITH_NL(op) && *reginput == '\n')
+	else if (rex->reg_line_lbr && WITH_NL(op) && *rex->reginput == '\n')
 	{
 	    ADVANCE_REGINPUT();
 	}
@@ -3904,14 +4413,14 @@ regmatch(scan)
 	      op -= ADD_NL;
 #ifdef FEAT_MBYTE
 	  if (has_mbyte)
-	      c = (*mb_ptr2char)(reginput);
+	      c = (*mb_ptr2char)(rex->reginput);
 	  else
 #endif
-	      c = *reginput;
+	      c = *rex->reginput;
 	  switch (op)
 	  {
 	  case BOL:
-	    if (reginput != regline)
+	    if (rex->reginput != rex->regline)
 		status = RA_NOMATCH;
 	    break;
 
@@ -3924,22 +4433,24 @@ regmatch(scan)
 	    /* We're not at the beginning of the file when below the first
 	     * line where we started, not at the start of the line or we
 	     * didn't start at the first line of the buffer. */
-	    if (reglnum != 0 || reginput != regline
-					  || (REG_MULTI && reg_firstlnum > 1))
+	    if (rex->reglnum != 0 || rex->reginput != rex->regline
+				      || (REG_MULTI && rex->reg_firstlnum > 1))
 		status = RA_NOMATCH;
 	    break;
 
 	  case RE_EOF:
-	    if (reglnum != reg_maxline || c != NUL)
+	    if (rex->reglnum != rex->reg_maxline || c != NUL)
 		status = RA_NOMATCH;
 	    break;
 
 	  case CURSOR:
 	    /* Check if the buffer is in a window and compare the
 	     * reg_win->w_cursor position to the match position. */
-	    if (reg_win == NULL
-		    || (reglnum + reg_firstlnum != reg_win->w_cursor.lnum)
-		    || ((colnr_T)(reginput - regline) != reg_win->w_cursor.col))
+	    if (rex->reg_win == NULL
+		    || (rex->reglnum + rex->reg_firstlnum
+						!= rex->reg_win->w_cursor.lnum)
+		    || ((colnr_T)(rex->reginput - rex->regline)
+						!= rex->reg_win->w_cursor.col))
 		status = RA_NOMATCH;
 	    break;
 
@@ -3954,13 +4465,16 @@ regmatch(scan)
 		pos = getmark(mark, FALSE);
 		if (pos == NULL		     /* mark doesn't exist */
 			|| pos->lnum <= 0    /* mark isn't set (in curbuf) */
-			|| (pos->lnum == reglnum + reg_firstlnum
-				? (pos->col == (colnr_T)(reginput - regline)
+			|| (pos->lnum == rex->reglnum + rex->reg_firstlnum
+				? (pos->col == (colnr_T)(rex->reginput
+								- rex->regline)
 				    ? (cmp == '<' || cmp == '>')
-				    : (pos->col < (colnr_T)(reginput - regline)
+				    : (pos->col < (colnr_T)(rex->reginput
+								- rex->regline)
 					? cmp != '>'
 					: cmp != '<'))
-				: (pos->lnum < reglnum + reg_firstlnum
+				: (pos->lnum
+					   < rex->reglnum + rex->reg_firstlnum
 				    ? cmp != '>'
 				    : cmp != '<')))
 		    status = RA_NOMATCH;
@@ -3971,14 +4485,14 @@ regmatch(scan)
 #ifdef FEAT_VISUAL
 	    /* Check if the buffer is the current buffer. and whether the
 	     * position is inside the Visual area. */
-	    if (reg_buf != curbuf || VIsual.lnum == 0)
+	    if (rex->reg_buf != curbuf || VIsual.lnum == 0)
 		status = RA_NOMATCH;
 	    else
 	    {
 		pos_T	    top, bot;
 		linenr_T    lnum;
 		colnr_T	    col;
-		win_T	    *wp = reg_win == NULL ? curwin : reg_win;
+		win_T	    *wp = rex->reg_win == NULL ? curwin : rex->reg_win;
 		int	    mode;
 
 		if (VIsual_active)
@@ -4009,8 +4523,8 @@ regmatch(scan)
 		    }
 		    mode = curbuf->b_visual.vi_mode;
 		}
-		lnum = reglnum + reg_firstlnum;
-		col = (colnr_T)(reginput - regline);
+		lnum = rex->reglnum + rex->reg_firstlnum;
+		col = (colnr_T)(rex->reginput - rex->regline);
 		if (lnum < top.lnum || lnum > bot.lnum)
 		    status = RA_NOMATCH;
 		else if (mode == 'v')
@@ -4035,7 +4549,7 @@ regmatch(scan)
 		    if (top.col == MAXCOL || bot.col == MAXCOL)
 			end = MAXCOL;
 		    cols = win_linetabsize(wp,
-				      regline, (colnr_T)(reginput - regline));
+			rex->regline, (colnr_T)(rex->reginput - rex->regline));
 		    if (cols < start || cols > end - (*p_sel == 'e'))
 			status = RA_NOMATCH;
 		}
@@ -4046,20 +4560,22 @@ regmatch(scan)
 	    break;
 
 	  case RE_LNUM:
-	    if (!REG_MULTI || !re_num_cmp((long_u)(reglnum + reg_firstlnum),
-									scan))
+	    if (!REG_MULTI || !re_num_cmp((long_u)(rex->reglnum
+						  + rex->reg_firstlnum), scan))
 		status = RA_NOMATCH;
 	    break;
 
 	  case RE_COL:
-	    if (!re_num_cmp((long_u)(reginput - regline) + 1, scan))
+	    if (!re_num_cmp((long_u)(rex->reginput - rex->regline) + 1, scan))
 		status = RA_NOMATCH;
 	    break;
 
 	  case RE_VCOL:
 	    if (!re_num_cmp((long_u)win_linetabsize(
-			    reg_win == NULL ? curwin : reg_win,
-			    regline, (colnr_T)(reginput - regline)) + 1, scan))
+			    rex->reg_win == NULL ? curwin : rex->reg_win,
+			    rex->regline,
+			    (colnr_T)(rex->reginput - rex->regline)) + 1,
+									scan))
 		status = RA_NOMATCH;
 	    break;
 
@@ -4072,23 +4588,24 @@ regmatch(scan)
 		int this_class;
 
 		/* Get class of current and previous char (if it exists). */
-		this_class = mb_get_class(reginput);
+		this_class = mb_get_class(rex->reginput);
 		if (this_class <= 1)
 		    status = RA_NOMATCH;  /* not on a word at all */
-		else if (reg_prev_class() == this_class)
+		else if (reg_prev_class(rex) == this_class)
 		    status = RA_NOMATCH;  /* previous char is in same word */
 	    }
 #endif
 	    else
 	    {
-		if (!vim_iswordc(c)
-			|| (reginput > regline && vim_iswordc(reginput[-1])))
+		if (!vim_iswordc(c) || (rex->reginput > rex->regline
+					    && vim_iswordc(rex->reginput[-1])))
 		    status = RA_NOMATCH;
 	    }
 	    break;
 
 	  case EOW:	/* word\>; reginput points after d */
-	    if (reginput == regline)    /* Can't match at start of line */
+	    /* Can't match at start of line */
+	    if (rex->reginput == rex->regline)
 		status = RA_NOMATCH;
 #ifdef FEAT_MBYTE
 	    else if (has_mbyte)
@@ -4096,8 +4613,8 @@ regmatch(scan)
 		int this_class, prev_class;
 
 		/* Get class of current and previous char (if it exists). */
-		this_class = mb_get_class(reginput);
-		prev_class = reg_prev_class();
+		this_class = mb_get_class(rex->reginput);
+		prev_class = reg_prev_class(rex);
 		if (this_class == prev_class
 			|| prev_class == 0 || prev_class == 1)
 		    status = RA_NOMATCH;
@@ -4105,8 +4622,8 @@ regmatch(scan)
 #endif
 	    else
 	    {
-		if (!vim_iswordc(reginput[-1])
-			|| (reginput[0] != NUL && vim_iswordc(c)))
+		if (!vim_iswordc(rex->reginput[-1])
+			|| (rex->reginput[0] != NUL && vim_iswordc(c)))
 		    status = RA_NOMATCH;
 	    }
 	    break; /* Matched with EOW */
@@ -4126,21 +4643,21 @@ regmatch(scan)
 	    break;
 
 	  case SIDENT:
-	    if (VIM_ISDIGIT(*reginput) || !vim_isIDc(c))
+	    if (VIM_ISDIGIT(*rex->reginput) || !vim_isIDc(c))
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
 	    break;
 
 	  case KWORD:
-	    if (!vim_iswordp(reginput))
+	    if (!vim_iswordp(rex->reginput))
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
 	    break;
 
 	  case SKWORD:
-	    if (VIM_ISDIGIT(*reginput) || !vim_iswordp(reginput))
+	    if (VIM_ISDIGIT(*rex->reginput) || !vim_iswordp(rex->reginput))
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
@@ -4154,21 +4671,21 @@ regmatch(scan)
 	    break;
 
 	  case SFNAME:
-	    if (VIM_ISDIGIT(*reginput) || !vim_isfilec(c))
+	    if (VIM_ISDIGIT(*rex->reginput) || !vim_isfilec(c))
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
 	    break;
 
 	  case PRINT:
-	    if (ptr2cells(reginput) != 1)
+	    if (ptr2cells(rex->reginput) != 1)
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
 	    break;
 
 	  case SPRINT:
-	    if (VIM_ISDIGIT(*reginput) || ptr2cells(reginput) != 1)
+	    if (VIM_ISDIGIT(*rex->reginput) || ptr2cells(rex->reginput) != 1)
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
@@ -4307,12 +4824,12 @@ regmatch(scan)
 
 		opnd = OPERAND(scan);
 		/* Inline the first byte, for speed. */
-		if (*opnd != *reginput
-			&& (!ireg_ic || (
+		if (*opnd != *rex->reginput
+			&& (!rex->ireg_ic || (
 #ifdef FEAT_MBYTE
 			    !enc_utf8 &&
 #endif
-			    MB_TOLOWER(*opnd) != MB_TOLOWER(*reginput))))
+			    MB_TOLOWER(*opnd) != MB_TOLOWER(*rex->reginput))))
 		    status = RA_NOMATCH;
 		else if (*opnd == NUL)
 		{
@@ -4321,30 +4838,30 @@ regmatch(scan)
 		}
 		else if (opnd[1] == NUL
 #ifdef FEAT_MBYTE
-			    && !(enc_utf8 && ireg_ic)
+			    && !(enc_utf8 && rex->ireg_ic)
 #endif
 			)
-		    ++reginput;		/* matched a single char */
+		    ++rex->reginput;		/* matched a single char */
 		else
 		{
 		    len = (int)STRLEN(opnd);
 		    /* Need to match first byte again for multi-byte. */
-		    if (cstrncmp(opnd, reginput, &len) != 0)
+		    if (cstrncmp(rex, opnd, rex->reginput, &len) != 0)
 			status = RA_NOMATCH;
 #ifdef FEAT_MBYTE
 		    /* Check for following composing character. */
-		    else if (enc_utf8
-			       && UTF_COMPOSINGLIKE(reginput, reginput + len))
+		    else if (enc_utf8 && UTF_COMPOSINGLIKE(rex->reginput,
+						     rex->reginput + len))
 		    {
 			/* raaron: This code makes a composing character get
 			 * ignored, which is the correct behavior (sometimes)
 			 * for voweled Hebrew texts. */
-			if (!ireg_icombine)
+			if (!rex->ireg_icombine)
 			    status = RA_NOMATCH;
 		    }
 #endif
 		    else
-			reginput += len;
+			rex->reginput += len;
 		}
 	    }
 	    break;
@@ -4353,7 +4870,7 @@ regmatch(scan)
 	  case ANYBUT:
 	    if (c == NUL)
 		status = RA_NOMATCH;
-	    else if ((cstrchr(OPERAND(scan), c) == NULL) == (op == ANYOF))
+	    else if ((cstrchr(rex, OPERAND(scan), c) == NULL) == (op == ANYOF))
 		status = RA_NOMATCH;
 	    else
 		ADVANCE_REGINPUT();
@@ -4382,9 +4899,10 @@ regmatch(scan)
 		    /* When only a composing char is given match at any
 		     * position where that composing char appears. */
 		    status = RA_NOMATCH;
-		    for (i = 0; reginput[i] != NUL; i += utf_char2len(inpc))
+		    for (i = 0; rex->reginput[i] != NUL;
+						       i += utf_char2len(inpc))
 		    {
-			inpc = mb_ptr2char(reginput + i);
+			inpc = mb_ptr2char(rex->reginput + i);
 			if (!utf_iscomposing(inpc))
 			{
 			    if (i > 0)
@@ -4393,7 +4911,7 @@ regmatch(scan)
 			else if (opndc == inpc)
 			{
 			    /* Include all following composing chars. */
-			    len = i + mb_ptr2len(reginput + i);
+			    len = i + mb_ptr2len(rex->reginput + i);
 			    status = RA_MATCH;
 			    break;
 			}
@@ -4401,12 +4919,12 @@ regmatch(scan)
 		}
 		else
 		    for (i = 0; i < len; ++i)
-			if (opnd[i] != reginput[i])
+			if (opnd[i] != rex->reginput[i])
 			{
 			    status = RA_NOMATCH;
 			    break;
 			}
-		reginput += len;
+		rex->reginput += len;
 	    }
 	    else
 		status = RA_NOMATCH;
@@ -4429,29 +4947,29 @@ regmatch(scan)
 		 * The positions are stored in "backpos" and found by the
 		 * current value of "scan", the position in the RE program.
 		 */
-		bp = (backpos_T *)backpos.ga_data;
-		for (i = 0; i < backpos.ga_len; ++i)
+		bp = (backpos_T *)rex->backpos.ga_data;
+		for (i = 0; i < rex->backpos.ga_len; ++i)
 		    if (bp[i].bp_scan == scan)
 			break;
-		if (i == backpos.ga_len)
+		if (i == rex->backpos.ga_len)
 		{
 		    /* First time at this BACK, make room to store the pos. */
-		    if (ga_grow(&backpos, 1) == FAIL)
+		    if (ga_grow(&rex->backpos, 1) == FAIL)
 			status = RA_FAIL;
 		    else
 		    {
 			/* get "ga_data" again, it may have changed */
-			bp = (backpos_T *)backpos.ga_data;
+			bp = (backpos_T *)rex->backpos.ga_data;
 			bp[i].bp_scan = scan;
-			++backpos.ga_len;
+			++rex->backpos.ga_len;
 		    }
 		}
-		else if (reg_save_equal(&bp[i].bp_pos))
+		else if (reg_save_equal(rex, &bp[i].bp_pos))
 		    /* Still at same position as last time, fail. */
 		    status = RA_NOMATCH;
 
 		if (status != RA_FAIL && status != RA_NOMATCH)
-		    reg_save(&bp[i].bp_pos, &backpos);
+		    reg_save(rex, &bp[i].bp_pos, &rex->backpos);
 	    }
 	    break;
 
@@ -4467,15 +4985,15 @@ regmatch(scan)
 	  case MOPEN + 9:
 	    {
 		no = op - MOPEN;
-		cleanup_subexpr();
-		rp = regstack_push(RS_MOPEN, scan);
+		cleanup_subexpr(rex);
+		rp = regstack_push(rex, RS_MOPEN, scan);
 		if (rp == NULL)
 		    status = RA_FAIL;
 		else
 		{
 		    rp->rs_no = no;
-		    save_se(&rp->rs_un.sesave, &reg_startpos[no],
-							     &reg_startp[no]);
+		    save_se(&rp->rs_un.sesave, &rex->reg_startpos[no],
+							 &rex->reg_startp[no]);
 		    /* We simply continue and handle the result when done. */
 		}
 	    }
@@ -4483,7 +5001,7 @@ regmatch(scan)
 
 	  case NOPEN:	    /* \%( */
 	  case NCLOSE:	    /* \) after \%( */
-		if (regstack_push(RS_NOPEN, scan) == NULL)
+		if (regstack_push(rex, RS_NOPEN, scan) == NULL)
 		    status = RA_FAIL;
 		/* We simply continue and handle the result when done. */
 		break;
@@ -4500,15 +5018,15 @@ regmatch(scan)
 	  case ZOPEN + 9:
 	    {
 		no = op - ZOPEN;
-		cleanup_zsubexpr();
-		rp = regstack_push(RS_ZOPEN, scan);
+		cleanup_zsubexpr(rex);
+		rp = regstack_push(rex, RS_ZOPEN, scan);
 		if (rp == NULL)
 		    status = RA_FAIL;
 		else
 		{
 		    rp->rs_no = no;
-		    save_se(&rp->rs_un.sesave, &reg_startzpos[no],
-							     &reg_startzp[no]);
+		    save_se(&rp->rs_un.sesave, &rex->reg_startzpos[no],
+							&rex->reg_startzp[no]);
 		    /* We simply continue and handle the result when done. */
 		}
 	    }
@@ -4527,14 +5045,15 @@ regmatch(scan)
 	  case MCLOSE + 9:
 	    {
 		no = op - MCLOSE;
-		cleanup_subexpr();
-		rp = regstack_push(RS_MCLOSE, scan);
+		cleanup_subexpr(rex);
+		rp = regstack_push(rex, RS_MCLOSE, scan);
 		if (rp == NULL)
 		    status = RA_FAIL;
 		else
 		{
 		    rp->rs_no = no;
-		    save_se(&rp->rs_un.sesave, &reg_endpos[no], &reg_endp[no]);
+		    save_se(&rp->rs_un.sesave, &rex->reg_endpos[no],
+							   &rex->reg_endp[no]);
 		    /* We simply continue and handle the result when done. */
 		}
 	    }
@@ -4552,15 +5071,15 @@ regmatch(scan)
 	  case ZCLOSE + 9:
 	    {
 		no = op - ZCLOSE;
-		cleanup_zsubexpr();
-		rp = regstack_push(RS_ZCLOSE, scan);
+		cleanup_zsubexpr(rex);
+		rp = regstack_push(rex, RS_ZCLOSE, scan);
 		if (rp == NULL)
 		    status = RA_FAIL;
 		else
 		{
 		    rp->rs_no = no;
-		    save_se(&rp->rs_un.sesave, &reg_endzpos[no],
-							      &reg_endzp[no]);
+		    save_se(&rp->rs_un.sesave, &rex->reg_endzpos[no],
+							  &rex->reg_endzp[no]);
 		    /* We simply continue and handle the result when done. */
 		}
 	    }
@@ -4583,10 +5102,11 @@ regmatch(scan)
 		char_u		*p;
 
 		no = op - BACKREF;
-		cleanup_subexpr();
+		cleanup_subexpr(rex);
 		if (!REG_MULTI)		/* Single-line regexp */
 		{
-		    if (reg_startp[no] == NULL || reg_endp[no] == NULL)
+		    if (rex->reg_startp[no] == NULL
+					       || rex->reg_endp[no] == NULL)
 		    {
 			/* Backref was not set: Match an empty string. */
 			len = 0;
@@ -4595,83 +5115,88 @@ regmatch(scan)
 		    {
 			/* Compare current input with back-ref in the same
 			 * line. */
-			len = (int)(reg_endp[no] - reg_startp[no]);
-			if (cstrncmp(reg_startp[no], reginput, &len) != 0)
+			len = (int)(rex->reg_endp[no] - rex->reg_startp[no]);
+			if (cstrncmp(rex, rex->reg_startp[no], rex->reginput,
+								    &len) != 0)
 			    status = RA_NOMATCH;
 		    }
 		}
 		else				/* Multi-line regexp */
 		{
-		    if (reg_startpos[no].lnum < 0 || reg_endpos[no].lnum < 0)
+		    if (rex->reg_startpos[no].lnum < 0
+					       || rex->reg_endpos[no].lnum < 0)
 		    {
 			/* Backref was not set: Match an empty string. */
 			len = 0;
 		    }
 		    else
 		    {
-			if (reg_startpos[no].lnum == reglnum
-				&& reg_endpos[no].lnum == reglnum)
+			if (rex->reg_startpos[no].lnum == rex->reglnum
+				&& rex->reg_endpos[no].lnum == rex->reglnum)
 			{
 			    /* Compare back-ref within the current line. */
-			    len = reg_endpos[no].col - reg_startpos[no].col;
-			    if (cstrncmp(regline + reg_startpos[no].col,
-							  reginput, &len) != 0)
+			    len = rex->reg_endpos[no].col
+						   - rex->reg_startpos[no].col;
+			    if (cstrncmp(rex, rex->regline
+						   + rex->reg_startpos[no].col,
+						     rex->reginput, &len) != 0)
 				status = RA_NOMATCH;
 			}
 			else
 			{
 			    /* Messy situation: Need to compare between two
 			     * lines. */
-			    ccol = reg_startpos[no].col;
-			    clnum = reg_startpos[no].lnum;
+			    ccol = rex->reg_startpos[no].col;
+			    clnum = rex->reg_startpos[no].lnum;
 			    for (;;)
 			    {
 				/* Since getting one line may invalidate
 				 * the other, need to make copy.  Slow! */
-				if (regline != reg_tofree)
+				if (rex->regline != rex->reg_tofree)
 				{
-				    len = (int)STRLEN(regline);
-				    if (reg_tofree == NULL
-						 || len >= (int)reg_tofreelen)
+				    len = (int)STRLEN(rex->regline);
+				    if (rex->reg_tofree == NULL
+					     || len >= (int)rex->reg_tofreelen)
 				    {
 					len += 50;	/* get some extra */
-					vim_free(reg_tofree);
-					reg_tofree = alloc(len);
-					if (reg_tofree == NULL)
+					vim_free(rex->reg_tofree);
+					rex->reg_tofree = alloc(len);
+					if (rex->reg_tofree == NULL)
 					{
 					    status = RA_FAIL; /* outof memory!*/
 					    break;
 					}
-					reg_tofreelen = len;
+					rex->reg_tofreelen = len;
 				    }
-				    STRCPY(reg_tofree, regline);
-				    reginput = reg_tofree
-						       + (reginput - regline);
-				    regline = reg_tofree;
+				    STRCPY(rex->reg_tofree, rex->regline);
+				    rex->reginput = rex->reg_tofree
+					      + (rex->reginput - rex->regline);
+				    rex->regline = rex->reg_tofree;
 				}
 
 				/* Get the line to compare with. */
-				p = reg_getline(clnum);
-				if (clnum == reg_endpos[no].lnum)
-				    len = reg_endpos[no].col - ccol;
+				p = reg_getline(rex, clnum);
+				if (clnum == rex->reg_endpos[no].lnum)
+				    len = rex->reg_endpos[no].col - ccol;
 				else
 				    len = (int)STRLEN(p + ccol);
 
-				if (cstrncmp(p + ccol, reginput, &len) != 0)
+				if (cstrncmp(rex, p + ccol, rex->reginput,
+								    &len) != 0)
 				{
 				    status = RA_NOMATCH;  /* doesn't match */
 				    break;
 				}
-				if (clnum == reg_endpos[no].lnum)
+				if (clnum == rex->reg_endpos[no].lnum)
 				    break;		/* match and at end! */
-				if (reglnum >= reg_maxline)
+				if (rex->reglnum >= rex->reg_maxline)
 				{
 				    status = RA_NOMATCH;  /* text too short */
 				    break;
 				}
 
 				/* Advance to next line. */
-				reg_nextline();
+				reg_nextline(rex);
 				++clnum;
 				ccol = 0;
 				if (got_int)
@@ -4688,7 +5213,7 @@ regmatch(scan)
 		}
 
 		/* Matched the backref, skip over it. */
-		reginput += len;
+		rex->reginput += len;
 	    }
 	    break;
 
@@ -4705,17 +5230,17 @@ regmatch(scan)
 	    {
 		int	len;
 
-		cleanup_zsubexpr();
+		cleanup_zsubexpr(rex);
 		no = op - ZREF;
 		if (re_extmatch_in != NULL
 			&& re_extmatch_in->matches[no] != NULL)
 		{
 		    len = (int)STRLEN(re_extmatch_in->matches[no]);
-		    if (cstrncmp(re_extmatch_in->matches[no],
-							  reginput, &len) != 0)
+		    if (cstrncmp(rex, re_extmatch_in->matches[no],
+						     rex->reginput, &len) != 0)
 			status = RA_NOMATCH;
 		    else
-			reginput += len;
+			rex->reginput += len;
 		}
 		else
 		{
@@ -4731,7 +5256,7 @@ regmatch(scan)
 		    next = OPERAND(scan);	/* Avoid recursion. */
 		else
 		{
-		    rp = regstack_push(RS_BRANCH, scan);
+		    rp = regstack_push(rex, RS_BRANCH, scan);
 		    if (rp == NULL)
 			status = RA_FAIL;
 		    else
@@ -4744,16 +5269,16 @@ regmatch(scan)
 	    {
 		if (OP(next) == BRACE_SIMPLE)
 		{
-		    bl_minval = OPERAND_MIN(scan);
-		    bl_maxval = OPERAND_MAX(scan);
+		    rex->bl_minval = OPERAND_MIN(scan);
+		    rex->bl_maxval = OPERAND_MAX(scan);
 		}
 		else if (OP(next) >= BRACE_COMPLEX
 			&& OP(next) < BRACE_COMPLEX + 10)
 		{
 		    no = OP(next) - BRACE_COMPLEX;
-		    brace_min[no] = OPERAND_MIN(scan);
-		    brace_max[no] = OPERAND_MAX(scan);
-		    brace_count[no] = 0;
+		    rex->brace_min[no] = OPERAND_MIN(scan);
+		    rex->brace_max[no] = OPERAND_MAX(scan);
+		    rex->brace_count[no] = 0;
 		}
 		else
 		{
@@ -4775,19 +5300,20 @@ regmatch(scan)
 	  case BRACE_COMPLEX + 9:
 	    {
 		no = op - BRACE_COMPLEX;
-		++brace_count[no];
+		++rex->brace_count[no];
 
 		/* If not matched enough times yet, try one more */
-		if (brace_count[no] <= (brace_min[no] <= brace_max[no]
-					     ? brace_min[no] : brace_max[no]))
+		if (rex->brace_count[no]
+			     <= (rex->brace_min[no] <= rex->brace_max[no]
+				    ? rex->brace_min[no] : rex->brace_max[no]))
 		{
-		    rp = regstack_push(RS_BRCPLX_MORE, scan);
+		    rp = regstack_push(rex, RS_BRCPLX_MORE, scan);
 		    if (rp == NULL)
 			status = RA_FAIL;
 		    else
 		    {
 			rp->rs_no = no;
-			reg_save(&rp->rs_un.regsave, &backpos);
+			reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 			next = OPERAND(scan);
 			/* We continue and handle the result when done. */
 		    }
@@ -4795,18 +5321,18 @@ regmatch(scan)
 		}
 
 		/* If matched enough times, may try matching some more */
-		if (brace_min[no] <= brace_max[no])
+		if (rex->brace_min[no] <= rex->brace_max[no])
 		{
 		    /* Range is the normal way around, use longest match */
-		    if (brace_count[no] <= brace_max[no])
+		    if (rex->brace_count[no] <= rex->brace_max[no])
 		    {
-			rp = regstack_push(RS_BRCPLX_LONG, scan);
+			rp = regstack_push(rex, RS_BRCPLX_LONG, scan);
 			if (rp == NULL)
 			    status = RA_FAIL;
 			else
 			{
 			    rp->rs_no = no;
-			    reg_save(&rp->rs_un.regsave, &backpos);
+			    reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 			    next = OPERAND(scan);
 			    /* We continue and handle the result when done. */
 			}
@@ -4815,14 +5341,14 @@ regmatch(scan)
 		else
 		{
 		    /* Range is backwards, use shortest match first */
-		    if (brace_count[no] <= brace_min[no])
+		    if (rex->brace_count[no] <= rex->brace_min[no])
 		    {
-			rp = regstack_push(RS_BRCPLX_SHORT, scan);
+			rp = regstack_push(rex, RS_BRCPLX_SHORT, scan);
 			if (rp == NULL)
 			    status = RA_FAIL;
 			else
 			{
-			    reg_save(&rp->rs_un.regsave, &backpos);
+			    reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 			    /* We continue and handle the result when done. */
 			}
 		    }
@@ -4843,7 +5369,7 @@ regmatch(scan)
 		if (OP(next) == EXACTLY)
 		{
 		    rst.nextb = *OPERAND(next);
-		    if (ireg_ic)
+		    if (rex->ireg_ic)
 		    {
 			if (MB_ISUPPER(rst.nextb))
 			    rst.nextb_ic = MB_TOLOWER(rst.nextb);
@@ -4865,8 +5391,8 @@ regmatch(scan)
 		}
 		else
 		{
-		    rst.minval = bl_minval;
-		    rst.maxval = bl_maxval;
+		    rst.minval = rex->bl_minval;
+		    rst.maxval = rex->bl_maxval;
 		}
 
 		/*
@@ -4875,7 +5401,7 @@ regmatch(scan)
 		 * minimal number (since the range is backwards, that's also
 		 * maxval!).
 		 */
-		rst.count = regrepeat(OPERAND(scan), rst.maxval);
+		rst.count = regrepeat(rex, OPERAND(scan), rst.maxval);
 		if (got_int)
 		{
 		    status = RA_FAIL;
@@ -4887,17 +5413,18 @@ regmatch(scan)
 		    /* It could match.  Prepare for trying to match what
 		     * follows.  The code is below.  Parameters are stored in
 		     * a regstar_T on the regstack. */
-		    if ((long)((unsigned)regstack.ga_len >> 10) >= p_mmp)
+		    if ((long)((unsigned)rex->regstack.ga_len >> 10) >= p_mmp)
 		    {
 			EMSG(_(e_maxmempat));
 			status = RA_FAIL;
 		    }
-		    else if (ga_grow(&regstack, sizeof(regstar_T)) == FAIL)
+		    else if (ga_grow(&rex->regstack, sizeof(regstar_T))
+								      == FAIL)
 			status = RA_FAIL;
 		    else
 		    {
-			regstack.ga_len += sizeof(regstar_T);
-			rp = regstack_push(rst.minval <= rst.maxval
+			rex->regstack.ga_len += sizeof(regstar_T);
+			rp = regstack_push(rex, rst.minval <= rst.maxval
 					? RS_STAR_LONG : RS_STAR_SHORT, scan);
 			if (rp == NULL)
 			    status = RA_FAIL;
@@ -4917,13 +5444,13 @@ regmatch(scan)
 	  case NOMATCH:
 	  case MATCH:
 	  case SUBPAT:
-	    rp = regstack_push(RS_NOMATCH, scan);
+	    rp = regstack_push(rex, RS_NOMATCH, scan);
 	    if (rp == NULL)
 		status = RA_FAIL;
 	    else
 	    {
 		rp->rs_no = op;
-		reg_save(&rp->rs_un.regsave, &backpos);
+		reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 		next = OPERAND(scan);
 		/* We continue and handle the result when done. */
 	    }
@@ -4932,27 +5459,27 @@ regmatch(scan)
 	  case BEHIND:
 	  case NOBEHIND:
 	    /* Need a bit of room to store extra positions. */
-	    if ((long)((unsigned)regstack.ga_len >> 10) >= p_mmp)
+	    if ((long)((unsigned)rex->regstack.ga_len >> 10) >= p_mmp)
 	    {
 		EMSG(_(e_maxmempat));
 		status = RA_FAIL;
 	    }
-	    else if (ga_grow(&regstack, sizeof(regbehind_T)) == FAIL)
+	    else if (ga_grow(&rex->regstack, sizeof(regbehind_T)) == FAIL)
 		status = RA_FAIL;
 	    else
 	    {
-		regstack.ga_len += sizeof(regbehind_T);
-		rp = regstack_push(RS_BEHIND1, scan);
+		rex->regstack.ga_len += sizeof(regbehind_T);
+		rp = regstack_push(rex, RS_BEHIND1, scan);
 		if (rp == NULL)
 		    status = RA_FAIL;
 		else
 		{
 		    /* Need to save the subexpr to be able to restore them
 		     * when there is a match but we don't use it. */
-		    save_subexpr(((regbehind_T *)rp) - 1);
+		    save_subexpr(rex, ((regbehind_T *)rp) - 1);
 
 		    rp->rs_no = op;
-		    reg_save(&rp->rs_un.regsave, &backpos);
+		    reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 		    /* First try if what follows matches.  If it does then we
 		     * check the behind match by looping. */
 		}
@@ -4962,22 +5489,23 @@ regmatch(scan)
 	  case BHPOS:
 	    if (REG_MULTI)
 	    {
-		if (behind_pos.rs_u.pos.col != (colnr_T)(reginput - regline)
-			|| behind_pos.rs_u.pos.lnum != reglnum)
+		if (rex->behind_pos.rs_u.pos.col
+				     != (colnr_T)(rex->reginput - rex->regline)
+			|| rex->behind_pos.rs_u.pos.lnum != rex->reglnum)
 		    status = RA_NOMATCH;
 	    }
-	    else if (behind_pos.rs_u.ptr != reginput)
+	    else if (rex->behind_pos.rs_u.ptr != rex->reginput)
 		status = RA_NOMATCH;
 	    break;
 
 	  case NEWL:
-	    if ((c != NUL || !REG_MULTI || reglnum > reg_maxline
-			     || reg_line_lbr) && (c != '\n' || !reg_line_lbr))
+	    if ((c != NUL || !REG_MULTI || rex->reglnum > rex->reg_maxline
+		    || rex->reg_line_lbr) && (c != '\n' || !rex->reg_line_lbr))
 		status = RA_NOMATCH;
-	    else if (reg_line_lbr)
+	    else if (rex->reg_line_lbr)
 		ADVANCE_REGINPUT();
 	    else
-		reg_nextline();
+		reg_nextline(rex);
 	    break;
 
 	  case END:
@@ -5007,75 +5535,76 @@ regmatch(scan)
      * If there is something on the regstack execute the code for the state.
      * If the state is popped then loop and use the older state.
      */
-    while (regstack.ga_len > 0 && status != RA_FAIL)
+    while (rex->regstack.ga_len > 0 && status != RA_FAIL)
     {
-	rp = (regitem_T *)((char *)regstack.ga_data + regstack.ga_len) - 1;
+	rp = (regitem_T *)((char *)rex->regstack.ga_data
+						   + rex->regstack.ga_len) - 1;
 	switch (rp->rs_state)
 	{
 	  case RS_NOPEN:
 	    /* Result is passed on as-is, simply pop the state. */
-	    regstack_pop(&scan);
+	    regstack_pop(rex, &scan);
 	    break;
 
 	  case RS_MOPEN:
 	    /* Pop the state.  Restore pointers when there is no match. */
 	    if (status == RA_NOMATCH)
-		restore_se(&rp->rs_un.sesave, &reg_startpos[rp->rs_no],
-						  &reg_startp[rp->rs_no]);
-	    regstack_pop(&scan);
+		restore_se(&rp->rs_un.sesave, &rex->reg_startpos[rp->rs_no],
+						  &rex->reg_startp[rp->rs_no]);
+	    regstack_pop(rex, &scan);
 	    break;
 
 #ifdef FEAT_SYN_HL
 	  case RS_ZOPEN:
 	    /* Pop the state.  Restore pointers when there is no match. */
 	    if (status == RA_NOMATCH)
-		restore_se(&rp->rs_un.sesave, &reg_startzpos[rp->rs_no],
-						 &reg_startzp[rp->rs_no]);
-	    regstack_pop(&scan);
+		restore_se(&rp->rs_un.sesave, &rex->reg_startzpos[rp->rs_no],
+						 &rex->reg_startzp[rp->rs_no]);
+	    regstack_pop(rex, &scan);
 	    break;
 #endif
 
 	  case RS_MCLOSE:
 	    /* Pop the state.  Restore pointers when there is no match. */
 	    if (status == RA_NOMATCH)
-		restore_se(&rp->rs_un.sesave, &reg_endpos[rp->rs_no],
-						    &reg_endp[rp->rs_no]);
-	    regstack_pop(&scan);
+		restore_se(&rp->rs_un.sesave, &rex->reg_endpos[rp->rs_no],
+						    &rex->reg_endp[rp->rs_no]);
+	    regstack_pop(rex, &scan);
 	    break;
 
 #ifdef FEAT_SYN_HL
 	  case RS_ZCLOSE:
 	    /* Pop the state.  Restore pointers when there is no match. */
 	    if (status == RA_NOMATCH)
-		restore_se(&rp->rs_un.sesave, &reg_endzpos[rp->rs_no],
-						   &reg_endzp[rp->rs_no]);
-	    regstack_pop(&scan);
+		restore_se(&rp->rs_un.sesave, &rex->reg_endzpos[rp->rs_no],
+						   &rex->reg_endzp[rp->rs_no]);
+	    regstack_pop(rex, &scan);
 	    break;
 #endif
 
 	  case RS_BRANCH:
 	    if (status == RA_MATCH)
 		/* this branch matched, use it */
-		regstack_pop(&scan);
+		regstack_pop(rex, &scan);
 	    else
 	    {
 		if (status != RA_BREAK)
 		{
 		    /* After a non-matching branch: try next one. */
-		    reg_restore(&rp->rs_un.regsave, &backpos);
+		    reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
 		    scan = rp->rs_scan;
 		}
 		if (scan == NULL || OP(scan) != BRANCH)
 		{
 		    /* no more branches, didn't find a match */
 		    status = RA_NOMATCH;
-		    regstack_pop(&scan);
+		    regstack_pop(rex, &scan);
 		}
 		else
 		{
 		    /* Prepare to try a branch. */
 		    rp->rs_scan = regnext(scan);
-		    reg_save(&rp->rs_un.regsave, &backpos);
+		    reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 		    scan = OPERAND(scan);
 		}
 	    }
@@ -5085,10 +5614,10 @@ regmatch(scan)
 	    /* Pop the state.  Restore pointers when there is no match. */
 	    if (status == RA_NOMATCH)
 	    {
-		reg_restore(&rp->rs_un.regsave, &backpos);
-		--brace_count[rp->rs_no];	/* decrement match count */
+		reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
+		--rex->brace_count[rp->rs_no];	/* decrement match count */
 	    }
-	    regstack_pop(&scan);
+	    regstack_pop(rex, &scan);
 	    break;
 
 	  case RS_BRCPLX_LONG:
@@ -5096,12 +5625,12 @@ regmatch(scan)
 	    if (status == RA_NOMATCH)
 	    {
 		/* There was no match, but we did find enough matches. */
-		reg_restore(&rp->rs_un.regsave, &backpos);
-		--brace_count[rp->rs_no];
+		reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
+		--rex->brace_count[rp->rs_no];
 		/* continue with the items after "\{}" */
 		status = RA_CONT;
 	    }
-	    regstack_pop(&scan);
+	    regstack_pop(rex, &scan);
 	    if (status == RA_CONT)
 		scan = regnext(scan);
 	    break;
@@ -5110,8 +5639,8 @@ regmatch(scan)
 	    /* Pop the state.  Restore pointers when there is no match. */
 	    if (status == RA_NOMATCH)
 		/* There was no match, try to match one more item. */
-		reg_restore(&rp->rs_un.regsave, &backpos);
-	    regstack_pop(&scan);
+		reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
+	    regstack_pop(rex, &scan);
 	    if (status == RA_NOMATCH)
 	    {
 		scan = OPERAND(scan);
@@ -5129,9 +5658,9 @@ regmatch(scan)
 	    {
 		status = RA_CONT;
 		if (rp->rs_no != SUBPAT)	/* zero-width */
-		    reg_restore(&rp->rs_un.regsave, &backpos);
+		    reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
 	    }
-	    regstack_pop(&scan);
+	    regstack_pop(rex, &scan);
 	    if (status == RA_CONT)
 		scan = regnext(scan);
 	    break;
@@ -5139,8 +5668,8 @@ regmatch(scan)
 	  case RS_BEHIND1:
 	    if (status == RA_NOMATCH)
 	    {
-		regstack_pop(&scan);
-		regstack.ga_len -= sizeof(regbehind_T);
+		regstack_pop(rex, &scan);
+		rex->regstack.ga_len -= sizeof(regbehind_T);
 	    }
 	    else
 	    {
@@ -5151,7 +5680,8 @@ regmatch(scan)
 		 * the current position. */
 
 		/* save the position after the found match for next */
-		reg_save(&(((regbehind_T *)rp) - 1)->save_after, &backpos);
+		reg_save(rex, &(((regbehind_T *)rp) - 1)->save_after,
+								&rex->backpos);
 
 		/* start looking for a match with operand at the current
 		 * position.  Go back one character until we find the
@@ -5159,12 +5689,12 @@ regmatch(scan)
 		 * line (for multi-line matching).
 		 * Set behind_pos to where the match should end, BHPOS
 		 * will match it.  Save the current value. */
-		(((regbehind_T *)rp) - 1)->save_behind = behind_pos;
-		behind_pos = rp->rs_un.regsave;
+		(((regbehind_T *)rp) - 1)->save_behind = rex->behind_pos;
+		rex->behind_pos = rp->rs_un.regsave;
 
 		rp->rs_state = RS_BEHIND2;
 
-		reg_restore(&rp->rs_un.regsave, &backpos);
+		reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
 		scan = OPERAND(rp->rs_scan);
 	    }
 	    break;
@@ -5173,23 +5703,23 @@ regmatch(scan)
 	    /*
 	     * Looping for BEHIND / NOBEHIND match.
 	     */
-	    if (status == RA_MATCH && reg_save_equal(&behind_pos))
+	    if (status == RA_MATCH && reg_save_equal(rex, &rex->behind_pos))
 	    {
 		/* found a match that ends where "next" started */
-		behind_pos = (((regbehind_T *)rp) - 1)->save_behind;
+		rex->behind_pos = (((regbehind_T *)rp) - 1)->save_behind;
 		if (rp->rs_no == BEHIND)
-		    reg_restore(&(((regbehind_T *)rp) - 1)->save_after,
-								    &backpos);
+		    reg_restore(rex, &(((regbehind_T *)rp) - 1)->save_after,
+								&rex->backpos);
 		else
 		{
 		    /* But we didn't want a match.  Need to restore the
 		     * subexpr, because what follows matched, so they have
 		     * been set. */
 		    status = RA_NOMATCH;
-		    restore_subexpr(((regbehind_T *)rp) - 1);
+		    restore_subexpr(rex, ((regbehind_T *)rp) - 1);
 		}
-		regstack_pop(&scan);
-		regstack.ga_len -= sizeof(regbehind_T);
+		regstack_pop(rex, &scan);
+		rex->regstack.ga_len -= sizeof(regbehind_T);
 	    }
 	    else
 	    {
@@ -5201,16 +5731,17 @@ regmatch(scan)
 		    if (rp->rs_un.regsave.rs_u.pos.col == 0)
 		    {
 			if (rp->rs_un.regsave.rs_u.pos.lnum
-					< behind_pos.rs_u.pos.lnum
-				|| reg_getline(
+					< rex->behind_pos.rs_u.pos.lnum
+				|| reg_getline(rex, 
 					--rp->rs_un.regsave.rs_u.pos.lnum)
 								  == NULL)
 			    no = FAIL;
 			else
 			{
-			    reg_restore(&rp->rs_un.regsave, &backpos);
+			    reg_restore(rex, &rp->rs_un.regsave,
+								&rex->backpos);
 			    rp->rs_un.regsave.rs_u.pos.col =
-						 (colnr_T)STRLEN(regline);
+						 (colnr_T)STRLEN(rex->regline);
 			}
 		    }
 		    else
@@ -5218,7 +5749,7 @@ regmatch(scan)
 		}
 		else
 		{
-		    if (rp->rs_un.regsave.rs_u.ptr == regline)
+		    if (rp->rs_un.regsave.rs_u.ptr == rex->regline)
 			no = FAIL;
 		    else
 			--rp->rs_un.regsave.rs_u.ptr;
@@ -5226,24 +5757,25 @@ regmatch(scan)
 		if (no == OK)
 		{
 		    /* Advanced, prepare for finding match again. */
-		    reg_restore(&rp->rs_un.regsave, &backpos);
+		    reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
 		    scan = OPERAND(rp->rs_scan);
 		    if (status == RA_MATCH)
 		    {
 			/* We did match, so subexpr may have been changed,
 			 * need to restore them for the next try. */
 			status = RA_NOMATCH;
-			restore_subexpr(((regbehind_T *)rp) - 1);
+			restore_subexpr(rex, ((regbehind_T *)rp) - 1);
 		    }
 		}
 		else
 		{
 		    /* Can't advance.  For NOBEHIND that's a match. */
-		    behind_pos = (((regbehind_T *)rp) - 1)->save_behind;
+		    rex->behind_pos = (((regbehind_T *)rp) - 1)->save_behind;
 		    if (rp->rs_no == NOBEHIND)
 		    {
-			reg_restore(&(((regbehind_T *)rp) - 1)->save_after,
-								    &backpos);
+			reg_restore(rex,
+				     &(((regbehind_T *)rp) - 1)->save_after,
+								&rex->backpos);
 			status = RA_MATCH;
 		    }
 		    else
@@ -5254,11 +5786,11 @@ regmatch(scan)
 			if (status == RA_MATCH)
 			{
 			    status = RA_NOMATCH;
-			    restore_subexpr(((regbehind_T *)rp) - 1);
+			    restore_subexpr(rex, ((regbehind_T *)rp) - 1);
 			}
 		    }
-		    regstack_pop(&scan);
-		    regstack.ga_len -= sizeof(regbehind_T);
+		    regstack_pop(rex, &scan);
+		    rex->regstack.ga_len -= sizeof(regbehind_T);
 		}
 	    }
 	    break;
@@ -5270,14 +5802,14 @@ regmatch(scan)
 
 		if (status == RA_MATCH)
 		{
-		    regstack_pop(&scan);
-		    regstack.ga_len -= sizeof(regstar_T);
+		    regstack_pop(rex, &scan);
+		    rex->regstack.ga_len -= sizeof(regstar_T);
 		    break;
 		}
 
 		/* Tried once already, restore input pointers. */
 		if (status != RA_BREAK)
-		    reg_restore(&rp->rs_un.regsave, &backpos);
+		    reg_restore(rex, &rp->rs_un.regsave, &rex->backpos);
 
 		/* Repeat until we found a position where it could match. */
 		for (;;)
@@ -5291,20 +5823,21 @@ regmatch(scan)
 			     * didn't match -- back up one char. */
 			    if (--rst->count < rst->minval)
 				break;
-			    if (reginput == regline)
+			    if (rex->reginput == rex->regline)
 			    {
 				/* backup to last char of previous line */
-				--reglnum;
-				regline = reg_getline(reglnum);
+				--rex->reglnum;
+				rex->regline = reg_getline(rex, rex->reglnum);
 				/* Just in case regrepeat() didn't count
 				 * right. */
-				if (regline == NULL)
+				if (rex->regline == NULL)
 				    break;
-				reginput = regline + STRLEN(regline);
+				rex->reginput = rex->regline
+							+ STRLEN(rex->regline);
 				fast_breakcheck();
 			    }
 			    else
-				mb_ptr_back(regline, reginput);
+				mb_ptr_back(rex->regline, rex->reginput);
 			}
 			else
 			{
@@ -5313,7 +5846,8 @@ regmatch(scan)
 			     * Couldn't or didn't match: try advancing one
 			     * char. */
 			    if (rst->count == rst->minval
-				  || regrepeat(OPERAND(rp->rs_scan), 1L) == 0)
+				    || regrepeat(rex, OPERAND(rp->rs_scan), 1L)
+									  == 0)
 				break;
 			    ++rst->count;
 			}
@@ -5324,10 +5858,10 @@ regmatch(scan)
 			status = RA_NOMATCH;
 
 		    /* If it could match, try it. */
-		    if (rst->nextb == NUL || *reginput == rst->nextb
-					     || *reginput == rst->nextb_ic)
+		    if (rst->nextb == NUL || *rex->reginput == rst->nextb
+					    || *rex->reginput == rst->nextb_ic)
 		    {
-			reg_save(&rp->rs_un.regsave, &backpos);
+			reg_save(rex, &rp->rs_un.regsave, &rex->backpos);
 			scan = regnext(rp->rs_scan);
 			status = RA_CONT;
 			break;
@@ -5336,8 +5870,8 @@ regmatch(scan)
 		if (status != RA_CONT)
 		{
 		    /* Failed. */
-		    regstack_pop(&scan);
-		    regstack.ga_len -= sizeof(regstar_T);
+		    regstack_pop(rex, &scan);
+		    rex->regstack.ga_len -= sizeof(regstar_T);
 		    status = RA_NOMATCH;
 		}
 	    }
@@ -5347,7 +5881,7 @@ regmatch(scan)
 	/* If we want to continue the inner loop or didn't pop a state
 	 * continue matching loop */
 	if (status == RA_CONT || rp == (regitem_T *)
-			     ((char *)regstack.ga_data + regstack.ga_len) - 1)
+		    ((char *)rex->regstack.ga_data + rex->regstack.ga_len) - 1)
 	    break;
     }
 
@@ -5358,7 +5892,7 @@ regmatch(scan)
     /*
      * If the regstack is empty or something failed we are done.
      */
-    if (regstack.ga_len == 0 || status == RA_FAIL)
+    if (rex->regstack.ga_len == 0 || status == RA_FAIL)
     {
 	if (scan == NULL)
 	{
@@ -5386,25 +5920,26 @@ regmatch(scan)
  * Returns pointer to new item.  Returns NULL when out of memory.
  */
     static regitem_T *
-regstack_push(state, scan)
+regstack_push(rex, state, scan)
+    regexec_T	*rex;
     regstate_T	state;
     char_u	*scan;
 {
     regitem_T	*rp;
 
-    if ((long)((unsigned)regstack.ga_len >> 10) >= p_mmp)
+    if ((long)((unsigned)rex->regstack.ga_len >> 10) >= p_mmp)
     {
 	EMSG(_(e_maxmempat));
 	return NULL;
     }
-    if (ga_grow(&regstack, sizeof(regitem_T)) == FAIL)
+    if (ga_grow(&rex->regstack, sizeof(regitem_T)) == FAIL)
 	return NULL;
 
-    rp = (regitem_T *)((char *)regstack.ga_data + regstack.ga_len);
+    rp = (regitem_T *)((char *)rex->regstack.ga_data + rex->regstack.ga_len);
     rp->rs_state = state;
     rp->rs_scan = scan;
 
-    regstack.ga_len += sizeof(regitem_T);
+    rex->regstack.ga_len += sizeof(regitem_T);
     return rp;
 }
 
@@ -5412,15 +5947,17 @@ regstack_push(state, scan)
  * Pop an item from the regstack.
  */
     static void
-regstack_pop(scan)
+regstack_pop(rex, scan)
+    regexec_T	*rex;
     char_u	**scan;
 {
     regitem_T	*rp;
 
-    rp = (regitem_T *)((char *)regstack.ga_data + regstack.ga_len) - 1;
+    rp = (regitem_T *)((char *)rex->regstack.ga_data
+						   + rex->regstack.ga_len) - 1;
     *scan = rp->rs_scan;
 
-    regstack.ga_len -= sizeof(regitem_T);
+    rex->regstack.ga_len -= sizeof(regitem_T);
 }
 
 /*
@@ -5428,7 +5965,8 @@ regstack_pop(scan)
  * Advances reginput (and reglnum) to just after the matched chars.
  */
     static int
-regrepeat(p, maxcount)
+regrepeat(rex, p, maxcount)
+    regexec_T	*rex;
     char_u	*p;
     long	maxcount;   /* maximum number of matches allowed */
 {
@@ -5438,7 +5976,7 @@ regrepeat(p, maxcount)
     int		mask;
     int		testval = 0;
 
-    scan = reginput;	    /* Make local copy of reginput for speed. */
+    scan = rex->reginput;	/* Make local copy of reginput for speed. */
     opnd = OPERAND(p);
     switch (OP(p))
     {
@@ -5453,12 +5991,13 @@ regrepeat(p, maxcount)
 		++count;
 		mb_ptr_adv(scan);
 	    }
-	    if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-					 || reg_line_lbr || count == maxcount)
+	    if (!REG_MULTI || !WITH_NL(OP(p))
+				     || rex->reglnum > rex->reg_maxline
+				     || rex->reg_line_lbr || count == maxcount)
 		break;
 	    ++count;		/* count the line-break */
-	    reg_nextline();
-	    scan = reginput;
+	    reg_nextline(rex);
+	    scan = rex->reginput;
 	    if (got_int)
 		break;
 	}
@@ -5478,15 +6017,15 @@ regrepeat(p, maxcount)
 	    }
 	    else if (*scan == NUL)
 	    {
-		if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-							      || reg_line_lbr)
+		if (!REG_MULTI || !WITH_NL(OP(p))
+		       || rex->reglnum > rex->reg_maxline || rex->reg_line_lbr)
 		    break;
-		reg_nextline();
-		scan = reginput;
+		reg_nextline(rex);
+		scan = rex->reginput;
 		if (got_int)
 		    break;
 	    }
-	    else if (reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
+	    else if (rex->reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
 		++scan;
 	    else
 		break;
@@ -5508,15 +6047,15 @@ regrepeat(p, maxcount)
 	    }
 	    else if (*scan == NUL)
 	    {
-		if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-							      || reg_line_lbr)
+		if (!REG_MULTI || !WITH_NL(OP(p))
+		       || rex->reglnum > rex->reg_maxline || rex->reg_line_lbr)
 		    break;
-		reg_nextline();
-		scan = reginput;
+		reg_nextline(rex);
+		scan = rex->reginput;
 		if (got_int)
 		    break;
 	    }
-	    else if (reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
+	    else if (rex->reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
 		++scan;
 	    else
 		break;
@@ -5538,15 +6077,15 @@ regrepeat(p, maxcount)
 	    }
 	    else if (*scan == NUL)
 	    {
-		if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-							      || reg_line_lbr)
+		if (!REG_MULTI || !WITH_NL(OP(p))
+		       || rex->reglnum > rex->reg_maxline || rex->reg_line_lbr)
 		    break;
-		reg_nextline();
-		scan = reginput;
+		reg_nextline(rex);
+		scan = rex->reginput;
 		if (got_int)
 		    break;
 	    }
-	    else if (reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
+	    else if (rex->reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
 		++scan;
 	    else
 		break;
@@ -5564,11 +6103,11 @@ regrepeat(p, maxcount)
 	{
 	    if (*scan == NUL)
 	    {
-		if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-							      || reg_line_lbr)
+		if (!REG_MULTI || !WITH_NL(OP(p))
+		       || rex->reglnum > rex->reg_maxline || rex->reg_line_lbr)
 		    break;
-		reg_nextline();
-		scan = reginput;
+		reg_nextline(rex);
+		scan = rex->reginput;
 		if (got_int)
 		    break;
 	    }
@@ -5576,7 +6115,7 @@ regrepeat(p, maxcount)
 	    {
 		mb_ptr_adv(scan);
 	    }
-	    else if (reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
+	    else if (rex->reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
 		++scan;
 	    else
 		break;
@@ -5595,11 +6134,11 @@ do_class:
 #endif
 	    if (*scan == NUL)
 	    {
-		if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-							      || reg_line_lbr)
+		if (!REG_MULTI || !WITH_NL(OP(p))
+		       || rex->reglnum > rex->reg_maxline || rex->reg_line_lbr)
 		    break;
-		reg_nextline();
-		scan = reginput;
+		reg_nextline(rex);
+		scan = rex->reginput;
 		if (got_int)
 		    break;
 	    }
@@ -5613,7 +6152,7 @@ do_class:
 #endif
 	    else if ((class_tab[*scan] & mask) == testval)
 		++scan;
-	    else if (reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
+	    else if (rex->reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
 		++scan;
 	    else
 		break;
@@ -5697,7 +6236,7 @@ do_class:
 	    /* This doesn't do a multi-byte character, because a MULTIBYTECODE
 	     * would have been used for it.  It does handle single-byte
 	     * characters, such as latin1. */
-	    if (ireg_ic)
+	    if (rex->ireg_ic)
 	    {
 		cu = MB_TOUPPER(*opnd);
 		cl = MB_TOLOWER(*opnd);
@@ -5728,14 +6267,14 @@ do_class:
 	     * compiling the program). */
 	    if ((len = (*mb_ptr2len)(opnd)) > 1)
 	    {
-		if (ireg_ic && enc_utf8)
+		if (rex->ireg_ic && enc_utf8)
 		    cf = utf_fold(utf_ptr2char(opnd));
 		while (count < maxcount)
 		{
 		    for (i = 0; i < len; ++i)
 			if (opnd[i] != scan[i])
 			    break;
-		    if (i < len && (!ireg_ic || !enc_utf8
+		    if (i < len && (!rex->ireg_ic || !enc_utf8
 					|| utf_fold(utf_ptr2char(scan)) != cf))
 			break;
 		    scan += len;
@@ -5760,27 +6299,28 @@ do_class:
 #endif
 	    if (*scan == NUL)
 	    {
-		if (!REG_MULTI || !WITH_NL(OP(p)) || reglnum > reg_maxline
-							      || reg_line_lbr)
+		if (!REG_MULTI || !WITH_NL(OP(p))
+		       || rex->reglnum > rex->reg_maxline || rex->reg_line_lbr)
 		    break;
-		reg_nextline();
-		scan = reginput;
+		reg_nextline(rex);
+		scan = rex->reginput;
 		if (got_int)
 		    break;
 	    }
-	    else if (reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
+	    else if (rex->reg_line_lbr && *scan == '\n' && WITH_NL(OP(p)))
 		++scan;
 #ifdef FEAT_MBYTE
 	    else if (has_mbyte && (len = (*mb_ptr2len)(scan)) > 1)
 	    {
-		if ((cstrchr(opnd, (*mb_ptr2char)(scan)) == NULL) == testval)
+		if ((cstrchr(rex, opnd, (*mb_ptr2char)(scan)) == NULL)
+								   == testval)
 		    break;
 		scan += len;
 	    }
 #endif
 	    else
 	    {
-		if ((cstrchr(opnd, *scan) == NULL) == testval)
+		if ((cstrchr(rex, opnd, *scan) == NULL) == testval)
 		    break;
 		++scan;
 	    }
@@ -5790,15 +6330,16 @@ do_class:
 
       case NEWL:
 	while (count < maxcount
-		&& ((*scan == NUL && reglnum <= reg_maxline && !reg_line_lbr
-			    && REG_MULTI) || (*scan == '\n' && reg_line_lbr)))
+		&& ((*scan == NUL && rex->reglnum <= rex->reg_maxline
+			 && !rex->reg_line_lbr && REG_MULTI)
+		    || (*scan == '\n' && rex->reg_line_lbr)))
 	{
 	    count++;
-	    if (reg_line_lbr)
+	    if (rex->reg_line_lbr)
 		ADVANCE_REGINPUT();
 	    else
-		reg_nextline();
-	    scan = reginput;
+		reg_nextline(rex);
+	    scan = rex->reginput;
 	    if (got_int)
 		break;
 	}
@@ -5812,7 +6353,7 @@ do_class:
 	break;
     }
 
-    reginput = scan;
+    rex->reginput = scan;
 
     return (int)count;
 }
@@ -5846,11 +6387,12 @@ regnext(p)
  * Return TRUE if it's wrong.
  */
     static int
-prog_magic_wrong()
+prog_magic_wrong(rex)
+    regexec_T	*rex;
 {
     if (UCHARAT(REG_MULTI
-		? reg_mmatch->regprog->program
-		: reg_match->regprog->program) != REGMAGIC)
+		? rex->reg_mmatch->regprog->program
+		: rex->reg_match->regprog->program) != REGMAGIC)
     {
 	EMSG(_(e_re_corr));
 	return TRUE;
@@ -5864,43 +6406,45 @@ prog_magic_wrong()
  * used (to increase speed).
  */
     static void
-cleanup_subexpr()
+cleanup_subexpr(rex)
+    regexec_T	*rex;
 {
-    if (need_clear_subexpr)
+    if (rex->need_clear_subexpr)
     {
 	if (REG_MULTI)
 	{
 	    /* Use 0xff to set lnum to -1 */
-	    vim_memset(reg_startpos, 0xff, sizeof(lpos_T) * NSUBEXP);
-	    vim_memset(reg_endpos, 0xff, sizeof(lpos_T) * NSUBEXP);
+	    vim_memset(rex->reg_startpos, 0xff, sizeof(lpos_T) * NSUBEXP);
+	    vim_memset(rex->reg_endpos, 0xff, sizeof(lpos_T) * NSUBEXP);
 	}
 	else
 	{
-	    vim_memset(reg_startp, 0, sizeof(char_u *) * NSUBEXP);
-	    vim_memset(reg_endp, 0, sizeof(char_u *) * NSUBEXP);
+	    vim_memset(rex->reg_startp, 0, sizeof(char_u *) * NSUBEXP);
+	    vim_memset(rex->reg_endp, 0, sizeof(char_u *) * NSUBEXP);
 	}
-	need_clear_subexpr = FALSE;
+	rex->need_clear_subexpr = FALSE;
     }
 }
 
 #ifdef FEAT_SYN_HL
     static void
-cleanup_zsubexpr()
+cleanup_zsubexpr(rex)
+    regexec_T	*rex;
 {
-    if (need_clear_zsubexpr)
+    if (rex->need_clear_zsubexpr)
     {
 	if (REG_MULTI)
 	{
 	    /* Use 0xff to set lnum to -1 */
-	    vim_memset(reg_startzpos, 0xff, sizeof(lpos_T) * NSUBEXP);
-	    vim_memset(reg_endzpos, 0xff, sizeof(lpos_T) * NSUBEXP);
+	    vim_memset(rex->reg_startzpos, 0xff, sizeof(lpos_T) * NSUBEXP);
+	    vim_memset(rex->reg_endzpos, 0xff, sizeof(lpos_T) * NSUBEXP);
 	}
 	else
 	{
-	    vim_memset(reg_startzp, 0, sizeof(char_u *) * NSUBEXP);
-	    vim_memset(reg_endzp, 0, sizeof(char_u *) * NSUBEXP);
+	    vim_memset(rex->reg_startzp, 0, sizeof(char_u *) * NSUBEXP);
+	    vim_memset(rex->reg_endzp, 0, sizeof(char_u *) * NSUBEXP);
 	}
-	need_clear_zsubexpr = FALSE;
+	rex->need_clear_zsubexpr = FALSE;
     }
 }
 #endif
@@ -5910,27 +6454,28 @@ cleanup_zsubexpr()
  * later by restore_subexpr().
  */
     static void
-save_subexpr(bp)
+save_subexpr(rex, bp)
+    regexec_T	*rex;
     regbehind_T *bp;
 {
     int i;
 
     /* When "need_clear_subexpr" is set we don't need to save the values, only
      * remember that this flag needs to be set again when restoring. */
-    bp->save_need_clear_subexpr = need_clear_subexpr;
-    if (!need_clear_subexpr)
+    bp->save_need_clear_subexpr = rex->need_clear_subexpr;
+    if (!rex->need_clear_subexpr)
     {
 	for (i = 0; i < NSUBEXP; ++i)
 	{
 	    if (REG_MULTI)
 	    {
-		bp->save_start[i].se_u.pos = reg_startpos[i];
-		bp->save_end[i].se_u.pos = reg_endpos[i];
+		bp->save_start[i].se_u.pos = rex->reg_startpos[i];
+		bp->save_end[i].se_u.pos = rex->reg_endpos[i];
 	    }
 	    else
 	    {
-		bp->save_start[i].se_u.ptr = reg_startp[i];
-		bp->save_end[i].se_u.ptr = reg_endp[i];
+		bp->save_start[i].se_u.ptr = rex->reg_startp[i];
+		bp->save_end[i].se_u.ptr = rex->reg_endp[i];
 	    }
 	}
     }
@@ -5940,26 +6485,27 @@ save_subexpr(bp)
  * Restore the subexpr from "bp".
  */
     static void
-restore_subexpr(bp)
+restore_subexpr(rex, bp)
+    regexec_T	*rex;
     regbehind_T *bp;
 {
     int i;
 
     /* Only need to restore saved values when they are not to be cleared. */
-    need_clear_subexpr = bp->save_need_clear_subexpr;
-    if (!need_clear_subexpr)
+    rex->need_clear_subexpr = bp->save_need_clear_subexpr;
+    if (!rex->need_clear_subexpr)
     {
 	for (i = 0; i < NSUBEXP; ++i)
 	{
 	    if (REG_MULTI)
 	    {
-		reg_startpos[i] = bp->save_start[i].se_u.pos;
-		reg_endpos[i] = bp->save_end[i].se_u.pos;
+		rex->reg_startpos[i] = bp->save_start[i].se_u.pos;
+		rex->reg_endpos[i] = bp->save_end[i].se_u.pos;
 	    }
 	    else
 	    {
-		reg_startp[i] = bp->save_start[i].se_u.ptr;
-		reg_endp[i] = bp->save_end[i].se_u.ptr;
+		rex->reg_startp[i] = bp->save_start[i].se_u.ptr;
+		rex->reg_endp[i] = bp->save_end[i].se_u.ptr;
 	    }
 	}
     }
@@ -5969,10 +6515,11 @@ restore_subexpr(bp)
  * Advance reglnum, regline and reginput to the next line.
  */
     static void
-reg_nextline()
+reg_nextline(rex)
+    regexec_T	*rex;
 {
-    regline = reg_getline(++reglnum);
-    reginput = regline;
+    rex->regline = reg_getline(rex, ++rex->reglnum);
+    rex->reginput = rex->regline;
     fast_breakcheck();
 }
 
@@ -5980,17 +6527,18 @@ reg_nextline()
  * Save the input line and position in a regsave_T.
  */
     static void
-reg_save(save, gap)
+reg_save(rex, save, gap)
+    regexec_T	*rex;
     regsave_T	*save;
     garray_T	*gap;
 {
     if (REG_MULTI)
     {
-	save->rs_u.pos.col = (colnr_T)(reginput - regline);
-	save->rs_u.pos.lnum = reglnum;
+	save->rs_u.pos.col = (colnr_T)(rex->reginput - rex->regline);
+	save->rs_u.pos.lnum = rex->reglnum;
     }
     else
-	save->rs_u.ptr = reginput;
+	save->rs_u.ptr = rex->reginput;
     save->rs_len = gap->ga_len;
 }
 
@@ -5998,23 +6546,24 @@ reg_save(save, gap)
  * Restore the input line and position from a regsave_T.
  */
     static void
-reg_restore(save, gap)
+reg_restore(rex, save, gap)
+    regexec_T	*rex;
     regsave_T	*save;
     garray_T	*gap;
 {
     if (REG_MULTI)
     {
-	if (reglnum != save->rs_u.pos.lnum)
+	if (rex->reglnum != save->rs_u.pos.lnum)
 	{
 	    /* only call reg_getline() when the line number changed to save
 	     * a bit of time */
-	    reglnum = save->rs_u.pos.lnum;
-	    regline = reg_getline(reglnum);
+	    rex->reglnum = save->rs_u.pos.lnum;
+	    rex->regline = reg_getline(rex, rex->reglnum);
 	}
-	reginput = regline + save->rs_u.pos.col;
+	rex->reginput = rex->regline + save->rs_u.pos.col;
     }
     else
-	reginput = save->rs_u.ptr;
+	rex->reginput = save->rs_u.ptr;
     gap->ga_len = save->rs_len;
 }
 
@@ -6022,13 +6571,14 @@ reg_restore(save, gap)
  * Return TRUE if current position is equal to saved position.
  */
     static int
-reg_save_equal(save)
+reg_save_equal(rex, save)
+    regexec_T	*rex;
     regsave_T	*save;
 {
     if (REG_MULTI)
-	return reglnum == save->rs_u.pos.lnum
-				  && reginput == regline + save->rs_u.pos.col;
-    return reginput == save->rs_u.ptr;
+	return rex->reglnum == save->rs_u.pos.lnum
+			 && rex->reginput == rex->regline + save->rs_u.pos.col;
+    return rex->reginput == save->rs_u.ptr;
 }
 
 /*
@@ -6039,22 +6589,24 @@ reg_save_equal(save)
  * depending on REG_MULTI.
  */
     static void
-save_se_multi(savep, posp)
+save_se_multi(rex, savep, posp)
+    regexec_T	*rex;
     save_se_T	*savep;
     lpos_T	*posp;
 {
     savep->se_u.pos = *posp;
-    posp->lnum = reglnum;
-    posp->col = (colnr_T)(reginput - regline);
+    posp->lnum = rex->reglnum;
+    posp->col = (colnr_T)(rex->reginput - rex->regline);
 }
 
     static void
-save_se_one(savep, pp)
+save_se_one(rex, savep, pp)
+    regexec_T	*rex;
     save_se_T	*savep;
     char_u	**pp;
 {
     savep->se_u.ptr = *pp;
-    *pp = reginput;
+    *pp = rex->reginput;
 }
 
 /*
@@ -6612,20 +7164,21 @@ mb_decompose(c, c1, c2, c3)
  * Correct the length "*n" when composing characters are ignored.
  */
     static int
-cstrncmp(s1, s2, n)
+cstrncmp(rex, s1, s2, n)
+    regexec_T	*rex;
     char_u	*s1, *s2;
     int		*n;
 {
     int		result;
 
-    if (!ireg_ic)
+    if (!rex->ireg_ic)
 	result = STRNCMP(s1, s2, *n);
     else
 	result = MB_STRNICMP(s1, s2, *n);
 
 #ifdef FEAT_MBYTE
     /* if it failed and it's utf8 and we want to combineignore: */
-    if (result != 0 && enc_utf8 && ireg_icombine)
+    if (result != 0 && enc_utf8 && rex->ireg_icombine)
     {
 	char_u	*str1, *str2;
 	int	c1, c2, c11, c12;
@@ -6644,14 +7197,15 @@ cstrncmp(s1, s2, n)
 	    /* decompose the character if necessary, into 'base' characters
 	     * because I don't care about Arabic, I will hard-code the Hebrew
 	     * which I *do* care about!  So sue me... */
-	    if (c1 != c2 && (!ireg_ic || utf_fold(c1) != utf_fold(c2)))
+	    if (c1 != c2 && (!rex->ireg_ic || utf_fold(c1) != utf_fold(c2)))
 	    {
 		/* decomposition necessary? */
 		mb_decompose(c1, &c11, &junk, &junk);
 		mb_decompose(c2, &c12, &junk, &junk);
 		c1 = c11;
 		c2 = c12;
-		if (c11 != c12 && (!ireg_ic || utf_fold(c11) != utf_fold(c12)))
+		if (c11 != c12
+			  && (!rex->ireg_ic || utf_fold(c11) != utf_fold(c12)))
 		    break;
 	    }
 	}
@@ -6668,14 +7222,15 @@ cstrncmp(s1, s2, n)
  * cstrchr: This function is used a lot for simple searches, keep it fast!
  */
     static char_u *
-cstrchr(s, c)
+cstrchr(rex, s, c)
+    regexec_T	*rex;
     char_u	*s;
     int		c;
 {
     char_u	*p;
     int		cc;
 
-    if (!ireg_ic
+    if (!rex->ireg_ic
 #ifdef FEAT_MBYTE
 	    || (!enc_utf8 && mb_char2len(c) > 1)
 #endif
@@ -6744,7 +7299,7 @@ static fptr_T do_Upper __ARGS((int *, int));
 static fptr_T do_lower __ARGS((int *, int));
 static fptr_T do_Lower __ARGS((int *, int));
 
-static int vim_regsub_both __ARGS((char_u *source, char_u *dest, int copy, int magic, int backslash));
+static int vim_regsub_both __ARGS((regexec_T *rex, char_u *source, char_u *dest, int copy, int magic, int backslash));
 
     static fptr_T
 do_upper(d, c)
@@ -6853,6 +7408,9 @@ regtilde(source, magic)
 	}
     }
 
+    /* Cached patterns with "~" were compiled with the old string. */
+    if (reg_prev_sub == NULL || STRCMP(reg_prev_sub, newsub) != 0)
+	vim_regcache_clear();
     vim_free(reg_prev_sub);
     if (newsub != source)	/* newsub was allocated, just keep it */
 	reg_prev_sub = newsub;
@@ -6864,13 +7422,9 @@ regtilde(source, magic)
 #ifdef FEAT_EVAL
 static int can_f_submatch = FALSE;	/* TRUE when submatch() can be used */
 
-/* These pointers are used instead of reg_match and reg_mmatch for
- * reg_submatch().  Needed for when the substitution string is an expression
- * that contains a call to substitute() and submatch(). */
-static regmatch_T	*submatch_match;
-static regmmatch_T	*submatch_mmatch;
-static linenr_T		submatch_firstlnum;
-static linenr_T		submatch_maxline;
+/* The state of the substitute that evaluates the expression, used by
+ * reg_submatch(). */
+static regexec_T	*submatch_rex;
 #endif
 
 #if defined(FEAT_MODIFY_FNAME) || defined(FEAT_EVAL) || defined(PROTO)
@@ -6901,10 +7455,14 @@ vim_regsub(rmp, source, dest, copy, magic, backslash)
     int		magic;
     int		backslash;
 {
-    reg_match = rmp;
-    reg_mmatch = NULL;
-    reg_maxline = 0;
-    return vim_regsub_both(source, dest, copy, magic, backslash);
+    regexec_T	rex;
+
+    /* No stacks are used, a match done by the expression can use the pool. */
+    vim_memset(&rex, 0, sizeof(rex));
+    rex.reg_match = rmp;
+    rex.reg_mmatch = NULL;
+    rex.reg_maxline = 0;
+    return vim_regsub_both(&rex, source, dest, copy, magic, backslash);
 }
 #endif
 
@@ -6918,16 +7476,20 @@ vim_regsub_multi(rmp, lnum, source, dest, copy, magic, backslash)
     int		magic;
     int		backslash;
 {
-    reg_match = NULL;
-    reg_mmatch = rmp;
-    reg_buf = curbuf;		/* always works on the current buffer! */
-    reg_firstlnum = lnum;
-    reg_maxline = curbuf->b_ml.ml_line_count - lnum;
-    return vim_regsub_both(source, dest, copy, magic, backslash);
+    regexec_T	rex;
+
+    vim_memset(&rex, 0, sizeof(rex));
+    rex.reg_match = NULL;
+    rex.reg_mmatch = rmp;
+    rex.reg_buf = curbuf;	/* always works on the current buffer! */
+    rex.reg_firstlnum = lnum;
+    rex.reg_maxline = curbuf->b_ml.ml_line_count - lnum;
+    return vim_regsub_both(&rex, source, dest, copy, magic, backslash);
 }
 
     static int
-vim_regsub_both(source, dest, copy, magic, backslash)
+vim_regsub_both(rex, source, dest, copy, magic, backslash)
+    regexec_T	*rex;
     char_u	*source;
     char_u	*dest;
     int		copy;
@@ -6953,7 +7515,7 @@ vim_regsub_both(source, dest, copy, magic, backslash)
 	EMSG(_(e_null));
 	return 0;
     }
-    if (prog_magic_wrong())
+    if (prog_magic_wrong(rex))
 	return 0;
     src = source;
     dst = dest;
@@ -6984,21 +7546,12 @@ vim_regsub_both(source, dest, copy, magic, backslash)
 	}
 	else
 	{
-	    win_T	*save_reg_win;
-	    int		save_ireg_ic;
-
 	    vim_free(eval_result);
 
 	    /* The expression may contain substitute(), which calls us
-	     * recursively.  Make sure submatch() gets the text from the first
-	     * level.  Don't need to save "reg_buf", because
-	     * vim_regexec_multi() can't be called recursively. */
-	    submatch_match = reg_match;
-	    submatch_mmatch = reg_mmatch;
-	    submatch_firstlnum = reg_firstlnum;
-	    submatch_maxline = reg_maxline;
-	    save_reg_win = reg_win;
-	    save_ireg_ic = ireg_ic;
+	     * recursively with its own state, but not for "\=".  Make sure
+	     * submatch() gets the text from this level. */
+	    submatch_rex = rex;
 	    can_f_submatch = TRUE;
 
 	    eval_result = eval_to_string(source + 2, NULL, TRUE);
@@ -7039,12 +7592,6 @@ vim_regsub_both(source, dest, copy, magic, backslash)
 		dst += STRLEN(eval_result);
 	    }
 
-	    reg_match = submatch_match;
-	    reg_mmatch = submatch_mmatch;
-	    reg_firstlnum = submatch_firstlnum;
-	    reg_maxline = submatch_maxline;
-	    reg_win = save_reg_win;
-	    ireg_ic = save_ireg_ic;
 	    can_f_submatch = FALSE;
 	}
 #endif
@@ -7171,26 +7718,27 @@ vim_regsub_both(source, dest, copy, magic, backslash)
 	{
 	    if (REG_MULTI)
 	    {
-		clnum = reg_mmatch->startpos[no].lnum;
-		if (clnum < 0 || reg_mmatch->endpos[no].lnum < 0)
+		clnum = rex->reg_mmatch->startpos[no].lnum;
+		if (clnum < 0 || rex->reg_mmatch->endpos[no].lnum < 0)
 		    s = NULL;
 		else
 		{
-		    s = reg_getline(clnum) + reg_mmatch->startpos[no].col;
-		    if (reg_mmatch->endpos[no].lnum == clnum)
-			len = reg_mmatch->endpos[no].col
-					       - reg_mmatch->startpos[no].col;
+		    s = reg_getline(rex, clnum)
+					   + rex->reg_mmatch->startpos[no].col;
+		    if (rex->reg_mmatch->endpos[no].lnum == clnum)
+			len = rex->reg_mmatch->endpos[no].col
+					   - rex->reg_mmatch->startpos[no].col;
 		    else
 			len = (int)STRLEN(s);
 		}
 	    }
 	    else
 	    {
-		s = reg_match->startp[no];
-		if (reg_match->endp[no] == NULL)
+		s = rex->reg_match->startp[no];
+		if (rex->reg_match->endp[no] == NULL)
 		    s = NULL;
 		else
-		    len = (int)(reg_match->endp[no] - s);
+		    len = (int)(rex->reg_match->endp[no] - s);
 	    }
 	    if (s != NULL)
 	    {
@@ -7200,14 +7748,14 @@ vim_regsub_both(source, dest, copy, magic, backslash)
 		    {
 			if (REG_MULTI)
 			{
-			    if (reg_mmatch->endpos[no].lnum == clnum)
+			    if (rex->reg_mmatch->endpos[no].lnum == clnum)
 				break;
 			    if (copy)
 				*dst = CAR;
 			    ++dst;
-			    s = reg_getline(++clnum);
-			    if (reg_mmatch->endpos[no].lnum == clnum)
-				len = reg_mmatch->endpos[no].col;
+			    s = reg_getline(rex, ++clnum);
+			    if (rex->reg_mmatch->endpos[no].lnum == clnum)
+				len = rex->reg_mmatch->endpos[no].col;
 			    else
 				len = (int)STRLEN(s);
 			}
@@ -7293,31 +7841,6 @@ exit:
 }
 
 #ifdef FEAT_EVAL
-static char_u *reg_getline_submatch __ARGS((linenr_T lnum));
-
-/*
- * Call reg_getline() with the line numbers from the submatch.  If a
- * substitute() was used the reg_maxline and other values have been
- * overwritten.
- */
-    static char_u *
-reg_getline_submatch(lnum)
-    linenr_T	lnum;
-{
-    char_u *s;
-    linenr_T save_first = reg_firstlnum;
-    linenr_T save_max = reg_maxline;
-
-    reg_firstlnum = submatch_firstlnum;
-    reg_maxline = submatch_maxline;
-
-    s = reg_getline(lnum);
-
-    reg_firstlnum = save_first;
-    reg_maxline = save_max;
-    return s;
-}
-
 /*
  * Used for the submatch() function: get the string from the n'th submatch in
  * allocated memory.
@@ -7332,11 +7855,15 @@ reg_submatch(no)
     int		len;
     int		round;
     linenr_T	lnum;
+    regmatch_T	*match;
+    regmmatch_T	*mmatch;
 
     if (!can_f_submatch || no < 0)
 	return NULL;
+    match = submatch_rex->reg_match;
+    mmatch = submatch_rex->reg_mmatch;
 
-    if (submatch_match == NULL)
+    if (match == NULL)
     {
 	/*
 	 * First round: compute the length and allocate memory.
@@ -7344,18 +7871,18 @@ reg_submatch(no)
 	 */
 	for (round = 1; round <= 2; ++round)
 	{
-	    lnum = submatch_mmatch->startpos[no].lnum;
-	    if (lnum < 0 || submatch_mmatch->endpos[no].lnum < 0)
+	    lnum = mmatch->startpos[no].lnum;
+	    if (lnum < 0 || mmatch->endpos[no].lnum < 0)
 		return NULL;
 
-	    s = reg_getline_submatch(lnum) + submatch_mmatch->startpos[no].col;
+	    s = reg_getline(submatch_rex, lnum) + mmatch->startpos[no].col;
 	    if (s == NULL)  /* anti-crash check, cannot happen? */
 		break;
-	    if (submatch_mmatch->endpos[no].lnum == lnum)
+	    if (mmatch->endpos[no].lnum == lnum)
 	    {
 		/* Within one line: take form start to end col. */
-		len = submatch_mmatch->endpos[no].col
-					  - submatch_mmatch->startpos[no].col;
+		len = mmatch->endpos[no].col
+					  - mmatch->startpos[no].col;
 		if (round == 2)
 		    vim_strncpy(retval, s, len);
 		++len;
@@ -7372,9 +7899,9 @@ reg_submatch(no)
 		}
 		++len;
 		++lnum;
-		while (lnum < submatch_mmatch->endpos[no].lnum)
+		while (lnum < mmatch->endpos[no].lnum)
 		{
-		    s = reg_getline_submatch(lnum++);
+		    s = reg_getline(submatch_rex, lnum++);
 		    if (round == 2)
 			STRCPY(retval + len, s);
 		    len += (int)STRLEN(s);
@@ -7383,9 +7910,9 @@ reg_submatch(no)
 		    ++len;
 		}
 		if (round == 2)
-		    STRNCPY(retval + len, reg_getline_submatch(lnum),
-					     submatch_mmatch->endpos[no].col);
-		len += submatch_mmatch->endpos[no].col;
+		    STRNCPY(retval + len, reg_getline(submatch_rex, lnum),
+					     mmatch->endpos[no].col);
+		len += mmatch->endpos[no].col;
 		if (round == 2)
 		    retval[len] = NUL;
 		++len;
@@ -7401,13 +7928,16 @@ reg_submatch(no)
     }
     else
     {
-	s = submatch_match->startp[no];
-	if (s == NULL || submatch_match->endp[no] == NULL)
+	s = match->startp[no];
+	if (s == NULL || match->endp[no] == NULL)
 	    retval = NULL;
 	else
-	    retval = vim_strnsave(s, (int)(submatch_match->endp[no] - s));
+	    retval = vim_strnsave(s, (int)(match->endp[no] - s));
     }
 
     return retval;
 }
 #endif
+
+/* The NFA engine. */
+#include "regexp_nfa.c"
@@ -21,6 +21,13 @@
  */
 #define NSUBEXP  10
 
+/*
+ * Values for 'regexpengine' and the "\%#=" pattern prefix.
+ */
+#define AUTOMATIC_ENGINE	0
+#define BACKTRACKING_ENGINE	1
+#define NFA_ENGINE		2
+
 /*
  * Structure returned by vim_regcomp() to pass on to vim_regexec().
  * These fields are only to be used in regexp.c!
@@ -32,8 +39,14 @@ typedef struct
     char_u		reganch;
     char_u		*regmust;
     int			regmlen;
+    char_u		regmskip[256];	/* for finding "regmust" ignoring case */
+    char_u		regmlast[32];
     unsigned		regflags;
     char_u		reghasz;
+    struct nfa_state_S	*regnfa;	/* NFA states, NULL when not used */
+    int			regnfa_len;	/* number of states in "regnfa" */
+    int			regnfa_nsub;	/* number of \( \) groups plus one */
+    int			regrefcount;	/* references when cached, else 0 */
     char_u		program[1];		/* actually longer.. */
 } regprog_T;
 
@@ -0,0 +1,1311 @@
+/* vi:set ts=8 sts=4 sw=4:
+ *
+ * NFA regular expression implementation.
+ *
+ * This file is included in "regexp.c".
+ *
+ * The backtracking matcher in regexp.c can take exponential time on patterns
+ * such as "\(a*\)*b", because it tries every way the pattern can match before
+ * giving up.  The engine here runs the same program as a Thompson NFA, all
+ * alternatives in lockstep, in time linear in the length of the text.
+ *
+ * There is no separate parser: vim_regcomp() compiles the pattern for the
+ * backtracking engine as always, then nfa_regcomp() translates that program
+ * into NFA states.  Those are appended to the same allocation, so that
+ * vim_free() of the program still frees everything.  Items the NFA can't do
+ * without backtracking (back references, look-behind, \z(), etc.) and items
+ * that match a line break make the translation fail; such a pattern is only
+ * matched by the backtracking engine.
+ *
+ * Matching is done Pike VM style: every thread has its own copy of the
+ * submatch positions and the threads are kept in priority order, the order in
+ * which the backtracking engine would try them.  When a thread reaches the
+ * end of the pattern all threads with a lower priority are dropped.  This
+ * gives the match that the backtracking engine finds.
+ *
+ * A repeated group that can match nothing is stopped like the backtracking
+ * engine does it: a thread fails at a BACK node that it already passed at the
+ * same column.  The backtracking engine does not forget such a column, or
+ * the count of a "\{}", when it backtracks out of a failed try.  In rare
+ * cases that makes another try fail or match, which can't be done here.
+ */
+
+/*
+ * Opcodes for NFA states that have no node in the backtracking program.  The
+ * other states use the opcode of the node they were made from, for these
+ * "ns_arg" is the offset of the node in the program.
+ */
+#define NFA_SPLIT	250	/* try "ns_out", then "ns_out1" */
+#define NFA_EMPTY	251	/* continue with "ns_out" */
+#define NFA_REP		252	/* one item of a STAR, PLUS or BRACE_SIMPLE */
+#define NFA_MATCH	253	/* end of the pattern */
+
+typedef struct nfa_state_S
+{
+    int		ns_op;
+    int		ns_out;		/* next state */
+    int		ns_out1;	/* alternative for NFA_SPLIT, number of a
+				   BACK node */
+    int		ns_arg;		/* offset of the node in the program */
+} nfa_state_T;
+
+/*
+ * Limit for the number of states, "\{1000}" on a group needs 1000 copies of
+ * the group.  Larger patterns are matched by the backtracking engine.
+ */
+#define NFA_MAX_STATES	2000
+
+/*
+ * Each BACK node has a bit in the mask used by nfa_closure(), thus the number
+ * of loops is limited.
+ */
+#define NFA_MAX_BACK	30
+
+/*
+ * A BRACE_COMPLEX item is unrolled: its operand is translated once for every
+ * repetition.  This is the context for one of those copies.
+ */
+typedef struct
+{
+    int		nc_parent;	/* enclosing context, -1 for none */
+    int		nc_brace;	/* offset of the BRACE_COMPLEX node */
+    int		nc_count;	/* number of times the operand was matched */
+    long	nc_min;		/* lower limit */
+    long	nc_max;		/* upper limit, MAX_LIMIT for none */
+    int		nc_lazy;	/* try the smallest count first */
+} nfa_ctx_T;
+
+/*
+ * Used while translating.  States are created on demand for a node in a
+ * context and filled in later, "nfa_todo" has the states still to be done.
+ */
+static char_u	*nfa_program;	/* the backtracking program */
+static garray_T	nfa_states;	/* nfa_state_T items */
+static garray_T	nfa_key;	/* two ints per state: node offset, context */
+static garray_T	nfa_ctxs;	/* nfa_ctx_T items */
+static garray_T	nfa_todo;	/* int: states to be filled in */
+static garray_T	nfa_backs;	/* int: offset of each BACK node */
+static int	*nfa_hash;	/* first state for a hash value, -1 for none */
+static int	*nfa_chain;	/* next state with the same hash value */
+static int	nfa_hash_size;
+static int	nfa_nsub;	/* highest \( \) group number plus one */
+static int	nfa_failed;	/* TRUE when the pattern can't be done */
+
+#define NFA_STATE(i)	(((nfa_state_T *)nfa_states.ga_data)[i])
+#define NFA_CTX(i)	(((nfa_ctx_T *)nfa_ctxs.ga_data)[i])
+#define NFA_HASH(node, ctx) ((unsigned)((node) * 31 + (ctx)) & (nfa_hash_size - 1))
+
+static int nfa_new_state __ARGS((int op, int node, int ctx));
+static int nfa_rehash __ARGS((void));
+static int nfa_state_for __ARGS((char_u *scan, int ctx));
+static int nfa_get_ctx __ARGS((int parent, int brace, int count, nfa_ctx_T *limits));
+static int nfa_back_nr __ARGS((char_u *scan));
+static int nfa_simple_item __ARGS((char_u *scan, int rep));
+static void nfa_fill_rep __ARGS((int idx, char_u *opnd, long minval, long maxval, int lazy, int out));
+static void nfa_fill_brace __ARGS((int idx, char_u *scan, int ctx));
+static void nfa_fill __ARGS((int idx));
+static int nfa_match_item __ARGS((regexec_T *rex, char_u *scan, char_u *s));
+static int nfa_match_rep __ARGS((regexec_T *rex, char_u *scan, char_u *s));
+static int nfa_push __ARGS((regexec_T *rex, int a, int b));
+static int nfa_closure __ARGS((regexec_T *rex, regprog_T *prog, int ncap, int start, colnr_T pos, garray_T *gap, colnr_T *nextposp));
+static colnr_T nfa_next_start __ARGS((regexec_T *rex, regprog_T *prog, colnr_T col));
+
+/*
+ * Add a state with opcode "op".  When "node" is not -1 the state is for the
+ * node at offset "node" in context "ctx" and must be filled in later.
+ * Returns the index of the new state, -1 when out of memory or when there
+ * would be too many states.
+ */
+    static int
+nfa_new_state(op, node, ctx)
+    int		op;
+    int		node;
+    int		ctx;
+{
+    int		idx = nfa_states.ga_len;
+    nfa_state_T	*st;
+    int		*key;
+
+    if (idx >= NFA_MAX_STATES || ga_grow(&nfa_states, 1) == FAIL
+	    || ga_grow(&nfa_key, 2) == FAIL
+	    || (node >= 0 && ga_grow(&nfa_todo, 1) == FAIL))
+    {
+	nfa_failed = TRUE;
+	return -1;
+    }
+    st = &NFA_STATE(idx);
+    st->ns_op = op;
+    st->ns_out = -1;
+    st->ns_out1 = -1;
+    st->ns_arg = node;
+    ++nfa_states.ga_len;
+    key = (int *)nfa_key.ga_data + 2 * idx;
+    key[0] = node;
+    key[1] = ctx;
+    nfa_key.ga_len += 2;
+
+    if (node >= 0)
+    {
+	if (idx < nfa_hash_size / 2)
+	{
+	    nfa_chain[idx] = nfa_hash[NFA_HASH(node, ctx)];
+	    nfa_hash[NFA_HASH(node, ctx)] = idx;
+	}
+	else if (nfa_rehash() == FAIL)	/* also adds this state */
+	{
+	    nfa_failed = TRUE;
+	    return -1;
+	}
+	((int *)nfa_todo.ga_data)[nfa_todo.ga_len++] = idx;
+    }
+    return idx;
+}
+
+/*
+ * Make the hash table twice as big and put all the states in it again.
+ */
+    static int
+nfa_rehash()
+{
+    int		size = nfa_hash_size == 0 ? 64 : nfa_hash_size;
+    int		*hash;
+    int		*chain;
+    int		*key;
+    int		i;
+
+    while (size / 2 <= nfa_states.ga_len)
+	size *= 2;
+    hash = (int *)alloc((unsigned)(size * sizeof(int)));
+    chain = (int *)alloc((unsigned)(size / 2 * sizeof(int)));
+    if (hash == NULL || chain == NULL)
+    {
+	vim_free(hash);
+	vim_free(chain);
+	return FAIL;
+    }
+    vim_free(nfa_hash);
+    vim_free(nfa_chain);
+    nfa_hash = hash;
+    nfa_chain = chain;
+    nfa_hash_size = size;
+    for (i = 0; i < size; ++i)
+	hash[i] = -1;
+    key = (int *)nfa_key.ga_data;
+    for (i = 0; i < nfa_states.ga_len; ++i)
+	if (key[2 * i] >= 0)
+	{
+	    chain[i] = hash[NFA_HASH(key[2 * i], key[2 * i + 1])];
+	    hash[NFA_HASH(key[2 * i], key[2 * i + 1])] = i;
+	}
+    return OK;
+}
+
+/*
+ * Return the state for node "scan" in context "ctx", add it when it doesn't
+ * exist yet.
+ */
+    static int
+nfa_state_for(scan, ctx)
+    char_u	*scan;
+    int		ctx;
+{
+    int		node;
+    int		idx;
+    int		*key = (int *)nfa_key.ga_data;
+
+    if (scan == NULL || nfa_failed)
+    {
+	nfa_failed = TRUE;
+	return -1;
+    }
+    node = (int)(scan - nfa_program);
+    if (nfa_hash_size > 0)
+	for (idx = nfa_hash[NFA_HASH(node, ctx)]; idx >= 0;
+							 idx = nfa_chain[idx])
+	    if (key[2 * idx] == node && key[2 * idx + 1] == ctx)
+		return idx;
+    return nfa_new_state(NFA_EMPTY, node, ctx);
+}
+
+/*
+ * Return the context for repetition "count" of the BRACE_COMPLEX node at
+ * offset "brace" inside context "parent".
+ */
+    static int
+nfa_get_ctx(parent, brace, count, limits)
+    int		parent;
+    int		brace;
+    int		count;
+    nfa_ctx_T	*limits;
+{
+    int		i;
+    nfa_ctx_T	*nc;
+
+    for (i = 0; i < nfa_ctxs.ga_len; ++i)
+    {
+	nc = &NFA_CTX(i);
+	if (nc->nc_parent == parent && nc->nc_brace == brace
+						     && nc->nc_count == count)
+	    return i;
+    }
+    if (ga_grow(&nfa_ctxs, 1) == FAIL)
+    {
+	nfa_failed = TRUE;
+	return -1;
+    }
+    nc = &NFA_CTX(i);
+    *nc = *limits;
+    nc->nc_parent = parent;
+    nc->nc_brace = brace;
+    nc->nc_count = count;
+    ++nfa_ctxs.ga_len;
+    return i;
+}
+
+/*
+ * Return the number of BACK node "scan", the same for all its states.
+ */
+    static int
+nfa_back_nr(scan)
+    char_u	*scan;
+{
+    int		node = (int)(scan - nfa_program);
+    int		i;
+
+    for (i = 0; i < nfa_backs.ga_len; ++i)
+	if (((int *)nfa_backs.ga_data)[i] == node)
+	    return i;
+    if (i >= NFA_MAX_BACK || ga_grow(&nfa_backs, 1) == FAIL)
+    {
+	nfa_failed = TRUE;
+	return -1;
+    }
+    ((int *)nfa_backs.ga_data)[nfa_backs.ga_len++] = node;
+    return i;
+}
+
+/*
+ * Return TRUE if "scan" is a node that matches one character (or a fixed
+ * string) and that nfa_match_item() can handle.  With "rep" set: the operand
+ * of a STAR, PLUS or BRACE_SIMPLE node, for nfa_match_rep().
+ */
+    static int
+nfa_simple_item(scan, rep)
+    char_u	*scan;
+    int		rep;
+{
+    int		op = OP(scan);
+
+    if ((op >= ANY && op <= NUPPER) || op == EXACTLY)
+	return TRUE;
+#ifdef FEAT_MBYTE
+    /* A composing character alone matches at a varying position. */
+    if (op == MULTIBYTECODE)
+	return rep || !(enc_utf8
+			  && utf_iscomposing(utf_ptr2char(OPERAND(scan))));
+#endif
+    return FALSE;
+}
+
+/*
+ * Fill state "idx" with a repeated simple item "opnd", matched "minval" to
+ * "maxval" times.  Each repetition is one NFA_REP state, thus "a\{3,5}"
+ * becomes a chain of three states followed by two that can be skipped.
+ */
+    static void
+nfa_fill_rep(idx, opnd, minval, maxval, lazy, out)
+    int		idx;
+    char_u	*opnd;
+    long	minval;
+    long	maxval;
+    int		lazy;
+    int		out;
+{
+    int		cur = idx;
+    int		rep;
+    int		next;
+    long	count;
+    int		arg = (int)(opnd - nfa_program);
+
+    if (!nfa_simple_item(opnd, TRUE) || minval > NFA_MAX_STATES
+	    || (maxval != MAX_LIMIT && maxval > NFA_MAX_STATES))
+    {
+	nfa_failed = TRUE;
+	return;
+    }
+    for (count = 0; ; ++count)
+    {
+	if (count >= maxval && maxval != MAX_LIMIT)
+	{
+	    NFA_STATE(cur).ns_out = out;
+	    return;
+	}
+	rep = nfa_new_state(NFA_REP, -1, 0);
+	if (rep < 0)
+	    return;
+	NFA_STATE(rep).ns_arg = arg;
+	if (count >= minval && maxval == MAX_LIMIT)
+	{
+	    /* Loop back to the split for any number of extra items. */
+	    NFA_STATE(rep).ns_out = cur;
+	    next = -1;
+	}
+	else
+	{
+	    next = nfa_new_state(NFA_EMPTY, -1, 0);
+	    if (next < 0)
+		return;
+	    NFA_STATE(rep).ns_out = next;
+	}
+	if (count < minval)
+	{
+	    NFA_STATE(cur).ns_out = rep;
+	}
+	else
+	{
+	    NFA_STATE(cur).ns_op = NFA_SPLIT;
+	    NFA_STATE(cur).ns_out = lazy ? out : rep;
+	    NFA_STATE(cur).ns_out1 = lazy ? rep : out;
+	}
+	if (next < 0)
+	    return;
+	cur = next;
+    }
+}
+
+/*
+ * Fill state "idx" for the BRACE_COMPLEX node "scan" in context "ctx".  The
+ * context tells how many times the operand has been matched.
+ */
+    static void
+nfa_fill_brace(idx, scan, ctx)
+    int		idx;
+    char_u	*scan;
+    int		ctx;
+{
+    nfa_ctx_T	nc;
+    int		node = (int)(scan - nfa_program);
+    int		more = -1;
+    int		out;
+
+    if (ctx < 0 || NFA_CTX(ctx).nc_brace != node)
+    {
+	nfa_failed = TRUE;
+	return;
+    }
+    nc = NFA_CTX(ctx);
+    if (nc.nc_max == MAX_LIMIT && nc.nc_count > nc.nc_min)
+    {
+	/* Any number of extra matches: loop back to the state after the
+	 * minimal number. */
+	/* Use a local: nfa_state_for() may move the states. */
+	out = nfa_state_for(scan,
+		       nfa_get_ctx(nc.nc_parent, node, (int)nc.nc_min, &nc));
+	NFA_STATE(idx).ns_out = out;
+	return;
+    }
+    if (nc.nc_max == MAX_LIMIT || nc.nc_count < nc.nc_max)
+	more = nfa_state_for(OPERAND(scan),
+		       nfa_get_ctx(nc.nc_parent, node, nc.nc_count + 1, &nc));
+    if (nc.nc_count < nc.nc_min)
+    {
+	NFA_STATE(idx).ns_out = more;
+	return;
+    }
+    out = nfa_state_for(regnext(scan), nc.nc_parent);
+    if (more < 0)
+    {
+	NFA_STATE(idx).ns_out = out;
+	return;
+    }
+    NFA_STATE(idx).ns_op = NFA_SPLIT;
+    NFA_STATE(idx).ns_out = nc.nc_lazy ? out : more;
+    NFA_STATE(idx).ns_out1 = nc.nc_lazy ? more : out;
+}
+
+/*
+ * Fill in state "idx" from the node it was made for.
+ */
+    static void
+nfa_fill(idx)
+    int		idx;
+{
+    int		*key = (int *)nfa_key.ga_data + 2 * idx;
+    int		ctx = key[1];
+    char_u	*scan = nfa_program + key[0];
+    char_u	*next = regnext(scan);
+    int		op = OP(scan);
+    int		out;
+    nfa_ctx_T	nc;
+
+    switch (op)
+    {
+      case END:
+	NFA_STATE(idx).ns_op = NFA_MATCH;
+	return;
+
+      case BRANCH:
+	out = nfa_state_for(OPERAND(scan), ctx);
+	if (OP(next) == BRANCH)	/* else only one choice */
+	{
+	    int out1 = nfa_state_for(next, ctx);
+
+	    NFA_STATE(idx).ns_op = NFA_SPLIT;
+	    NFA_STATE(idx).ns_out1 = out1;
+	}
+	break;
+
+      case EXACTLY:
+	if (*OPERAND(scan) != NUL)
+	    NFA_STATE(idx).ns_op = op;
+	/* else: "~" when the previous substitute string was empty */
+	out = nfa_state_for(next, ctx);
+	break;
+
+      case BACK:
+	/* Kept, nfa_closure() stops a loop that doesn't move on here. */
+	NFA_STATE(idx).ns_op = op;
+	NFA_STATE(idx).ns_out1 = nfa_back_nr(scan);
+	out = nfa_state_for(next, ctx);
+	break;
+
+      case NOTHING:
+      case NOPEN:
+      case NCLOSE:
+	out = nfa_state_for(next, ctx);
+	break;
+
+      case BOL:
+      case EOL:
+      case BOW:
+      case EOW:
+      case MOPEN + 0: case MOPEN + 1: case MOPEN + 2: case MOPEN + 3:
+      case MOPEN + 4: case MOPEN + 5: case MOPEN + 6: case MOPEN + 7:
+      case MOPEN + 8: case MOPEN + 9:
+      case MCLOSE + 0: case MCLOSE + 1: case MCLOSE + 2: case MCLOSE + 3:
+      case MCLOSE + 4: case MCLOSE + 5: case MCLOSE + 6: case MCLOSE + 7:
+      case MCLOSE + 8: case MCLOSE + 9:
+	if (op >= MOPEN && op <= MCLOSE + 9 && (op - MOPEN) % 10 >= nfa_nsub)
+	    nfa_nsub = (op - MOPEN) % 10 + 1;
+	NFA_STATE(idx).ns_op = op;
+	out = nfa_state_for(next, ctx);
+	break;
+
+      case STAR:
+	nfa_fill_rep(idx, OPERAND(scan), 0L, MAX_LIMIT, FALSE,
+						    nfa_state_for(next, ctx));
+	return;
+
+      case PLUS:
+	nfa_fill_rep(idx, OPERAND(scan), 1L, MAX_LIMIT, FALSE,
+						    nfa_state_for(next, ctx));
+	return;
+
+      case BRACE_LIMITS:
+	/* Reversed limits mean: shortest match first. */
+	nc.nc_lazy = OPERAND_MIN(scan) > OPERAND_MAX(scan);
+	nc.nc_min = nc.nc_lazy ? OPERAND_MAX(scan) : OPERAND_MIN(scan);
+	nc.nc_max = nc.nc_lazy ? OPERAND_MIN(scan) : OPERAND_MAX(scan);
+	if (next != NULL && OP(next) == BRACE_SIMPLE)
+	{
+	    nfa_fill_rep(idx, OPERAND(next), nc.nc_min, nc.nc_max, nc.nc_lazy,
+					  nfa_state_for(regnext(next), ctx));
+	    return;
+	}
+	if (next == NULL || OP(next) < BRACE_COMPLEX
+					       || OP(next) > BRACE_COMPLEX + 9)
+	{
+	    nfa_failed = TRUE;
+	    return;
+	}
+	out = nfa_state_for(next,
+		   nfa_get_ctx(ctx, (int)(next - nfa_program), 0, &nc));
+	break;
+
+      case BRACE_COMPLEX + 0: case BRACE_COMPLEX + 1: case BRACE_COMPLEX + 2:
+      case BRACE_COMPLEX + 3: case BRACE_COMPLEX + 4: case BRACE_COMPLEX + 5:
+      case BRACE_COMPLEX + 6: case BRACE_COMPLEX + 7: case BRACE_COMPLEX + 8:
+      case BRACE_COMPLEX + 9:
+	nfa_fill_brace(idx, scan, ctx);
+	return;
+
+      default:
+	if (!nfa_simple_item(scan, FALSE))
+	{
+	    /* NEWL, BACKREF, BEHIND, CURSOR, etc. */
+	    nfa_failed = TRUE;
+	    return;
+	}
+	NFA_STATE(idx).ns_op = op;
+	out = nfa_state_for(next, ctx);
+	break;
+    }
+    if (!nfa_failed)
+	NFA_STATE(idx).ns_out = out;
+}
+
+/*
+ * Translate the backtracking program "prog", of "progsize" bytes, into an NFA
+ * and return a new program with the NFA states appended.  "prog" is freed
+ * then.  When the pattern can't be done by the NFA, or "force" is FALSE and
+ * the pattern doesn't repeat a group, "prog" is returned unmodified.
+ */
+    static regprog_T *
+nfa_regcomp(prog, progsize, force)
+    regprog_T	*prog;
+    long	progsize;
+    int		force;
+{
+    regprog_T	*r = prog;
+    long	offset;
+
+    /* Line breaks can't be matched, "\Z" is not supported. */
+    if (prog->regflags & (RF_HASNL | RF_LOOKBH | RF_ICOMBINE))
+	return prog;
+    /* Without "\(a*\)*" or "\(a\|b\)\{2,}" backtracking is cheap enough. */
+    if (!force && !(prog->regflags & RF_LOOP))
+	return prog;
+
+    nfa_program = prog->program;
+    ga_init2(&nfa_states, (int)sizeof(nfa_state_T), 32);
+    ga_init2(&nfa_key, (int)sizeof(int), 64);
+    ga_init2(&nfa_ctxs, (int)sizeof(nfa_ctx_T), 8);
+    ga_init2(&nfa_todo, (int)sizeof(int), 32);
+    ga_init2(&nfa_backs, (int)sizeof(int), 8);
+    nfa_hash = NULL;
+    nfa_chain = NULL;
+    nfa_hash_size = 0;
+    nfa_nsub = 1;
+    nfa_failed = FALSE;
+
+    /* The first state is for the first node, where matching starts. */
+    nfa_state_for(prog->program + 1, -1);
+    while (nfa_todo.ga_len > 0 && !nfa_failed)
+	nfa_fill(((int *)nfa_todo.ga_data)[--nfa_todo.ga_len]);
+
+    if (!nfa_failed)
+    {
+	/* Append the states after the program, suitably aligned. */
+	offset = (long)sizeof(regprog_T) + progsize;
+	offset = (offset + sizeof(long) - 1) / sizeof(long) * sizeof(long);
+	r = (regprog_T *)lalloc((long_u)(offset
+			      + nfa_states.ga_len * sizeof(nfa_state_T)), TRUE);
+	if (r == NULL)
+	    r = prog;
+	else
+	{
+	    mch_memmove(r, prog, (size_t)(sizeof(regprog_T) + progsize));
+	    if (prog->regmust != NULL)
+		r->regmust = r->program + (prog->regmust - prog->program);
+	    r->regnfa = (nfa_state_T *)((char_u *)r + offset);
+	    mch_memmove(r->regnfa, nfa_states.ga_data,
+				 nfa_states.ga_len * sizeof(nfa_state_T));
+	    r->regnfa_len = nfa_states.ga_len;
+	    r->regnfa_nsub = nfa_nsub;
+	    vim_free(prog);
+	}
+    }
+
+    ga_clear(&nfa_states);
+    ga_clear(&nfa_key);
+    ga_clear(&nfa_ctxs);
+    ga_clear(&nfa_todo);
+    ga_clear(&nfa_backs);
+    vim_free(nfa_hash);
+    vim_free(nfa_chain);
+    return r;
+}
+
+/*
+ * A thread in "nfa_list" is a sequence of ints: the column where it
+ * continues, the state and the submatch columns (-1 for not set).
+ */
+#define NFA_THREAD_HDR	2
+#define NFA_LIST_INITIAL 1024
+
+/*
+ * Check if the simple item "scan" matches at "s", like regmatch() does.
+ * Returns the number of bytes matched, -1 if it doesn't match.
+ */
+    static int
+nfa_match_item(rex, scan, s)
+    regexec_T	*rex;
+    char_u	*scan;
+    char_u	*s;
+{
+    int		op = OP(scan);
+    int		c;
+    int		ok;
+    int		len;
+    char_u	*opnd = OPERAND(scan);
+
+    if (*s == NUL)
+	return -1;
+#ifdef FEAT_MBYTE
+    if (has_mbyte)
+	c = (*mb_ptr2char)(s);
+    else
+#endif
+	c = *s;
+
+    switch (op)
+    {
+      case ANY:	    ok = TRUE; break;
+      case IDENT:   ok = vim_isIDc(c); break;
+      case SIDENT:  ok = !VIM_ISDIGIT(*s) && vim_isIDc(c); break;
+      case KWORD:   ok = vim_iswordp(s); break;
+      case SKWORD:  ok = !VIM_ISDIGIT(*s) && vim_iswordp(s); break;
+      case FNAME:   ok = vim_isfilec(c); break;
+      case SFNAME:  ok = !VIM_ISDIGIT(*s) && vim_isfilec(c); break;
+      case PRINT:   ok = ptr2cells(s) == 1; break;
+      case SPRINT:  ok = !VIM_ISDIGIT(*s) && ptr2cells(s) == 1; break;
+      case WHITE:   ok = vim_iswhite(c); break;
+      case NWHITE:  ok = !vim_iswhite(c); break;
+      case DIGIT:   ok = ri_digit(c); break;
+      case NDIGIT:  ok = !ri_digit(c); break;
+      case HEX:	    ok = ri_hex(c); break;
+      case NHEX:    ok = !ri_hex(c); break;
+      case OCTAL:   ok = ri_octal(c); break;
+      case NOCTAL:  ok = !ri_octal(c); break;
+      case WORD:    ok = ri_word(c); break;
+      case NWORD:   ok = !ri_word(c); break;
+      case HEAD:    ok = ri_head(c); break;
+      case NHEAD:   ok = !ri_head(c); break;
+      case ALPHA:   ok = ri_alpha(c); break;
+      case NALPHA:  ok = !ri_alpha(c); break;
+      case LOWER:   ok = ri_lower(c); break;
+      case NLOWER:  ok = !ri_lower(c); break;
+      case UPPER:   ok = ri_upper(c); break;
+      case NUPPER:  ok = !ri_upper(c); break;
+
+      case ANYOF:
+      case ANYBUT:
+	ok = (cstrchr(rex, opnd, c) == NULL) != (op == ANYOF);
+	break;
+
+      case EXACTLY:
+	if (*opnd != *s && (!rex->ireg_ic || (
+#ifdef FEAT_MBYTE
+			    !enc_utf8 &&
+#endif
+			    MB_TOLOWER(*opnd) != MB_TOLOWER(*s))))
+	    return -1;
+	if (opnd[1] == NUL
+#ifdef FEAT_MBYTE
+		&& !(enc_utf8 && rex->ireg_ic)
+#endif
+	   )
+	    return 1;
+	len = (int)STRLEN(opnd);
+	if (cstrncmp(rex, opnd, s, &len) != 0)
+	    return -1;
+#ifdef FEAT_MBYTE
+	/* Can't match when a composing character follows. */
+	if (enc_utf8 && UTF_COMPOSINGLIKE(s, s + len))
+	    return -1;
+#endif
+	return len;
+
+#ifdef FEAT_MBYTE
+      case MULTIBYTECODE:
+	if (!has_mbyte || (len = (*mb_ptr2len)(opnd)) < 2
+					    || STRNCMP(opnd, s, len) != 0)
+	    return -1;
+	return len;
+#endif
+
+      default:
+	return -1;
+    }
+
+    if (!ok)
+	return -1;
+#ifdef FEAT_MBYTE
+    if (has_mbyte)
+	return (*mb_ptr2len)(s);
+#endif
+    return 1;
+}
+
+/*
+ * Check if the operand "scan" of a STAR, PLUS or BRACE_SIMPLE node matches
+ * once at "s", like one round in regrepeat().
+ * Returns the number of bytes matched, -1 if it doesn't match.
+ */
+    static int
+nfa_match_rep(rex, scan, s)
+    regexec_T	*rex;
+    char_u	*scan;
+    char_u	*s;
+{
+    char_u	*opnd = OPERAND(scan);
+    int		mask = 0;
+    int		testval = 0;
+    int		len = 1;
+
+    if (*s == NUL)
+	return -1;
+#ifdef FEAT_MBYTE
+    if (has_mbyte)
+	len = (*mb_ptr2len)(s);
+#endif
+
+    switch (OP(scan))
+    {
+      case ANY:
+	return len;
+
+      case IDENT:
+      case SIDENT:
+	if (vim_isIDc(*s) && (OP(scan) == IDENT || !VIM_ISDIGIT(*s)))
+	    return len;
+	return -1;
+
+      case KWORD:
+      case SKWORD:
+	if (vim_iswordp(s) && (OP(scan) == KWORD || !VIM_ISDIGIT(*s)))
+	    return len;
+	return -1;
+
+      case FNAME:
+      case SFNAME:
+	if (vim_isfilec(*s) && (OP(scan) == FNAME || !VIM_ISDIGIT(*s)))
+	    return len;
+	return -1;
+
+      case PRINT:
+      case SPRINT:
+	if (ptr2cells(s) == 1 && (OP(scan) == PRINT || !VIM_ISDIGIT(*s)))
+	    return len;
+	return -1;
+
+      case WHITE:	testval = RI_WHITE;	/*FALLTHROUGH*/
+      case NWHITE:	mask = RI_WHITE;	break;
+      case DIGIT:	testval = RI_DIGIT;	/*FALLTHROUGH*/
+      case NDIGIT:	mask = RI_DIGIT;	break;
+      case HEX:		testval = RI_HEX;	/*FALLTHROUGH*/
+      case NHEX:	mask = RI_HEX;		break;
+      case OCTAL:	testval = RI_OCTAL;	/*FALLTHROUGH*/
+      case NOCTAL:	mask = RI_OCTAL;	break;
+      case WORD:	testval = RI_WORD;	/*FALLTHROUGH*/
+      case NWORD:	mask = RI_WORD;		break;
+      case HEAD:	testval = RI_HEAD;	/*FALLTHROUGH*/
+      case NHEAD:	mask = RI_HEAD;		break;
+      case ALPHA:	testval = RI_ALPHA;	/*FALLTHROUGH*/
+      case NALPHA:	mask = RI_ALPHA;	break;
+      case LOWER:	testval = RI_LOWER;	/*FALLTHROUGH*/
+      case NLOWER:	mask = RI_LOWER;	break;
+      case UPPER:	testval = RI_UPPER;	/*FALLTHROUGH*/
+      case NUPPER:	mask = RI_UPPER;	break;
+
+      case EXACTLY:
+	if (rex->ireg_ic ? (*s == MB_TOUPPER(*opnd) || *s == MB_TOLOWER(*opnd))
+								: *s == *opnd)
+	    return 1;
+	return -1;
+
+#ifdef FEAT_MBYTE
+      case MULTIBYTECODE:
+	if ((len = (*mb_ptr2len)(opnd)) < 2)
+	    return -1;
+	if (STRNCMP(opnd, s, len) == 0
+		|| (rex->ireg_ic && enc_utf8 && utf_fold(utf_ptr2char(s))
+					       == utf_fold(utf_ptr2char(opnd))))
+	    return len;
+	return -1;
+#endif
+
+      case ANYOF:
+      case ANYBUT:
+#ifdef FEAT_MBYTE
+	if (len > 1)
+	{
+	    if ((cstrchr(rex, opnd, (*mb_ptr2char)(s)) == NULL)
+							 == (OP(scan) == ANYOF))
+		return -1;
+	    return len;
+	}
+#endif
+	if ((cstrchr(rex, opnd, *s) == NULL) == (OP(scan) == ANYOF))
+	    return -1;
+	return 1;
+
+      default:
+	return -1;
+    }
+
+    /* Character classes, like the "do_class" code in regrepeat(). */
+#ifdef FEAT_MBYTE
+    if (len > 1)
+	return testval != 0 ? -1 : len;
+#endif
+    if ((class_tab[*s] & mask) == testval)
+	return 1;
+    return -1;
+}
+
+/*
+ * Push two ints on "nfa_stack".
+ */
+    static int
+nfa_push(rex, a, b)
+    regexec_T	*rex;
+    int		a;
+    int		b;
+{
+    int		*p;
+
+    if (ga_grow(&rex->nfa_stack, 2) == FAIL)
+	return FAIL;
+    p = (int *)rex->nfa_stack.ga_data + rex->nfa_stack.ga_len;
+    p[0] = a;
+    p[1] = b;
+    rex->nfa_stack.ga_len += 2;
+    return OK;
+}
+
+/*
+ * Follow the states from "start" at column "pos" that don't consume
+ * characters, in priority order, with the submatches in "nfa_sub".  The
+ * threads for which the next character matches are added to "gap", the
+ * lowest column where one continues is stored in "*nextposp".
+ * Like the backtracking engine a loop stops at a BACK it already passed at
+ * this column.  Each state on the stack comes with a mask of the BACK nodes
+ * passed, a state is followed again when it is reached with fewer of them.
+ * Returns TRUE when the end of the pattern is reached, then "nfa_best" has
+ * the submatches and the remaining threads must be dropped.  Also returns
+ * TRUE when out of memory, with "nfa_nomem" set.
+ */
+    static int
+nfa_closure(rex, prog, ncap, start, pos, gap, nextposp)
+    regexec_T	*rex;
+    regprog_T	*prog;
+    int		ncap;
+    int		start;
+    colnr_T	pos;
+    garray_T	*gap;
+    colnr_T	*nextposp;
+{
+    nfa_state_T	*st;
+    int		*p;
+    int		a, b;
+    int		slot;
+    int		len;
+    int		c;
+
+    rex->nfa_stack.ga_len = 0;
+    if (nfa_push(rex, start, 0) == FAIL)
+	goto nomem;
+    while (rex->nfa_stack.ga_len > 0)
+    {
+	rex->nfa_stack.ga_len -= 2;
+	a = ((int *)rex->nfa_stack.ga_data)[rex->nfa_stack.ga_len];
+	b = ((int *)rex->nfa_stack.ga_data)[rex->nfa_stack.ga_len + 1];
+	if (a < -2 * NSUBEXP)
+	{
+	    /* Done with all the states after state "a". */
+	    a = -1 - 2 * NSUBEXP - a;
+	    if (rex->nfa_visited[a] == rex->nfa_listid)
+		rex->nfa_visited[a] = rex->nfa_listid + 1;
+	    continue;
+	}
+	if (a < 0)
+	{
+	    /* Done with the states after a MOPEN or MCLOSE. */
+	    rex->nfa_sub[-1 - a] = b;
+	    continue;
+	}
+	st = &prog->regnfa[a];
+	if (rex->nfa_visited[a] == rex->nfa_listid + 1
+					     && (rex->nfa_vmask[a] & ~b) == 0)
+	    /* A thread with a higher priority was here and could pass all
+	     * the BACK nodes this one can, nothing new to be found. */
+	    continue;
+	if (rex->nfa_visited[a] != rex->nfa_listid)
+	{
+	    rex->nfa_visited[a] = rex->nfa_listid;
+	    rex->nfa_vmask[a] = b;
+	    if (nfa_push(rex, -1 - 2 * NSUBEXP - a, 0) == FAIL)
+		goto nomem;
+	}
+	/* else: looped back to a state that is still being followed, without
+	 * consuming anything.  Go on like the backtracking engine does, the
+	 * BACK of the loop stops it. */
+	len = -1;
+
+	switch (st->ns_op)
+	{
+	  case NFA_MATCH:
+	    mch_memmove(rex->nfa_best, rex->nfa_sub, ncap * sizeof(int));
+	    if (rex->nfa_best[1] < 0)
+		rex->nfa_best[1] = pos;
+	    return TRUE;
+
+	  case NFA_SPLIT:
+	    if (nfa_push(rex, st->ns_out1, b) == FAIL)
+		goto nomem;
+	    /*FALLTHROUGH*/
+	  case NFA_EMPTY:
+	    len = 0;
+	    break;
+
+	  case BACK:
+	    /* A repetition that didn't move on fails. */
+	    if (!(b & (1 << st->ns_out1)))
+	    {
+		b |= 1 << st->ns_out1;
+		len = 0;
+	    }
+	    break;
+
+	  case BOL:
+	    if (pos == 0)
+		len = 0;
+	    break;
+
+	  case EOL:
+	    if (rex->regline[pos] == NUL)
+		len = 0;
+	    break;
+
+	  case BOW:	/* \<word; reginput points to w */
+	    c = rex->regline[pos];
+	    if (c == NUL)	/* Can't match at end of line */
+		break;
+#ifdef FEAT_MBYTE
+	    if (has_mbyte)
+	    {
+		int this_class;
+
+		/* Get class of current and previous char (if it exists). */
+		this_class = mb_get_class(rex->reginput);
+		if (this_class > 1 && reg_prev_class(rex) != this_class)
+		    len = 0;
+	    }
+	    else
+#endif
+	    if (vim_iswordc(c)
+			  && (pos == 0 || !vim_iswordc(rex->regline[pos - 1])))
+		len = 0;
+	    break;
+
+	  case EOW:	/* word\>; reginput points after d */
+	    if (pos == 0)	/* Can't match at start of line */
+		break;
+#ifdef FEAT_MBYTE
+	    if (has_mbyte)
+	    {
+		int this_class, prev_class;
+
+		/* Get class of current and previous char (if it exists). */
+		this_class = mb_get_class(rex->reginput);
+		prev_class = reg_prev_class(rex);
+		if (this_class != prev_class && prev_class != 0
+							     && prev_class != 1)
+		    len = 0;
+	    }
+	    else
+#endif
+	    if (vim_iswordc(rex->regline[pos - 1])
+		    && (rex->regline[pos] == NUL
+					   || !vim_iswordc(rex->regline[pos])))
+		len = 0;
+	    break;
+
+	  case NFA_REP:
+	    len = nfa_match_rep(rex, prog->program + st->ns_arg,
+								rex->reginput);
+	    break;
+
+	  default:
+	    if (st->ns_op >= MOPEN && st->ns_op <= MCLOSE + 9)
+	    {
+		/* Remember the column, restore it when the states after
+		 * this one have been done. */
+		if (st->ns_op < MCLOSE)
+		    slot = 2 * (st->ns_op - MOPEN);
+		else
+		    slot = 2 * (st->ns_op - MCLOSE) + 1;
+		if (nfa_push(rex, -1 - slot, rex->nfa_sub[slot]) == FAIL)
+		    goto nomem;
+		rex->nfa_sub[slot] = pos;
+		len = 0;
+	    }
+	    else
+		len = nfa_match_item(rex, prog->program + st->ns_arg,
+								rex->reginput);
+	    break;
+	}
+
+	if (len == 0)
+	{
+	    if (nfa_push(rex, st->ns_out, b) == FAIL)
+		goto nomem;
+	}
+	else if (len > 0)
+	{
+	    /* Matched "len" bytes, continue after them. */
+	    if (ga_grow(gap, NFA_THREAD_HDR + ncap) == FAIL)
+		goto nomem;
+	    p = (int *)gap->ga_data + gap->ga_len;
+	    p[0] = pos + len;
+	    p[1] = st->ns_out;
+	    mch_memmove(p + NFA_THREAD_HDR, rex->nfa_sub, ncap * sizeof(int));
+	    gap->ga_len += NFA_THREAD_HDR + ncap;
+	    if (pos + len < *nextposp)
+		*nextposp = pos + len;
+	}
+    }
+    return FALSE;
+
+nomem:
+    rex->nfa_nomem = TRUE;
+    return TRUE;
+}
+
+/*
+ * Return the first column at or after "col" where the backtracking engine
+ * would try a match: where the "regstart" character appears.  Returns -1 if
+ * there is none.
+ */
+    static colnr_T
+nfa_next_start(rex, prog, col)
+    regexec_T	*rex;
+    regprog_T	*prog;
+    colnr_T	col;
+{
+    char_u	*s;
+
+    if (prog->regstart != NUL)
+    {
+	if (!rex->ireg_ic
+#ifdef FEAT_MBYTE
+		&& !has_mbyte
+#endif
+		)
+	    s = vim_strbyte(rex->regline + col, prog->regstart);
+	else
+	    s = cstrchr(rex, rex->regline + col, prog->regstart);
+	if (s == NULL)
+	    return -1;
+	col = (colnr_T)(s - rex->regline);
+    }
+    if (rex->ireg_maxcol > 0 && col >= rex->ireg_maxcol)
+	return -1;
+    return col;
+}
+
+/*
+ * Match the NFA of "prog" against "regline", starting at column "col".  Like
+ * the loop around regtry() in vim_regexec_both(), but all start columns and
+ * all alternatives are tried at the same time.
+ * Returns 0 for failure, 1 for a match.
+ */
+    static long
+nfa_regexec(rex, prog, col, tm)
+    regexec_T	*rex;
+    regprog_T	*prog;
+    colnr_T	col;
+    proftime_T	*tm UNUSED;
+{
+    int		ncap = 2 * prog->regnfa_nsub;
+    int		size = NFA_THREAD_HDR + ncap;
+    garray_T	*cur = &rex->nfa_list[0];
+    garray_T	*nxt = &rex->nfa_list[1];
+    garray_T	*tmp;
+    colnr_T	pos;
+    colnr_T	startcol;	/* where the next match may start, or -1 */
+    colnr_T	nextpos;
+    int		matched = FALSE;
+    int		done;
+    int		*p;
+    int		i;
+#ifdef FEAT_RELTIME
+    int		tm_count = 0;
+#endif
+
+    if (rex->nfa_visited_len < prog->regnfa_len)
+    {
+	vim_free(rex->nfa_visited);
+	vim_free(rex->nfa_vmask);
+	rex->nfa_visited = (int *)alloc_clear(
+				   (unsigned)(prog->regnfa_len * sizeof(int)));
+	rex->nfa_vmask = (int *)alloc(
+				   (unsigned)(prog->regnfa_len * sizeof(int)));
+	if (rex->nfa_visited == NULL || rex->nfa_vmask == NULL)
+	{
+	    vim_free(rex->nfa_visited);
+	    vim_free(rex->nfa_vmask);
+	    rex->nfa_visited = NULL;
+	    rex->nfa_vmask = NULL;
+	    rex->nfa_visited_len = 0;
+	    return 0L;
+	}
+	rex->nfa_visited_len = prog->regnfa_len;
+	rex->nfa_listid = 0;
+    }
+    if (rex->nfa_listid > 1000000000)
+    {
+	vim_memset(rex->nfa_visited, 0, rex->nfa_visited_len * sizeof(int));
+	rex->nfa_listid = 0;
+    }
+    for (i = 0; i < 2; ++i)
+    {
+	if (rex->nfa_list[i].ga_data == NULL)
+	    ga_init2(&rex->nfa_list[i], (int)sizeof(int), NFA_LIST_INITIAL);
+	rex->nfa_list[i].ga_len = 0;
+    }
+    if (rex->nfa_stack.ga_data == NULL)
+	ga_init2(&rex->nfa_stack, (int)sizeof(int), NFA_LIST_INITIAL);
+
+    rex->nfa_nomem = FALSE;
+
+    /* The caller already checked "regstart" for an anchored pattern. */
+    startcol = prog->reganch ? col : nfa_next_start(rex, prog, col);
+    pos = startcol;
+
+    while (pos >= 0)
+    {
+	rex->nfa_listid += 2;
+	nxt->ga_len = 0;
+	nextpos = MAXCOL;
+	rex->reginput = rex->regline + pos;
+	done = FALSE;
+
+	/* Threads in priority order.  Those that continue further on are
+	 * only passed on. */
+	for (i = 0; i < cur->ga_len && !done; i += size)
+	{
+	    p = (int *)cur->ga_data + i;
+	    if (p[0] > pos)
+	    {
+		if (ga_grow(nxt, size) == FAIL)
+		{
+		    rex->nfa_nomem = TRUE;
+		    break;
+		}
+		mch_memmove((int *)nxt->ga_data + nxt->ga_len, p,
+							   size * sizeof(int));
+		nxt->ga_len += size;
+		if (p[0] < nextpos)
+		    nextpos = p[0];
+	    }
+	    else
+	    {
+		mch_memmove(rex->nfa_sub, p + NFA_THREAD_HDR,
+							   ncap * sizeof(int));
+		done = nfa_closure(rex, prog, ncap, p[1], pos, nxt,
+								    &nextpos);
+	    }
+	}
+
+	/* A new thread for a match starting here has the lowest priority. */
+	if (!done && !matched && pos == startcol)
+	{
+	    for (i = 0; i < ncap; ++i)
+		rex->nfa_sub[i] = -1;
+	    rex->nfa_sub[0] = pos;
+	    done = nfa_closure(rex, prog, ncap, 0, pos, nxt, &nextpos);
+	    if (prog->reganch || rex->regline[pos] == NUL)
+		startcol = -1;
+	    else
+	    {
+#ifdef FEAT_MBYTE
+		if (has_mbyte)
+		    startcol = pos + (*mb_ptr2len)(rex->regline + pos);
+		else
+#endif
+		    startcol = pos + 1;
+		startcol = nfa_next_start(rex, prog, startcol);
+	    }
+	}
+
+	fast_breakcheck();
+	if (got_int || rex->nfa_nomem)
+	{
+	    matched = FALSE;
+	    break;
+	}
+	if (done)
+	{
+	    /* Found a match, only threads with a higher priority can still
+	     * find a better one. */
+	    matched = TRUE;
+	    startcol = -1;
+	}
+#ifdef FEAT_RELTIME
+	/* Check for timeout once in a twenty times to avoid overhead. */
+	if (tm != NULL && ++tm_count == 20)
+	{
+	    tm_count = 0;
+	    if (profile_passed_limit(tm))
+	    {
+		matched = FALSE;
+		break;
+	    }
+	}
+#endif
+
+	tmp = cur;
+	cur = nxt;
+	nxt = tmp;
+
+	/* Continue where the first thread is, or where the next match may
+	 * start. */
+	if (cur->ga_len == 0)
+	    pos = startcol;
+	else if (startcol >= 0 && startcol < nextpos)
+	    pos = startcol;
+	else
+	    pos = nextpos;
+    }
+
+    if (rex->nfa_list[0].ga_maxlen > NFA_LIST_INITIAL * 8)
+	ga_clear(&rex->nfa_list[0]);
+    if (rex->nfa_list[1].ga_maxlen > NFA_LIST_INITIAL * 8)
+	ga_clear(&rex->nfa_list[1]);
+    if (rex->nfa_stack.ga_maxlen > NFA_LIST_INITIAL * 8)
+	ga_clear(&rex->nfa_stack);
+
+    if (!matched)
+	return 0L;
+
+    if (REG_MULTI)
+    {
+	for (i = 0; i < NSUBEXP; ++i)
+	{
+	    rex->reg_startpos[i].lnum = -1;
+	    rex->reg_startpos[i].col = -1;
+	    rex->reg_endpos[i].lnum = -1;
+	    rex->reg_endpos[i].col = -1;
+	    if (i < prog->regnfa_nsub && rex->nfa_best[2 * i] >= 0)
+	    {
+		rex->reg_startpos[i].lnum = 0;
+		rex->reg_startpos[i].col = rex->nfa_best[2 * i];
+	    }
+	    if (i < prog->regnfa_nsub && rex->nfa_best[2 * i + 1] >= 0)
+	    {
+		rex->reg_endpos[i].lnum = 0;
+		rex->reg_endpos[i].col = rex->nfa_best[2 * i + 1];
+	    }
+	}
+    }
+    else
+    {
+	for (i = 0; i < NSUBEXP; ++i)
+	{
+	    rex->reg_startp[i] = NULL;
+	    rex->reg_endp[i] = NULL;
+	    if (i < prog->regnfa_nsub && rex->nfa_best[2 * i] >= 0)
+		rex->reg_startp[i] = rex->regline + rex->nfa_best[2 * i];
+	    if (i < prog->regnfa_nsub && rex->nfa_best[2 * i + 1] >= 0)
+		rex->reg_endp[i] = rex->regline + rex->nfa_best[2 * i + 1];
+	}
+    }
+#ifdef FEAT_SYN_HL
+    /* A pattern with \z(...\) is never done here. */
+    unref_extmatch(re_extmatch_out);
+    re_extmatch_out = NULL;
+#endif
+    return 1L;
+}
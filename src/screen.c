@@ -110,6 +110,39 @@ static int	screen_cur_row, screen_cur_col;	/* last known cursor position */
 
 #ifdef FEAT_SEARCH_EXTRA
 static match_T search_hl;	/* used for 'hlsearch' highlight matching */
+
+/*
+ * Cache of the results of searching lines for 'hlsearch' and match
+ * highlighting.  Without it every redraw searches the displayed lines again,
+ * and for a multi-line pattern also the lines above them.
+ * There is a cache for each pattern and buffer.  An entry holds the result of
+ * vim_regexec_multi() for a line and start column.  Entries are sorted on
+ * line number and column.  Changing the text invalidates the entries for the
+ * changed lines, see search_hl_cache_changed().
+ */
+typedef struct
+{
+    linenr_T	lnum;		/* line searched */
+    colnr_T	col;		/* column where the search started */
+    long	nmatched;	/* result of vim_regexec_multi() */
+    lpos_T	startpos;	/* start of the match, relative to "lnum" */
+    lpos_T	endpos;		/* end of the match, relative to "lnum" */
+} hlentry_T;
+
+typedef struct
+{
+    regprog_T	*prog;		/* the pattern, we hold a reference */
+    int		ic;		/* ignore case */
+    buf_T	*buf;		/* the buffer searched */
+    char_u	chartab[32];	/* 'iskeyword' used for "\k", "\<", etc. */
+    garray_T	entries;	/* growarray of hlentry_T */
+} hlcache_T;
+
+#define HLCACHE_SIZE	    8	    /* max nr of caches */
+#define HLCACHE_MAXENTRIES  1000    /* max nr of entries in one cache */
+
+static hlcache_T hlcache[HLCACHE_SIZE];	/* most recently used first */
+static int	hlcache_len = 0;	/* nr of used items in hlcache[] */
 #endif
 
 #ifdef FEAT_FOLDING
@@ -150,6 +183,10 @@ static void end_search_hl __ARGS((void));
 static void init_search_hl __ARGS((win_T *wp));
 static void prepare_search_hl __ARGS((win_T *wp, linenr_T lnum));
 static void next_search_hl __ARGS((win_T *win, match_T *shl, linenr_T lnum, colnr_T mincol));
+static long search_hl_regexec __ARGS((win_T *win, match_T *shl, linenr_T lnum, colnr_T col));
+static hlcache_T *hlcache_get __ARGS((match_T *shl));
+static int hlcache_find __ARGS((hlcache_T *hc, linenr_T lnum, colnr_T col));
+static void hlcache_free __ARGS((hlcache_T *hc));
 #endif
 #ifdef FEAT_VIMSHELL
 void screen_start_highlight __ARGS((int attr));
@@ -7029,7 +7066,7 @@ end_search_hl()
 {
     if (search_hl.rm.regprog != NULL)
     {
-	vim_free(search_hl.rm.regprog);
+	vim_regfree(search_hl.rm.regprog);
 	search_hl.rm.regprog = NULL;
     }
 }
@@ -7218,20 +7255,14 @@ next_search_hl(win, shl, lnum, mincol)
 	    matchcol = shl->rm.endpos[0].col;
 
 	shl->lnum = lnum;
-	nmatched = vim_regexec_multi(&shl->rm, win, shl->buf, lnum, matchcol,
-#ifdef FEAT_RELTIME
-		&(shl->tm)
-#else
-		NULL
-#endif
-		);
+	nmatched = search_hl_regexec(win, shl, lnum, matchcol);
 	if (called_emsg || got_int)
 	{
 	    /* Error while handling regexp: stop using this regexp. */
 	    if (shl == &search_hl)
 	    {
 		/* don't free regprog in the match list, it's a copy */
-		vim_free(shl->rm.regprog);
+		vim_regfree(shl->rm.regprog);
 		no_hlsearch = TRUE;
 	    }
 	    shl->rm.regprog = NULL;
@@ -7254,6 +7285,223 @@ next_search_hl(win, shl, lnum, mincol)
 	}
     }
 }
+
+/*
+ * Search for "shl" in line "lnum" of window "win" starting at column "col",
+ * like vim_regexec_multi().  Uses the cache when possible.
+ */
+    static long
+search_hl_regexec(win, shl, lnum, col)
+    win_T	*win;
+    match_T	*shl;
+    linenr_T	lnum;
+    colnr_T	col;
+{
+    hlcache_T	*hc;
+    hlentry_T	*ep;
+    hlentry_T	entry;
+    int		idx = 0;
+    long	nmatched;
+
+    hc = hlcache_get(shl);
+    if (hc != NULL)
+    {
+	idx = hlcache_find(hc, lnum, col);
+	ep = (hlentry_T *)hc->entries.ga_data + idx;
+	if (idx < hc->entries.ga_len && ep->lnum == lnum && ep->col == col)
+	{
+	    shl->rm.startpos[0] = ep->startpos;
+	    shl->rm.endpos[0] = ep->endpos;
+	    return ep->nmatched;
+	}
+    }
+
+    nmatched = vim_regexec_multi(&shl->rm, win, shl->buf, lnum, col,
+#ifdef FEAT_RELTIME
+	    &(shl->tm)
+#else
+	    NULL
+#endif
+	    );
+
+    /* Don't remember the result of a search that failed or was stopped.
+     * "hc" can't have become invalid, searching doesn't change the text. */
+    if (hc == NULL || called_emsg || got_int
+#ifdef FEAT_RELTIME
+	    || profile_passed_limit(&(shl->tm))
+#endif
+	    )
+	return nmatched;
+    if (hc->entries.ga_len >= HLCACHE_MAXENTRIES)
+    {
+	/* Too many entries, start all over. */
+	hc->entries.ga_len = 0;
+	idx = 0;
+    }
+    if (ga_grow(&hc->entries, 1) == OK)
+    {
+	entry.lnum = lnum;
+	entry.col = col;
+	entry.nmatched = nmatched;
+	entry.startpos = shl->rm.startpos[0];
+	entry.endpos = shl->rm.endpos[0];
+	ep = (hlentry_T *)hc->entries.ga_data + idx;
+	mch_memmove(ep + 1, ep,
+			 (size_t)(hc->entries.ga_len - idx) * sizeof(hlentry_T));
+	*ep = entry;
+	++hc->entries.ga_len;
+    }
+    return nmatched;
+}
+
+/*
+ * Get the cache for the pattern and buffer of "shl", creating it when
+ * needed.  Returns NULL when the result of the pattern depends on more than
+ * the text.
+ */
+    static hlcache_T *
+hlcache_get(shl)
+    match_T	*shl;
+{
+    hlcache_T	hc;
+    int		i;
+
+    for (i = 0; i < hlcache_len; ++i)
+	if (hlcache[i].prog == shl->rm.regprog
+		&& hlcache[i].ic == shl->rm.rmm_ic
+		&& hlcache[i].buf == shl->buf
+		&& vim_memcmp(hlcache[i].chartab, curbuf->b_chartab,
+						  sizeof(hc.chartab)) == 0)
+	{
+	    if (i > 0)
+	    {
+		/* Move it to the front. */
+		hc = hlcache[i];
+		mch_memmove(hlcache + 1, hlcache, i * sizeof(hlcache_T));
+		hlcache[0] = hc;
+	    }
+	    return &hlcache[0];
+	}
+
+    if (re_bufpos(shl->rm.regprog))
+	return NULL;
+
+    /* Drop the least recently used cache when all are in use. */
+    if (hlcache_len == HLCACHE_SIZE)
+	hlcache_free(&hlcache[--hlcache_len]);
+    mch_memmove(hlcache + 1, hlcache, hlcache_len * sizeof(hlcache_T));
+    ++hlcache_len;
+
+    vim_regref(shl->rm.regprog);
+    hlcache[0].prog = shl->rm.regprog;
+    hlcache[0].ic = shl->rm.rmm_ic;
+    hlcache[0].buf = shl->buf;
+    mch_memmove(hlcache[0].chartab, curbuf->b_chartab,
+						    sizeof(hlcache[0].chartab));
+    ga_init2(&hlcache[0].entries, (int)sizeof(hlentry_T), 100);
+    return &hlcache[0];
+}
+
+/*
+ * Return the index of the first entry in "hc" at or after line "lnum" and
+ * column "col".
+ */
+    static int
+hlcache_find(hc, lnum, col)
+    hlcache_T	*hc;
+    linenr_T	lnum;
+    colnr_T	col;
+{
+    hlentry_T	*entries = (hlentry_T *)hc->entries.ga_data;
+    int		lo = 0;
+    int		hi = hc->entries.ga_len;
+    int		mid;
+
+    while (lo < hi)
+    {
+	mid = (lo + hi) / 2;
+	if (entries[mid].lnum < lnum
+		|| (entries[mid].lnum == lnum && entries[mid].col < col))
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+    static void
+hlcache_free(hc)
+    hlcache_T	*hc;
+{
+    vim_regfree(hc->prog);
+    ga_clear(&hc->entries);
+}
+
+/*
+ * Called when lines "lnum" to "lnume" (exclusive) in buffer "buf" were
+ * changed and "xtra" lines were inserted (negative: deleted) before "lnume".
+ * Drops the cached results that may have changed and adjusts the line
+ * numbers below the change.
+ */
+    void
+search_hl_cache_changed(buf, lnum, lnume, xtra)
+    buf_T	*buf;
+    linenr_T	lnum;
+    linenr_T	lnume;
+    long	xtra;
+{
+    hlcache_T	*hc;
+    hlentry_T	*entries;
+    int		i;
+    int		n;
+    int		len;
+
+    for (hc = hlcache; hc < hlcache + hlcache_len; ++hc)
+    {
+	if (hc->buf != buf || hc->entries.ga_len == 0)
+	    continue;
+	entries = (hlentry_T *)hc->entries.ga_data;
+	len = hc->entries.ga_len;
+
+	/* A match for a multi-line pattern in a line above may continue in
+	 * the changed lines.  With a look-behind a match below may also
+	 * depend on them. */
+	i = hlcache_find(hc, re_multiline(hc->prog) ? 1 : lnum, 0);
+	if (re_multiline(hc->prog) && re_lookbehind(hc->prog))
+	    n = len;
+	else
+	    n = hlcache_find(hc, lnume, 0);
+	if (n > i)
+	{
+	    mch_memmove(entries + i, entries + n,
+					  (size_t)(len - n) * sizeof(hlentry_T));
+	    len -= n - i;
+	    hc->entries.ga_len = len;
+	}
+	if (xtra != 0)
+	    for ( ; i < len; ++i)
+		entries[i].lnum += xtra;
+    }
+}
+
+/*
+ * Clear the cache for buffer "buf", for all buffers when "buf" is NULL.
+ */
+    void
+search_hl_cache_clear(buf)
+    buf_T	*buf;
+{
+    int		i;
+
+    for (i = hlcache_len - 1; i >= 0; --i)
+	if (buf == NULL || hlcache[i].buf == buf)
+	{
+	    hlcache_free(&hlcache[i]);
+	    mch_memmove(hlcache + i, hlcache + i + 1,
+				  (hlcache_len - i - 1) * sizeof(hlcache_T));
+	    --hlcache_len;
+	}
+}
 #endif
 
 #ifdef FEAT_VIMSHELL
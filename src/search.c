@@ -17,6 +17,14 @@ static void save_re_pat __ARGS((int idx, char_u *pat, int magic));
 static void set_vv_searchforward __ARGS((void));
 static int first_submatch __ARGS((regmmatch_T *rp));
 #endif
+#if defined(FEAT_SEARCH_EXTRA) && defined(FEAT_RELTIME)
+static int search_count_check __ARGS((void));
+static int search_count_todo __ARGS((void));
+static int search_count_full __ARGS((void));
+static void search_count_work __ARGS((proftime_T *tm));
+static int search_count_line __ARGS((regmmatch_T *rm, linenr_T lnum));
+static int search_count_find __ARGS((linenr_T lnum, colnr_T col));
+#endif
 static int check_prevcol __ARGS((char_u *linep, int col, int ch, int *prevcol));
 static int inmacro __ARGS((char_u *, char_u *));
 static int check_linecomment __ARGS((char_u *line));
@@ -213,7 +221,7 @@ search_regcomp(pat, pat_save, pat_use, options, regmatch)
 
     regmatch->rmm_ic = ignorecase(pat);
     regmatch->rmm_maxcol = 0;
-    regmatch->regprog = vim_regcomp(pat, magic ? RE_MAGIC : 0);
+    regmatch->regprog = vim_regcomp_cached(pat, magic ? RE_MAGIC : 0);
     if (regmatch->regprog == NULL)
 	return FAIL;
     return OK;
@@ -514,6 +522,466 @@ last_pat_prog(regmatch)
 }
 #endif
 
+#if (defined(FEAT_SEARCH_EXTRA) && defined(FEAT_RELTIME)) || defined(PROTO)
+/*
+ * Counting the matches of the last search pattern, for searchcount() and
+ * "%S" in 'statusline'.  The start positions of the matches in the current
+ * buffer are kept in order.  On a big file counting takes a while, it is
+ * done a bit at a time while waiting for the user to type, see
+ * search_count_background().  When the text changes only the changed lines
+ * are counted again, see search_count_changed().  searchcount() stops
+ * counting when the maximum count that was asked for is reached.  For "%S" in
+ * 'statusline' all matches are counted.
+ */
+#define SCNT_MAXSHIFT	1000	/* max matches to move for a change */
+
+typedef struct
+{
+    lpos_T	pos;		/* start of the match */
+    linenr_T	from;		/* line the search started in, "pos.lnum" is
+				   below it for a multi-line pattern */
+} scnt_match_T;
+
+static struct
+{
+    regprog_T	*prog;		/* pattern counted, we hold a reference */
+    int		ic;		/* ignore case */
+    int		cpo_search;	/* CPO_SEARCH in 'cpo' */
+    buf_T	*buf;		/* buffer counted in */
+    garray_T	matches;	/* scnt_match_T for each match, sorted */
+    linenr_T	next_lnum;	/* next line to count, zero when at the end */
+    linenr_T	dirty_top;	/* first changed line to count again */
+    linenr_T	dirty_bot;	/* below last changed line to count again */
+    long	maxcount;	/* stop counting at this many, zero: never */
+    int		wanted;		/* somebody asked for the count */
+    int		in_stl;		/* count is in a status line or the ruler */
+} scnt;
+
+/*
+ * Make sure the count is for the last search pattern in the current buffer,
+ * start all over if not.
+ * Returns FAIL when there is no search pattern.
+ */
+    static int
+search_count_check()
+{
+    regmmatch_T	regmatch;
+    int		cpo_search = (vim_strchr(p_cpo, CPO_SEARCH) != NULL);
+
+    last_pat_prog(&regmatch);
+    if (regmatch.regprog == NULL)
+    {
+	search_count_clear(NULL);
+	return FAIL;
+    }
+    if (regmatch.regprog != scnt.prog || regmatch.rmm_ic != scnt.ic
+	    || cpo_search != scnt.cpo_search || curbuf != scnt.buf)
+    {
+	search_count_clear(NULL);
+	vim_regref(regmatch.regprog);
+	scnt.prog = regmatch.regprog;
+	scnt.ic = regmatch.rmm_ic;
+	scnt.cpo_search = cpo_search;
+	scnt.buf = curbuf;
+	ga_init2(&scnt.matches, (int)sizeof(scnt_match_T), 100);
+	scnt.next_lnum = 1;
+    }
+    vim_regfree(regmatch.regprog);
+    return OK;
+}
+
+/*
+ * Forget about counting in buffer "buf", any buffer when "buf" is NULL.
+ * Used when the buffer is unloaded.
+ */
+    void
+search_count_clear(buf)
+    buf_T	*buf;
+{
+    if (scnt.prog == NULL || (buf != NULL && buf != scnt.buf))
+	return;
+    vim_regfree(scnt.prog);
+    ga_clear(&scnt.matches);
+    vim_memset(&scnt, 0, sizeof(scnt));
+}
+
+/*
+ * Return TRUE when there are lines left to count.
+ */
+    static int
+search_count_todo()
+{
+    return scnt.next_lnum != 0 || scnt.dirty_top < scnt.dirty_bot;
+}
+
+/*
+ * Return TRUE when the maximum count was reached.  Counting for the status
+ * line goes on until the end.
+ */
+    static int
+search_count_full()
+{
+    return scnt.maxcount > 0 && !scnt.in_stl
+				       && scnt.matches.ga_len >= scnt.maxcount;
+}
+
+/*
+ * Count matches until done, the maximum count is reached or time limit "tm"
+ * is passed.
+ */
+    static void
+search_count_work(tm)
+    proftime_T	*tm;
+{
+    regmmatch_T	regmatch;
+    linenr_T	lnum;
+
+    regmatch.regprog = scnt.prog;
+    regmatch.rmm_ic = scnt.ic;
+    regmatch.rmm_maxcol = 0;
+    while (!search_count_full() && !profile_passed_limit(tm))
+    {
+	/* First the changed lines, then carry on below what was done. */
+	if (scnt.dirty_top < scnt.dirty_bot
+			     && scnt.dirty_top <= curbuf->b_ml.ml_line_count)
+	    lnum = scnt.dirty_top++;
+	else if (scnt.next_lnum != 0
+			     && scnt.next_lnum <= curbuf->b_ml.ml_line_count)
+	    lnum = scnt.next_lnum++;
+	else
+	{
+	    scnt.dirty_top = scnt.dirty_bot = 0;
+	    scnt.next_lnum = 0;
+	    break;
+	}
+	if (search_count_line(&regmatch, lnum) == FAIL)
+	    break;
+    }
+}
+
+/*
+ * Count the matches found when searching from line "lnum" of the current
+ * buffer, replacing what was found from it before.
+ */
+    static int
+search_count_line(rm, lnum)
+    regmmatch_T	*rm;
+    linenr_T	lnum;
+{
+    scnt_match_T *m;
+    lpos_T	match;
+    colnr_T	col;
+    char_u	*ptr;
+    int		i;
+    int		j;
+    int		n;
+
+    /* A match in this line that was found from a line above, for a pattern
+     * like "\n\zsfoo", is kept.  One found from this line that starts
+     * below it is found again, see search_count_changed(). */
+    m = (scnt_match_T *)scnt.matches.ga_data;
+    i = n = search_count_find(lnum, 0);
+    for (j = i; j < scnt.matches.ga_len && m[j].pos.lnum == lnum; ++j)
+	if (m[j].from != lnum)
+	    m[n++] = m[j];
+    if (j > n)
+    {
+	mch_memmove(m + n, m + j,
+		      (size_t)(scnt.matches.ga_len - j) * sizeof(scnt_match_T));
+	scnt.matches.ga_len -= j - n;
+    }
+
+    col = 0;
+    while (vim_regexec_multi(rm, curwin, curbuf, lnum, col, NULL) > 0)
+    {
+	match.lnum = lnum + rm->startpos[0].lnum;
+	match.col = rm->startpos[0].col;
+	i = search_count_find(match.lnum, match.col);
+	m = (scnt_match_T *)scnt.matches.ga_data;
+	if (i == scnt.matches.ga_len || m[i].pos.lnum != match.lnum
+						  || m[i].pos.col != match.col)
+	{
+	    if (ga_grow(&scnt.matches, 1) == FAIL)
+		return FAIL;
+	    m = (scnt_match_T *)scnt.matches.ga_data + i;
+	    mch_memmove(m + 1, m,
+		      (size_t)(scnt.matches.ga_len - i) * sizeof(scnt_match_T));
+	    m->pos = match;
+	    m->from = lnum;
+	    ++scnt.matches.ga_len;
+	}
+
+	/* Matches starting in a next line are found there. */
+	if (rm->startpos[0].lnum > 0 || rm->endpos[0].lnum > 0)
+	    break;
+	/* Continue after the match like "n" does. */
+	if (scnt.cpo_search && rm->endpos[0].col > rm->startpos[0].col)
+	    col = rm->endpos[0].col;
+	else
+	{
+	    ptr = ml_get_buf(curbuf, lnum, FALSE) + rm->startpos[0].col;
+	    if (*ptr == NUL)
+		break;
+#ifdef FEAT_MBYTE
+	    if (has_mbyte)
+		col = rm->startpos[0].col + (*mb_ptr2len)(ptr);
+	    else
+#endif
+		col = rm->startpos[0].col + 1;
+	}
+    }
+    return OK;
+}
+
+/*
+ * Return the index of the first counted match at or after "lnum" and "col".
+ */
+    static int
+search_count_find(lnum, col)
+    linenr_T	lnum;
+    colnr_T	col;
+{
+    scnt_match_T *m = (scnt_match_T *)scnt.matches.ga_data;
+    int		lo = 0;
+    int		hi = scnt.matches.ga_len;
+    int		mid;
+
+    while (lo < hi)
+    {
+	mid = (lo + hi) / 2;
+	if (m[mid].pos.lnum < lnum
+			 || (m[mid].pos.lnum == lnum && m[mid].pos.col < col))
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Called when lines "lnum" to "lnume" (exclusive) in buffer "buf" were
+ * changed and "xtra" lines were inserted (negative: deleted) before "lnume".
+ * Drops the matches in the changed lines, adjusts the line numbers below them
+ * and remembers to count the changed lines again.
+ */
+    void
+search_count_changed(buf, lnum, lnume, xtra)
+    buf_T	*buf;
+    linenr_T	lnum;
+    linenr_T	lnume;
+    long	xtra;
+{
+    scnt_match_T *m;
+    linenr_T	first;
+    linenr_T	last;
+    int		i;
+    int		n;
+
+    if (scnt.prog == NULL || buf != scnt.buf)
+	return;
+
+    /* A match for a multi-line pattern in a line above may continue in the
+     * changed lines. */
+    first = re_multiline(scnt.prog) ? 1 : lnum;
+    last = lnume + xtra;
+
+    m = (scnt_match_T *)scnt.matches.ga_data;
+    i = search_count_find(first, 0);
+    n = search_count_find(lnume, 0);
+    if (scnt.matches.ga_len - n > SCNT_MAXSHIFT
+	    || (re_multiline(scnt.prog) && re_lookbehind(scnt.prog)))
+    {
+	/* Moving many matches for every changed line is slow, e.g. for
+	 * ":g/pat/d".  Count everything below the change again instead.
+	 * With a look-behind a match below may also depend on the changed
+	 * lines. */
+	scnt.matches.ga_len = i;
+	scnt.next_lnum = first;
+	scnt.dirty_top = scnt.dirty_bot = 0;
+	return;
+    }
+
+    /* Drop the matches in the changed lines and the ones below them that
+     * were found from a changed line.  Adjust the line numbers of the
+     * others.  A dropped match may also be found from lines below the
+     * change, up to where it starts, count those again too. */
+    for ( ; n < scnt.matches.ga_len; ++n)
+    {
+	m[n].pos.lnum += xtra;
+	if (m[n].from >= lnume)
+	{
+	    m[i] = m[n];
+	    m[i].from += xtra;
+	    ++i;
+	}
+	else if (m[n].pos.lnum >= last)
+	    last = m[n].pos.lnum + 1;
+    }
+    scnt.matches.ga_len = i;
+
+    if (scnt.next_lnum >= lnume)
+	scnt.next_lnum += xtra;
+    else if (scnt.next_lnum > first)
+	scnt.next_lnum = first;
+
+    if (scnt.dirty_top < scnt.dirty_bot)
+    {
+	if (scnt.dirty_top >= lnume)
+	    scnt.dirty_top += xtra;
+	else if (scnt.dirty_top > first)
+	    scnt.dirty_top = first;
+	if (scnt.dirty_bot >= lnume)
+	    scnt.dirty_bot += xtra;
+	else if (scnt.dirty_bot > first)
+	    scnt.dirty_bot = first;
+	if (first < scnt.dirty_top)
+	    scnt.dirty_top = first;
+	if (last > scnt.dirty_bot)
+	    scnt.dirty_bot = last;
+    }
+    else
+    {
+	scnt.dirty_top = first;
+	scnt.dirty_bot = last;
+    }
+    /* Lines from "next_lnum" onwards are counted anyway. */
+    if (scnt.next_lnum != 0 && scnt.dirty_bot > scnt.next_lnum)
+	scnt.dirty_bot = scnt.next_lnum;
+}
+
+/*
+ * Count matches while waiting for the user to type, when somebody asked for
+ * the count before.  Updates the status lines and ruler when done.
+ */
+    void
+search_count_background()
+{
+    proftime_T	tm;
+    int		did_work = FALSE;
+
+    if (scnt.prog == NULL || !scnt.wanted || scnt.buf != curbuf)
+	return;
+    while (search_count_todo() && !search_count_full() && !ui_char_avail())
+    {
+	profile_setlimit(20L, &tm);
+	search_count_work(&tm);
+	did_work = TRUE;
+    }
+    if (did_work && scnt.in_stl && redrawing() && !msg_scrolled
+	    && (State == NORMAL || State == NORMAL_BUSY
+			       || ((State & INSERT) && !(State & CMDLINE))))
+    {
+	status_redraw_curbuf();
+	redraw_statuslines();
+	showruler(TRUE);
+	setcursor();
+	out_flush();
+    }
+}
+
+/*
+ * Get the count of the matches of the last search pattern for the cursor in
+ * window "wp", which must be showing the current buffer.  Counts for up to
+ * "msec" milliseconds if not done yet, until done when "msec" is zero, not
+ * at all when "msec" is negative.  Stops counting at "maxcount" matches,
+ * zero for no limit.
+ * "*current" is set to the number of the match at or before the cursor,
+ * zero when it is not known yet.  "*total" is set to the number of matches,
+ * only matches counted so far when "*incomplete" is set, then it's not more
+ * than "maxcount".  "*exact" is set when the cursor is at the start of a
+ * match.
+ * Returns FAIL when there is no search pattern.
+ */
+    int
+search_count_get(wp, msec, maxcount, current, total, exact, incomplete)
+    win_T	*wp;
+    long	msec;
+    long	maxcount;
+    long	*current;
+    long	*total;
+    int		*exact;
+    int		*incomplete;
+{
+    proftime_T	tm;
+    scnt_match_T *m;
+    linenr_T	lnum = wp->w_cursor.lnum;
+    int		i;
+
+    if (wp->w_buffer != curbuf || search_count_check() == FAIL)
+	return FAIL;
+    scnt.wanted = TRUE;
+    scnt.maxcount = maxcount < 0 ? 0 : maxcount;
+    if (msec >= 0)
+    {
+	profile_setlimit(msec, &tm);
+	search_count_work(&tm);
+    }
+
+    *incomplete = search_count_todo();
+    *total = scnt.matches.ga_len;
+    *current = 0;
+    *exact = FALSE;
+    if ((scnt.next_lnum == 0 || lnum < scnt.next_lnum)
+	    && (scnt.dirty_top >= scnt.dirty_bot || lnum < scnt.dirty_top))
+    {
+	i = search_count_find(lnum, wp->w_cursor.col);
+	m = (scnt_match_T *)scnt.matches.ga_data + i;
+	if (i < scnt.matches.ga_len && m->pos.lnum == lnum
+					     && m->pos.col == wp->w_cursor.col)
+	{
+	    *exact = TRUE;
+	    ++i;
+	}
+	*current = i;
+    }
+
+    /* The last line counted may have had more matches than asked for. */
+    if (*incomplete && scnt.maxcount > 0)
+    {
+	if (*total > scnt.maxcount)
+	    *total = scnt.maxcount;
+	if (*current > scnt.maxcount)
+	{
+	    *current = 0;
+	    *exact = FALSE;
+	}
+    }
+    return OK;
+}
+
+/*
+ * Put the count of matches for window "wp" in "buf[len]" for "%S" in
+ * 'statusline': "3/12".  When not done counting the total is shown as
+ * ">12" and an unknown current match as "?".
+ * Returns FAIL when there is nothing to show.
+ */
+    int
+search_count_str(wp, buf, len)
+    win_T	*wp;
+    char_u	*buf;
+    int		len;
+{
+    long	current;
+    long	total;
+    int		exact;
+    int		incomplete;
+    char_u	cur[20];
+
+    /* Count a bit right away, for a small buffer that is enough. */
+    if (search_count_get(wp, 10L, 0L, &current, &total, &exact,
+							   &incomplete) == FAIL)
+	return FAIL;
+    scnt.in_stl = TRUE;
+    if (incomplete && current == 0)
+	STRCPY(cur, "?");
+    else
+	sprintf((char *)cur, "%ld", current);
+    vim_snprintf((char *)buf, len, "%s/%s%ld", cur, incomplete ? ">" : "",
+									total);
+    return OK;
+}
+#endif
+
 /*
  * lowest level search function.
  * Search for 'count'th occurrence of pattern 'pat' in direction 'dir'.
@@ -562,7 +1030,7 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
     long	nmatched;
     int		submatch = 0;
     int		save_called_emsg = called_emsg;
-#ifdef FEAT_SEARCH_EXTRA
+#if defined(FEAT_SEARCH_EXTRA) || defined(FEAT_RELTIME)
     int		break_loop = FALSE;
 #endif
 
@@ -598,6 +1066,7 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
      * find the string
      */
     called_emsg = FALSE;
+    search_stop_lnum = 0;
     do	/* loop for count */
     {
 	start_pos = *pos;	/* remember start pos for detecting no match */
@@ -638,7 +1107,11 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
 #ifdef FEAT_RELTIME
 		/* Stop after passing the "tm" time limit. */
 		if (tm != NULL && profile_passed_limit(tm))
+		{
+		    search_stop_lnum = lnum;
+		    break_loop = TRUE;
 		    break;
+		}
 #endif
 
 		/*
@@ -655,6 +1128,16 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
 		/* Abort searching on an error (e.g., out of stack). */
 		if (called_emsg)
 		    break;
+#ifdef FEAT_RELTIME
+		/* The time limit may have stopped matching halfway the line,
+		 * resume with this line. */
+		if (nmatched == 0 && tm != NULL && profile_passed_limit(tm))
+		{
+		    search_stop_lnum = lnum;
+		    break_loop = TRUE;
+		    break;
+		}
+#endif
 		if (nmatched > 0)
 		{
 		    /* match may actually be in another line when using \zs */
@@ -932,6 +1415,7 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
 			&& ((lnum - pos->lnum) & 0x3f) == 0
 			&& char_avail())
 		{
+		    search_stop_lnum = lnum;
 		    break_loop = TRUE;
 		    break;
 		}
@@ -948,7 +1432,7 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
 	     * twice.
 	     */
 	    if (!p_ws || stop_lnum != 0 || got_int || called_emsg
-#ifdef FEAT_SEARCH_EXTRA
+#if defined(FEAT_SEARCH_EXTRA) || defined(FEAT_RELTIME)
 					       || break_loop
 #endif
 					       || found || loop)
@@ -970,7 +1454,7 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
 					  ? top_bot_msg : bot_top_msg), TRUE);
 	}
 	if (got_int || called_emsg
-#ifdef FEAT_SEARCH_EXTRA
+#if defined(FEAT_SEARCH_EXTRA) || defined(FEAT_RELTIME)
 		|| break_loop
 #endif
 		)
@@ -978,7 +1462,7 @@ searchit(win, buf, pos, dir, pat, count, options, pat_use, stop_lnum, tm)
     }
     while (--count > 0 && found);   /* stop after count matches or no match */
 
-    vim_free(regmatch.regprog);
+    vim_regfree(regmatch.regprog);
 
     called_emsg |= save_called_emsg;
 
@@ -376,6 +376,7 @@ struct m_info
 typedef struct block_hdr    bhdr_T;
 typedef struct memfile	    memfile_T;
 typedef long		    blocknr_T;
+typedef struct mf_zblock_S  mf_zblock_T;
 
 /*
  * for each (previously) used block in the memfile there is one block header.
@@ -386,7 +387,7 @@ typedef long		    blocknr_T;
  * The used list is a doubly linked list, most recently used block first.
  *	The blocks in the used list have a block of memory allocated.
  *	mf_used_count is the number of pages in the used list.
- * The hash lists are used to quickly find a block in the used list.
+ * The hash table is used to quickly find a block in the used list.
  * The free list is a single linked list, not sorted.
  *	The blocks in the free list have no block of memory allocated and
  *	the contents of the block in the file (if any) is irrelevant.
@@ -396,11 +397,10 @@ struct block_hdr
 {
     bhdr_T	*bh_next;	    /* next block_hdr in free or used list */
     bhdr_T	*bh_prev;	    /* previous block_hdr in used list */
-    bhdr_T	*bh_hash_next;	    /* next block_hdr in hash list */
-    bhdr_T	*bh_hash_prev;	    /* previous block_hdr in hash list */
     blocknr_T	bh_bnum;	    /* block number */
     char_u	*bh_data;	    /* pointer to memory (for used block) */
     int		bh_page_count;	    /* number of pages in this block */
+    mf_zblock_T	*bh_zblock;	    /* compressed copy of bh_data or NULL */
 
 #define BH_DIRTY    1
 #define BH_LOCKED   2
@@ -411,14 +411,12 @@ struct block_hdr
  * when a block with a negative number is flushed to the file, it gets
  * a positive number. Because the reference to the block is still the negative
  * number, we remember the translation to the new positive number in the
- * double linked trans lists. The structure is the same as the hash lists.
+ * trans table. It is the same kind of hash table as used for the blocks.
  */
 typedef struct nr_trans NR_TRANS;
 
 struct nr_trans
 {
-    NR_TRANS	*nt_next;		/* next nr_trans in hash list */
-    NR_TRANS	*nt_prev;		/* previous nr_trans in hash list */
     blocknr_T	nt_old_bnum;		/* old, negative, number */
     blocknr_T	nt_new_bnum;		/* new, positive, number */
 };
@@ -504,11 +502,47 @@ struct vim_shell_window;
 #endif
 
 /*
- * Simplistic hashing scheme to quickly locate the blocks in the used list.
- * 64 blocks are found directly (64 * 4K = 256K, most files are smaller).
+ * Hash table to quickly locate a block by its number: the blocks in the used
+ * list and the number translations.  Open addressing with linear probing, an
+ * empty slot has mhi_item NULL.  The table doubles in size when it gets half
+ * full, thus a huge file with many blocks in memory doesn't make a lookup
+ * slower.  Small tables use mht_small_array, no allocation needed.
  */
-#define MEMHASHSIZE	64
-#define MEMHASH(nr)	((nr) & (MEMHASHSIZE - 1))
+typedef struct mf_hashitem_S
+{
+    blocknr_T	mhi_key;		/* block number */
+    void	*mhi_item;		/* bhdr_T, NR_TRANS or mf_zblock_T */
+} mf_hashitem_T;
+
+#define MHT_INIT_SIZE	64		/* must be a power of two */
+
+typedef struct mf_hashtab_S
+{
+    long_u	    mht_mask;		/* mask used for hash value (nr of
+					   slots - 1) */
+    long_u	    mht_count;		/* nr of items in the table */
+    mf_hashitem_T   *mht_buckets;	/* mht_small_array or allocated */
+    mf_hashitem_T   mht_small_array[MHT_INIT_SIZE];
+} mf_hashtab_T;
+
+/*
+ * A block that was released from memory, but is kept compressed, so that it
+ * doesn't need to be read from the swap file when it is used again.  The
+ * block has been written to the swap file before.  The compressed blocks of a
+ * memfile are in a list, most recently compressed first, and in mf_zhash.
+ * When the block is used again the compressed copy goes to bh_zblock, until
+ * the block is changed.
+ */
+struct mf_zblock_S
+{
+    mf_zblock_T	*zb_next;		/* next (older) compressed block */
+    mf_zblock_T	*zb_prev;		/* previous (newer) compressed block */
+    blocknr_T	zb_bnum;		/* block number */
+    int		zb_page_count;		/* number of pages in this block */
+    unsigned	zb_size;		/* number of bytes in zb_data */
+    char_u	zb_data[1];		/* compressed block, actually longer */
+};
+
 #define MF_SEED_LEN	8
 
 struct memfile
@@ -521,14 +555,24 @@ struct memfile
     bhdr_T	*mf_used_last;		/* lru block_hdr in used list */
     unsigned	mf_used_count;		/* number of pages in used list */
     unsigned	mf_used_count_max;	/* maximum number of pages in memory */
-    bhdr_T	*mf_hash[MEMHASHSIZE];	/* array of hash lists */
-    NR_TRANS	*mf_trans[MEMHASHSIZE];	/* array of trans lists */
+    mf_hashtab_T mf_hash;		/* hash table for blocks in used list */
+    mf_hashtab_T mf_trans;		/* hash table for number translations */
+    mf_hashtab_T mf_zhash;		/* hash table for compressed blocks */
+    mf_zblock_T	*mf_zfirst;		/* most recently compressed block */
+    mf_zblock_T	*mf_zlast;		/* least recently compressed block */
+    long_u	mf_zbytes;		/* memory used for compressed blocks */
     blocknr_T	mf_blocknr_max;		/* highest positive block number + 1*/
     blocknr_T	mf_blocknr_min;		/* lowest negative block number - 1 */
     blocknr_T	mf_neg_count;		/* number of negative blocks numbers */
     blocknr_T	mf_infile_count;	/* number of pages in the file */
     unsigned	mf_page_size;		/* number of bytes in a page */
     int		mf_dirty;		/* TRUE if there are dirty blocks */
+#ifdef FEAT_SWAP_WRITER
+    /* Protected by the mutex of the swap file writer in memfile.c. */
+    int		mf_wr_pending;		/* nr of queued writes and syncs */
+    int		mf_wr_error;		/* a queued write or sync failed */
+    void	*mf_wr_sync;		/* queued sync request or NULL */
+#endif
 #ifdef FEAT_CRYPT
     buf_T	*mf_buffer;		/* bufer this memfile is for */
     char_u	mf_seed[MF_SEED_LEN];	/* seed for encryption */
@@ -571,6 +615,53 @@ typedef struct ml_chunksize
 #define ML_CHNK_UPDLINE 3
 #endif
 
+typedef struct mlmap_S mlmap_T;	/* forward declaration */
+
+#ifdef FEAT_MMAP
+/*
+ * A file that is mapped into memory instead of read into the memline, see
+ * ml_map_open().  The index has the offset of the first line of every group
+ * of MM_GROUP lines.  When a line is needed its group is copied, NUL
+ * terminated, like the lines of a data block.
+ * When "mm_load" is set the lines are copied into the memline a piece at a
+ * time, the first "mm_loaded" lines are there already.
+ */
+# define MM_GROUP_SHIFT	7
+# define MM_GROUP	(1 << MM_GROUP_SHIFT)
+
+typedef struct mm_group_S
+{
+    long	mg_nr;		/* group number, -1 if not used */
+    char_u	*mg_text;	/* text of the lines in the group */
+    long_u	mg_size;	/* allocated size of mg_text */
+    long_u	mg_start[MM_GROUP]; /* offset of each line in mg_text */
+} mm_group_T;
+
+struct mlmap_S
+{
+    char_u	*mm_addr;	/* start of the mapped file */
+    long_u	mm_size;	/* size of the mapped file */
+    int		mm_fd;		/* file descriptor, to notice truncation */
+    dev_t	mm_dev;		/* device and inode of the file */
+    ino_t	mm_ino;
+    long_u	*mm_index;	/* offset of the first line of each group */
+    linenr_T	mm_lines;	/* number of lines */
+    long_u	mm_textsize;	/* bytes used for lines, with line breaks */
+    int		mm_nocr;	/* a NL without a CR before it was found */
+    int		mm_firstcr;	/* the first NL has a CR before it */
+    int		mm_noeol;	/* the last line has no NL */
+    int		mm_dos;		/* lines end in CR-NL, the CR is dropped */
+    int		mm_changed;	/* the file was found to be truncated or
+				   changed */
+    int		mm_load;	/* being loaded into the memline */
+    linenr_T	mm_loaded;	/* number of lines loaded so far */
+    long_u	mm_dropped;	/* pages before this were dropped */
+    mm_group_T	mm_group[2];	/* groups copied for ml_get() */
+    int		mm_mru;		/* index in mm_group[] of the last used one */
+    char_u	*mm_marks;	/* bit for each line marked by ":global" */
+};
+#endif
+
 /*
  * the memline structure holds all the information about a memline
  */
@@ -601,6 +692,13 @@ typedef struct memline
     chunksize_T *ml_chunksize;
     int		ml_numchunks;
     int		ml_usedchunks;
+    chunksize_T *ml_chunktree;	/* Fenwick tree over ml_chunksize[] */
+    int		ml_chunktree_size;  /* allocated entries in ml_chunktree */
+    int		ml_chunktree_len;   /* nr of chunks in ml_chunktree, zero when
+				       it must be rebuilt */
+#endif
+#ifdef FEAT_MMAP
+    mlmap_T	*ml_map;	/* mapped file the lines come from or NULL */
 #endif
 } memline_T;
 
@@ -1181,6 +1279,18 @@ struct dictvar_S
 typedef struct qf_info_S qf_info_T;
 #endif
 
+#ifdef FEAT_PROFILE
+/*
+ * Used for ":syntime": timing of executing a syntax pattern.
+ */
+typedef struct {
+    proftime_T	total;		/* total time used */
+    proftime_T	slowest;	/* time of slowest call */
+    long	count;		/* nr of times used */
+    long	match;		/* nr of times matched */
+} syn_time_T;
+#endif
+
 typedef struct {
 #ifdef FEAT_SYN_HL
     hashtab_T	b_keywtab;		/* syntax keywords hash table */
@@ -1202,6 +1312,9 @@ typedef struct {
     char_u	*b_syn_linecont_pat;	/* line continuation pattern */
     regprog_T	*b_syn_linecont_prog;	/* line continuation program */
     int		b_syn_linecont_ic;	/* ignore-case flag for above */
+# ifdef FEAT_PROFILE
+    syn_time_T	b_syn_linecont_time;
+# endif
     int		b_syn_topgrp;		/* for ":syntax include" */
 # ifdef FEAT_CONCEAL
     int		b_syn_conceal;		/* auto-conceal for :syn cmds */
@@ -128,6 +128,16 @@ static void hl_do_font __ARGS((int idx, char_u *arg, int do_normal, int do_menu,
 static char *(spo_name_tab[SPO_COUNT]) =
 	    {"ms=", "me=", "hs=", "he=", "rs=", "re=", "lc="};
 
+static char msg_no_items[] = N_("No Syntax items defined for this buffer");
+
+#ifdef FEAT_PROFILE
+static int syn_time_on = FALSE;	/* ":syntime on" used */
+# define IF_SYN_TIME(p) (p)
+#else
+# define IF_SYN_TIME(p) NULL
+typedef int syn_time_T;
+#endif
+
 /*
  * The patterns that are being searched for are stored in a syn_pattern.
  * A match item consists of one pattern.
@@ -159,6 +169,9 @@ typedef struct syn_pattern
     int		 sp_sync_idx;		/* sync item index (syncing only) */
     int		 sp_line_id;		/* ID of last line where tried */
     int		 sp_startcol;		/* next match in sp_line_id line */
+#ifdef FEAT_PROFILE
+    syn_time_T	 sp_time;		/* for ":syntime" */
+#endif
 } synpat_T;
 
 /* The sp_off_flags are computed like this:
@@ -363,6 +376,22 @@ static short	*current_next_list = NULL; /* when non-zero, nextgroup list */
 static int	current_next_flags = 0; /* flags for current_next_list */
 static int	current_line_id = 0;	/* unique number for current line */
 
+/*
+ * Bytes and pairs of bytes in the current line, for syn_lit_may_match().
+ * ASCII letters are folded to lower case.  Pairs are hashed into a bit
+ * table, a collision only means a pattern is tried when it can't match.
+ */
+#define SYN_LIT_PAIRS	4096
+#define SYN_LIT_HASH(c1, c2) \
+		((((unsigned)(c1) << 5) ^ (unsigned)(c2)) & (SYN_LIT_PAIRS - 1))
+#define SYN_LIT_SET(tab, i)	((tab)[(i) >> 3] |= 1 << ((i) & 7))
+#define SYN_LIT_HAS(tab, i)	((tab)[(i) >> 3] & (1 << ((i) & 7)))
+
+static char_u	syn_lit_bytes[256 / 8];
+static char_u	syn_lit_pairs[SYN_LIT_PAIRS / 8];
+static int	syn_lit_nonascii;	/* line contains a byte >= 0x80 */
+static int	syn_lit_line_id = -1;	/* current_line_id the tables are for */
+
 #define CUR_STATE(idx)	((stateitem_T *)(current_state.ga_data))[idx]
 
 static void syn_sync __ARGS((win_T *wp, linenr_T lnum, synstate_T *last_valid));
@@ -401,7 +430,9 @@ static void limit_pos_zero __ARGS((lpos_T *pos, lpos_T *limit));
 static void syn_add_end_off __ARGS((lpos_T *result, regmmatch_T *regmatch, synpat_T *spp, int idx, int extra));
 static void syn_add_start_off __ARGS((lpos_T *result, regmmatch_T *regmatch, synpat_T *spp, int idx, int extra));
 static char_u *syn_getcurline __ARGS((void));
-static int syn_regexec __ARGS((regmmatch_T *rmp, linenr_T lnum, colnr_T col));
+static void syn_lit_init_line __ARGS((void));
+static int syn_lit_may_match __ARGS((synpat_T *spp));
+static int syn_regexec __ARGS((regmmatch_T *rmp, linenr_T lnum, colnr_T col, syn_time_T *st));
 static int check_keyword_id __ARGS((char_u *line, int startcol, int *endcol, long *flags, short **next_list, stateitem_T *cur_si, int *ccharp));
 static void syn_cmd_case __ARGS((exarg_T *eap, int syncing));
 static void syn_cmd_spell __ARGS((exarg_T *eap, int syncing));
@@ -966,7 +997,8 @@ syn_match_linecont(lnum)
     {
 	regmatch.rmm_ic = syn_block->b_syn_linecont_ic;
 	regmatch.regprog = syn_block->b_syn_linecont_prog;
-	return syn_regexec(&regmatch, lnum, (colnr_T)0);
+	return syn_regexec(&regmatch, lnum, (colnr_T)0,
+				IF_SYN_TIME(&syn_block->b_syn_linecont_time));
     }
     return FALSE;
 }
@@ -2049,6 +2081,14 @@ syn_current_attr(syncing, displaying, can_spell, keep_state)
 				continue;
 			    spp->sp_line_id = current_line_id;
 
+			    /* Skip the pattern when its literal text isn't in
+			     * the line. */
+			    if (!syn_lit_may_match(spp))
+			    {
+				spp->sp_startcol = MAXCOL;
+				continue;
+			    }
+
 			    lc_col = current_col - spp->sp_offsets[SPO_LC_OFF];
 			    if (lc_col < 0)
 				lc_col = 0;
@@ -2056,7 +2096,8 @@ syn_current_attr(syncing, displaying, can_spell, keep_state)
 			    regmatch.rmm_ic = spp->sp_ic;
 			    regmatch.regprog = spp->sp_prog;
 			    if (!syn_regexec(&regmatch, current_lnum,
-							     (colnr_T)lc_col))
+					     (colnr_T)lc_col,
+					     IF_SYN_TIME(&spp->sp_time)))
 			    {
 				/* no match in this line, try another one */
 				spp->sp_startcol = MAXCOL;
@@ -2935,7 +2976,8 @@ find_endpos(idx, startpos, m_endpos, hl_endpos, flagsp, end_endpos,
 
 	    regmatch.rmm_ic = spp->sp_ic;
 	    regmatch.regprog = spp->sp_prog;
-	    if (syn_regexec(&regmatch, startpos->lnum, lc_col))
+	    if (syn_regexec(&regmatch, startpos->lnum, lc_col,
+						 IF_SYN_TIME(&spp->sp_time)))
 	    {
 		if (best_idx == -1 || regmatch.startpos[0].col
 					      < best_regmatch.startpos[0].col)
@@ -2966,7 +3008,8 @@ find_endpos(idx, startpos, m_endpos, hl_endpos, flagsp, end_endpos,
 		lc_col = 0;
 	    regmatch.rmm_ic = spp_skip->sp_ic;
 	    regmatch.regprog = spp_skip->sp_prog;
-	    if (syn_regexec(&regmatch, startpos->lnum, lc_col)
+	    if (syn_regexec(&regmatch, startpos->lnum, lc_col,
+					    IF_SYN_TIME(&spp_skip->sp_time))
 		    && regmatch.startpos[0].col
 					     <= best_regmatch.startpos[0].col)
 	    {
@@ -3209,18 +3252,107 @@ syn_getcurline()
     return ml_get_buf(syn_buf, current_lnum, FALSE);
 }
 
+/*
+ * Fill the tables with the bytes and byte pairs in the current line.
+ */
+    static void
+syn_lit_init_line()
+{
+    char_u	*p;
+    int		c;
+    int		prev = NUL;
+
+    vim_memset(syn_lit_bytes, 0, sizeof(syn_lit_bytes));
+    vim_memset(syn_lit_pairs, 0, sizeof(syn_lit_pairs));
+    syn_lit_nonascii = FALSE;
+    for (p = syn_getcurline(); *p != NUL; ++p)
+    {
+	c = TOLOWER_ASC(*p);
+	if (c >= 0x80)
+	    syn_lit_nonascii = TRUE;
+	SYN_LIT_SET(syn_lit_bytes, c);
+	if (prev != NUL)
+	    SYN_LIT_SET(syn_lit_pairs, SYN_LIT_HASH(prev, c));
+	prev = c;
+    }
+    syn_lit_line_id = current_line_id;
+}
+
+/*
+ * Return FALSE when pattern "spp" can't match in the current line, because
+ * the literal text that every match contains isn't there.  Checking the bytes
+ * against the tables for the line is much cheaper than starting the regexp
+ * engine, which matters when there are hundreds of syntax items.
+ */
+    static int
+syn_lit_may_match(spp)
+    synpat_T	*spp;
+{
+    char_u	*lit;
+    int		ic;
+    int		c;
+    int		prev = NUL;
+
+    lit = vim_regmust(spp->sp_prog, spp->sp_ic, &ic);
+    if (lit == NULL)
+	return TRUE;
+    if (syn_lit_line_id != current_line_id)
+	syn_lit_init_line();
+    /* Ignoring case a non-ASCII character may match an ASCII one, e.g.
+     * the Kelvin sign matches "k". */
+    if (ic && syn_lit_nonascii)
+	return TRUE;
+    for ( ; *lit != NUL; ++lit)
+    {
+	c = TOLOWER_ASC(*lit);
+	if (ic && c >= 0x80)
+	    return TRUE;
+	if (!SYN_LIT_HAS(syn_lit_bytes, c)
+		|| (prev != NUL
+			&& !SYN_LIT_HAS(syn_lit_pairs, SYN_LIT_HASH(prev, c))))
+	    return FALSE;
+	prev = c;
+    }
+    return TRUE;
+}
+
 /*
  * Call vim_regexec() to find a match with "rmp" in "syn_buf".
+ * When ":syntime on" was used the time spent is added to "st".
  * Returns TRUE when there is a match.
  */
     static int
-syn_regexec(rmp, lnum, col)
+syn_regexec(rmp, lnum, col, st)
     regmmatch_T	*rmp;
     linenr_T	lnum;
     colnr_T	col;
+    syn_time_T	*st UNUSED;
 {
+    int		r;
+#ifdef FEAT_PROFILE
+    proftime_T	pt;
+
+    if (syn_time_on)
+	profile_start(&pt);
+#endif
+
     rmp->rmm_maxcol = syn_buf->b_p_smc;
-    if (vim_regexec_multi(rmp, syn_win, syn_buf, lnum, col, NULL) > 0)
+    r = vim_regexec_multi(rmp, syn_win, syn_buf, lnum, col, NULL);
+
+#ifdef FEAT_PROFILE
+    if (syn_time_on)
+    {
+	profile_end(&pt);
+	profile_add(&st->total, &pt);
+	if (profile_cmp(&pt, &st->slowest) < 0)
+	    st->slowest = pt;
+	++st->count;
+	if (r > 0)
+	    ++st->match;
+    }
+#endif
+
+    if (r > 0)
     {
 	rmp->startpos[0].lnum += lnum;
 	rmp->endpos[0].lnum += lnum;
@@ -3751,7 +3883,7 @@ syn_cmd_list(eap, syncing)
 
     if (!syntax_present(curwin))
     {
-	MSG(_("No Syntax items defined for this buffer"));
+	MSG(_(msg_no_items));
 	return;
     }
 
@@ -6433,6 +6565,224 @@ syn_get_foldlevel(wp, lnum)
 }
 #endif
 
+#if defined(FEAT_PROFILE) || defined(PROTO)
+static void syn_clear_time __ARGS((syn_time_T *st));
+static void syntime_clear __ARGS((void));
+static void syntime_add_entry __ARGS((garray_T *gap, syn_time_T *st, int id, char_u *pat, proftime_T *total, long *count));
+static void syntime_report __ARGS((void));
+# ifdef __BORLANDC__
+static int _RTLENTRYF syn_compare_syntime __ARGS((const void *v1, const void *v2));
+# else
+static int syn_compare_syntime __ARGS((const void *v1, const void *v2));
+# endif
+
+/*
+ * ":syntime {on,off,clear,report}"
+ */
+    void
+ex_syntime(eap)
+    exarg_T	*eap;
+{
+    if (STRCMP(eap->arg, "on") == 0)
+	syn_time_on = TRUE;
+    else if (STRCMP(eap->arg, "off") == 0)
+	syn_time_on = FALSE;
+    else if (STRCMP(eap->arg, "clear") == 0)
+	syntime_clear();
+    else if (STRCMP(eap->arg, "report") == 0)
+	syntime_report();
+    else
+	EMSG2(_(e_invarg2), eap->arg);
+}
+
+    static void
+syn_clear_time(st)
+    syn_time_T	*st;
+{
+    profile_zero(&st->total);
+    profile_zero(&st->slowest);
+    st->count = 0;
+    st->match = 0;
+}
+
+/*
+ * Clear the syntax timing for the current window.
+ */
+    static void
+syntime_clear()
+{
+    int		idx;
+
+    if (!syntax_present(curwin))
+    {
+	MSG(_(msg_no_items));
+	return;
+    }
+    for (idx = 0; idx < curwin->w_s->b_syn_patterns.ga_len; ++idx)
+	syn_clear_time(&(SYN_ITEMS(curwin->w_s)[idx].sp_time));
+    syn_clear_time(&curwin->w_s->b_syn_linecont_time);
+}
+
+# if defined(FEAT_CMDL_COMPL) || defined(PROTO)
+static char *(syntime_args[]) = {"on", "off", "clear", "report", NULL};
+
+/*
+ * Function given to ExpandGeneric() to obtain the possible arguments of the
+ * ":syntime {on,off,clear,report}" command.
+ */
+    char_u *
+get_syntime_arg(xp, idx)
+    expand_T	*xp UNUSED;
+    int		idx;
+{
+    return (char_u *)syntime_args[idx];
+}
+# endif
+
+typedef struct
+{
+    proftime_T	total;
+    proftime_T	slowest;
+    proftime_T	average;
+    long	count;
+    long	match;
+    int		id;		/* syntax group ID, 0 for "linecont" */
+    char_u	*pattern;
+} time_entry_T;
+
+/*
+ * Compare function for qsort(): sort on total time, slowest first.
+ */
+    static int
+# ifdef __BORLANDC__
+_RTLENTRYF
+# endif
+syn_compare_syntime(v1, v2)
+    const void	*v1;
+    const void	*v2;
+{
+    const time_entry_T	*s1 = v1;
+    const time_entry_T	*s2 = v2;
+
+    return profile_cmp((proftime_T *)&s1->total, (proftime_T *)&s2->total);
+}
+
+/*
+ * Add an entry for the time used by "pat" to "gap" and add it to the totals.
+ */
+    static void
+syntime_add_entry(gap, st, id, pat, total, count)
+    garray_T	*gap;
+    syn_time_T	*st;
+    int		id;
+    char_u	*pat;
+    proftime_T	*total;
+    long	*count;
+{
+    time_entry_T *p;
+
+    if (st->count == 0 || ga_grow(gap, 1) == FAIL)
+	return;
+    p = (time_entry_T *)gap->ga_data + gap->ga_len;
+    p->total = st->total;
+    p->slowest = st->slowest;
+    profile_divide(&st->total, st->count, &p->average);
+    p->count = st->count;
+    p->match = st->match;
+    p->id = id;
+    p->pattern = pat;
+    ++gap->ga_len;
+
+    profile_add(total, &st->total);
+    *count += st->count;
+}
+
+/*
+ * ":syntime report": list the patterns of the current window that were
+ * tried, the most expensive one first.
+ */
+    static void
+syntime_report()
+{
+    int		idx;
+    synpat_T	*spp;
+    time_entry_T *p;
+    garray_T	ga;
+    proftime_T	total_total;
+    long	total_count = 0;
+    int		len;
+
+    if (!syntax_present(curwin))
+    {
+	MSG(_(msg_no_items));
+	return;
+    }
+
+    ga_init2(&ga, (int)sizeof(time_entry_T), 50);
+    profile_zero(&total_total);
+    for (idx = 0; idx < curwin->w_s->b_syn_patterns.ga_len; ++idx)
+    {
+	spp = &(SYN_ITEMS(curwin->w_s)[idx]);
+	syntime_add_entry(&ga, &spp->sp_time, spp->sp_syn.id,
+			       spp->sp_pattern, &total_total, &total_count);
+    }
+    syntime_add_entry(&ga, &curwin->w_s->b_syn_linecont_time, 0,
+				curwin->w_s->b_syn_linecont_pat,
+				&total_total, &total_count);
+
+    if (ga.ga_len > 1)
+	qsort(ga.ga_data, (size_t)ga.ga_len, sizeof(time_entry_T),
+							 syn_compare_syntime);
+
+    MSG_PUTS_TITLE(_("  TOTAL      COUNT  MATCH   SLOWEST     AVERAGE   NAME               PATTERN"));
+    MSG_PUTS("\n");
+    for (idx = 0; idx < ga.ga_len && !got_int; ++idx)
+    {
+	p = (time_entry_T *)ga.ga_data + idx;
+
+	MSG_PUTS(profile_msg(&p->total));
+	MSG_PUTS(" ");	/* make sure there is always a separating space */
+	msg_advance(13);
+	msg_outnum(p->count);
+	MSG_PUTS(" ");
+	msg_advance(20);
+	msg_outnum(p->match);
+	MSG_PUTS(" ");
+	msg_advance(26);
+	MSG_PUTS(profile_msg(&p->slowest));
+	MSG_PUTS(" ");
+	msg_advance(38);
+	MSG_PUTS(profile_msg(&p->average));
+	MSG_PUTS(" ");
+	msg_advance(50);
+	if (p->id == 0)
+	    MSG_PUTS("linecont");
+	else
+	    msg_outtrans(HL_TABLE()[p->id - 1].sg_name);
+	MSG_PUTS(" ");
+
+	msg_advance(69);
+	if (Columns < 80)
+	    len = 20;	/* will wrap anyway */
+	else
+	    len = Columns - 70;
+	if (len > (int)STRLEN(p->pattern))
+	    len = (int)STRLEN(p->pattern);
+	msg_outtrans_len(p->pattern, len);
+	MSG_PUTS("\n");
+    }
+    ga_clear(&ga);
+    if (!got_int)
+    {
+	MSG_PUTS("\n");
+	MSG_PUTS(profile_msg(&total_total));
+	msg_advance(13);
+	msg_outnum(total_count);
+	MSG_PUTS("\n");
+    }
+}
+#endif
+
 #endif /* FEAT_SYN_HL */
 
 
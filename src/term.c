@@ -2691,6 +2691,32 @@ term_cursor_right(i)
     OUT_STR(tgoto((char *)T_CRI, 0, i));
 }
 
+#if defined(FEAT_VIMSHELL) || defined(PROTO)
+/*
+ * Return the number of bytes term_windgoto(row, col) sends.
+ */
+    int
+term_windgoto_cost(row, col)
+    int	    row;
+    int	    col;
+{
+    return (int)STRLEN(tgoto((char *)T_CM, col, row));
+}
+
+/*
+ * Return the number of bytes term_cursor_right(i) sends, 9999 when the
+ * terminal can't do it.
+ */
+    int
+term_cursor_right_cost(i)
+    int	    i;
+{
+    if (*T_CRI == NUL)
+	return 9999;
+    return (int)STRLEN(tgoto((char *)T_CRI, 0, i));
+}
+#endif
+
     void
 term_append_lines(line_count)
     int	    line_count;
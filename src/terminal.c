@@ -4,11 +4,15 @@
  * This is the screen-like terminal emulator; it is a better vt100 and supports the
  * same commands that screen does (including color etc).
  *
- * The interface is vim_shell_terminal_input and vim_shell_terminal_output. These
+ * The interface is vim_shell_vt_feed and vim_shell_terminal_output. These
  * functions get characters from the shell (or from the user) and process them
  * accordingly to the terminal rules (ESC sequences etc). They then work directly
  * on the vim_shell-window-buffer, updating its contents.
  *
+ * Everything but vim_shell_terminal_output (which needs VIM's key codes) is the
+ * VT engine declared in vim_shell_vt.h. It doesn't use VIM and is compiled on its
+ * own when VIMSHELL_STANDALONE is defined, e.g. for vtbench.
+ *
  * VIMSHELL TODO: *) don't scroll scroll region if cursor is outside
  *                *) change the buffer name according to the window title
  *                *) CSI (0x9B)
@@ -30,9 +34,13 @@ static char *RCSID="$Id$";
 #include <ctype.h>
 #include <errno.h>
 
-#include "vim.h"
+#ifdef VIMSHELL_STANDALONE
+# include "vim_shell_vt.h"
+#else
+# include "vim.h"
+#endif
 
-#ifdef FEAT_VIMSHELL
+#if defined(FEAT_VIMSHELL) || defined(VIMSHELL_STANDALONE)
 #ifdef VIMSHELL_DEBUG
 #  define ESCDEBUG
 /*
@@ -54,6 +62,16 @@ static char *RCSID="$Id$";
 #  define VERBOSEPRINTF(a...)
 #endif
 
+/*
+ * Text for the de-escaped output log of the shell.
+ */
+#ifdef VIMSHELL_STANDALONE
+#  define LOGPUTC(shell, c)
+#else
+#  define LOGPUTC(shell, c) if((shell)->log!=NULL && !(shell)->log->raw) vim_shell_log_putc((shell)->log, c)
+#endif
+
+#ifndef VIMSHELL_STANDALONE
 /*
  * These are the VIM keynames.
  */
@@ -96,6 +114,7 @@ static char *RCSID="$Id$";
 #define VIMSHELL_KEY_KMULTIPLY	K_KMULTIPLY
 #define VIMSHELL_KEY_KENTER	K_KENTER
 #define VIMSHELL_KEY_KPOINT	K_KPOINT
+#endif
 
 static void terminal_ED(struct vim_shell_window *shell, int argc, char argv[20][20]);
 static void terminal_CUP(struct vim_shell_window *shell, int argc, char argv[20][20]);
@@ -137,6 +156,113 @@ static void hexdump(FILE *fp, unsigned char *buffer, long len)
 	}
 }
 
+/*
+ * Record that rows top to bottom have changed, see vim_shell_vt_damage().
+ */
+static void terminal_damage(struct vim_shell_window *shell, int top, int bottom)
+{
+	if(shell->damage_top>shell->damage_bottom)
+	{
+		shell->damage_top=top;
+		shell->damage_bottom=bottom;
+		return;
+	}
+	if(top<shell->damage_top)
+		shell->damage_top=top;
+	if(bottom>shell->damage_bottom)
+		shell->damage_bottom=bottom;
+}
+
+/*
+ * Free the buffers of a screen, but not the struct itself.
+ */
+static void terminal_free_screen(struct vim_shell_window *shell)
+{
+	vim_shell_free(shell->winbuf);
+	vim_shell_free(shell->fgbuf);
+	vim_shell_free(shell->bgbuf);
+	vim_shell_free(shell->rendbuf);
+	vim_shell_free(shell->tabstops);
+	vim_shell_free(shell->charset);
+}
+
+/*
+ * Blank "len" cells starting at cell "pos": a space with the default colors,
+ * no rendition and the USASCII charset. One fill per cell plane.
+ */
+static void terminal_erase_cells(struct vim_shell_window *shell, int pos, int len)
+{
+	if(len<=0)
+		return;
+	terminal_damage(shell, pos/shell->size_x, (pos+len-1)/shell->size_x);
+	memset(shell->winbuf+pos, ' ', len);
+	memset(shell->fgbuf+pos, VIMSHELL_COLOR_DEFAULT, len);
+	memset(shell->bgbuf+pos, VIMSHELL_COLOR_DEFAULT, len);
+	memset(shell->rendbuf+pos, 0, len);
+	memset(shell->charset+pos, 0, len);
+}
+
+/*
+ * Move "len" cells from cell "from" to cell "to", with their colors and
+ * attributes. The ranges may overlap.
+ */
+static void terminal_move_cells(struct vim_shell_window *shell, int to, int from, int len)
+{
+	if(len<=0)
+		return;
+	terminal_damage(shell, to/shell->size_x, (to+len-1)/shell->size_x);
+	memmove(shell->winbuf+to, shell->winbuf+from, len);
+	memmove(shell->fgbuf+to, shell->fgbuf+from, len);
+	memmove(shell->bgbuf+to, shell->bgbuf+from, len);
+	memmove(shell->rendbuf+to, shell->rendbuf+from, len);
+	memmove(shell->charset+to, shell->charset+from, len);
+}
+
+/*
+ * Index of the lowest set bit, "bits" must not be zero.
+ */
+static int terminal_lowest_bit(uint32_t bits)
+{
+#if defined(__GNUC__)
+	return __builtin_ctz(bits);
+#else
+	int i=0;
+	while((bits&1)==0)
+	{
+		bits>>=1;
+		i++;
+	}
+	return i;
+#endif
+}
+
+/*
+ * Returns the column of the next tab stop right of column x, or the right
+ * margin if there is none.
+ */
+static int terminal_next_tabstop(struct vim_shell_window *shell, int x)
+{
+	int w, nwords;
+	uint32_t bits;
+
+	x++;
+	if(x>=shell->size_x)
+		return shell->size_x-1;
+
+	nwords=VIMSHELL_TABSTOP_WORDS(shell->size_x);
+	w=x>>5;
+	bits=shell->tabstops[w] & ~(((uint32_t)1<<(x&31))-1);
+	while(bits==0)
+	{
+		if(++w>=nwords)
+			return shell->size_x-1;
+		bits=shell->tabstops[w];
+	}
+
+	x=(w<<5)+terminal_lowest_bit(bits);
+	return x<shell->size_x ? x : shell->size_x-1;
+}
+
 /*
  * Tabulation Clear (TBC)
  *
@@ -175,10 +301,10 @@ static void terminal_TBC(struct vim_shell_window *shell, int argc, char argv[20]
 	switch(param)
 	{
 		case 0:
-			shell->tabline[shell->cursor_x]=0;
+			VIMSHELL_TABSTOP_CLEAR(shell, shell->cursor_x);
 			break;
 		case 3:
-			memset(shell->tabline, 0, shell->size_x);
+			memset(shell->tabstops, 0, VIMSHELL_TABSTOP_WORDS(shell->size_x)*sizeof(uint32_t));
 			break;
 		default:
 			ESCDEBUGPRINTF( "%s: sequence error (2)\n", __FUNCTION__);
@@ -422,12 +548,7 @@ static void terminal_backup_screen(struct vim_shell_window *shell)
 	if(shell->alt!=NULL)
 	{
 		ESCDEBUGPRINTF( "%s: WARNING: alternate screen taken\n", __FUNCTION__);
-		vim_shell_free(shell->alt->winbuf);
-		vim_shell_free(shell->alt->bgbuf);
-		vim_shell_free(shell->alt->fgbuf);
-		vim_shell_free(shell->alt->rendbuf);
-		vim_shell_free(shell->alt->tabline);
-		vim_shell_free(shell->alt->charset);
+		terminal_free_screen(shell->alt);
 		vim_shell_free(shell->alt);
 		shell->alt=NULL;
 	}
@@ -446,17 +567,17 @@ static void terminal_backup_screen(struct vim_shell_window *shell)
 	shell->alt->fgbuf=(uint8_t *)vim_shell_malloc(len);
 	shell->alt->bgbuf=(uint8_t *)vim_shell_malloc(len);
 	shell->alt->rendbuf=(uint8_t *)vim_shell_malloc(len);
-	shell->alt->tabline=(uint8_t *)vim_shell_malloc(shell->size_x);
+	shell->alt->tabstops=(uint32_t *)vim_shell_malloc(VIMSHELL_TABSTOP_WORDS(shell->size_x)*sizeof(uint32_t));
 	shell->alt->charset=(uint8_t *)vim_shell_malloc(len);
 	if(shell->alt->winbuf==NULL || shell->alt->winbuf==NULL || shell->alt->winbuf==NULL || shell->alt->winbuf==NULL ||
-			shell->alt->charset==NULL || shell->alt->tabline==NULL)
+			shell->alt->charset==NULL || shell->alt->tabstops==NULL)
 	{
 		ESCDEBUGPRINTF( "%s: ERROR: unable to allocate buffers\n", __FUNCTION__);
 		if(shell->alt->winbuf) vim_shell_free(shell->alt->winbuf);
 		if(shell->alt->fgbuf) vim_shell_free(shell->alt->fgbuf);
 		if(shell->alt->bgbuf) vim_shell_free(shell->alt->bgbuf);
 		if(shell->alt->rendbuf) vim_shell_free(shell->alt->rendbuf);
-		if(shell->alt->tabline) vim_shell_free(shell->alt->tabline);
+		if(shell->alt->tabstops) vim_shell_free(shell->alt->tabstops);
 		if(shell->alt->charset) vim_shell_free(shell->alt->charset);
 		vim_shell_free(shell->alt);
 		shell->alt=NULL;
@@ -468,7 +589,7 @@ static void terminal_backup_screen(struct vim_shell_window *shell)
 	memcpy(shell->alt->bgbuf, shell->bgbuf, len);
 	memcpy(shell->alt->rendbuf, shell->rendbuf, len);
 	memcpy(shell->alt->charset, shell->charset, len);
-	memcpy(shell->alt->tabline, shell->tabline, shell->size_x);
+	memcpy(shell->alt->tabstops, shell->tabstops, VIMSHELL_TABSTOP_WORDS(shell->size_x)*sizeof(uint32_t));
 }
 
 /*
@@ -483,14 +604,10 @@ static void terminal_restore_screen(struct vim_shell_window *shell)
 		return;
 	}
 
-	vim_shell_free(shell->winbuf);
-	vim_shell_free(shell->rendbuf);
-	vim_shell_free(shell->tabline);
-	vim_shell_free(shell->fgbuf);
-	vim_shell_free(shell->bgbuf);
-	vim_shell_free(shell->charset);
+	terminal_free_screen(shell);
 
 	alt=shell->alt;
+	alt->log=shell->log;
 	*shell=*(shell->alt);
 	shell->alt=NULL;
 
@@ -500,6 +617,7 @@ static void terminal_restore_screen(struct vim_shell_window *shell)
 	 * Invalidate the shell so it will be fully redrawn
 	 */
 	shell->force_redraw=1;
+	terminal_damage(shell, 0, shell->size_y-1);
 }
 
 /*
@@ -594,7 +712,7 @@ static void terminal_mode(struct vim_shell_window *shell, int set, int argc, cha
  */
 static void terminal_EL(struct vim_shell_window *shell, int argc, char argv[20][20])
 {
-	int i, size, pos;
+	int i, row;
 
 	if(argc==0)
 		i=0;
@@ -609,19 +727,14 @@ static void terminal_EL(struct vim_shell_window *shell, int argc, char argv[20][
 		return;
 	}
 
-	size=shell->size_x*shell->size_y;
-	pos=shell->cursor_y*shell->size_x+shell->cursor_x;
+	row=shell->cursor_y*shell->size_x;
 	if(i==0)
 	{
 		/*
 		 * erase from the active position to the end of line
 		 */
 
-		memset(shell->winbuf+pos, ' ', shell->size_x-shell->cursor_x);
-		memset(shell->fgbuf+pos,  VIMSHELL_COLOR_DEFAULT, shell->size_x-shell->cursor_x);
-		memset(shell->bgbuf+pos,  VIMSHELL_COLOR_DEFAULT, shell->size_x-shell->cursor_x);
-		memset(shell->rendbuf+pos, 0, shell->size_x-shell->cursor_x);
-		memset(shell->charset+pos, 0, shell->size_x-shell->cursor_x);
+		terminal_erase_cells(shell, row+shell->cursor_x, shell->size_x-shell->cursor_x);
 		ESCDEBUGPRINTF( "%s: erase from active position to end of line\n", __FUNCTION__);
 
 	}
@@ -631,11 +744,7 @@ static void terminal_EL(struct vim_shell_window *shell, int argc, char argv[20][
 		 * erase from start of the line to the active position, inclusive
 		 */
 
-		memset(shell->winbuf+shell->cursor_y*shell->size_x, ' ', shell->cursor_x);
-		memset(shell->fgbuf+ shell->cursor_y*shell->size_x, VIMSHELL_COLOR_DEFAULT, shell->cursor_x);
-		memset(shell->bgbuf+ shell->cursor_y*shell->size_x, VIMSHELL_COLOR_DEFAULT, shell->cursor_x);
-		memset(shell->rendbuf+shell->cursor_y*shell->size_x, 0, shell->cursor_x);
-		memset(shell->charset+shell->cursor_y*shell->size_x, 0, shell->cursor_x);
+		terminal_erase_cells(shell, row, shell->cursor_x);
 		ESCDEBUGPRINTF( "%s: erase from start of line to active position\n", __FUNCTION__);
 	}
 	else if(i==2)
@@ -644,11 +753,7 @@ static void terminal_EL(struct vim_shell_window *shell, int argc, char argv[20][
 		 * Erase all of the line
 		 */
 
-		memset(shell->winbuf +shell->cursor_y*shell->size_x, ' ', shell->size_x);
-		memset(shell->fgbuf  +shell->cursor_y*shell->size_x, VIMSHELL_COLOR_DEFAULT, shell->size_x);
-		memset(shell->bgbuf  +shell->cursor_y*shell->size_x, VIMSHELL_COLOR_DEFAULT, shell->size_x);
-		memset(shell->rendbuf+shell->cursor_y*shell->size_x, 0, shell->size_x);
-		memset(shell->charset+shell->cursor_y*shell->size_x, 0, shell->size_x);
+		terminal_erase_cells(shell, row, shell->size_x);
 		ESCDEBUGPRINTF( "%s: erase all of the line\n", __FUNCTION__);
 	}
 	else
@@ -696,11 +801,7 @@ static void terminal_ED(struct vim_shell_window *shell, int argc, char argv[20][
 		 * erase from the active position to the end of screen
 		 */
 
-		memset(shell->winbuf+pos, ' ', size-pos);
-		memset(shell->fgbuf+pos, VIMSHELL_COLOR_DEFAULT, size-pos);
-		memset(shell->bgbuf+pos, VIMSHELL_COLOR_DEFAULT, size-pos);
-		memset(shell->rendbuf+pos, 0, size-pos);
-		memset(shell->charset+pos, 0, size-pos);
+		terminal_erase_cells(shell, pos, size-pos);
 		ESCDEBUGPRINTF( "%s: erase from active position to end of screen\n", __FUNCTION__);
 
 	}
@@ -710,11 +811,7 @@ static void terminal_ED(struct vim_shell_window *shell, int argc, char argv[20][
 		 * erase from start of the screen to the active position, inclusive
 		 */
 
-		memset(shell->winbuf, ' ', pos);
-		memset(shell->fgbuf, VIMSHELL_COLOR_DEFAULT, pos);
-		memset(shell->bgbuf, VIMSHELL_COLOR_DEFAULT, pos);
-		memset(shell->rendbuf, 0, pos);
-		memset(shell->charset, 0, pos);
+		terminal_erase_cells(shell, 0, pos);
 		ESCDEBUGPRINTF( "%s: erase from start of screen to active position\n", __FUNCTION__);
 	}
 	else if(i==2)
@@ -723,11 +820,7 @@ static void terminal_ED(struct vim_shell_window *shell, int argc, char argv[20][
 		 * Erase all of the display
 		 */
 
-		memset(shell->winbuf, ' ', size);
-		memset(shell->fgbuf, VIMSHELL_COLOR_DEFAULT, size);
-		memset(shell->bgbuf, VIMSHELL_COLOR_DEFAULT, size);
-		memset(shell->rendbuf, 0, size);
-		memset(shell->charset, 0, size);
+		terminal_erase_cells(shell, 0, size);
 		ESCDEBUGPRINTF( "%s: erase all of the display\n", __FUNCTION__);
 	}
 	else
@@ -820,6 +913,12 @@ static void terminal_DECSTBM(struct vim_shell_window *shell, int argc, char argv
 	ESCDEBUGPRINTF( "%s: top margin = %d, bottom margin = %d\n", __FUNCTION__,
 			shell->scroll_top_margin, shell->scroll_bottom_margin);
 
+	/*
+	 * The program may not know yet that the screen has become smaller.
+	 */
+	if(shell->scroll_bottom_margin>=shell->size_y)
+		shell->scroll_bottom_margin=shell->size_y-1;
+
 	if(shell->scroll_top_margin>=shell->scroll_bottom_margin)
 	{
 		ESCDEBUGPRINTF( "%s: scroll margin error %d >= %d\n", __FUNCTION__,
@@ -837,67 +936,46 @@ static void terminal_DECSTBM(struct vim_shell_window *shell, int argc, char argv
 
 
 // Status: 100%
-static void terminal_scroll_up(struct vim_shell_window *shell)
+static void terminal_scroll_up(struct vim_shell_window *shell, int lines)
 {
 	// VIMSHELL TODO: maintain a scrollback buffer? copy the first line into
 	// a scrollback buffer.
 
 	/*
-	 * scroll up by moving up the screen buffer a whole line. blank out
-	 * the last line.
+	 * scroll up by moving up the scroll region 'lines' lines. blank out
+	 * the lines that became free at the bottom.
 	 */
-	int len, from, to;
+	int rows, top;
 
-	ESCDEBUGPRINTF( "%s: done\n", __FUNCTION__);
+	ESCDEBUGPRINTF( "%s: %d lines\n", __FUNCTION__, lines);
 
-	len=shell->scroll_bottom_margin-shell->scroll_top_margin;
-	len*=shell->size_x;
-
-	to=shell->scroll_top_margin*shell->size_x;
-	from=shell->size_x+shell->scroll_top_margin*shell->size_x;
-
-	memmove(shell->winbuf+to, shell->winbuf+from, len);
-	memmove(shell->fgbuf+to, shell->fgbuf+from, len);
-	memmove(shell->bgbuf+to, shell->bgbuf+from, len);
-	memmove(shell->rendbuf+to, shell->rendbuf+from, len);
-	memmove(shell->charset+to, shell->charset+from, len);
+	rows=shell->scroll_bottom_margin-shell->scroll_top_margin+1;
+	if(lines>rows)
+		lines=rows;
+	top=shell->scroll_top_margin*shell->size_x;
 
-	memset(shell->winbuf+shell->scroll_bottom_margin*shell->size_x, ' ', shell->size_x);
-	memset(shell->fgbuf+shell->scroll_bottom_margin*shell->size_x, VIMSHELL_COLOR_DEFAULT, shell->size_x);
-	memset(shell->bgbuf+shell->scroll_bottom_margin*shell->size_x, VIMSHELL_COLOR_DEFAULT, shell->size_x);
-	memset(shell->rendbuf+shell->scroll_bottom_margin*shell->size_x, 0, shell->size_x);
-	memset(shell->charset+shell->scroll_bottom_margin*shell->size_x, 0, shell->size_x);
+	terminal_move_cells(shell, top, top+lines*shell->size_x, (rows-lines)*shell->size_x);
+	terminal_erase_cells(shell, top+(rows-lines)*shell->size_x, lines*shell->size_x);
 }
 
 // Status: unknown
-static void terminal_scroll_down(struct vim_shell_window *shell)
+static void terminal_scroll_down(struct vim_shell_window *shell, int lines)
 {
 	/*
-	 * scroll down by moving the screen buffer down a whole line, overwriting
-	 * the last line. Then, blank out the first line.
+	 * scroll down by moving the scroll region down 'lines' lines, overwriting
+	 * the last lines. Then, blank out the first lines.
 	 */
-	size_t len;
-	int from, to;
-
-	ESCDEBUGPRINTF( "%s: done\n", __FUNCTION__);
+	int rows, top;
 
-	len=shell->scroll_bottom_margin-shell->scroll_top_margin;
-	len*=shell->size_x;
+	ESCDEBUGPRINTF( "%s: %d lines\n", __FUNCTION__, lines);
 
-	to=shell->scroll_top_margin*shell->size_x+shell->size_x;
-	from=shell->scroll_top_margin*shell->size_x;
-
-	memmove(shell->winbuf+to, shell->winbuf+from, len);
-	memmove(shell->fgbuf+to, shell->fgbuf+from, len);
-	memmove(shell->bgbuf+to, shell->bgbuf+from, len);
-	memmove(shell->rendbuf+to, shell->rendbuf+from, len);
-	memmove(shell->charset+to, shell->charset+from, len);
+	rows=shell->scroll_bottom_margin-shell->scroll_top_margin+1;
+	if(lines>rows)
+		lines=rows;
+	top=shell->scroll_top_margin*shell->size_x;
 
-	memset(shell->winbuf+from, ' ', shell->size_x);
-	memset(shell->fgbuf+from, VIMSHELL_COLOR_DEFAULT, shell->size_x);
-	memset(shell->bgbuf+from, VIMSHELL_COLOR_DEFAULT, shell->size_x);
-	memset(shell->rendbuf+from, 0, shell->size_x);
-	memset(shell->charset+from, 0, shell->size_x);
+	terminal_move_cells(shell, top+lines*shell->size_x, top, (rows-lines)*shell->size_x);
+	terminal_erase_cells(shell, top, lines*shell->size_x);
 }
 
 /*
@@ -936,11 +1014,11 @@ static void terminal_IL(struct vim_shell_window *shell, int argc, char argv[20][
 	ESCDEBUGPRINTF( "%s: inserted %d lines\n", __FUNCTION__, lines);
 
 	/*
-	 * Set a scrolling region around the part we want to move and scroll down 'lines' times.
+	 * Set a scrolling region around the part we want to move and scroll it down.
 	 */
 	shell->scroll_top_margin=shell->cursor_y;
-	while(lines--)
-		terminal_scroll_down(shell);
+	if(lines>0)
+		terminal_scroll_down(shell, lines);
 
 	shell->scroll_top_margin=bak_top;
 
@@ -984,11 +1062,11 @@ static void terminal_DL(struct vim_shell_window *shell, int argc, char argv[20][
 	ESCDEBUGPRINTF( "%s: deleted %d lines\n", __FUNCTION__, lines);
 
 	/*
-	 * Set a scrolling region around the part we want to move and scroll up 'lines' times.
+	 * Set a scrolling region around the part we want to move and scroll it up.
 	 */
 	shell->scroll_top_margin=shell->cursor_y;
-	while(lines--)
-		terminal_scroll_up(shell);
+	if(lines>0)
+		terminal_scroll_up(shell, lines);
 
 	shell->scroll_top_margin=bak_top;
 
@@ -1024,24 +1102,18 @@ static void terminal_ICH(struct vim_shell_window *shell, int argc, char argv[20]
 	}
 
 	curpos=shell->cursor_y*shell->size_x+shell->cursor_x;
-	len=shell->size_x-shell->cursor_x-1;
+	len=shell->size_x-shell->cursor_x;
+	if(chars>len)
+		chars=len;
 
 	ESCDEBUGPRINTF( "%s: inserted %d characters\n", __FUNCTION__, chars);
 
-	while(chars--)
-	{
-		memmove(shell->winbuf+curpos+1, shell->winbuf+curpos, len);
-		memmove(shell->fgbuf+curpos+1, shell->fgbuf+curpos, len);
-		memmove(shell->bgbuf+curpos+1, shell->bgbuf+curpos, len);
-		memmove(shell->rendbuf+curpos+1, shell->rendbuf+curpos, len);
-		memmove(shell->charset+curpos+1, shell->charset+curpos, len);
-
-		memset(shell->winbuf+curpos, ' ', 1);
-		memset(shell->fgbuf+curpos, VIMSHELL_COLOR_DEFAULT, 1);
-		memset(shell->bgbuf+curpos, VIMSHELL_COLOR_DEFAULT, 1);
-		memset(shell->rendbuf+curpos, 0, 1);
-		memset(shell->charset+curpos, 0, 1);
-	}
+	/*
+	 * Shift the rest of the line right in one go, whatever falls off the
+	 * right margin is lost.
+	 */
+	terminal_move_cells(shell, curpos+chars, curpos, len-chars);
+	terminal_erase_cells(shell, curpos, chars);
 }
 
 /*
@@ -1073,24 +1145,18 @@ static void terminal_DCH(struct vim_shell_window *shell, int argc, char argv[20]
 	}
 
 	curpos=shell->cursor_y*shell->size_x+shell->cursor_x;
-	len=shell->size_x-shell->cursor_x-1;
+	len=shell->size_x-shell->cursor_x;
+	if(chars>len)
+		chars=len;
 
 	ESCDEBUGPRINTF( "%s: deleted %d characters\n", __FUNCTION__, chars);
 
-	while(chars--)
-	{
-		memmove(shell->winbuf+curpos, shell->winbuf+curpos+1, len);
-		memmove(shell->fgbuf+curpos, shell->fgbuf+curpos+1, len);
-		memmove(shell->bgbuf+curpos, shell->bgbuf+curpos+1, len);
-		memmove(shell->rendbuf+curpos, shell->rendbuf+curpos+1, len);
-		memmove(shell->charset+curpos, shell->charset+curpos+1, len);
-
-		memset(shell->winbuf+curpos+len, ' ', 1);
-		memset(shell->fgbuf+curpos+len, VIMSHELL_COLOR_DEFAULT, 1);
-		memset(shell->bgbuf+curpos+len, VIMSHELL_COLOR_DEFAULT, 1);
-		memset(shell->rendbuf+curpos+len, 0, 1);
-		memset(shell->charset+curpos+len, 0, 1);
-	}
+	/*
+	 * Shift the rest of the line left in one go and blank the cells that
+	 * became free at the right margin.
+	 */
+	terminal_move_cells(shell, curpos, curpos+chars, len-chars);
+	terminal_erase_cells(shell, curpos+len-chars, chars);
 }
 
 static void terminal_BEL(struct vim_shell_window *shell)
@@ -1132,7 +1198,7 @@ static void terminal_LF(struct vim_shell_window *shell)
 	if(shell->cursor_y-1==shell->scroll_bottom_margin)
 	{
 		shell->cursor_y--;
-		terminal_scroll_up(shell);
+		terminal_scroll_up(shell, 1);
 	}
 
 	VERBOSEPRINTF( "%s: did LF, cursor is now at X = %u, Y = %u\n", __FUNCTION__,
@@ -1170,7 +1236,7 @@ static void terminal_RI(struct vim_shell_window *shell)
 {
 	ESCDEBUGPRINTF( "%s: done\n", __FUNCTION__);
 	if(shell->cursor_y==shell->scroll_top_margin)
-		terminal_scroll_down(shell);
+		terminal_scroll_down(shell, 1);
 	else
 		shell->cursor_y--;
 }
@@ -1187,7 +1253,7 @@ static void terminal_IND(struct vim_shell_window *shell)
 {
 	ESCDEBUGPRINTF( "%s: done\n", __FUNCTION__);
 	if(shell->cursor_y==shell->scroll_bottom_margin)
-		terminal_scroll_up(shell);
+		terminal_scroll_up(shell, 1);
 	else
 		shell->cursor_y++;
 }
@@ -1428,7 +1494,7 @@ static void terminal_parse_esc_sequence(struct vim_shell_window *shell)
 				ESCDEBUGPRINTF( "%s: keypad switched to numeric mode\n", __FUNCTION__);
 				break;
 			case 'H': // Set Horizontal Tab
-				shell->tabline[shell->cursor_x]=1;
+				VIMSHELL_TABSTOP_SET(shell, shell->cursor_x);
 				break;
 			case 'E': // NEL - Moves cursor to first position on next line. If cursor is
 				  // at bottom margin, screen performs a scroll-up.
@@ -1558,6 +1624,9 @@ static void terminal_normal_char(struct vim_shell_window *shell, char input)
 	else
 		charset=shell->G0_charset=='0' ? VIMSHELL_CHARSET_DRAWING : VIMSHELL_CHARSET_USASCII;
 
+	LOGPUTC(shell, input);
+	terminal_damage(shell, shell->cursor_y, shell->cursor_y);
+
 	shell->winbuf[pos]=input;
 	shell->fgbuf[pos]=shell->fgcolor;
 	shell->bgbuf[pos]=shell->bgcolor;
@@ -1589,24 +1658,18 @@ static void terminal_process_control_char(struct vim_shell_window *shell, char i
 				 * Move to the next tabstop or stop at the right margin if no
 				 * tabstop found.
 				 */
-				int i, found;
-				for(found=0, i=shell->cursor_x+1;i<shell->size_x && !found;i++)
-				{
-					if(shell->tabline[i]==1)
-					{
-						shell->cursor_x=i;
-						found=1;
-					}
-				}
-				if(found==0)
-				{
-					shell->cursor_x=shell->size_x-1;
-				}
+				shell->cursor_x=terminal_next_tabstop(shell, shell->cursor_x);
+				LOGPUTC(shell, '\t');
 			}
 			break;
 		case 013:
 		case 014:
 		case 012: // LF, Line Feed, 0x0a, \n
+			/*
+			 * Only real line feeds end a line in the de-escaped log,
+			 * auto margin wraps call terminal_LF directly.
+			 */
+			LOGPUTC(shell, '\n');
 			terminal_LF(shell);
 			break;
 		case 015: // CR, Carriage Return, 0x0d, \r
@@ -1725,12 +1788,100 @@ static int terminal_flush_output(struct vim_shell_window *shell)
 	return 0;
 }
 
+/*
+ * Allocate the screen buffers of a new, blank screen.
+ * rval: 0 = success, <0 = out of memory (nothing allocated)
+ */
+static int terminal_alloc_screen(struct vim_shell_window *shell, int width, int height)
+{
+	shell->winbuf=(uint8_t *)vim_shell_malloc(width*height);
+	shell->fgbuf=(uint8_t *)vim_shell_malloc(width*height);
+	shell->bgbuf=(uint8_t *)vim_shell_malloc(width*height);
+	shell->rendbuf=(uint8_t *)vim_shell_malloc(width*height);
+	shell->charset=(uint8_t *)vim_shell_malloc(width*height);
+	shell->tabstops=(uint32_t *)vim_shell_malloc(VIMSHELL_TABSTOP_WORDS(width)*sizeof(uint32_t));
+	if(shell->winbuf==NULL || shell->fgbuf==NULL || shell->bgbuf==NULL || shell->rendbuf==NULL || shell->charset==NULL ||
+			shell->tabstops==NULL)
+	{
+		if(shell->winbuf) vim_shell_free(shell->winbuf);
+		if(shell->fgbuf) vim_shell_free(shell->fgbuf);
+		if(shell->bgbuf) vim_shell_free(shell->bgbuf);
+		if(shell->rendbuf) vim_shell_free(shell->rendbuf);
+		if(shell->charset) vim_shell_free(shell->charset);
+		if(shell->tabstops) vim_shell_free(shell->tabstops);
+		return -1;
+	}
+	memset(shell->winbuf, ' ', width*height);
+	memset(shell->fgbuf, shell->fgcolor, width*height);
+	memset(shell->bgbuf, shell->bgcolor, width*height);
+	memset(shell->rendbuf, 0, width*height);
+	memset(shell->charset, 0, width*height);
+	memset(shell->tabstops, 0, VIMSHELL_TABSTOP_WORDS(width)*sizeof(uint32_t));
+	return 0;
+}
+
+/*
+ * Create a new engine with a blank screen of width x height cells.
+ * @return: pointer to a new struct vim_shell_window on success
+ *          NULL if out of memory
+ */
+struct vim_shell_window *vim_shell_vt_new(int width, int height)
+{
+	struct vim_shell_window *rval;
+	int i;
+
+	rval=(struct vim_shell_window *)vim_shell_malloc(sizeof(struct vim_shell_window));
+	if(rval==NULL)
+		return NULL;
+
+	memset(rval, 0, sizeof(struct vim_shell_window));
+
+	rval->size_x=width;
+	rval->size_y=height;
+
+	rval->fgcolor=VIMSHELL_COLOR_DEFAULT;
+	rval->bgcolor=VIMSHELL_COLOR_DEFAULT;
+
+	rval->G0_charset='B';  // United States (USASCII)
+	rval->G1_charset='0';  // Special graphics characters and line drawing set
+	rval->active_charset=0;
+
+	if(terminal_alloc_screen(rval, width, height)<0)
+	{
+		vim_shell_free(rval);
+		return NULL;
+	}
+
+	/*
+	 * Set a tab every 8 columns (default)
+	 */
+	for(i=1;i<width;i++)
+	{
+		if((i+1)%8==0 && i+1<width)
+			VIMSHELL_TABSTOP_SET(rval, i);
+	}
+
+	rval->wraparound=1;
+
+	rval->cursor_x=0;
+	rval->cursor_y=0;
+	rval->cursor_visible=1;
+
+	rval->scroll_top_margin=0;
+	rval->scroll_bottom_margin=height-1;
+
+	rval->fd_master=-1;
+	terminal_damage(rval, 0, height-1);
+
+	return rval;
+}
+
 /*
  * Main Terminal processing method (VIM <- Shell).
  * Gets a buffer with input data from the shell, interprets it and updates
  * the shell window's windowbuffer accordingly.
  */
-void vim_shell_terminal_input(struct vim_shell_window *shell, char *input, int len)
+void vim_shell_vt_feed(struct vim_shell_window *shell, char *input, int len)
 {
 	int i;
 	for(i=0;i<len;i++)
@@ -1739,6 +1890,163 @@ void vim_shell_terminal_input(struct vim_shell_window *shell, char *input, int l
 	}
 }
 
+/*
+ * Get the contents of the cell in column x, row y.
+ */
+void vim_shell_vt_get_cell(struct vim_shell_window *shell, int x, int y, struct vim_shell_cell *cell)
+{
+	int pos=y*shell->size_x+x;
+
+	cell->c=shell->winbuf[pos];
+	cell->fg=shell->fgbuf[pos];
+	cell->bg=shell->bgbuf[pos];
+	cell->rendition=shell->rendbuf[pos];
+	cell->charset=shell->charset[pos];
+}
+
+/*
+ * Get the rows that changed since the last call in *top and *bottom.
+ * Returns 0 if nothing changed (*top and *bottom are not set), 1 otherwise.
+ */
+int vim_shell_vt_damage(struct vim_shell_window *shell, int *top, int *bottom)
+{
+	if(shell->damage_top>shell->damage_bottom)
+		return 0;
+
+	*top=shell->damage_top;
+	*bottom=shell->damage_bottom;
+	shell->damage_top=1;
+	shell->damage_bottom=0;
+	return 1;
+}
+
+/*
+ * Does the work of actually resizing a screen's buffers. Deallocating them,
+ * reallocating them, copying over the old contents to the right places, etc...
+ * rval: 0 = success, <0 = error (the screen is unchanged)
+ */
+static int terminal_resize_screen(struct vim_shell_window *shell, int width, int height)
+{
+	struct vim_shell_window old;
+	int x, y, len, vlen;
+
+	old=*shell;
+	if(terminal_alloc_screen(shell, width, height)<0)
+	{
+		/*
+		 * The buffers allocated so far are freed already, put the old
+		 * ones back.
+		 */
+		*shell=old;
+		return -1;
+	}
+	shell->size_x=(uint16_t)width;
+	shell->size_y=(uint16_t)height;
+
+	/*
+	 * copy over the old contents of the screen, line by line (!)
+	 */
+	len=(old.size_x<width ? old.size_x : width);
+	vlen=(old.size_y<height ? old.size_y : height);
+	for(y=0;y<vlen;y++)
+	{
+		int y_off;
+		y_off=old.size_y-vlen;
+		memcpy(shell->winbuf+y*width, old.winbuf+(y+y_off)*old.size_x, len);
+		memcpy(shell->fgbuf+y*width, old.fgbuf+(y+y_off)*old.size_x, len);
+		memcpy(shell->bgbuf+y*width, old.bgbuf+(y+y_off)*old.size_x, len);
+		memcpy(shell->rendbuf+y*width, old.rendbuf+(y+y_off)*old.size_x, len);
+		memcpy(shell->charset+y*width, old.charset+(y+y_off)*old.size_x, len);
+	}
+	memcpy(shell->tabstops, old.tabstops, VIMSHELL_TABSTOP_WORDS(len)*sizeof(uint32_t));
+	if(len%32)
+		shell->tabstops[len/32]&=((uint32_t)1<<(len%32))-1;
+
+	/*
+	 * free the old contents
+	 */
+	terminal_free_screen(&old);
+
+	/*
+	 * Correct tabs
+	 */
+	if(old.size_x<width)
+	{
+		for(x=old.size_x;x<width;x++)
+		{
+			if((x+1)%8==0 && x+1<width)
+				VIMSHELL_TABSTOP_SET(shell, x);
+		}
+	}
+
+	/*
+	 * Correct cursor
+	 */
+	if(shell->cursor_x>=shell->size_x)
+		shell->cursor_x=shell->size_x-1;
+	if(shell->cursor_y>=shell->size_y)
+		shell->cursor_y=shell->size_y-1;
+
+	/*
+	 * Update scroll region
+	 */
+	shell->scroll_top_margin=0;
+	shell->scroll_bottom_margin=shell->size_y-1;
+
+	/*
+	 * Invalidate the vimshell screen buffer, so vim_shell_redraw redraws the whole
+	 * screen.
+	 */
+	shell->force_redraw=1;
+	shell->damage_top=1;
+	shell->damage_bottom=0;
+	terminal_damage(shell, 0, shell->size_y-1);
+
+	return 0;
+}
+
+/*
+ * Resize the screen, and the alternate screen if there is one, to width x
+ * height cells. The old contents are kept as far as they fit.
+ * rval: 0 = success, <0 = out of memory (the screen is unchanged, but the
+ *       alternate screen may have been dropped)
+ */
+int vim_shell_vt_resize(struct vim_shell_window *shell, int width, int height)
+{
+	if(terminal_resize_screen(shell, width, height)<0)
+		return -1;
+
+	if(shell->alt!=NULL && terminal_resize_screen(shell->alt, width, height)<0)
+	{
+		/*
+		 * The main screen is already resized and this one didn't work.
+		 * Just drop the screen backup so it never gets restored.
+		 */
+		ESCDEBUGPRINTF( "%s: error while resizing the backup screen, dropped\n", __FUNCTION__);
+		terminal_free_screen(shell->alt);
+		vim_shell_free(shell->alt);
+		shell->alt=NULL;
+	}
+
+	return 0;
+}
+
+/*
+ * Free the engine: the screen, the alternate screen and the struct itself.
+ */
+void vim_shell_vt_free(struct vim_shell_window *shell)
+{
+	if(shell->alt)
+	{
+		terminal_free_screen(shell->alt);
+		vim_shell_free(shell->alt);
+	}
+	terminal_free_screen(shell);
+	vim_shell_free(shell);
+}
+
+#ifndef VIMSHELL_STANDALONE
+
 /*
  * Main Terminal output method (VIM -> Shell).
  * Translates the character 'c' into an appropriate escape sequence (if necessary)
@@ -1931,3 +2239,4 @@ int vim_shell_terminal_output(struct vim_shell_window *shell, int c)
 	return written;
 }
 #endif
+#endif
@@ -58,6 +58,10 @@ ui_write(s, len)
 #endif
 }
 
+#ifdef FEAT_MMAP
+static long ui_map_load __ARGS((long msec));
+#endif
+
 #if defined(UNIX) || defined(VMS) || defined(PROTO)
 /*
  * When executing an external program, there may be some typed characters that
@@ -166,6 +170,37 @@ ui_inchar(buf, maxlen, wtime, tb_change_cnt)
     }
 #endif
 
+#ifdef FEAT_MMAP
+    /* When going to wait for some time or block, load files in the
+     * background until a character is typed or the time is up, then wait
+     * for what is left of the time. */
+    if (wtime > 100L)
+	wtime = ui_map_load(wtime);
+    else if (wtime == -1 && ui_map_load(p_ut) == 0 && !ui_char_avail())
+    {
+	/* When blocking, 'updatetime' is the limit.  Do what is done after
+	 * waiting that long for a character, then load the rest. */
+# ifdef FEAT_AUTOCMD
+	if (trigger_cursorhold() && maxlen >= 3
+					   && !typebuf_changed(tb_change_cnt))
+	{
+#  ifdef FEAT_GUI
+	    buf[0] = gui.in_use ? CSI : K_SPECIAL;
+#  else
+	    buf[0] = K_SPECIAL;
+#  endif
+	    buf[1] = KS_EXTRA;
+	    buf[2] = (int)KE_CURSORHOLD;
+	    retval = 3;
+	    goto theend;
+	}
+# endif
+	before_blocking();
+	while (ml_map_load_step() && !ui_char_avail())
+	    ;
+    }
+#endif
+
     /* If we are going to wait for some time or block... */
     if (wtime == -1 || wtime > 100L)
     {
@@ -178,6 +213,18 @@ ui_inchar(buf, maxlen, wtime, tb_change_cnt)
 	    ctrl_c_interrupts = FALSE;
     }
 
+#ifdef FEAT_VIMSHELL
+    /* Output of ":vimshellread" is only appended while waiting for a typed
+     * key, not at a prompt in the middle of a command. */
+    if (wtime == -1 && State != HITRETURN && State != ASKMORE
+							  && State != CONFIRM)
+    {
+	vim_shell_stream_idle = TRUE;
+	if (vim_shell_stream_flush() > 0)
+	    update_screen(VALID);
+    }
+#endif
+
 #ifdef FEAT_GUI
     if (gui.in_use)
     {
@@ -193,6 +240,9 @@ ui_inchar(buf, maxlen, wtime, tb_change_cnt)
 	retval = mch_inchar(buf, maxlen, wtime, tb_change_cnt);
     }
 #endif
+#ifdef FEAT_VIMSHELL
+    vim_shell_stream_idle = FALSE;
+#endif
 
     if (wtime == -1 || wtime > 100L)
 	/* block SIGHUP et al. */
@@ -200,7 +250,7 @@ ui_inchar(buf, maxlen, wtime, tb_change_cnt)
 
     ctrl_c_interrupts = TRUE;
 
-#ifdef NO_CONSOLE_INPUT
+#if defined(NO_CONSOLE_INPUT) || (defined(FEAT_MMAP) && defined(FEAT_AUTOCMD))
 theend:
 #endif
 #ifdef FEAT_PROFILE
@@ -210,6 +260,37 @@ theend:
     return retval;
 }
 
+#ifdef FEAT_MMAP
+/*
+ * Load files in the background for at most "msec" msec or until a character
+ * is typed.
+ * Returns the time that is left.
+ */
+    static long
+ui_map_load(msec)
+    long	msec;
+{
+# if defined(HAVE_GETTIMEOFDAY) && defined(HAVE_SYS_TIME_H)
+    struct timeval	start_tv;
+    struct timeval	now_tv;
+    long		done = 0;
+
+    gettimeofday(&start_tv, NULL);
+    while (done < msec && ml_map_load_step() && !ui_char_avail())
+    {
+	gettimeofday(&now_tv, NULL);
+	done = (now_tv.tv_sec - start_tv.tv_sec) * 1000L
+				  + (now_tv.tv_usec - start_tv.tv_usec) / 1000L;
+    }
+    return done < msec ? msec - done : 0L;
+# else
+    /* Can't tell the time, only load one piece. */
+    (void)ml_map_load_step();
+    return msec;
+# endif
+}
+#endif
+
 /*
  * return non-zero if a character is available
  */
@@ -58,6 +58,12 @@ static char *RCSID="$Id$";
 #  define SIGDEBUGPRINTF(a...)
 #endif
 
+/*
+ * How long vim_shell_reap() waits for a child to exit, in steps of 10 msec,
+ * before it sends SIGKILL.
+ */
+#define VIMSHELL_REAP_STEPS 50
+
 
 int vimshell_errno;
 
@@ -122,77 +128,14 @@ static void hexdump(FILE *fp, unsigned char *buffer, long len)
 struct vim_shell_window *vim_shell_new(uint16_t width, uint16_t height)
 {
 	struct vim_shell_window *rval;
-	int i;
 
-	rval=(struct vim_shell_window *)vim_shell_malloc(sizeof(struct vim_shell_window));
+	rval=vim_shell_vt_new(width, height);
 	if(rval==NULL)
 	{
 		vimshell_errno=VIMSHELL_OUT_OF_MEMORY;
 		return NULL;
 	}
 
-	memset(rval, 0, sizeof(struct vim_shell_window));
-
-	rval->size_x=width;
-	rval->size_y=height;
-
-	rval->fgcolor=VIMSHELL_COLOR_DEFAULT;
-	rval->bgcolor=VIMSHELL_COLOR_DEFAULT;
-
-	rval->G0_charset='B';  // United States (USASCII)
-	rval->G1_charset='0';  // Special graphics characters and line drawing set
-	rval->active_charset=0;
-
-	rval->winbuf=(uint8_t *)vim_shell_malloc(width*height);
-	rval->fgbuf=(uint8_t *)vim_shell_malloc(width*height);
-	rval->bgbuf=(uint8_t *)vim_shell_malloc(width*height);
-	rval->rendbuf=(uint8_t *)vim_shell_malloc(width*height);
-	rval->charset=(uint8_t *)vim_shell_malloc(width*height);
-	rval->tabline=(uint8_t *)vim_shell_malloc(width);
-	//rval->phys_screen=(uint32_t *)vim_shell_malloc(width*height*4);
-	if(rval->winbuf==NULL || rval->fgbuf==NULL || rval->bgbuf==NULL || rval->rendbuf==NULL || rval->charset==NULL ||
-			rval->tabline==NULL /* || rval->phys_screen==NULL */)
-	{
-		vimshell_errno=VIMSHELL_OUT_OF_MEMORY;
-		// VIMSHELL TODO: cleanup, free the buffers that were successfully allocated
-		vim_shell_free(rval);
-		return NULL;
-	}
-	memset(rval->winbuf, ' ', width*height);
-	memset(rval->fgbuf, rval->fgcolor, width*height);
-	memset(rval->bgbuf, rval->bgcolor, width*height);
-	memset(rval->rendbuf, 0, width*height);
-	memset(rval->charset, 0, width*height);
-	memset(rval->tabline, 0, width);
-
-#if 0
-	for(i=0;i<width*height;i++)
-	{
-		/*
-		 * This is: default foreground, default background, no rendering attributes, ' ' as character
-		 */
-		rval->phys_screen[i]=0x09090020;
-	}
-#endif
-
-	/*
-	 * Set a tab every 8 columns (default)
-	 */
-	for(i=1;i<width;i++)
-	{
-		if((i+1)%8==0 && i+1<width)
-			rval->tabline[i]=1;
-	}
-
-	rval->wraparound=1;
-
-	rval->cursor_x=0;
-	rval->cursor_y=0;
-	rval->cursor_visible=1;
-
-	rval->scroll_top_margin=0;
-	rval->scroll_bottom_margin=height-1;
-
 	CHILDDEBUGPRINTF("%s: vimshell created, width = %d, height = %d\n",
 			__FUNCTION__, width, height);
 
@@ -292,7 +235,8 @@ char *vim_shell_strerror()
 		"execv error",
 		"sigaction error",
 	        "read (EOF)",
-	        "fcntl error"};
+	        "fcntl error",
+	        "open error"};
 
 	if(errno==0)
 		return errmsg[vimshell_errno];
@@ -301,6 +245,384 @@ char *vim_shell_strerror()
 	return errbuf;
 }
 
+/*
+ * Write len bytes to the log file. When the file would grow beyond its
+ * maximum size, it is filled up to the last line that still fits, renamed to
+ * fname_old (replacing an older one) and a fresh file is started.
+ * This runs in the writer thread, so only plain system calls in here.
+ */
+static void log_write_file(struct vim_shell_log *log, uint8_t *data, size_t len)
+{
+	ssize_t w;
+	size_t n, i;
+	int cut;
+
+	while(len>0)
+	{
+		n=len;
+		cut=0;
+		if(log->maxsize>0 && log->size+(off_t)len>log->maxsize)
+		{
+			if(log->size>=log->maxsize)
+			{
+				close(log->fd);
+				rename(log->fname, log->fname_old);
+				log->fd=open(log->fname, O_WRONLY|O_CREAT|O_TRUNC|O_APPEND, 0644);
+				log->size=0;
+				if(log->fd<0)
+				{
+					if(log->write_error==0)
+						log->write_error=errno;
+					return;
+				}
+				continue;
+			}
+
+			/*
+			 * Cut after the last complete line that fits, so lines
+			 * don't get split between two files if it can be helped.
+			 */
+			n=(size_t)(log->maxsize-log->size);
+			for(i=n;i>0 && data[i-1]!='\n';i--)
+				;
+			if(i>0)
+				n=i;
+			cut=1;
+		}
+		if(log->fd<0)
+			return;
+
+		w=write(log->fd, data, n);
+		if(w<0)
+		{
+			if(errno==EINTR)
+				continue;
+			if(log->write_error==0)
+				log->write_error=errno;
+			return;
+		}
+		data+=w;
+		len-=w;
+		log->size+=w;
+
+		/*
+		 * The file is as full as it gets: rotate on the next round.
+		 */
+		if(cut && (size_t)w==n)
+			log->size=log->maxsize;
+	}
+}
+
+#ifdef HAVE_PTHREAD_H
+/*
+ * The log writer thread. Sleeps until there is pending data, swaps the
+ * pending buffer with its own and writes it out with the mutex released,
+ * so a slow disk only ever blocks this thread.
+ */
+static void *log_writer(void *arg)
+{
+	struct vim_shell_log *log=(struct vim_shell_log *)arg;
+	uint8_t *p;
+	size_t len;
+
+	pthread_mutex_lock(&log->mutex);
+	for(;;)
+	{
+		while(log->pending_len==0 && !log->quit)
+			pthread_cond_wait(&log->cond, &log->mutex);
+		if(log->pending_len==0)
+			break;
+
+		p=log->pending;
+		len=log->pending_len;
+		log->pending=log->writing;
+		log->pending_len=0;
+		log->writing=p;
+
+		pthread_mutex_unlock(&log->mutex);
+		log_write_file(log, p, len);
+		pthread_mutex_lock(&log->mutex);
+	}
+	pthread_mutex_unlock(&log->mutex);
+
+	return NULL;
+}
+
+/*
+ * Start the writer thread of a log.
+ * rval: 0 = success, otherwise the error number of pthread_create()
+ */
+static int log_start_writer(struct vim_shell_log *log)
+{
+	int err;
+
+	pthread_mutex_init(&log->mutex, NULL);
+	pthread_cond_init(&log->cond, NULL);
+	log->quit=0;
+	if((err=pthread_create(&log->thread, NULL, log_writer, log))!=0)
+	{
+		pthread_mutex_destroy(&log->mutex);
+		pthread_cond_destroy(&log->cond);
+		log->quit=1;
+	}
+	return err;
+}
+
+/*
+ * Let the writer thread of a log write out what is pending and wait until it
+ * has ended.
+ */
+static void log_stop_writer(struct vim_shell_log *log)
+{
+	if(log->quit)
+		return;		/* not running */
+	pthread_mutex_lock(&log->mutex);
+	log->quit=1;
+	pthread_cond_signal(&log->cond);
+	pthread_mutex_unlock(&log->mutex);
+	pthread_join(log->thread, NULL);
+	pthread_mutex_destroy(&log->mutex);
+	pthread_cond_destroy(&log->cond);
+}
+#endif
+
+/*
+ * Queue len bytes for the log writer. Never blocks on the disk: if the
+ * writer can't keep up and the pending buffer is full, the data is dropped
+ * and counted in log->dropped.
+ */
+static void log_append(struct vim_shell_log *log, uint8_t *data, size_t len)
+{
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&log->mutex);
+	if(log->pending_len+len>VIMSHELL_LOG_BUFSIZE)
+	{
+		log->dropped+=len;
+	}
+	else
+	{
+		memcpy(log->pending+log->pending_len, data, len);
+		log->pending_len+=len;
+		pthread_cond_signal(&log->cond);
+	}
+	pthread_mutex_unlock(&log->mutex);
+#else
+	/*
+	 * No threads: coalesce the output and write it in big chunks.
+	 */
+	if(log->pending_len+len>VIMSHELL_LOG_BUFSIZE)
+	{
+		log_write_file(log, log->pending, log->pending_len);
+		log->pending_len=0;
+	}
+	if(len>VIMSHELL_LOG_BUFSIZE)
+	{
+		log_write_file(log, data, len);
+		return;
+	}
+	memcpy(log->pending+log->pending_len, data, len);
+	log->pending_len+=len;
+#endif
+}
+
+/*
+ * Hand the de-escaped characters collected so far over to the writer.
+ */
+static void log_flush_stage(struct vim_shell_log *log)
+{
+	if(log->stage_len>0)
+	{
+		log_append(log, log->stage, log->stage_len);
+		log->stage_len=0;
+	}
+}
+
+/*
+ * Called by the terminal layer for every character that ends up in the
+ * de-escaped log.
+ */
+void vim_shell_log_putc(struct vim_shell_log *log, int c)
+{
+	if(log->stage_len>=sizeof(log->stage))
+		log_flush_stage(log);
+	log->stage[log->stage_len++]=(uint8_t)c;
+}
+
+/*
+ * Start logging the output of the shell to the file fname. Output is
+ * appended to the file. When raw is non-zero the bytes are logged as the
+ * program sent them, otherwise only the text with the escape sequences
+ * removed. When maxsize is non-zero the log is rotated when it would grow
+ * beyond maxsize bytes.
+ * An already running log of this shell is closed first.
+ * rval: 0 = success, <0 = error
+ */
+int vim_shell_log_open(struct vim_shell_window *shell, char *fname, int raw, long maxsize)
+{
+	struct vim_shell_log *log;
+	struct stat st;
+	size_t fnamelen;
+
+	vim_shell_log_close(shell);
+
+	log=(struct vim_shell_log *)vim_shell_malloc(sizeof(struct vim_shell_log));
+	if(log==NULL)
+	{
+		vimshell_errno=VIMSHELL_OUT_OF_MEMORY;
+		return -1;
+	}
+	memset(log, 0, sizeof(struct vim_shell_log));
+
+	fnamelen=strlen(fname);
+	log->fname=(char *)vim_shell_malloc(fnamelen+1);
+	log->fname_old=(char *)vim_shell_malloc(fnamelen+3);
+	log->pending=(uint8_t *)vim_shell_malloc(VIMSHELL_LOG_BUFSIZE);
+#ifdef HAVE_PTHREAD_H
+	log->writing=(uint8_t *)vim_shell_malloc(VIMSHELL_LOG_BUFSIZE);
+#endif
+	if(log->fname==NULL || log->fname_old==NULL || log->pending==NULL
+#ifdef HAVE_PTHREAD_H
+			|| log->writing==NULL
+#endif
+			)
+	{
+		vimshell_errno=VIMSHELL_OUT_OF_MEMORY;
+		goto fail;
+	}
+	strcpy(log->fname, fname);
+	sprintf(log->fname_old, "%s.1", fname);
+
+	log->raw=raw;
+	log->maxsize=maxsize;
+	log->fd=open(fname, O_WRONLY|O_CREAT|O_APPEND, 0644);
+	if(log->fd<0)
+	{
+		vimshell_errno=VIMSHELL_OPEN_ERROR;
+		goto fail;
+	}
+	if(fstat(log->fd, &st)==0)
+		log->size=st.st_size;
+
+#ifdef HAVE_PTHREAD_H
+	if(log_start_writer(log)!=0)
+	{
+		close(log->fd);
+		vimshell_errno=VIMSHELL_OUT_OF_MEMORY;
+		goto fail;
+	}
+#endif
+
+	shell->log=log;
+
+	CHILDDEBUGPRINTF("%s: logging to %s (%s, maxsize %ld)\n", __FUNCTION__,
+			fname, raw ? "raw" : "text", maxsize);
+
+	vimshell_errno=VIMSHELL_SUCCESS;
+	return 0;
+
+fail:
+	vim_shell_free(log->fname);
+	vim_shell_free(log->fname_old);
+	vim_shell_free(log->pending);
+	vim_shell_free(log->writing);
+	vim_shell_free(log);
+	return -1;
+}
+
+/*
+ * Stop logging the shell's output. Everything queued so far is written out
+ * before the file is closed.
+ */
+void vim_shell_log_close(struct vim_shell_window *shell)
+{
+	struct vim_shell_log *log=shell->log;
+
+	if(log==NULL)
+		return;
+
+	log_flush_stage(log);
+#ifdef HAVE_PTHREAD_H
+	log_stop_writer(log);
+#else
+	log_write_file(log, log->pending, log->pending_len);
+#endif
+	if(log->fd>=0)
+		close(log->fd);
+
+	CHILDDEBUGPRINTF("%s: closed log %s, %lu bytes dropped\n", __FUNCTION__,
+			log->fname, log->dropped);
+
+	/*
+	 * The writer can't report anything itself, tell the user now that
+	 * the log is incomplete.
+	 */
+	if(log->write_error!=0)
+	{
+		vim_snprintf((char *)IObuff, IOSIZE,
+				_("VIMSHELL: error writing the log %s: %s"),
+				log->fname, strerror(log->write_error));
+		emsg(IObuff);
+	}
+	if(log->dropped>0)
+	{
+		vim_snprintf((char *)IObuff, IOSIZE,
+				_("VIMSHELL: %lu bytes were not written to the log %s"),
+				log->dropped, log->fname);
+		emsg(IObuff);
+	}
+
+	vim_shell_free(log->fname);
+	vim_shell_free(log->fname_old);
+	vim_shell_free(log->pending);
+	vim_shell_free(log->writing);
+	vim_shell_free(log);
+	shell->log=NULL;
+}
+
+/*
+ * Called before fork() when the child continues as VIM (":gui"). Threads
+ * don't continue in the child: let the log writers write out what is pending
+ * and end, vim_shell_fork_done() starts them again.
+ */
+void vim_shell_fork_prepare(void)
+{
+#ifdef HAVE_PTHREAD_H
+	buf_T *buf;
+
+	for(buf=firstbuf;buf!=NULL;buf=buf->b_next)
+	{
+		if(buf->is_shell!=0 && buf->shell!=NULL && buf->shell->log!=NULL)
+		{
+			log_flush_stage(buf->shell->log);
+			log_stop_writer(buf->shell->log);
+		}
+	}
+#endif
+}
+
+/*
+ * Called after fork() in the process that continues as VIM: the child, or the
+ * parent when fork() failed.
+ */
+void vim_shell_fork_done(void)
+{
+#ifdef HAVE_PTHREAD_H
+	buf_T *buf;
+	int err;
+
+	for(buf=firstbuf;buf!=NULL;buf=buf->b_next)
+	{
+		if(buf->is_shell!=0 && buf->shell!=NULL && buf->shell->log!=NULL
+				&& (err=log_start_writer(buf->shell->log))!=0)
+		{
+			/* Can't log without a writer, report it and stop. */
+			buf->shell->log->write_error=err;
+			vim_shell_log_close(buf->shell);
+		}
+	}
+#endif
+}
+
 /*
  * Read what is available from the master pty and tear it through the
  * terminal emulation. This will fill the window buffer.
@@ -356,7 +678,13 @@ retry:
 	 * Interface to the terminal layer: give the input buffer to the
 	 * terminal emulator for processing.
 	 */
-	vim_shell_terminal_input(shell, input, rval);
+	if(shell->log!=NULL && shell->log->raw)
+		log_append(shell->log, (uint8_t *)input, rval);
+
+	vim_shell_vt_feed(shell, input, rval);
+
+	if(shell->log!=NULL && !shell->log->raw)
+		log_flush_stage(shell->log);
 
 success:
 	vimshell_errno=VIMSHELL_SUCCESS;
@@ -379,6 +707,37 @@ int vim_shell_write(struct vim_shell_window *shell, int c)
 	return 0;
 }
 
+/*
+ * Wait for the child "pid" to exit after it was sent SIGTERM and SIGHUP or
+ * closed the pty. A child that ignores the signals or keeps running is killed
+ * with SIGKILL after a short while, Vim must not hang on it.
+ */
+static void vim_shell_reap(pid_t pid)
+{
+	int status=0;
+	int i;
+	pid_t r;
+
+	for(i=0;;)
+	{
+		r=waitpid(pid, &status, WNOHANG);
+		if(r<0 && errno==EINTR)
+			continue;
+		if(r!=0)
+			break;
+		if(++i>VIMSHELL_REAP_STEPS)
+		{
+			CHILDDEBUGPRINTF( "%s: PID %u still running, killing it\n", __FUNCTION__, pid);
+			kill(pid, SIGKILL);
+			while(waitpid(pid, &status, 0)<0 && errno==EINTR);
+			break;
+		}
+		usleep(10000);
+	}
+	CHILDDEBUGPRINTF( "%s: PID %u terminated, exit status = %d\n", __FUNCTION__, pid,
+		WEXITSTATUS(status));
+}
+
 /*
  * Free everything that is associated with this shell window.
  * Also terminates the process. The shell pointer will be set to NULL.
@@ -387,47 +746,25 @@ int vim_shell_write(struct vim_shell_window *shell, int c)
 void vim_shell_delete(buf_T *buf)
 {
 	struct vim_shell_window *sh=buf->shell;
-	int status;
 	pid_t pid;
 
 	/*
 	 * First, kill the child and wait for it.
-	 * VIMSHELL TODO: this can be extended a lot. e.g. using a SIGCHLD handler
-	 * or an SIGALRM handler and kill(SIGKILL) the process when the alarm fires
-	 * etc. But for now (and most of all cases) this should be OK.
 	 */
 	pid=sh->pid;
 	if(pid>0)
 	{
 		kill(pid, SIGTERM);
 		kill(pid, SIGHUP);
-		while(waitpid(pid, &status, 0)<0 && errno==EINTR);
-		CHILDDEBUGPRINTF( "%s: PID %u terminated, exit status = %d\n", __FUNCTION__, pid,
-			WEXITSTATUS(status));
+		vim_shell_reap(pid);
 	}
 
 	/*
 	 * The child is dead. Clean up
 	 */
 	close(sh->fd_master);
-	if(sh->alt)
-	{
-		vim_shell_free(sh->alt->winbuf);
-		vim_shell_free(sh->alt->fgbuf);
-		vim_shell_free(sh->alt->bgbuf);
-		vim_shell_free(sh->alt->rendbuf);
-		vim_shell_free(sh->alt->tabline);
-		vim_shell_free(sh->alt->charset);
-		vim_shell_free(sh->alt);
-		sh->alt=NULL;
-	}
-	vim_shell_free(sh->winbuf);
-	vim_shell_free(sh->fgbuf);
-	vim_shell_free(sh->bgbuf);
-	vim_shell_free(sh->rendbuf);
-	vim_shell_free(sh->tabline);
-	vim_shell_free(sh->charset);
-	vim_shell_free(sh);
+	vim_shell_log_close(sh);
+	vim_shell_vt_free(sh);
 
 	CHILDDEBUGPRINTF( "%s: vimshell %p freed.\n", __FUNCTION__, sh);
 
@@ -436,134 +773,6 @@ void vim_shell_delete(buf_T *buf)
 	buf->b_p_ro=FALSE;
 }
 
-/*
- * Does the work of actually resizing the shell's buffers. Deallocating them,
- * reallocating them, copying over the old contents to the right places, etc...
- * rval: 0 = success, <0 = error
- */
-static int internal_screenbuf_resize(struct vim_shell_window *shell, int width, int height)
-{
-	uint8_t *owinbuf, *ofgbuf, *obgbuf, *orendbuf, *otabline, *ocharset;
-	int x, y, len, vlen;
-	uint16_t oldwidth, oldheight;
-
-	oldwidth=shell->size_x;
-	oldheight=shell->size_y;
-	shell->size_x=(uint16_t)width;
-	shell->size_y=(uint16_t)height;
-
-	owinbuf=shell->winbuf;
-	ofgbuf=shell->fgbuf;
-	obgbuf=shell->bgbuf;
-	orendbuf=shell->rendbuf;
-	ocharset=shell->charset;
-	otabline=shell->tabline;
-
-	shell->winbuf=(uint8_t *)vim_shell_malloc(width*height);
-	shell->fgbuf=(uint8_t *)vim_shell_malloc(width*height);
-	shell->bgbuf=(uint8_t *)vim_shell_malloc(width*height);
-	shell->rendbuf=(uint8_t *)vim_shell_malloc(width*height);
-	shell->charset=(uint8_t *)vim_shell_malloc(width*height);
-	shell->tabline=(uint8_t *)vim_shell_malloc(width);
-	if(shell->winbuf==NULL || shell->fgbuf==NULL || shell->bgbuf==NULL || shell->rendbuf==NULL || shell->charset==NULL ||
-			shell->tabline==NULL)
-	{
-		vimshell_errno=VIMSHELL_OUT_OF_MEMORY;
-		if(shell->winbuf) vim_shell_free(shell->winbuf);
-		if(shell->fgbuf) vim_shell_free(shell->fgbuf);
-		if(shell->bgbuf) vim_shell_free(shell->bgbuf);
-		if(shell->rendbuf) vim_shell_free(shell->rendbuf);
-		if(shell->charset) vim_shell_free(shell->charset);
-		if(shell->tabline) vim_shell_free(shell->tabline);
-
-		/*
-		 * Reassign the old buffers, they are still valid. And bring the shell
-		 * back to a sane state.
-		 */
-		shell->winbuf=owinbuf;
-		shell->fgbuf=ofgbuf;
-		shell->bgbuf=obgbuf;
-		shell->rendbuf=orendbuf;
-		shell->charset=ocharset;
-		shell->tabline=otabline;
-
-		shell->size_x=oldwidth;
-		shell->size_y=oldheight;
-
-		return -1;
-	}
-	memset(shell->winbuf, ' ', width*height);
-	memset(shell->fgbuf, shell->fgcolor, width*height);
-	memset(shell->bgbuf, shell->bgcolor, width*height);
-	memset(shell->rendbuf, 0, width*height);
-	memset(shell->charset, 0, width*height);
-	memset(shell->tabline, 0, width);
-
-	CHILDDEBUGPRINTF( "%s: width = %d, height = %d, oldwidth = %d, oldheight = %d\n",__FUNCTION__,width,height,
-			oldwidth,oldheight);
-
-	/*
-	 * copy over the old contents of the screen, line by line (!)
-	 */
-	len=(oldwidth<width ? oldwidth : width);
-	vlen=(oldheight<height ? oldheight : height);
-	for(y=0;y<vlen;y++)
-	{
-		int y_off;
-		y_off=oldheight-vlen;
-		memcpy(shell->winbuf+y*width, owinbuf+(y+y_off)*oldwidth, len);
-		memcpy(shell->fgbuf+y*width, ofgbuf+(y+y_off)*oldwidth, len);
-		memcpy(shell->bgbuf+y*width, obgbuf+(y+y_off)*oldwidth, len);
-		memcpy(shell->rendbuf+y*width, orendbuf+(y+y_off)*oldwidth, len);
-		memcpy(shell->charset+y*width, ocharset+(y+y_off)*oldwidth, len);
-	}
-	memcpy(shell->tabline, otabline, len);
-
-	/*
-	 * free the old contents
-	 */
-	vim_shell_free(owinbuf);
-	vim_shell_free(ofgbuf);
-	vim_shell_free(obgbuf);
-	vim_shell_free(orendbuf);
-	vim_shell_free(otabline);
-	vim_shell_free(ocharset);
-
-	/*
-	 * Correct tabs
-	 */
-	if(oldwidth<width)
-	{
-		for(x=oldwidth;x<width;x++)
-		{
-			if((x+1)%8==0 && x+1<width)
-				shell->tabline[x]=1;
-		}
-	}
-
-	/*
-	 * Correct cursor
-	 */
-	if(shell->cursor_x>=shell->size_x)
-		shell->cursor_x=shell->size_x-1;
-	if(shell->cursor_y>=shell->size_y)
-		shell->cursor_y=shell->size_y-1;
-
-	/*
-	 * Update scroll region
-	 */
-	shell->scroll_top_margin=0;
-	shell->scroll_bottom_margin=shell->size_y-1;
-
-	/*
-	 * Invalidate the vimshell screen buffer, so vim_shell_redraw redraws the whole
-	 * screen.
-	 */
-	shell->force_redraw=1;
-
-	return 0;
-}
-
 /*
  * Resizes the shell.
  * It reallocates all the size dependant buffers and instructs the shell to change
@@ -593,27 +802,11 @@ void vim_shell_resize(struct vim_shell_window *shell, int want_width, int want_h
 
 	CHILDDEBUGPRINTF( "%s: resizing to %d, %d\n",__FUNCTION__,width,height);
 
-	if(internal_screenbuf_resize(shell, width, height)<0)
+	if(vim_shell_vt_resize(shell, width, height)<0)
 	{
 		CHILDDEBUGPRINTF("%s: error while resizing.\n", __FUNCTION__);
 		return;
 	}
-	if(shell->alt!=NULL)
-	{
-		if(internal_screenbuf_resize(shell->alt, width, height)<0)
-		{
-			CHILDDEBUGPRINTF("%s: error while resizing the backup screen. Recovering...\n", __FUNCTION__);
-
-			/*
-			 * We now really have a problem. The main shell window is already
-			 * resized and this one didn't work. What should we do? Just destroy the screen
-			 * backup so it never gets restored. internal_screenbuf_resize already did
-			 * the job to of freeing the SINGle buffers, we just have to free the remaining struct.
-			 */
-			vim_shell_free(shell->alt);
-			shell->alt=NULL;
-		}
-	}
 
 	/*
 	 * Tell the shell that the size has changed.
@@ -629,6 +822,206 @@ void vim_shell_resize(struct vim_shell_window *shell, int want_width, int want_h
 	}
 }
 
+/*
+ * The attributes of a shell cell the way they are stored in ScreenAttrs:
+ * rendition in the low byte, foreground and background color above.
+ */
+static sattr_T cell_attr(struct vim_shell_window *shell, size_t index)
+{
+	return (sattr_T)shell->rendbuf[index] | (shell->fgbuf[index]&0x0F)<<12 |
+		(shell->bgbuf[index]&0x0F)<<8;
+}
+
+/*
+ * Cursor motion planning for vim_shell_redraw(), much like mvcur() in
+ * ncurses: for each move we compute how many bytes the alternatives cost and
+ * use the cheapest one. The alternatives are
+ *  - re-printing the cells in between (only when they have the attributes
+ *    and charset the terminal is currently set to),
+ *  - relative motions: T_LE to the left, T_ND or T_CRI to the right, CR to
+ *    the left margin and CR LF to the next rows,
+ *  - absolute addressing with T_CM.
+ * The costs are the lengths of the actual termcap strings.
+ */
+#define MOTION_INFINITY 9999
+
+#define MOTION_RIGHT_REPRINT 1
+#define MOTION_RIGHT_ND 2
+#define MOTION_RIGHT_CRI 3
+
+struct motion_state
+{
+	struct vim_shell_window *shell;
+	int win_row, win_col;	/* screen position of the shell window */
+	int row, col;		/* terminal cursor, row -1 if unknown */
+	sattr_T attr;		/* cell attributes the terminal is set to */
+	int attr_valid;		/* FALSE if attr is unknown */
+	int cs;			/* charset the terminal is set to */
+	long bytes;		/* bytes spent on cursor motion this frame */
+};
+
+/*
+ * Can the cells from screen column 'from' up to 'to' (exclusive) in screen
+ * row 'row' be re-printed to move the cursor? They have to belong to the
+ * shell and need the current attributes and charset.
+ */
+static int motion_can_reprint(struct motion_state *ms, int row, int from, int to)
+{
+	size_t index;
+	int x;
+
+	if(!ms->attr_valid || from<ms->win_col)
+		return FALSE;
+	index=(row-ms->win_row)*ms->shell->size_x+(from-ms->win_col);
+	for(x=from;x<to;x++, index++)
+	{
+		if(cell_attr(ms->shell, index)!=ms->attr || ms->shell->charset[index]!=ms->cs)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * Cost to move the cursor n columns to the right, from screen column 'from'
+ * in screen row 'row'. The way to do it is stored in *how.
+ */
+static int motion_right_cost(struct motion_state *ms, int row, int from, int n, int *how)
+{
+	int cost=MOTION_INFINITY, c;
+
+	if(n<=0)
+	{
+		*how=0;
+		return 0;
+	}
+	if(*T_ND!=NUL && (c=n*(int)STRLEN(T_ND))<cost)
+	{
+		cost=c;
+		*how=MOTION_RIGHT_ND;
+	}
+	if((c=term_cursor_right_cost(n))<cost)
+	{
+		cost=c;
+		*how=MOTION_RIGHT_CRI;
+	}
+	if(n<cost && motion_can_reprint(ms, row, from, from+n))
+	{
+		cost=n;
+		*how=MOTION_RIGHT_REPRINT;
+	}
+	return cost;
+}
+
+static void motion_right(struct motion_state *ms, int row, int from, int n, int how)
+{
+	size_t index;
+
+	switch(how)
+	{
+		case MOTION_RIGHT_ND:
+			while(n-->0)
+				out_str_nf(T_ND);
+			break;
+		case MOTION_RIGHT_CRI:
+			term_cursor_right(n);
+			break;
+		case MOTION_RIGHT_REPRINT:
+			index=(row-ms->win_row)*ms->shell->size_x+(from-ms->win_col);
+			while(n-->0)
+				out_char(ms->shell->winbuf[index++]);
+			break;
+	}
+}
+
+/*
+ * Move the terminal cursor to screen position row, col the cheapest way.
+ */
+static void motion_goto(struct motion_state *ms, int row, int col)
+{
+#define PLAN_ABS 0
+#define PLAN_RIGHT 1
+#define PLAN_LE 2
+#define PLAN_CR 3
+#define PLAN_NL 4
+	int plan, cost, c, how, right_how=0, i;
+
+	if(ms->row==row && ms->col==col)
+		return;
+
+	plan=PLAN_ABS;
+	cost=term_windgoto_cost(row, col);
+
+	if(ms->row>=0)
+	{
+		if(row==ms->row && col>ms->col)
+		{
+			c=motion_right_cost(ms, row, ms->col, col-ms->col, &how);
+			if(c<cost)
+			{
+				plan=PLAN_RIGHT;
+				cost=c;
+				right_how=how;
+			}
+		}
+		else if(row==ms->row && col<ms->col && *T_LE!=NUL)
+		{
+			c=(ms->col-col)*(int)STRLEN(T_LE);
+			if(c<cost)
+			{
+				plan=PLAN_LE;
+				cost=c;
+			}
+		}
+		if(row==ms->row && col<ms->col)
+		{
+			c=1+motion_right_cost(ms, row, 0, col, &how);
+			if(c<cost)
+			{
+				plan=PLAN_CR;
+				cost=c;
+				right_how=how;
+			}
+		}
+		else if(row>ms->row)
+		{
+			c=2*(row-ms->row)+motion_right_cost(ms, row, 0, col, &how);
+			if(c<cost)
+			{
+				plan=PLAN_NL;
+				cost=c;
+				right_how=how;
+			}
+		}
+	}
+
+	switch(plan)
+	{
+		case PLAN_ABS:
+			term_windgoto(row, col);
+			break;
+		case PLAN_RIGHT:
+			motion_right(ms, row, ms->col, col-ms->col, right_how);
+			break;
+		case PLAN_LE:
+			for(i=ms->col;i>col;i--)
+				out_str_nf(T_LE);
+			break;
+		case PLAN_CR:
+			out_char('\r');
+			motion_right(ms, row, 0, col, right_how);
+			break;
+		case PLAN_NL:
+			for(i=ms->row;i<row;i++)
+				out_char('\n');	/* out_char() sends CR LF */
+			motion_right(ms, row, 0, col, right_how);
+			break;
+	}
+
+	ms->bytes+=cost;
+	ms->row=row;
+	ms->col=col;
+}
+
 /*
  * Draws the Shell-Buffer into the VIM-Window.
  */
@@ -640,7 +1033,7 @@ void vim_shell_redraw(struct vim_shell_window *shell, win_T *win)
 	int last_set_fg, last_set_bg;
 	int cs_state;
 	int term_is_bold, term_is_underline, term_is_negative;
-	int saved_screen_cur_row, saved_screen_cur_col;
+	struct motion_state ms;
 	int force_redraw;
 	int using_gui=0;
 	int t_colors_original=t_colors;
@@ -666,21 +1059,32 @@ void vim_shell_redraw(struct vim_shell_window *shell, win_T *win)
 	last_set_fg=last_set_bg=-1;
 	cs_state=VIMSHELL_CHARSET_USASCII;
 
-	saved_screen_cur_row=screen_cur_row;
-	saved_screen_cur_col=screen_cur_col;
-
 	// go to normal mode
 	term_is_bold=term_is_underline=term_is_negative=0;
 	screen_stop_highlight();
 
+	/*
+	 * Start from where VIM knows the cursor is, if it knows.
+	 */
+	ms.shell=shell;
+	ms.win_row=win_row;
+	ms.win_col=win_col;
+	if(screen_cur_row<screen_Rows && screen_cur_col<screen_Columns)
+	{
+		ms.row=screen_cur_row;
+		ms.col=screen_cur_col;
+	}
+	else
+		ms.row=ms.col=-1;
+	ms.attr_valid=FALSE;
+	ms.cs=cs_state;
+	ms.bytes=0;
+
 	for(y=0;y<shell->size_y;y++)
 	{
 		size_t index=y*shell->size_x;
-		int skipped, y_reposition_necessary;
 
 		off=LineOffset[win_row+y]+win_col;
-		skipped=0;
-		y_reposition_necessary=1;
 		for(x=0;x<shell->size_x;x++)
 		{
 			uint8_t c=shell->winbuf[index];
@@ -714,6 +1118,7 @@ void vim_shell_redraw(struct vim_shell_window *shell, win_T *win)
 					out_str_nf("\033(0");
 					CHILDDEBUGPRINTF( "%s: switched terminal to alternate charset\n",__FUNCTION__);
 				}
+				ms.cs=cs;
 			}
 
 			/*
@@ -777,26 +1182,26 @@ void vim_shell_redraw(struct vim_shell_window *shell, win_T *win)
 						last_set_bg=bg_color;
 					}
 				}
+				ms.attr=r;
+				ms.attr_valid=TRUE;
 
 				ScreenLines[off]=c;
 				ScreenAttrs[off]=r;
 
-				if(y_reposition_necessary || skipped>0)
-				{
-					/*
-					 * Bring the cursor to where we need it.
-					 */
-					term_windgoto(win_row+y, win_col+x);
-					skipped=0;
-					y_reposition_necessary=0;
-				}
+				/*
+				 * Bring the cursor to where we need it.
+				 */
+				motion_goto(&ms, win_row+y, win_col+x);
 
 				// print it
 				out_char(c);
-			}
-			else
-			{
-				skipped++;
+
+				/*
+				 * After writing into the last column the cursor
+				 * position depends on the terminal.
+				 */
+				if(++ms.col>=screen_Columns)
+					ms.row=ms.col=-1;
 			}
 
 			off++;
@@ -814,10 +1219,21 @@ void vim_shell_redraw(struct vim_shell_window *shell, win_T *win)
 		CHILDDEBUGPRINTF( "%s: switched terminal to normal charset\n",__FUNCTION__);
 	}
 
+	out_str_nf(T_ME);
+
+	CHILDDEBUGPRINTF("%s: %ld bytes of cursor motion\n", __FUNCTION__, ms.bytes);
+
 	/*
-	 * Move the cursor to where VIM thinks it is :)
+	 * Tell VIM where the cursor is now, so it can move it from here the
+	 * cheap way.
 	 */
-	term_windgoto(saved_screen_cur_row, saved_screen_cur_col);
+	if(ms.row>=0)
+	{
+		screen_cur_row=ms.row;
+		screen_cur_col=ms.col;
+	}
+	else
+		screen_start();
 
 	/*
 	 * Position the cursor.
@@ -832,7 +1248,6 @@ void vim_shell_redraw(struct vim_shell_window *shell, win_T *win)
 	/*
 	 * Restore the rendering attributes
 	 */
-	out_str_nf(T_ME);
 	screen_start_highlight(screen_attr);
 	out_flush();
 
@@ -865,7 +1280,7 @@ int vim_shell_do_read_lowlevel(buf_T *buf)
 
 /*
  * This function is called from two places: os_unix.c and ui.c, and handles
- * shell reads that are necessary because a select() became ready. This function
+ * shell and stream reads that are necessary because a select() became ready. This function
  * is here to avoid identical code in both places.
  * It returns the number of shell-reads.
  * If there was no activity in any of the shells, it returns 0.
@@ -878,9 +1293,21 @@ int vim_shell_do_read_select(fd_set rfds)
 	 * fds. If so, call the shell's read handler.
 	 */
 	buf_T *buf;
+	struct vim_shell_stream *st;
 	int did_redraw=0;
 	int rval=0;
 
+	for(st=vim_shell_streams;st!=NULL;st=st->next)
+	{
+		if(st->fd>=0 && FD_ISSET(st->fd, &rfds))
+		{
+			vim_shell_stream_read(st);
+			rval++;
+		}
+	}
+	if(vim_shell_stream_flush()>0)
+		did_redraw=1;
+
 	for(buf=firstbuf;buf!=NULL;buf=buf->b_next)
 	{
 		if(buf->is_shell != 0)
@@ -923,4 +1350,382 @@ int vim_shell_do_read_select(fd_set rfds)
 
 	return rval;
 }
+
+/*
+ * ":vimshellread": output of a command streamed into an ordinary buffer.
+ *
+ * The command runs on a pty (so it line-buffers its output like it would in
+ * a terminal) and the master side is watched by the same select()/GTK input
+ * machinery as the shells. That also happens from breakcheck(), in the middle
+ * of a ":s", ":g" or a redraw that doesn't expect lines to appear, so the
+ * output is only queued there. Complete lines are appended below the
+ * insertion point in batches while VIM waits for a typed key; a trailing
+ * incomplete line is kept until its newline arrives or the command exits.
+ */
+
+struct vim_shell_stream *vim_shell_streams=NULL;
+
+/*
+ * Set by ui_inchar() while it waits for a typed key, only then queued output
+ * is appended.
+ */
+int vim_shell_stream_idle=0;
+
+/*
+ * Most bytes taken from one stream per wakeup, so that a command that
+ * produces output faster than we can append it doesn't starve the user.
+ */
+#define VIMSHELL_STREAM_CHUNK (64*1024)
+
+/*
+ * Most bytes queued while the output can't be appended. Then the stream isn't
+ * read and the command waits until its pty is read again.
+ */
+#define VIMSHELL_STREAM_QUEUE (1024*1024)
+
+/*
+ * Start "cmd" with 'shell' and stream its output into "buf", below line
+ * "lnum" (0 for above the first line).
+ */
+int vim_shell_stream_start(buf_T *buf, linenr_T lnum, char_u *cmd)
+{
+	struct vim_shell_stream *st;
+	struct winsize winsize;
+	struct termios termios;
+	int fd;
+
+	st=(struct vim_shell_stream *)vim_shell_malloc(sizeof(struct vim_shell_stream));
+	if(st==NULL)
+	{
+		vimshell_errno=VIMSHELL_OUT_OF_MEMORY;
+		return -1;
+	}
+	memset(st, 0, sizeof(struct vim_shell_stream));
+	ga_init2(&st->partial, 1, 1000);
+	st->buf=buf;
+	st->lnum=lnum;
+
+	/*
+	 * No echo and no output processing: we want the bytes exactly as the
+	 * command writes them, "\n" and not "\r\n".
+	 */
+	memset(&termios, 0, sizeof(struct termios));
+	termios.c_cflag=CS8 | CREAD | HUPCL;
+	termios.c_cc[VMIN]=1;
+	termios.c_cc[VTIME]=0;
+
+	winsize.ws_row=24;
+	winsize.ws_col=80;
+	winsize.ws_xpixel=0;
+	winsize.ws_ypixel=0;
+
+	st->pid=forkpty(&st->fd, NULL, &termios, &winsize);
+	if(st->pid==0)
+	{
+		/*
+		 * child code. Input doesn't go anywhere, so don't let the command
+		 * wait for it on the pty.
+		 */
+		if((fd=open("/dev/null", O_RDONLY))>=0)
+		{
+			dup2(fd, 0);
+			close(fd);
+		}
+		setenv("TERM", "dumb", 1);
+		execl((char *)p_sh, (char *)p_sh, (char *)p_shcf, (char *)cmd, (char *)NULL);
+		_exit(127);
+	}
+	else if(st->pid<0)
+	{
+		vim_shell_free(st);
+		vimshell_errno=VIMSHELL_FORKPTY_ERROR;
+		return -1;
+	}
+
+	if(fcntl(st->fd, F_SETFL, fcntl(st->fd, F_GETFL) | O_NONBLOCK)<0)
+		CHILDDEBUGPRINTF( "%s: ERROR: fcntl: %s\n", __FUNCTION__, strerror(errno));
+
+	CHILDDEBUGPRINTF( "%s: PID %u streams into buffer %d below line %ld\n",
+		__FUNCTION__, st->pid, buf->b_fnum, (long)lnum);
+
+	st->next=vim_shell_streams;
+	vim_shell_streams=st;
+
+	vimshell_errno=VIMSHELL_SUCCESS;
+	return 0;
+}
+
+/*
+ * Stop watching the pty of a stream and close it. With "kill_it" the command
+ * is terminated first, otherwise it has already exited and only needs to be
+ * reaped. The queued output is kept.
+ */
+static void stream_close(struct vim_shell_stream *st, int kill_it)
+{
+#if defined(FEAT_GUI_GTK)
+	if(st->gtk_input_id!=0)
+	{
+		gdk_input_remove(st->gtk_input_id);
+		st->gtk_input_id=0;
+	}
+#elif defined(FEAT_GUI_MACVIM)
+	if(st->fdref!=NULL)
+	{
+		CFFileDescriptorInvalidate(st->fdref);
+		CFRelease(st->fdref);
+		st->fdref=NULL;
+		CFRunLoopSourceInvalidate(st->source);
+		CFRelease(st->source);
+		st->source=NULL;
+	}
+#endif
+	if(kill_it)
+	{
+		kill(st->pid, SIGTERM);
+		kill(st->pid, SIGHUP);
+	}
+	close(st->fd);
+	st->fd=-1;
+	vim_shell_reap(st->pid);
+}
+
+/*
+ * Unlink and free a stream, see stream_close() for "kill_it".
+ */
+static void stream_free(struct vim_shell_stream *st, int kill_it)
+{
+	struct vim_shell_stream **pp;
+
+	for(pp=&vim_shell_streams;*pp!=NULL;pp=&(*pp)->next)
+	{
+		if(*pp==st)
+		{
+			*pp=st->next;
+			break;
+		}
+	}
+
+	if(st->fd>=0)
+		stream_close(st, kill_it);
+	ga_clear(&st->partial);
+	vim_shell_free(st);
+}
+
+/*
+ * Append the "count" NUL separated lines in "lines" below the insertion
+ * point of "st", as one change.
+ */
+static void stream_append(struct vim_shell_stream *st, char_u *lines, int count)
+{
+	aco_save_T aco;
+	linenr_T lnum;
+	int i;
+
+	if(count==0)
+		return;
+
+	aucmd_prepbuf(&aco, st->buf);
+
+	lnum=st->lnum;
+	if(lnum>curbuf->b_ml.ml_line_count)
+		lnum=curbuf->b_ml.ml_line_count;
+
+	/* Undo isn't very useful here, ignore failure. */
+	u_sync(TRUE);
+	(void)u_save(lnum, lnum+1);
+
+	for(i=0;i<count;i++)
+	{
+		ml_append(lnum+i, lines, (colnr_T)0, FALSE);
+		lines+=STRLEN(lines)+1;
+	}
+	appended_lines_mark(lnum, (long)count);
+	st->lnum=lnum+count;
+
+	aucmd_restbuf(&aco);
+}
+
+/*
+ * Return TRUE if the pty of "st" is to be read: the command is still running
+ * and not too much output is queued.
+ */
+int vim_shell_stream_wants_read(struct vim_shell_stream *st)
+{
+	return st->fd>=0
+		&& (st->lines==0 || st->partial.ga_len<VIMSHELL_STREAM_QUEUE);
+}
+
+/*
+ * Read what is available from a stream and queue it, vim_shell_stream_flush()
+ * appends the complete lines.
+ * Returns 1 if the command has exited and the pty was closed, 0 otherwise.
+ */
+int vim_shell_stream_read(struct vim_shell_stream *st)
+{
+	char_u input[4096];
+	garray_T *ga=&st->partial;
+	int total=0;
+	int eof=0;
+	int rval;
+	int i;
+
+	while(total<VIMSHELL_STREAM_CHUNK && vim_shell_stream_wants_read(st))
+	{
+		if((rval=read(st->fd, input, sizeof(input)))<0)
+		{
+			if(errno==EINTR)
+				continue;
+			if(errno!=EAGAIN)
+				eof=1;	/* Linux gives EIO once the slave side is closed */
+			break;
+		}
+		if(rval==0)
+		{
+			eof=1;
+			break;
+		}
+		if(ga_grow(ga, rval)==FAIL)
+			break;
+
+		/*
+		 * Lines are stored NUL terminated, a NUL in the output becomes a NL
+		 * (that's how Vim keeps a NUL in a line).
+		 */
+		for(i=0;i<rval;i++)
+		{
+			if(input[i]=='\n')
+			{
+				input[i]=NUL;
+				st->lines++;
+			}
+			else if(input[i]==NUL)
+				input[i]='\n';
+		}
+		mch_memmove((char_u *)ga->ga_data+ga->ga_len, input, (size_t)rval);
+		ga->ga_len+=rval;
+		total+=rval;
+	}
+
+	if(!eof)
+		return 0;
+
+	if(ga->ga_len>0 && ((char_u *)ga->ga_data)[ga->ga_len-1]!=NUL
+			&& ga_grow(ga, 1)==OK)
+	{
+		((char_u *)ga->ga_data)[ga->ga_len++]=NUL;
+		st->lines++;
+	}
+	stream_close(st, FALSE);
+	return 1;
+}
+
+/*
+ * Append the complete lines queued for "st".
+ */
+static void stream_append_queued(struct vim_shell_stream *st)
+{
+	garray_T *ga=&st->partial;
+	char_u *line, *q;
+	int count;
+	int i;
+
+	/*
+	 * Drop a CR before a line end, in case the command writes "\r\n"
+	 * itself.
+	 */
+	count=0;
+	line=q=(char_u *)ga->ga_data;
+	for(i=0;i<ga->ga_len && count<st->lines;i++)
+	{
+		if(((char_u *)ga->ga_data)[i]==NUL)
+		{
+			if(q>line && q[-1]=='\r')
+				q--;
+			*q++=NUL;
+			count++;
+			line=q;
+		}
+		else
+			*q++=((char_u *)ga->ga_data)[i];
+	}
+
+	if(buf_valid(st->buf) && st->buf->b_ml.ml_mfp!=NULL)
+		stream_append(st, (char_u *)ga->ga_data, count);
+
+	/* keep the incomplete last line */
+	ga->ga_len-=i;
+	if(ga->ga_len>0)
+		mch_memmove(ga->ga_data, (char_u *)ga->ga_data+i, (size_t)ga->ga_len);
+	st->lines=0;
+}
+
+/*
+ * Append the queued output of all streams and free the ones whose command
+ * has exited. Does nothing unless VIM is waiting for a typed key.
+ * Returns the number of lines appended.
+ */
+int vim_shell_stream_flush(void)
+{
+	struct vim_shell_stream *st, *next;
+	int count=0;
+
+	if(!vim_shell_stream_idle || updating_screen)
+		return 0;
+
+	/* Appending may check for typeahead, don't get back here then. */
+	vim_shell_stream_idle=0;
+	for(st=vim_shell_streams;st!=NULL;st=next)
+	{
+		next=st->next;
+		if(st->lines>0)
+		{
+			count+=st->lines;
+			stream_append_queued(st);
+		}
+		if(st->fd<0)
+			stream_free(st, FALSE);
+	}
+	vim_shell_stream_idle=1;
+	return count;
+}
+
+/*
+ * Terminate all commands that stream into "buf", called when the buffer is
+ * unloaded.
+ */
+void vim_shell_stream_stop(buf_T *buf)
+{
+	struct vim_shell_stream *st, *next;
+
+	for(st=vim_shell_streams;st!=NULL;st=next)
+	{
+		next=st->next;
+		if(st->buf==buf)
+			stream_free(st, TRUE);
+	}
+}
+
+/*
+ * Keep the insertion points in the current buffer in place when lines are
+ * inserted or deleted above them. Called from mark_adjust().
+ */
+void vim_shell_stream_mark_adjust(linenr_T line1, linenr_T line2, long amount, long amount_after)
+{
+	struct vim_shell_stream *st;
+
+	for(st=vim_shell_streams;st!=NULL;st=st->next)
+	{
+		if(st->buf!=curbuf)
+			continue;
+		if(st->lnum>=line1 && st->lnum<=line2)
+		{
+			if(amount==MAXLNUM)
+				st->lnum=line1-1;
+			else
+				st->lnum+=amount;
+		}
+		else if(amount_after && st->lnum>line2)
+			st->lnum+=amount_after;
+	}
+}
 #endif
@@ -17,220 +17,93 @@
 #include "vim.h"
 
 #include <stdio.h>
-#ifdef HAVE_STDINT_H
-#include <stdint.h>
-#endif
 #include <sys/types.h>
 #include <sys/select.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
-/*
- * Master debug flag. Disable this and no debug messages at all will
- * be written anywhere.
- */
-//#define VIMSHELL_DEBUG
-
-/*
- * Rendition constants
- */
-#define RENDITION_BOLD 1
-#define RENDITION_UNDERSCORE 2
-#define RENDITION_BLINK 4
-#define RENDITION_NEGATIVE 8
-#define RENDITION_DIM 16
-#define RENDITION_HIDDEN 32
-
-/*
- * charset constants
- */
-#define VIMSHELL_CHARSET_USASCII 0
-#define VIMSHELL_CHARSET_DRAWING 1
+#include "vim_shell_vt.h"
 
 /*
- * Color constants
+ * Size of the buffer that collects shell output for the log writer. When the
+ * writer falls this far behind, further output is dropped (and counted)
+ * instead of blocking the shell.
  */
-#define VIMSHELL_COLOR_BLACK 0
-#define VIMSHELL_COLOR_RED 1
-#define VIMSHELL_COLOR_GREEN 2
-#define VIMSHELL_COLOR_YELLOW 3
-#define VIMSHELL_COLOR_BLUE 4
-#define VIMSHELL_COLOR_MAGENTA 5
-#define VIMSHELL_COLOR_CYAN 6
-#define VIMSHELL_COLOR_WHITE 7
-#define VIMSHELL_COLOR_DEFAULT 9
-
-#define vim_shell_malloc alloc
-#define vim_shell_free vim_free
+#define VIMSHELL_LOG_BUFSIZE (256*1024)
 
 /*
- * The main vim_shell_window struct.
- * Holds everything that is needed to know about a single
- * vim shell. (like file descriptors, window buffers, window
- * positions, etc)
+ * Output log of a shell (see ":vimshelllog").
+ * vim_shell_read() and the terminal layer append to 'pending', the writer
+ * (a thread if we have pthreads) takes it over and writes it to 'fd'.
  */
-struct vim_shell_window
+struct vim_shell_log
 {
-	/*
-	 * current dimensions of the window
-	 */
-	uint16_t size_x;
-	uint16_t size_y;
-
-	/*
-	 * cursor position and visible flag
-	 */
-	uint16_t cursor_x;
-	uint16_t cursor_y;
-	uint16_t cursor_visible;
-
-	/*
-	 * Saved cursor positions (ESC 7, ESC 8)
-	 */
-	uint16_t saved_cursor_x;
-	uint16_t saved_cursor_y;
-
-	/*
-	 * We support the xterm title hack and store the title in this buffer.
-	 */
-	char windowtitle[50];
-
-	/*
-	 * The output buffer. This is necessary because writes to the shell can be delayed,
-	 * e.g. if we are waiting for an incoming ESC sequence to complete.
-	 */
-	uint8_t outbuf[100];
-	uint8_t outbuf_pos;
-
-	/*
-	 * Pointer to the window buffer.
-	 * The window buffer is the internal representation of the
-	 * window's content. The vim shell receives characters from
-	 * the terminal, which the terminal emulation translates into
-	 * e.g. cursor positions or actual characters. These are placed
-	 * here at the right screen position. Its size is size_y*size_x.
-	 */
-	uint8_t *winbuf;
-	uint8_t *fgbuf;
-	uint8_t *bgbuf;
-	uint8_t *rendbuf;
-	uint8_t *charset;
-
-	/*
-	 * The tabulator line. It represents a single row. Zero means no
-	 * tab at this position, 1 means there is a tab.
-	 */
-	uint8_t *tabline;
-
-	/*
-	 * These buffers hold what's currently physical on the screen.
-	 * Note, not on the "virtual" screen, that is the image of the shell,
-	 * but the real screen that is printed out in vim_shell_redraw.
-	 * This is mainly to implement caching features...
-	 * We hold here:
-	 * 1 byte foreground-color
-	 * 1 byte background-color
-	 * 1 byte rendering attributes
-	 * 1 byte the actual character
-	 */
-	uint32_t *phys_screen;
-
-	/*
-	 * Flag that determines if we are right in the middle of an
-	 * escape sequence coming in.
-	 */
-	uint8_t in_esc_sequence;
-
-	/*
-	 * Buffer for a escape sequence in progress (see in_esc_sequence).
-	 */
-	uint8_t esc_sequence[50];
-
-	/*
-	 * Auto-Margin enabled?
-	 */
-	uint8_t wraparound;
-
-	/*
-	 * Caused the last character a warp around?
-	 */
-	uint8_t just_wrapped_around;
-
-	/*
-	 * The currently used rendition of the shell.
-	 */
-	uint8_t rendition;
-	uint8_t saved_rendition;
+	char *fname;		/* name of the log file */
+	char *fname_old;	/* fname with ".1" appended, for rotation */
+	int raw;		/* log raw bytes instead of the de-escaped text */
+	int fd;
+	off_t size;		/* bytes in the current log file */
+	off_t maxsize;		/* rotate when size exceeds this, 0 = never */
 
 	/*
-	 * The currently active colors.
+	 * De-escaped characters are collected here by the terminal layer, one
+	 * at a time and without locking. Handed over in vim_shell_read().
 	 */
-	uint8_t fgcolor;
-	uint8_t bgcolor;
-	uint8_t saved_fgcolor;
-	uint8_t saved_bgcolor;
+	uint8_t stage[1024];
+	int stage_len;
 
 	/*
-	 * Scroll region.
+	 * Data waiting to be written, and the buffer the writer currently
+	 * works on. The two are swapped under the mutex.
 	 */
-	uint8_t scroll_top_margin;
-	uint8_t scroll_bottom_margin;
+	uint8_t *pending;
+	size_t pending_len;
+	uint8_t *writing;
 
-	/*
-	 * Charset configuration.
-	 */
-	uint8_t G0_charset;
-	uint8_t G1_charset;
-	uint8_t active_charset;
-	uint8_t saved_G0_charset;
-	uint8_t saved_G1_charset;
-	uint8_t saved_active_charset;
-
-	/*
-	 * Mode switches.
-	 */
-	uint8_t application_keypad_mode;
-	uint8_t application_cursor_mode;
-	uint8_t saved_application_keypad_mode;
-	uint8_t saved_application_cursor_mode;
+	unsigned long dropped;	/* bytes lost because the writer lagged */
+	int write_error;	/* errno of the first failing write, or 0 */
 
-	uint8_t insert_mode;
-	uint8_t saved_insert_mode;
-
-	/*
-	 * This flag determines if the shell should be completely redrawn in the next
-	 * vim_shell_redraw, regardless of what we think to know about the screen.
-	 */
-	uint8_t force_redraw;
-
-	/*
-	 * Pointer to the alternate screen. If NULL, there is no alternate screen.
-	 * If not NULL, this holds a backup of the screen contents and properties
-	 * before the screen switch. Switching back means to copy back the contents
-	 * of the alternate screen to the main screen and freeing the alternate screen.
-	 */
-	struct vim_shell_window *alt;
-
-	/*
-	 * file descriptor of the master side of the pty
-	 */
-	int fd_master;
+#ifdef HAVE_PTHREAD_H
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int quit;
+#endif
+};
 
-	/*
-	 * pid of the subshell
-	 */
+/*
+ * Output of a command that is streamed into an ordinary buffer (see
+ * ":vimshellread").
+ */
+struct vim_shell_stream
+{
+	struct vim_shell_stream *next;
+	buf_T *buf;		/* buffer the output goes into */
+	linenr_T lnum;		/* append below this line */
+	int fd;			/* master side of the pty, -1 when closed */
 	pid_t pid;
-
+	garray_T partial;	/* output not appended yet, NUL separated */
+	int lines;		/* number of complete lines in "partial" */
+#if defined(FEAT_GUI_GTK)
+	int gtk_input_id;	/* GTK-input id returned by gdk_input_add */
+#elif defined(FEAT_GUI_MACVIM)
+	CFFileDescriptorRef fdref;
+	CFRunLoopSourceRef source;
+#endif
 };
 
 /*
- * This is set when something goes wrong in one of the
- * vim_shell functions.
+ * All running streams.
  */
-extern int vimshell_errno;
+extern struct vim_shell_stream *vim_shell_streams;
+extern int vim_shell_stream_idle;
 
 /*
- * The debug handle where debug-messages will be written
+ * This is set when something goes wrong in one of the
+ * vim_shell functions.
  */
-extern FILE *vimshell_debug_fp;
+extern int vimshell_errno;
 
 #define VIMSHELL_SUCCESS 0
 #define VIMSHELL_OUT_OF_MEMORY 1
@@ -241,6 +114,7 @@ extern FILE *vimshell_debug_fp;
 #define VIMSHELL_SIGACTION_ERROR 6
 #define VIMSHELL_READ_EOF 7
 #define VIMSHELL_FCNTL_ERROR 8
+#define VIMSHELL_OPEN_ERROR 9
 
 /*
  * vim_shell.c
@@ -256,11 +130,21 @@ extern int vim_shell_do_read_select(fd_set rfds);
 extern int vim_shell_do_read_lowlevel(buf_T *buf);
 extern void vim_shell_delete(buf_T *buf);
 extern void vim_shell_resize(struct vim_shell_window *shell, int width, int height);
+extern int vim_shell_log_open(struct vim_shell_window *shell, char *fname, int raw, long maxsize);
+extern void vim_shell_log_close(struct vim_shell_window *shell);
+extern void vim_shell_log_putc(struct vim_shell_log *log, int c);
+extern void vim_shell_fork_prepare(void);
+extern void vim_shell_fork_done(void);
+extern int vim_shell_stream_start(buf_T *buf, linenr_T lnum, char_u *cmd);
+extern int vim_shell_stream_wants_read(struct vim_shell_stream *st);
+extern int vim_shell_stream_read(struct vim_shell_stream *st);
+extern int vim_shell_stream_flush(void);
+extern void vim_shell_stream_stop(buf_T *buf);
+extern void vim_shell_stream_mark_adjust(linenr_T line1, linenr_T line2, long amount, long amount_after);
 
 /*
- * terminal.c
+ * terminal.c, the part that needs VIM (key codes)
  */
-extern void vim_shell_terminal_input(struct vim_shell_window *shell, char *input, int len);
 extern int vim_shell_terminal_output(struct vim_shell_window *shell, int c);
 
 /*
@@ -0,0 +1,279 @@
+/*
+ * vim_shell_vt.h
+ *
+ * The VT engine of VIM-Shell: the screen model and the escape sequence parser
+ * in terminal.c. Nothing in here depends on VIM, so the engine can also be
+ * built on its own (with VIMSHELL_STANDALONE defined), see vtbench.c.
+ *
+ * This file is part of the VIM-Shell project. http://vimshell.wana.at
+ *
+ * Author: Thomas Wana <thomas@wana.at>
+ *
+ * $Id$
+ */
+
+#ifndef __VIMSHELL_VT_H
+
+#define __VIMSHELL_VT_H
+
+#include <stdio.h>
+#if defined(VIMSHELL_STANDALONE) || defined(HAVE_STDINT_H)
+#include <stdint.h>
+#endif
+#include <sys/types.h>
+
+/*
+ * Master debug flag. Disable this and no debug messages at all will
+ * be written anywhere.
+ */
+//#define VIMSHELL_DEBUG
+
+/*
+ * Rendition constants
+ */
+#define RENDITION_BOLD 1
+#define RENDITION_UNDERSCORE 2
+#define RENDITION_BLINK 4
+#define RENDITION_NEGATIVE 8
+#define RENDITION_DIM 16
+#define RENDITION_HIDDEN 32
+
+/*
+ * charset constants
+ */
+#define VIMSHELL_CHARSET_USASCII 0
+#define VIMSHELL_CHARSET_DRAWING 1
+
+/*
+ * Color constants
+ */
+#define VIMSHELL_COLOR_BLACK 0
+#define VIMSHELL_COLOR_RED 1
+#define VIMSHELL_COLOR_GREEN 2
+#define VIMSHELL_COLOR_YELLOW 3
+#define VIMSHELL_COLOR_BLUE 4
+#define VIMSHELL_COLOR_MAGENTA 5
+#define VIMSHELL_COLOR_CYAN 6
+#define VIMSHELL_COLOR_WHITE 7
+#define VIMSHELL_COLOR_DEFAULT 9
+
+#ifdef VIMSHELL_STANDALONE
+# define vim_shell_malloc malloc
+# define vim_shell_free free
+#else
+# define vim_shell_malloc alloc
+# define vim_shell_free vim_free
+#endif
+
+/*
+ * Tab stop bitset access, see tabstops in struct vim_shell_window.
+ */
+#define VIMSHELL_TABSTOP_WORDS(width) (((width)+31)/32)
+#define VIMSHELL_TABSTOP_SET(shell, x) ((shell)->tabstops[(x)>>5] |= (uint32_t)1<<((x)&31))
+#define VIMSHELL_TABSTOP_CLEAR(shell, x) ((shell)->tabstops[(x)>>5] &= ~((uint32_t)1<<((x)&31)))
+
+/*
+ * Defined in vim_shell.h, the engine only passes it on.
+ */
+struct vim_shell_log;
+
+/*
+ * The main vim_shell_window struct.
+ * Holds everything that is needed to know about a single
+ * vim shell. (like file descriptors, window buffers, window
+ * positions, etc)
+ */
+struct vim_shell_window
+{
+	/*
+	 * current dimensions of the window
+	 */
+	uint16_t size_x;
+	uint16_t size_y;
+
+	/*
+	 * cursor position and visible flag
+	 */
+	uint16_t cursor_x;
+	uint16_t cursor_y;
+	uint16_t cursor_visible;
+
+	/*
+	 * Saved cursor positions (ESC 7, ESC 8)
+	 */
+	uint16_t saved_cursor_x;
+	uint16_t saved_cursor_y;
+
+	/*
+	 * We support the xterm title hack and store the title in this buffer.
+	 */
+	char windowtitle[50];
+
+	/*
+	 * The output buffer. This is necessary because writes to the shell can be delayed,
+	 * e.g. if we are waiting for an incoming ESC sequence to complete.
+	 */
+	uint8_t outbuf[100];
+	uint8_t outbuf_pos;
+
+	/*
+	 * Pointer to the window buffer.
+	 * The window buffer is the internal representation of the
+	 * window's content. The vim shell receives characters from
+	 * the terminal, which the terminal emulation translates into
+	 * e.g. cursor positions or actual characters. These are placed
+	 * here at the right screen position. Its size is size_y*size_x.
+	 */
+	uint8_t *winbuf;
+	uint8_t *fgbuf;
+	uint8_t *bgbuf;
+	uint8_t *rendbuf;
+	uint8_t *charset;
+
+	/*
+	 * The tab stops of a row as a bitset: bit (x % 32) of tabstops[x / 32]
+	 * is set when there is a tab stop in column x. See VIMSHELL_TABSTOP_*.
+	 */
+	uint32_t *tabstops;
+
+	/*
+	 * These buffers hold what's currently physical on the screen.
+	 * Note, not on the "virtual" screen, that is the image of the shell,
+	 * but the real screen that is printed out in vim_shell_redraw.
+	 * This is mainly to implement caching features...
+	 * We hold here:
+	 * 1 byte foreground-color
+	 * 1 byte background-color
+	 * 1 byte rendering attributes
+	 * 1 byte the actual character
+	 */
+	uint32_t *phys_screen;
+
+	/*
+	 * Flag that determines if we are right in the middle of an
+	 * escape sequence coming in.
+	 */
+	uint8_t in_esc_sequence;
+
+	/*
+	 * Buffer for a escape sequence in progress (see in_esc_sequence).
+	 */
+	uint8_t esc_sequence[50];
+
+	/*
+	 * Auto-Margin enabled?
+	 */
+	uint8_t wraparound;
+
+	/*
+	 * Caused the last character a warp around?
+	 */
+	uint8_t just_wrapped_around;
+
+	/*
+	 * The currently used rendition of the shell.
+	 */
+	uint8_t rendition;
+	uint8_t saved_rendition;
+
+	/*
+	 * The currently active colors.
+	 */
+	uint8_t fgcolor;
+	uint8_t bgcolor;
+	uint8_t saved_fgcolor;
+	uint8_t saved_bgcolor;
+
+	/*
+	 * Scroll region.
+	 */
+	uint8_t scroll_top_margin;
+	uint8_t scroll_bottom_margin;
+
+	/*
+	 * Charset configuration.
+	 */
+	uint8_t G0_charset;
+	uint8_t G1_charset;
+	uint8_t active_charset;
+	uint8_t saved_G0_charset;
+	uint8_t saved_G1_charset;
+	uint8_t saved_active_charset;
+
+	/*
+	 * Mode switches.
+	 */
+	uint8_t application_keypad_mode;
+	uint8_t application_cursor_mode;
+	uint8_t saved_application_keypad_mode;
+	uint8_t saved_application_cursor_mode;
+
+	uint8_t insert_mode;
+	uint8_t saved_insert_mode;
+
+	/*
+	 * This flag determines if the shell should be completely redrawn in the next
+	 * vim_shell_redraw, regardless of what we think to know about the screen.
+	 */
+	uint8_t force_redraw;
+
+	/*
+	 * Pointer to the alternate screen. If NULL, there is no alternate screen.
+	 * If not NULL, this holds a backup of the screen contents and properties
+	 * before the screen switch. Switching back means to copy back the contents
+	 * of the alternate screen to the main screen and freeing the alternate screen.
+	 */
+	struct vim_shell_window *alt;
+
+	/*
+	 * Output log, NULL if the output of this shell isn't logged.
+	 */
+	struct vim_shell_log *log;
+
+	/*
+	 * Rows changed since the last vim_shell_vt_damage(), none when
+	 * damage_top > damage_bottom.
+	 */
+	uint16_t damage_top;
+	uint16_t damage_bottom;
+
+	/*
+	 * file descriptor of the master side of the pty
+	 */
+	int fd_master;
+
+	/*
+	 * pid of the subshell
+	 */
+	pid_t pid;
+
+};
+
+/*
+ * One cell of the screen, see vim_shell_vt_get_cell().
+ */
+struct vim_shell_cell
+{
+	uint8_t c;
+	uint8_t fg;
+	uint8_t bg;
+	uint8_t rendition;
+	uint8_t charset;
+};
+
+/*
+ * The debug handle where debug-messages will be written
+ */
+extern FILE *vimshell_debug_fp;
+
+/*
+ * terminal.c
+ */
+extern struct vim_shell_window *vim_shell_vt_new(int width, int height);
+extern void vim_shell_vt_feed(struct vim_shell_window *shell, char *input, int len);
+extern void vim_shell_vt_get_cell(struct vim_shell_window *shell, int x, int y, struct vim_shell_cell *cell);
+extern int vim_shell_vt_damage(struct vim_shell_window *shell, int *top, int *bottom);
+extern int vim_shell_vt_resize(struct vim_shell_window *shell, int width, int height);
+extern void vim_shell_vt_free(struct vim_shell_window *shell);
+
+#endif
@@ -0,0 +1,333 @@
+/*
+ * vtbench.c
+ *
+ * Benchmark driver for the VIM-Shell VT engine (terminal.c, see vim_shell_vt.h).
+ * Built without VIM by "make vtbench", so the escape sequence parser and the
+ * screen model can be profiled on their own, e.g. with "perf record ./vtbench".
+ *
+ * Every workload generates a chunk of shell output that mostly exercises one
+ * operation and feeds it to an engine over and over.
+ *
+ * usage: vtbench [-t] [-m megabytes] [-s WIDTHxHEIGHT] [workload ...]
+ *
+ *   -t   test mode: feed every chunk once and print a checksum of the resulting
+ *        screen, cursor and damage. testdir/test74 compares these to catch
+ *        changes in behaviour.
+ *   -m   feed this many megabytes per workload (default 64)
+ *   -s   screen size (default 80x24)
+ *
+ * This file is part of the VIM-Shell project. http://vimshell.wana.at
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "vim_shell_vt.h"
+
+FILE *vimshell_debug_fp=NULL;
+
+#define CHUNK_SIZE (64*1024)
+
+static char chunk[CHUNK_SIZE+256];
+static int chunk_len;
+static int width=80, height=24;
+static unsigned long seed;
+
+/*
+ * Deterministic pseudo random numbers, so test mode gives the same screen
+ * everywhere.
+ */
+static int rnd(int n)
+{
+	seed=seed*1103515245UL+12345UL;
+	return (int)((seed>>16)&0x7fff)%n;
+}
+
+static void put(char *fmt, int a, int b)
+{
+	chunk_len+=sprintf(chunk+chunk_len, fmt, a, b);
+}
+
+/*
+ * Move to a random position on the screen.
+ */
+static void put_cup()
+{
+	put("\033[%d;%dH", rnd(height)+1, rnd(width)+1);
+}
+
+static void put_word()
+{
+	static char *words[]={"vim", "shell", "terminal", "escape", "sequence",
+		"screen", "bench", "x", "tabstop", "renditions"};
+	chunk_len+=sprintf(chunk+chunk_len, "%s ", words[rnd(10)]);
+}
+
+static void gen_text()
+{
+	int col=0;
+	while(chunk_len<CHUNK_SIZE)
+	{
+		put_word();
+		if(++col%10==0)
+			put("\r\n", 0, 0);
+	}
+}
+
+static void gen_sgr()
+{
+	while(chunk_len<CHUNK_SIZE)
+	{
+		put("\033[%d;3%dm", rnd(2), rnd(8));
+		put_word();
+		put("\033[0m", 0, 0);
+		if(rnd(10)==0)
+			put("\r\n", 0, 0);
+	}
+}
+
+static void gen_cup()
+{
+	while(chunk_len<CHUNK_SIZE)
+	{
+		put_cup();
+		put("%c", 'a'+rnd(26), 0);
+	}
+}
+
+static void gen_el()
+{
+	while(chunk_len<CHUNK_SIZE)
+	{
+		put_cup();
+		put_word();
+		put_cup();
+		put("\033[%dK", rnd(3), 0);
+	}
+}
+
+static void gen_ed()
+{
+	while(chunk_len<CHUNK_SIZE)
+	{
+		put_cup();
+		put_word();
+		put_cup();
+		put("\033[%dJ", rnd(8)==0 ? 2 : rnd(2), 0);
+	}
+}
+
+static void gen_ich()
+{
+	while(chunk_len<CHUNK_SIZE)
+	{
+		put_cup();
+		put_word();
+		put_cup();
+		put("\033[%d@", rnd(8)+1, 0);
+	}
+}
+
+static void gen_dch()
+{
+	while(chunk_len<CHUNK_SIZE)
+	{
+		put_cup();
+		put_word();
+		put_cup();
+		put("\033[%dP", rnd(8)+1, 0);
+	}
+}
+
+static void gen_ildl()
+{
+	while(chunk_len<CHUNK_SIZE)
+	{
+		put_cup();
+		put_word();
+		put_cup();
+		put(rnd(2) ? "\033[%dL" : "\033[%dM", rnd(4)+1, 0);
+	}
+}
+
+static void gen_scroll()
+{
+	put("\033[%d;%dr", 3, height-2);
+	put("\033[%d;1H", height-2, 0);
+	while(chunk_len<CHUNK_SIZE)
+	{
+		put_word();
+		put("\r\n", 0, 0);
+		if(rnd(16)==0)
+			put("\033[%d;1H\033M", 3, 0);	/* RI at the top margin */
+	}
+	put("\033[r", 0, 0);
+}
+
+static void gen_tab()
+{
+	int i;
+	while(chunk_len<CHUNK_SIZE)
+	{
+		if(rnd(32)==0)
+		{
+			/* new set of tab stops */
+			put("\033[3g", 0, 0);
+			for(i=0;i<6;i++)
+				put("\033[1;%dH\033H", rnd(width)+1, 0);
+			put("\033[1;%dH\033[g", rnd(width)+1, 0);
+		}
+		put("\r\n", 0, 0);
+		for(i=rnd(8);i>0;i--)
+		{
+			put("\t", 0, 0);
+			put_word();
+		}
+	}
+}
+
+struct workload
+{
+	char *name;
+	void (*gen)();
+};
+
+static struct workload workloads[]={
+	{"text", gen_text},
+	{"sgr", gen_sgr},
+	{"cup", gen_cup},
+	{"el", gen_el},
+	{"ed", gen_ed},
+	{"ich", gen_ich},
+	{"dch", gen_dch},
+	{"ildl", gen_ildl},
+	{"scroll", gen_scroll},
+	{"tab", gen_tab},
+	{NULL, NULL}
+};
+
+/*
+ * FNV-1a over all cells plus the cursor position.
+ */
+static unsigned long checksum(struct vim_shell_window *vt)
+{
+	struct vim_shell_cell cell;
+	unsigned long h=2166136261UL;
+	int x, y;
+
+#define HASH(b) h=((h^(uint8_t)(b))*16777619UL)&0xffffffffUL
+	for(y=0;y<vt->size_y;y++)
+	{
+		for(x=0;x<vt->size_x;x++)
+		{
+			vim_shell_vt_get_cell(vt, x, y, &cell);
+			HASH(cell.c);
+			HASH(cell.fg);
+			HASH(cell.bg);
+			HASH(cell.rendition);
+			HASH(cell.charset);
+		}
+	}
+	HASH(vt->cursor_x);
+	HASH(vt->cursor_y);
+#undef HASH
+	return h;
+}
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec+tv.tv_usec/1e6;
+}
+
+static void run(struct workload *w, int test, long megabytes)
+{
+	struct vim_shell_window *vt;
+	int top, bottom;
+	long fed=0;
+	double start, t;
+
+	seed=1;
+	chunk_len=0;
+	w->gen();
+
+	vt=vim_shell_vt_new(width, height);
+	if(vt==NULL)
+	{
+		fprintf(stderr, "vtbench: out of memory\n");
+		exit(1);
+	}
+
+	if(test)
+	{
+		vim_shell_vt_damage(vt, &top, &bottom);
+		vim_shell_vt_feed(vt, chunk, chunk_len);
+		if(!vim_shell_vt_damage(vt, &top, &bottom))
+			top=bottom=-1;
+		printf("%-8s %08lx cursor %d,%d damage %d-%d\n", w->name, checksum(vt),
+				vt->cursor_x, vt->cursor_y, top, bottom);
+
+		/* the same again after making the screen smaller and larger */
+		vim_shell_vt_resize(vt, width/2, height/2);
+		vim_shell_vt_feed(vt, chunk, chunk_len);
+		vim_shell_vt_resize(vt, width+7, height+3);
+		vim_shell_vt_feed(vt, chunk, chunk_len/2);
+		printf("%-8s %08lx cursor %d,%d (resized)\n", w->name, checksum(vt),
+				vt->cursor_x, vt->cursor_y);
+	}
+	else
+	{
+		start=now();
+		while(fed<megabytes*1024*1024)
+		{
+			vim_shell_vt_feed(vt, chunk, chunk_len);
+			fed+=chunk_len;
+		}
+		t=now()-start;
+		printf("%-8s %8.1f MB/s %8.2f ns/byte\n", w->name,
+				fed/t/(1024*1024), t*1e9/fed);
+	}
+
+	vim_shell_vt_free(vt);
+}
+
+int main(int argc, char *argv[])
+{
+	struct workload *w;
+	long megabytes=64;
+	int test=0;
+	int i, j, any;
+
+	for(i=1;i<argc && argv[i][0]=='-';i++)
+	{
+		if(!strcmp(argv[i], "-t"))
+			test=1;
+		else if(!strcmp(argv[i], "-m") && i+1<argc)
+			megabytes=atol(argv[++i]);
+		else if(!strcmp(argv[i], "-s") && i+1<argc
+				&& sscanf(argv[++i], "%dx%d", &width, &height)==2
+				&& width>1 && height>1 && width<=1000 && height<=255)
+			;
+		else
+		{
+			fprintf(stderr, "usage: vtbench [-t] [-m megabytes] [-s WIDTHxHEIGHT] [workload ...]\n");
+			return 1;
+		}
+	}
+
+	for(w=workloads;w->name!=NULL;w++)
+	{
+		any=(i==argc);
+		for(j=i;j<argc;j++)
+			if(!strcmp(argv[j], w->name))
+				any=1;
+		if(any)
+			run(w, test, megabytes);
+	}
+
+	return 0;
+}